@@ -281,6 +281,7 @@ defmodule Raxol.Core.Runtime.Lifecycle.Initializer do
       ]
       |> maybe_add_opt(:liveview_topic, Keyword.get(options, :liveview_topic))
       |> maybe_add_opt(:io_writer, Keyword.get(options, :io_writer))
+      |> maybe_add_opt(:native_diff, Keyword.get(options, :native_diff))
       |> maybe_add_opt(
         :cycle_profiler,
         Keyword.get(options, :cycle_profiler_pid)
@@ -9,6 +9,7 @@ defmodule Raxol.Core.Runtime.Rendering.Backends do
 
   require Raxol.Core.Runtime.Log
 
+  alias Raxol.Terminal.Integration.NativeFrame
   alias Raxol.Terminal.ScreenBuffer
 
   # --- Backend Dispatch ---
@@ -151,21 +152,77 @@ defmodule Raxol.Core.Runtime.Rendering.Backends do
 
   @doc """
   Renders cells to an SSH channel via an io_writer function.
+
+  With `native_diff: true` in the state, frames are diffed by a termbox memory
+  context (see `Raxol.Terminal.Integration.NativeFrame`) kept in
+  `:native_frame`, so only changed cells go over the wire and idle frames
+  write nothing. Without it, or if the NIF is unavailable, every frame is a
+  full repaint.
   """
   def render_to_ssh(cells, state) do
     updated_buffer = apply_cells_to_buffer(cells, state)
 
-    renderer = Raxol.Terminal.Renderer.new(updated_buffer)
-    output_string = Raxol.Terminal.Renderer.render(renderer)
+    case native_ssh_frame(updated_buffer, state) do
+      {:ok, "", state} ->
+        {:ok, %{state | buffer: updated_buffer}}
 
-    # Home cursor and clear screen before each frame, matching render_to_terminal
-    frame = "\e[H\e[2J" <> output_string
+      {:ok, frame, state} ->
+        write_output(state.io_writer, frame, state.sync_output)
+        {:ok, %{state | buffer: updated_buffer}}
 
-    write_output(state.io_writer, frame, state.sync_output)
+      {:full, state} ->
+        renderer = Raxol.Terminal.Renderer.new(updated_buffer)
+        output_string = Raxol.Terminal.Renderer.render(renderer)
 
-    {:ok, %{state | buffer: updated_buffer}}
+        # Home cursor and clear screen before each frame, matching render_to_terminal
+        frame = "\e[H\e[2J" <> output_string
+
+        write_output(state.io_writer, frame, state.sync_output)
+
+        {:ok, %{state | buffer: updated_buffer}}
+    end
+  end
+
+  defp native_ssh_frame(buffer, %{native_diff: true} = state) do
+    case Map.get(state, :native_frame) do
+      :unavailable ->
+        {:full, state}
+
+      nil ->
+        case NativeFrame.open(buffer.width, buffer.height) do
+          {:ok, ctx} ->
+            # The client's screen is unknown, so start from a clear one
+            state = Map.put(state, :native_frame, ctx)
+
+            with {:ok, frame, state} <- native_ssh_frame(buffer, state) do
+              {:ok, "\e[H\e[2J" <> frame, state}
+            end
+
+          {:error, reason} ->
+            Raxol.Core.Runtime.Log.warning_with_context(
+              "SSH render: native diffing unavailable, using full repaints",
+              %{reason: inspect(reason)}
+            )
+
+            native_ssh_frame(buffer, Map.put(state, :native_frame, :unavailable))
+        end
+
+      ctx ->
+        case NativeFrame.render(ctx, buffer) do
+          {:ok, frame} ->
+            {:ok, frame, state}
+
+          {:error, _reason} ->
+            # The context no longer knows what the client shows, so repaint
+            # this frame in full and start over from the next one
+            NativeFrame.close(ctx)
+            {:full, Map.put(state, :native_frame, nil)}
+        end
+    end
   end
 
+  defp native_ssh_frame(_buffer, state), do: {:full, state}
+
   # --- Output Helpers ---
 
   @doc false
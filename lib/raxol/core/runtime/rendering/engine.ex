@@ -39,6 +39,10 @@ defmodule Raxol.Core.Runtime.Rendering.Engine do
               process_components: %{},
               # Whether terminal supports Mode 2026 synchronized output
               sync_output: false,
+              # Whether SSH frames are diffed natively instead of repainted
+              native_diff: false,
+              # Termbox memory context holding the last SSH frame
+              native_frame: nil,
               # Cycle profiler pid (nil when disabled)
               cycle_profiler: nil,
               # Cached prepared element tree (Pretext-inspired two-phase)
@@ -9,13 +9,19 @@ defmodule Raxol.SSH.CLIHandler do
     :session_pid,
     :channel_id,
     :connection_ref,
+    native_diff: false,
     registered: false
   ]
 
   @impl true
   def init(opts) do
     app_module = Keyword.fetch!(opts, :app_module)
-    {:ok, %__MODULE__{app_module: app_module}}
+
+    {:ok,
+     %__MODULE__{
+       app_module: app_module,
+       native_diff: Keyword.get(opts, :native_diff, false)
+     }}
   end
 
   @impl true
@@ -70,7 +76,8 @@ defmodule Raxol.SSH.CLIHandler do
         connection_ref: state.connection_ref,
         channel_id: state.channel_id,
         width: width,
-        height: height
+        height: height,
+        native_diff: state.native_diff
       )
 
     {:ok, %{state | session_pid: session_pid}}
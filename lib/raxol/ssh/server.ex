@@ -16,6 +16,8 @@ defmodule Raxol.SSH.Server do
     * `:port` - Port to listen on (default: 2222)
     * `:host_keys_dir` - Directory for SSH host keys (default: "/tmp/raxol_ssh_keys")
     * `:max_connections` - Maximum concurrent connections (default: 50)
+    * `:native_diff` - Send each frame as a termbox diff against the previous
+      one instead of a full repaint; needs the termbox2 NIF (default: false)
   """
 
   use GenServer
@@ -41,7 +43,8 @@ defmodule Raxol.SSH.Server do
       port: Keyword.get(opts, :port, @default_port),
       host_keys_dir: Keyword.get(opts, :host_keys_dir, "/tmp/raxol_ssh_keys"),
       max_connections:
-        Keyword.get(opts, :max_connections, @default_max_connections)
+        Keyword.get(opts, :max_connections, @default_max_connections),
+      native_diff: Keyword.get(opts, :native_diff, false)
     )
   end
 
@@ -83,7 +86,12 @@ defmodule Raxol.SSH.Server do
 
     daemon_opts = [
       system_dir: String.to_charlist(host_keys_dir),
-      ssh_cli: {Raxol.SSH.CLIHandler, [app_module: app_module]},
+      ssh_cli:
+        {Raxol.SSH.CLIHandler,
+         [
+           app_module: app_module,
+           native_diff: Keyword.get(opts, :native_diff, false)
+         ]},
       no_auth_needed: true
     ]
 
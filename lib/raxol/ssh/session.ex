@@ -41,6 +41,7 @@ defmodule Raxol.SSH.Session do
       Raxol.Core.Runtime.Lifecycle.start_link(app_module,
         environment: :ssh,
         io_writer: io_writer,
+        native_diff: Keyword.get(opts, :native_diff, false),
         width: width,
         height: height,
         name: :"ssh_session_#{inspect(self())}"
@@ -0,0 +1,60 @@
+defmodule Raxol.Terminal.ANSI.NativeParser do
+  @moduledoc """
+  Native parser for the byte stream programs write to the emulator.
+
+  Wraps `:termbox2_nif.vt_parse/2`, a C implementation of the DEC VT500 state
+  machine (ground, escape, CSI, DCS, OSC and SOS/PM/APC strings) that
+  `Raxol.Terminal.ANSI.StateMachine` and the `Raxol.Terminal.Parser.States`
+  modules step through byte by byte. Each chunk comes back as a list of ops,
+  with printable text as whole runs rather than single characters, which
+  `Raxol.Terminal.Parser.NativeOps` applies to the emulator.
+
+  A parser keeps whatever sequence (or UTF-8 character) a chunk ends in the
+  middle of and completes it from the next chunk, so it must see one stream,
+  in order.
+  """
+
+  alias Raxol.Terminal.Native
+
+  @type t :: reference()
+
+  @typedoc """
+  A parsed item. Text is a binary referencing the parsed chunk, and C0
+  controls are bare integers. CSI and DCS intermediates start with the
+  private marker, if any, matching `Raxol.Terminal.Parser.ParserState`.
+  """
+  @type op ::
+          binary()
+          | byte()
+          | {:esc, intermediates :: binary(), final :: byte()}
+          | {:csi, params :: binary(), intermediates :: binary(), final :: byte()}
+          | {:dcs, params :: binary(), intermediates :: binary(), final :: byte(),
+             data :: binary()}
+          | {:osc | :sos | :pm | :apc, data :: binary()}
+
+  @doc """
+  Creates a parser in the ground state.
+  """
+  @spec new() :: {:ok, t()} | {:error, term()}
+  def new, do: Native.call(&:termbox2_nif.vt_parser_new/0)
+
+  @doc """
+  Parses the next chunk of the stream.
+  """
+  @spec parse(t(), binary()) :: [op()]
+  def parse(parser, chunk), do: :termbox2_nif.vt_parse(parser, chunk)
+
+  @doc """
+  Returns `parser_state` with a new native parser attached, so the emulator
+  parses its input natively from then on, or `parser_state` unchanged if the
+  NIF is not available. Attach before any input is parsed, since the native
+  parser starts in the ground state.
+  """
+  @spec attach(map()) :: map()
+  def attach(parser_state) do
+    case new() do
+      {:ok, parser} -> Map.put(parser_state, :native, parser)
+      {:error, _} -> parser_state
+    end
+  end
+end
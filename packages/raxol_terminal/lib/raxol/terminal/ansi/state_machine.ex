@@ -2,6 +2,9 @@ defmodule Raxol.Terminal.ANSI.StateMachine do
   @moduledoc """
   A state machine for parsing ANSI escape sequences.
   This module provides a more efficient alternative to regex-based parsing.
+
+  For bulk output such as logs, `Raxol.Terminal.ANSI.NativeParser` runs the
+  full DEC state machine natively and returns text in runs.
   """
 
   require Raxol.Core.Runtime.Log
@@ -4,6 +4,7 @@ defmodule Raxol.Terminal.Buffer.Eraser do
   Forwards calls to Raxol.Terminal.ScreenBuffer.Operations.
   """
 
+  alias Raxol.Terminal.Buffer.Scrollback
   alias Raxol.Terminal.ScreenBuffer.Operations, as: ConsolidatedOps
 
   @doc """
@@ -117,7 +118,7 @@ defmodule Raxol.Terminal.Buffer.Eraser do
   """
   def clear_scrollback(buffer) do
     # Clear scrollback history
-    %{buffer | scrollback: []}
+    Scrollback.clear(buffer)
   end
 
   @doc """
@@ -3,13 +3,41 @@ defmodule Raxol.Terminal.Buffer.Scrollback do
   Handles scrollback buffer operations for the screen buffer.
   This module manages the history of lines that have scrolled off the screen,
   including adding, retrieving, and clearing scrollback content.
+
+  `buffer.scrollback` is a list of lines, newest first, or a
+  `Raxol.Terminal.Scrollback.Ring` after `attach_native/2`. Every function
+  here works with either.
+  """
+
+  alias Raxol.Terminal.Scrollback.{Matcher, Ring}
+
+  @doc """
+  Moves the buffer's scrollback into a native ring bounded by
+  `buffer.scrollback_limit` lines and, with `max_bytes: n`, by `n` bytes.
+  Returns the buffer unchanged if the NIF is not available.
   """
+  def attach_native(buffer, opts \\ [])
 
-  # ScreenBuffer and Cell aliases removed - not currently used
+  def attach_native(%{scrollback: %Ring{}} = buffer, _opts), do: buffer
+
+  def attach_native(buffer, opts) do
+    opts = Keyword.put(opts, :max_lines, buffer.scrollback_limit)
+
+    case Ring.open(opts) do
+      {:ok, ring} ->
+        %{buffer | scrollback: Ring.push(ring, Enum.reverse(buffer.scrollback || []))}
+
+      {:error, _} ->
+        buffer
+    end
+  end
 
   @doc """
   Adds a line to the scrollback buffer.
   """
+  def add_line(%{scrollback: %Ring{} = ring} = buffer, line) when is_list(line),
+    do: %{buffer | scrollback: Ring.push(ring, [line])}
+
   def add_line(buffer, line) when is_list(line) do
     scrollback = [line | buffer.scrollback]
     scrollback = trim_scrollback(scrollback, buffer.scrollback_limit)
@@ -21,6 +49,10 @@ defmodule Raxol.Terminal.Buffer.Scrollback do
   @doc """
   Adds multiple lines to the scrollback buffer.
   """
+  # The first of lines ends up newest, as with the list
+  def add_lines(%{scrollback: %Ring{} = ring} = buffer, lines) when is_list(lines),
+    do: %{buffer | scrollback: Ring.push(ring, Enum.reverse(lines))}
+
   def add_lines(buffer, lines) when is_list(lines) do
     scrollback = lines ++ buffer.scrollback
     scrollback = trim_scrollback(scrollback, buffer.scrollback_limit)
@@ -32,6 +64,9 @@ defmodule Raxol.Terminal.Buffer.Scrollback do
   @doc """
   Gets a specific line from the scrollback buffer.
   """
+  def get_line(%{scrollback: %Ring{} = ring}, index) when index >= 0,
+    do: Ring.get(ring, Ring.size(ring) - 1 - index)
+
   def get_line(buffer, index) when index >= 0 do
     buffer.scrollback
     |> Enum.reverse()
@@ -43,6 +78,15 @@ defmodule Raxol.Terminal.Buffer.Scrollback do
   @doc """
   Gets lines from the scrollback buffer.
   """
+  def get_lines(%{scrollback: %Ring{} = ring}, start, count) when start >= 0 and count > 0 do
+    # Lines start.. counting from the oldest are these counting from the newest
+    newest = Ring.size(ring) - start - count
+
+    ring
+    |> Ring.range(max(newest, 0), count + min(newest, 0))
+    |> Enum.reverse()
+  end
+
   def get_lines(buffer, start, count) when start >= 0 and count > 0 do
     buffer.scrollback
     |> Enum.reverse()
@@ -52,15 +96,40 @@ defmodule Raxol.Terminal.Buffer.Scrollback do
   def get_lines(_, _, _), do: []
 
   @doc """
-  Gets the total number of lines in the scrollback buffer.
+  Searches up to `count` lines from `index` back towards the oldest, where
+  the newest line is 0 (unlike `get_line/2`), returning
+  `{index, column, text}` per match, newest line first. A native ring is
+  searched in C; list lines are searched by their cells' text, leaving out
+  wide-character placeholders as the ring does.
   """
-  def size(buffer) do
-    length(buffer.scrollback)
+  @spec search_page(map(), Matcher.t(), non_neg_integer(), non_neg_integer()) :: [
+          Matcher.line_match()
+        ]
+  def search_page(%{scrollback: %Ring{} = ring}, %Matcher{} = matcher, index, count),
+    do: Ring.search(ring, matcher.pattern, index, count, matcher.fold)
+
+  def search_page(%{scrollback: lines}, %Matcher{} = matcher, index, count)
+      when is_list(lines) and index >= 0 and count > 0 do
+    for {line, i} <- lines |> Enum.slice(index, count) |> Enum.with_index(index),
+        {column, text} <- Matcher.line_matches(matcher, line_text(line)),
+        do: {i, column, text}
   end
 
+  def search_page(_buffer, _matcher, _index, _count), do: []
+
+  @doc """
+  Gets the total number of lines in the scrollback buffer.
+  """
+  def size(%{scrollback: %Ring{} = ring}), do: Ring.size(ring)
+  def size(%{scrollback: nil}), do: 0
+  def size(buffer), do: length(buffer.scrollback)
+
   @doc """
   Clears the scrollback buffer.
   """
+  def clear(%{scrollback: %Ring{} = ring} = buffer),
+    do: %{buffer | scrollback: Ring.clear(ring)}
+
   def clear(buffer) do
     %{buffer | scrollback: []}
   end
@@ -68,6 +137,11 @@ defmodule Raxol.Terminal.Buffer.Scrollback do
   @doc """
   Sets the scrollback limit.
   """
+  def set_limit(%{scrollback: %Ring{} = ring} = buffer, limit) when limit >= 0 do
+    ring = Ring.set_limits(ring, limit, ring.max_bytes)
+    %{buffer | scrollback: ring, scrollback_limit: limit}
+  end
+
   def set_limit(buffer, limit) when limit >= 0 do
     scrollback = trim_scrollback(buffer.scrollback, limit)
     %{buffer | scrollback: scrollback, scrollback_limit: limit}
@@ -86,12 +160,25 @@ defmodule Raxol.Terminal.Buffer.Scrollback do
   Checks if the scrollback buffer is full.
   """
   def full?(buffer) do
-    length(buffer.scrollback) >= buffer.scrollback_limit
+    size(buffer) >= buffer.scrollback_limit
+  end
+
+  @doc """
+  Drops all but the newest `count` lines, leaving the limit as it is.
+  """
+  def trim(%{scrollback: %Ring{} = ring} = buffer, count) when count >= 0 do
+    trimmed = Ring.set_limits(ring, count, ring.max_bytes)
+    %{buffer | scrollback: Ring.set_limits(trimmed, ring.max_lines, ring.max_bytes)}
   end
 
+  def trim(buffer, count) when count >= 0,
+    do: %{buffer | scrollback: trim_scrollback(buffer.scrollback || [], count)}
+
   @doc """
   Gets the oldest line in the scrollback buffer.
   """
+  def get_oldest_line(%{scrollback: %Ring{} = ring}), do: Ring.get(ring, Ring.size(ring) - 1)
+
   def get_oldest_line(buffer) do
     List.last(buffer.scrollback)
   end
@@ -99,12 +186,22 @@ defmodule Raxol.Terminal.Buffer.Scrollback do
   @doc """
   Gets the newest line in the scrollback buffer.
   """
+  def get_newest_line(%{scrollback: %Ring{} = ring}), do: Ring.get(ring, 0)
+
   def get_newest_line(buffer) do
     List.first(buffer.scrollback)
   end
 
   # Private helper functions
 
+  defp line_text(line) when is_binary(line), do: line
+
+  defp line_text(cells) do
+    for cell <- cells, not Map.get(cell, :wide_placeholder, false), into: "" do
+      Map.get(cell, :char) || " "
+    end
+  end
+
   defp trim_scrollback(scrollback, limit) do
     case length(scrollback) > limit do
       true ->
@@ -9,6 +9,10 @@ defmodule Raxol.Terminal.CharacterHandling do
   - Supporting Unicode character properties
   """
 
+  import Bitwise
+
+  alias Raxol.Terminal.Native
+
   require Raxol.Core.Runtime.Log
 
   @doc """
@@ -52,12 +56,17 @@ defmodule Raxol.Terminal.CharacterHandling do
 
   @doc """
   Determine the display width of a given character code point or string.
+
+  Uses termbox's own width table when the NIF is loaded, so the result matches
+  what the terminal renderer lays out, and falls back to `wide_char?/1`
+  otherwise.
   """
   @spec get_char_width(codepoint :: integer() | String.t()) :: 1 | 2
   def get_char_width(codepoint) when is_integer(codepoint) do
-    case wide_char?(codepoint) do
-      true -> 2
-      false -> 1
+    case table_width(codepoint) do
+      2 -> 2
+      nil -> if wide_char?(codepoint), do: 2, else: 1
+      _ -> 1
     end
   end
 
@@ -68,6 +77,46 @@ defmodule Raxol.Terminal.CharacterHandling do
     end
   end
 
+  # Two loads into the table from :termbox2_nif.tb_wcwidth_table/0, or nil
+  # past its limit or without the NIF
+  defp table_width(codepoint) when codepoint >= 0 do
+    case width_table() do
+      {stage1, stage2, limit} when codepoint < limit ->
+        block = :binary.at(stage1, codepoint >>> 8)
+        offset = (block * 16 + (codepoint >>> 4 &&& 0xF)) * 4
+        <<word::native-32>> = binary_part(stage2, offset, 4)
+
+        case word >>> (2 * (codepoint &&& 0xF)) &&& 3 do
+          3 -> -1
+          width -> width
+        end
+
+      _ ->
+        nil
+    end
+  end
+
+  defp table_width(_codepoint), do: nil
+
+  defp width_table do
+    case :persistent_term.get({__MODULE__, :width_table}, nil) do
+      nil ->
+        table = load_width_table()
+        :persistent_term.put({__MODULE__, :width_table}, table)
+        table
+
+      table ->
+        table
+    end
+  end
+
+  defp load_width_table do
+    case Native.call(&:termbox2_nif.tb_wcwidth_table/0) do
+      {stage1, stage2, limit} -> {stage1, stage2, limit}
+      {:error, _reason} -> :unavailable
+    end
+  end
+
   @doc """
   Determines if a character is a combining character.
   """
@@ -58,7 +58,8 @@ defmodule Raxol.Terminal.Driver do
               init_retries: 0,
               io_terminal_state: nil,
               input_buffer: <<>>,
-              flush_timer: nil
+              flush_timer: nil,
+              native_input: nil
   end
 
   # --- Public API ---
@@ -164,47 +165,22 @@ defmodule Raxol.Terminal.Driver do
         # so we must redirect from /dev/tty for stty to affect the real terminal)
         original_stty = Raxol.Terminal.Driver.Stty.save()
 
-        # Raw mode on the actual terminal: no echo, no line buffering, no signals
-        Raxol.Terminal.Driver.Stty.raw!()
-
         # Suppress Logger console output so it doesn't corrupt the TUI
         Logger.configure(level: :none)
 
-        # Enter alternate screen, hide cursor
-        IO.write("\e[?1049h\e[?25l")
-
-        # Reset mouse tracking (may be left over from a crashed session)
-        IO.write("\e[?1003l\e[?1006l\e[?1000l")
-
-        # Enable SGR mouse mode (button events + SGR extended coordinates)
-        if mouse_enabled do
-          IO.write("\e[?1000h\e[?1006h")
-        end
+        state = %{state | termbox_state: :initialized, original_stty: original_stty}
 
-        # Enable terminal modes: focus reporting, bracketed paste
-        IO.write("\e[?1004h\e[?2004h")
+        # Read input natively through termbox, or through stdin if it won't start
+        state =
+          case TermboxLifecycle.start_native(self(), mouse_enabled) do
+            {:ok, resource} -> %{state | native_input: resource}
+            :error -> start_stdin_input(state, mouse_enabled)
+          end
 
         # Send initial resize event if we have a dispatcher
         if dispatcher_pid,
           do: Dispatch.send_initial_resize_event(dispatcher_pid)
 
-        # Activate prim_tty reader for input. In -noshell mode, prim_tty
-        # was initialized with tty => false, so the reader gets no select
-        # notifications. start_stdin_reader triggers reinit with tty => true
-        # and sets up trace interception of the reader's output.
-        start_stdin_reader(self())
-
-        state = %{
-          state
-          | termbox_state: :initialized,
-            original_stty: original_stty,
-            io_terminal_state: %{
-              input_reader: Process.whereis(:user_drv_reader),
-              tty_fd: nil,
-              tty_port: nil
-            }
-        }
-
         {:ok, state}
 
       {_, false, _} ->
@@ -225,7 +201,13 @@ defmodule Raxol.Terminal.Driver do
     case TermboxLifecycle.initialize() do
       :ok ->
         Raxol.Core.Runtime.Log.info("Successfully initialized termbox on retry")
-        {:noreply, %{state | termbox_state: :initialized}}
+
+        {:noreply,
+         %{
+           state
+           | termbox_state: :initialized,
+             native_input: TermboxLifecycle.start_native_input(self())
+         }}
 
       {:error, reason} ->
         Raxol.Core.Runtime.Log.error(
@@ -285,6 +267,28 @@ defmodule Raxol.Terminal.Driver do
     {:noreply, state}
   end
 
+  # The NIF's input watcher saw the tty or resize pipe become readable; drain
+  # everything it decoded in one call and dispatch it in order.
+  @impl true
+  def handle_manager_info(
+        {:select, resource, _ref, :ready_input},
+        %{native_input: resource} = state
+      )
+      when not is_nil(resource) do
+    resource
+    |> TermboxLifecycle.poll_native_input()
+    |> Enum.reduce({:noreply, state}, fn event_map, {:noreply, acc} ->
+      handle_manager_info({:termbox_event, event_map}, acc)
+    end)
+  end
+
+  # The terminal hung up, so the NIF stopped the watcher rather than re-arm it
+  @impl true
+  def handle_manager_info({:termbox_input, :closed}, state) do
+    Raxol.Core.Runtime.Log.warning_with_context("Terminal input closed", %{})
+    {:noreply, %{state | native_input: nil}}
+  end
+
   @impl true
   def handle_manager_info({:termbox_error, reason}, state) do
     Raxol.Core.Runtime.Log.error(
@@ -490,6 +494,42 @@ defmodule Raxol.Terminal.Driver do
     {:noreply, state}
   end
 
+  # termbox has put the terminal in raw mode and the alternate screen itself;
+  # without it, set the terminal up by hand and read input from stdin
+  defp start_stdin_input(state, mouse_enabled) do
+    # Raw mode on the actual terminal: no echo, no line buffering, no signals
+    Raxol.Terminal.Driver.Stty.raw!()
+
+    # Enter alternate screen, hide cursor
+    IO.write("\e[?1049h\e[?25l")
+
+    # Reset mouse tracking (may be left over from a crashed session)
+    IO.write("\e[?1003l\e[?1006l\e[?1000l")
+
+    # Enable SGR mouse mode (button events + SGR extended coordinates)
+    if mouse_enabled do
+      IO.write("\e[?1000h\e[?1006h")
+    end
+
+    # Enable terminal modes: focus reporting, bracketed paste
+    IO.write("\e[?1004h\e[?2004h")
+
+    # Activate prim_tty reader for input. In -noshell mode, prim_tty
+    # was initialized with tty => false, so the reader gets no select
+    # notifications. start_stdin_reader triggers reinit with tty => true
+    # and sets up trace interception of the reader's output.
+    start_stdin_reader(self())
+
+    %{
+      state
+      | io_terminal_state: %{
+          input_reader: Process.whereis(:user_drv_reader),
+          tty_fd: nil,
+          tty_port: nil
+        }
+    }
+  end
+
   # --- Input reader ---
   # In -noshell mode (mix run), prim_tty is initialized with tty => false,
   # so its reader process never receives select notifications. We trigger
@@ -18,6 +18,25 @@ defmodule Raxol.Terminal.Driver.EventTranslator do
     end
   end
 
+  @doc """
+  Unpacks the binary returned by `:termbox2_nif.tb_input_poll/1` into the
+  event maps `translate/1` accepts.
+  """
+  def unpack(packed) when is_binary(packed) do
+    for <<type, mod, key::native-16, ch::native-32, x::native-signed-32,
+          y::native-signed-32 <- packed>>,
+        do: unpack_event(type, mod, key, ch, x, y)
+  end
+
+  defp unpack_event(1, mod, key, ch, _x, _y),
+    do: %{type: :key, key: key, char: ch, mod: mod}
+
+  defp unpack_event(2, _mod, _key, _ch, w, h),
+    do: %{type: :resize, width: w, height: h}
+
+  defp unpack_event(3, _mod, button, _ch, x, y),
+    do: %{type: :mouse, x: x, y: y, button: button}
+
   defp translate_event_map(%{
          type: :key,
          key: key_code,
@@ -72,11 +91,39 @@ defmodule Raxol.Terminal.Driver.EventTranslator do
   defp translate_key_or_char(data, _char_code, 68),
     do: Map.put(data, :key, :left)
 
-  defp translate_key_or_char(data, _char_code, 265),
-    do: Map.put(data, :key, :f1)
+  defp translate_key_or_char(data, _char_code, key_code)
+       when key_code in 265..276,
+       do: Map.put(data, :key, :"f#{key_code - 264}")
+
+  defp translate_key_or_char(data, _char_code, 331),
+    do: Map.put(data, :key, :insert)
+
+  defp translate_key_or_char(data, _char_code, 330),
+    do: Map.put(data, :key, :delete)
+
+  defp translate_key_or_char(data, _char_code, 262),
+    do: Map.put(data, :key, :home)
+
+  defp translate_key_or_char(data, _char_code, 360),
+    do: Map.put(data, :key, :end)
+
+  defp translate_key_or_char(data, _char_code, 339),
+    do: Map.put(data, :key, :page_up)
+
+  defp translate_key_or_char(data, _char_code, 338),
+    do: Map.put(data, :key, :page_down)
+
+  defp translate_key_or_char(data, _char_code, 13),
+    do: Map.put(data, :key, :enter)
+
+  defp translate_key_or_char(data, _char_code, 9), do: Map.put(data, :key, :tab)
+
+  defp translate_key_or_char(data, _char_code, 27),
+    do: Map.put(data, :key, :escape)
 
-  defp translate_key_or_char(data, _char_code, 266),
-    do: Map.put(data, :key, :f2)
+  defp translate_key_or_char(data, _char_code, key_code)
+       when key_code in [8, 127],
+       do: Map.put(data, :key, :backspace)
 
   defp translate_key_or_char(data, _char_code, _key_code),
     do: Map.put(data, :key, :unknown)
@@ -88,6 +135,7 @@ defmodule Raxol.Terminal.Driver.EventTranslator do
       2 -> :middle
       3 -> :wheel_up
       4 -> :wheel_down
+      5 -> :release
       _ -> :unknown
     end
   end
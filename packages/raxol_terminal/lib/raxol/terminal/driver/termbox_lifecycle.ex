@@ -6,6 +6,7 @@ defmodule Raxol.Terminal.Driver.TermboxLifecycle do
   require Logger
 
   alias Raxol.Core.Runtime.Log
+  alias Raxol.Terminal.Driver.EventTranslator
   alias Raxol.Terminal.IOTerminal
 
   import Raxol.Terminal.TerminalUtils, only: [has_terminal_device?: 0]
@@ -19,12 +20,8 @@ defmodule Raxol.Terminal.Driver.TermboxLifecycle do
   @dialyzer {:nowarn_function, initialize: 0}
   def initialize do
     case call_termbox_init() do
-      0 ->
-        :ok
-
-      -1 ->
-        {:error, :init_failed}
-        # NIF only returns 0 or -1
+      0 -> :ok
+      _code -> {:error, :init_failed}
     end
   end
 
@@ -41,6 +38,60 @@ defmodule Raxol.Terminal.Driver.TermboxLifecycle do
     end
   end
 
+  @doc """
+  Starts native input for `owner`: the NIF watches the tty and resize pipe with
+  `enif_select` and `owner` receives `{:select, resource, _, :ready_input}`,
+  which it answers with `poll_native_input/1`, or `{:termbox_input, :closed}`
+  once the terminal hangs up. Returns the watcher resource, or nil if termbox
+  is not initialized or the NIF is unavailable.
+  """
+  @dialyzer {:nowarn_function, start_native_input: 1}
+  def start_native_input(owner) do
+    if @termbox2_available do
+      case :termbox2_nif.tb_input_start(owner) do
+        {:ok, resource} ->
+          resource
+
+        {:error, code} ->
+          Log.warning("Native termbox input unavailable: #{inspect(code)}")
+          nil
+      end
+    end
+  end
+
+  @doc """
+  Initializes termbox on the controlling terminal and starts native input for
+  `owner`, reporting mouse events if `mouse?` is true. Returns
+  `{:ok, resource}`, or `:error` with termbox shut down again, so the caller
+  can fall back to reading stdin.
+  """
+  @dialyzer {:nowarn_function, start_native: 2}
+  def start_native(owner, mouse?) do
+    with true <- @termbox2_available,
+         :ok <- initialize(),
+         {:ok, resource} <- start_watcher(owner) do
+      # TB_INPUT_ESC, plus TB_INPUT_MOUSE
+      _ = :termbox2_nif.tb_set_input_mode(if mouse?, do: 5, else: 1)
+      {:ok, resource}
+    else
+      _ -> :error
+    end
+  end
+
+  @doc """
+  Drains all pending input for the watcher and returns it as a list of
+  termbox event maps, oldest first.
+  """
+  @dialyzer {:nowarn_function, poll_native_input: 1}
+  def poll_native_input(resource) do
+    with true <- @termbox2_available,
+         packed when is_binary(packed) <- :termbox2_nif.tb_input_poll(resource) do
+      EventTranslator.unpack(packed)
+    else
+      _ -> []
+    end
+  end
+
   @doc """
   Attempts recovery from a termbox error by shutting down and reinitializing.
   Returns {:noreply, state} or {:stop, reason, state}.
@@ -52,7 +103,7 @@ defmodule Raxol.Terminal.Driver.TermboxLifecycle do
         case initialize() do
           :ok ->
             Log.info("Successfully recovered from termbox error")
-            {:noreply, state}
+            {:noreply, restart_native_input(state)}
 
           {:error, init_reason} ->
             Log.error("Failed to recover from termbox error: #{inspect(init_reason)}")
@@ -99,6 +150,9 @@ defmodule Raxol.Terminal.Driver.TermboxLifecycle do
         :ok
     end
 
+    # Shutting termbox down also stops its input watcher
+    _ = if Map.get(state, :native_input), do: terminate()
+
     # Only attempt shutdown if not in test environment
     if not Env.test?() and has_terminal_device?() do
       # Disable terminal modes before restoring
@@ -117,6 +171,25 @@ defmodule Raxol.Terminal.Driver.TermboxLifecycle do
     :ok
   end
 
+  defp start_watcher(owner) do
+    case start_native_input(owner) do
+      nil ->
+        _ = :termbox2_nif.tb_shutdown()
+        :error
+
+      resource ->
+        {:ok, resource}
+    end
+  end
+
+  # tb_shutdown/0 stopped the old watcher along with termbox
+  defp restart_native_input(%{native_input: resource} = state)
+       when not is_nil(resource) do
+    %{state | native_input: start_native_input(self())}
+  end
+
+  defp restart_native_input(state), do: state
+
   @dialyzer {:nowarn_function, call_termbox_init: 0}
   defp call_termbox_init do
     if @termbox2_available do
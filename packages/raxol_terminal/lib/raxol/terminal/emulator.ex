@@ -95,6 +95,7 @@ defmodule Raxol.Terminal.Emulator do
             cursor_manager: nil,
             scrollback_manager: nil,
             selection_manager: nil,
+            search_buffer: %Raxol.Terminal.SearchBuffer{},
             mode_manager_pid: nil,
             style_manager: nil,
             damage_tracker: nil,
@@ -176,6 +177,7 @@ defmodule Raxol.Terminal.Emulator do
           cursor_manager: any(),
           scrollback_manager: any(),
           selection_manager: any(),
+          search_buffer: Raxol.Terminal.SearchBuffer.t(),
           mode_manager_pid: any(),
           style_manager: any(),
           damage_tracker: any(),
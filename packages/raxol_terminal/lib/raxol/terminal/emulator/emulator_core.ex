@@ -13,7 +13,8 @@ defmodule Raxol.Terminal.Emulator.Core do
     Buffer.Scrollback,
     Cursor.Manager,
     Input.CoreHandler,
-    ScreenBuffer
+    ScreenBuffer,
+    SearchManager
   }
 
   @doc """
@@ -320,12 +321,15 @@ defmodule Raxol.Terminal.Emulator.Core do
       ScreenBuffer.scroll_up(active_buffer, 1)
 
     log_scroll_result(scrolled_lines)
-    updated_buffer = update_scrollback_buffer(scrolled_buffer, scrolled_lines)
+    {updated_buffer, added} = update_scrollback_buffer(scrolled_buffer, scrolled_lines)
     log_buffer_update(updated_buffer)
 
-    # Update the buffer
+    # Update the buffer, and any search for the lines that reached the
+    # scrollback and the rows the screen scrolled in
     emulator_with_updated_buffer =
-      update_active_buffer(emulator, updated_buffer)
+      emulator
+      |> update_active_buffer(updated_buffer)
+      |> SearchManager.lines_added(added, length(scrolled_lines || []))
 
     # Handle cursor position based on autowrap state
     cursor_handled = Map.get(emulator, :cursor_handled_by_autowrap, false)
@@ -364,6 +368,7 @@ defmodule Raxol.Terminal.Emulator.Core do
     %{emulator_with_updated_buffer | cursor: updated_cursor}
   end
 
+  # Returns the buffer and the number of lines added to its scrollback
   defp update_scrollback_buffer(scrolled_buffer, scrolled_lines) do
     has_lines = scrolled_lines != nil and scrolled_lines != []
     handle_scrollback_update(has_lines, scrolled_buffer, scrolled_lines)
@@ -371,7 +376,7 @@ defmodule Raxol.Terminal.Emulator.Core do
 
   defp handle_scrollback_update(false, scrolled_buffer, _scrolled_lines) do
     Raxol.Core.Runtime.Log.debug("[maybe_scroll] No scrolled_lines to add")
-    scrolled_buffer
+    {scrolled_buffer, 0}
   end
 
   defp handle_scrollback_update(true, scrolled_buffer, scrolled_lines) do
@@ -390,7 +395,7 @@ defmodule Raxol.Terminal.Emulator.Core do
   defp handle_meaningful_lines_update(false, scrolled_buffer, _meaningful_lines) do
     Raxol.Core.Runtime.Log.debug("[maybe_scroll] No meaningful lines to add to scrollback")
 
-    scrolled_buffer
+    {scrolled_buffer, 0}
   end
 
   defp handle_meaningful_lines_update(true, scrolled_buffer, meaningful_lines) do
@@ -398,7 +403,7 @@ defmodule Raxol.Terminal.Emulator.Core do
       "[maybe_scroll] Adding #{length(meaningful_lines)} meaningful lines to scrollback"
     )
 
-    Scrollback.add_lines(scrolled_buffer, meaningful_lines)
+    {Scrollback.add_lines(scrolled_buffer, meaningful_lines), length(meaningful_lines)}
   end
 
   defp has_meaningful_content?(line) do
@@ -455,7 +460,7 @@ defmodule Raxol.Terminal.Emulator.Core do
 
   defp log_buffer_update(updated_buffer) do
     Raxol.Core.Runtime.Log.debug(
-      "[maybe_scroll] Updated buffer scrollback length: #{length(updated_buffer.scrollback)}"
+      "[maybe_scroll] Updated buffer scrollback length: #{Scrollback.size(updated_buffer)}"
     )
   end
 end
@@ -4,6 +4,8 @@ defmodule Raxol.Terminal.Emulator.Factory do
   """
 
   alias Raxol.Core.Runtime.Log
+  alias Raxol.Terminal.ANSI.NativeParser
+  alias Raxol.Terminal.Buffer.Scrollback
   alias Raxol.Terminal.Cursor.Manager, as: CursorManager
   alias Raxol.Terminal.ScreenBufferAdapter, as: ScreenBuffer
 
@@ -14,7 +16,10 @@ defmodule Raxol.Terminal.Emulator.Factory do
   Falls back to basic emulator on failure.
   """
   def create_full(width, height, opts) do
-    Raxol.Terminal.Emulator.Coordinator.new(width, height, opts)
+    width
+    |> Raxol.Terminal.Emulator.Coordinator.new(height, opts)
+    |> maybe_attach_native_parser(opts)
+    |> maybe_attach_native_scrollback(opts)
   rescue
     error ->
       Log.warning("Failed to create full emulator with GenServers: #{inspect(error)}")
@@ -24,6 +29,11 @@ defmodule Raxol.Terminal.Emulator.Factory do
 
   @doc """
   Creates a basic emulator without GenServer processes (optimized for performance).
+
+  Both constructors take `native_parser: true` to parse input with
+  `Raxol.Terminal.ANSI.NativeParser` when the NIF is available, and
+  `native_scrollback: true` to keep the main screen's scrollback in a
+  `Raxol.Terminal.Scrollback.Ring`, optionally capped at `scrollback_bytes`.
   """
   def create_basic(width, height, opts) do
     enable_history = Keyword.get(opts, :enable_history, true)
@@ -113,5 +123,25 @@ defmodule Raxol.Terminal.Emulator.Factory do
       last_col_exceeded: false,
       plugin_manager: Keyword.get(opts, :plugin_manager)
     }
+    |> maybe_attach_native_parser(opts)
+    |> maybe_attach_native_scrollback(opts)
+  end
+
+  defp maybe_attach_native_parser(emulator, opts) do
+    if Keyword.get(opts, :native_parser, false),
+      do: %{emulator | parser_state: NativeParser.attach(emulator.parser_state)},
+      else: emulator
+  end
+
+  defp maybe_attach_native_scrollback(emulator, opts) do
+    if Keyword.get(opts, :native_scrollback, false) do
+      main = emulator.main_screen_buffer
+      ring_opts = [max_bytes: Keyword.get(opts, :scrollback_bytes, 0)]
+      attached = Scrollback.attach_native(main, ring_opts)
+      active = if emulator.active_buffer == main, do: attached, else: emulator.active_buffer
+      %{emulator | main_screen_buffer: attached, active_buffer: active}
+    else
+      emulator
+    end
   end
 end
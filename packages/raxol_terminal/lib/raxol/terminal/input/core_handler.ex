@@ -4,7 +4,9 @@ defmodule Raxol.Terminal.Input.CoreHandler do
   Manages the main input buffer and cursor state.
   """
 
+  alias Raxol.Terminal.ANSI.NativeParser
   alias Raxol.Terminal.ModeManager
+  alias Raxol.Terminal.Parser.NativeOps
   alias Raxol.Terminal.TerminalParser, as: Parser
 
   @type t :: %__MODULE__{
@@ -56,6 +58,14 @@ defmodule Raxol.Terminal.Input.CoreHandler do
   """
   @spec process_terminal_input(map(), binary()) ::
           {map(), list()}
+  def process_terminal_input(%{parser_state: %{native: parser} = parser_state} = emulator, input)
+      when is_binary(input) and is_reference(parser) do
+    {parsed_emulator, parsed_parser_state} =
+      NativeOps.apply_ops(emulator, parser_state, NativeParser.parse(parser, input))
+
+    take_output(%{parsed_emulator | parser_state: parsed_parser_state})
+  end
+
   def process_terminal_input(emulator, input) when is_binary(input) do
     current_parser_state = emulator.parser_state
 
@@ -72,18 +82,10 @@ defmodule Raxol.Terminal.Input.CoreHandler do
         )
     end
 
-    final_emulator_updated = %{
-      parsed_emulator
-      | parser_state: parsed_parser_state
-    }
-
-    output_to_send = final_emulator_updated.output_buffer
-
-    final_emulator_state_no_output = %{
-      final_emulator_updated
-      | output_buffer: ""
-    }
+    take_output(%{parsed_emulator | parser_state: parsed_parser_state})
+  end
 
-    {final_emulator_state_no_output, output_to_send}
+  defp take_output(emulator) do
+    {%{emulator | output_buffer: ""}, emulator.output_buffer}
   end
 end
@@ -1,32 +1,22 @@
 defmodule Raxol.Terminal.Integration.CellRenderer do
   @moduledoc """
   Renders a list of cells to the terminal.
+
+  Cells are packed into a single binary and uploaded to the termbox back
+  buffer with one `:termbox2_nif.tb_set_cells/1` call per frame, rather than
+  one NIF call per cell.
   """
 
+  # Records carry x and y as 16-bit values
+  @max_position 0xFFFF
+
   @doc """
   Renders a list of cells to the terminal.
+
+  Returns `{:error, {:invalid_position, {x, y}}}`, uploading nothing, if a
+  cell's position doesn't fit a record.
   """
   def render(cells) do
-    cells
-    |> Enum.reduce_while(:ok, fn {row_of_cells, y_offset}, _acc ->
-      case render_row(row_of_cells, y_offset) do
-        :ok -> {:cont, :ok}
-        error -> {:halt, error}
-      end
-    end)
-  end
-
-  defp render_row(row_of_cells, y_offset) do
-    row_of_cells
-    |> Enum.reduce_while(:ok, fn {cell, x_offset}, _acc ->
-      case render_cell(cell, x_offset, y_offset) do
-        :ok -> {:cont, :ok}
-        error -> {:halt, error}
-      end
-    end)
-  end
-
-  defp render_cell(cell, x_offset, y_offset) do
     # Check if we're in test mode
     case Application.get_env(:raxol, :terminal_test_mode, false) do
       true ->
@@ -34,27 +24,63 @@ defmodule Raxol.Terminal.Integration.CellRenderer do
         :ok
 
       false ->
-        char_s = cell.char
-
-        codepoint =
-          case is_nil(char_s) or char_s == "" do
-            true -> ?\s
-            false -> hd(String.to_charlist(char_s))
-          end
-
-        case :termbox2_nif.tb_set_cell(
-               x_offset,
-               y_offset,
-               codepoint,
-               cell.fg,
-               cell.bg
-             ) do
-          0 ->
-            :ok
-
-          error_code ->
-            {:error, {:set_cell_failed, {x_offset, y_offset, error_code}}}
+        case pack(cells) do
+          {:ok, packed} -> upload(packed)
+          {:error, _reason} = error -> error
         end
     end
   end
+
+  @doc """
+  Packs `{row_of_cells, y_offset}` rows into the iodata layout expected by
+  `:termbox2_nif.tb_set_cells/1`.
+
+  Raises `ArgumentError` if a position is negative or above 65535, rather
+  than letting it wrap onto another cell. Only the first codepoint of a
+  multi-codepoint character is kept.
+  """
+  def pack_cells(cells) do
+    case pack(cells) do
+      {:ok, packed} ->
+        packed
+
+      {:error, {:invalid_position, position}} ->
+        raise ArgumentError, "cell position #{inspect(position)} does not fit 16 bits"
+    end
+  end
+
+  defp pack(cells) do
+    packed =
+      Enum.map(cells, fn {row_of_cells, y_offset} ->
+        Enum.map(row_of_cells, fn {cell, x_offset} ->
+          pack_cell(cell, x_offset, y_offset)
+        end)
+      end)
+
+    {:ok, packed}
+  catch
+    {:invalid_position, _position} = reason -> {:error, reason}
+  end
+
+  defp pack_cell(cell, x_offset, y_offset)
+       when x_offset in 0..@max_position and y_offset in 0..@max_position do
+    <<x_offset::native-16, y_offset::native-16, codepoint(cell.char)::native-32,
+      cell.fg::native-64, cell.bg::native-64>>
+  end
+
+  defp pack_cell(_cell, x_offset, y_offset), do: throw({:invalid_position, {x_offset, y_offset}})
+
+  defp codepoint(nil), do: ?\s
+  defp codepoint(""), do: ?\s
+  defp codepoint(char_s), do: hd(String.to_charlist(char_s))
+
+  defp upload(packed) do
+    case :termbox2_nif.tb_set_cells(packed) do
+      written when is_integer(written) and written >= 0 ->
+        :ok
+
+      error_code ->
+        {:error, {:set_cells_failed, error_code}}
+    end
+  end
 end
@@ -350,6 +350,9 @@ defmodule Raxol.Terminal.Integration.Renderer do
              0 ->
                Log.info("[Renderer] :termbox2_nif.tb_init() returned 0 (success)")
 
+               # Skip frames rather than block while the terminal is behind,
+               # see present_buffer_by_mode/1
+               _ = :termbox2_nif.tb_set_output_nonblock(true)
                :ok
 
              int_val when is_integer(int_val) ->
@@ -438,13 +441,52 @@ defmodule Raxol.Terminal.Integration.Renderer do
     :ok
   end
 
+  # While the terminal is still taking an earlier frame, skip this one: its
+  # cells stay in termbox's back buffer and go out with the next present. The
+  # flush asks for {:select, _, _, :ready_output} once there is room, which
+  # Raxol.Terminal.Integration.Main answers by rendering again.
   defp present_buffer_by_mode(false) do
-    case :termbox2_nif.tb_present() do
-      0 -> :ok
-      error_code -> {:error, {:present_failed, error_code}}
+    with :ok <- :termbox2_nif.tb_flush(),
+         {:ok, damage} <- :termbox2_nif.tb_present_damage() do
+      record_present_damage(damage)
+    else
+      {:pending, _bytes} ->
+        :ok
+
+      {:error, error_code} ->
+        {:error, {:present_failed, error_code}}
     end
   end
 
+  defp record_present_damage(%{
+         bytes: bytes,
+         cells: cells,
+         spans: spans,
+         scroll: scroll,
+         pending: pending
+       }) do
+    case Application.get_env(:raxol, :enable_performance_metrics, false) do
+      true ->
+        :telemetry.execute(
+          [:raxol, :terminal, :present],
+          %{
+            bytes: bytes,
+            cells: cells,
+            rows: length(spans),
+            scrolled_rows: scrolled_rows(scroll),
+            pending_bytes: pending
+          },
+          %{spans: spans, scroll: scroll}
+        )
+
+      false ->
+        :ok
+    end
+  end
+
+  defp scrolled_rows(nil), do: 0
+  defp scrolled_rows({_top, _bottom, rows}), do: abs(rows)
+
   defp get_dimensions_by_mode(true) do
     # Return mock dimensions for tests
     {:ok, {80, 24}}
@@ -275,6 +275,14 @@ defmodule Raxol.Terminal.Integration do
     IntegrationRenderer.get_title(state)
   end
 
+  @doc """
+  Renders again once the terminal can take more output, after frames were
+  skipped because it was still busy with an earlier one.
+  """
+  def resume_output(%State{} = state) do
+    render(state)
+  end
+
   # Private functions
 
   defp render(%State{} = state) do
@@ -336,6 +344,19 @@ defmodule Raxol.Terminal.Integration.Main do
     {:reply, :ok, new_state}
   end
 
+  # The terminal has room again after a frame was skipped, see
+  # Raxol.Terminal.Integration.Renderer
+  @impl Raxol.Core.Behaviours.BaseManager
+  def handle_manager_info({:select, _watcher, _ref, :ready_output}, state) do
+    _ = Raxol.Terminal.Integration.resume_output(state)
+    {:noreply, state}
+  end
+
+  @impl Raxol.Core.Behaviours.BaseManager
+  def handle_manager_info(_msg, state) do
+    {:noreply, state}
+  end
+
   # Functions expected by tests
   def get_state(pid) when is_pid(pid) do
     GenServer.call(pid, {:get_state})
@@ -0,0 +1,183 @@
+defmodule Raxol.Terminal.Integration.NativeFrame do
+  @moduledoc """
+  Diffs screen buffer frames natively for backends without a local terminal.
+
+  Each session keeps a termbox memory context (see
+  `:termbox2_nif.tb_open_memory/2`) holding the frame it sent last. `render/2`
+  blits the new frame into it and returns only the escape sequences that take
+  the client from the previous frame to this one, so an idle frame costs
+  nothing instead of a full repaint.
+
+  The context renders in 256-color mode: named colors map to palette indices
+  0..15, and RGB or hex colors to the nearest entry of the 6x6x6 color cube.
+  """
+
+  import Bitwise
+
+  alias Raxol.Terminal.{Native, ScreenBuffer}
+
+  @type t :: reference()
+
+  # TB_OUTPUT_256
+  @output_256 2
+
+  # Attribute bits of the NIF's 64-bit termbox attrs
+  @bold 0x01000000
+  @underline 0x02000000
+  @reverse 0x04000000
+  @italic 0x08000000
+  @blink 0x10000000
+  @hi_black 0x20000000
+  @dim 0x80000000
+
+  @named_colors %{
+    black: 0,
+    red: 1,
+    green: 2,
+    yellow: 3,
+    blue: 4,
+    magenta: 5,
+    cyan: 6,
+    white: 7,
+    bright_black: 8,
+    bright_red: 9,
+    bright_green: 10,
+    bright_yellow: 11,
+    bright_blue: 12,
+    bright_magenta: 13,
+    bright_cyan: 14,
+    bright_white: 15
+  }
+
+  @doc """
+  Opens a `width`x`height` context. The setup sequences termbox would send to
+  a fresh terminal are dropped, so the caller should clear the client's screen
+  before sending the first frame.
+  """
+  @spec open(pos_integer(), pos_integer()) :: {:ok, t()} | {:error, term()}
+  def open(width, height) do
+    Native.call(fn ->
+      with {:ok, ctx} <- :termbox2_nif.tb_open_memory(width, height),
+           _ <- :termbox2_nif.tb_set_output_mode(ctx, @output_256),
+           {:ok, _setup} <- :termbox2_nif.tb_present_binary(ctx) do
+        {:ok, ctx}
+      end
+    end)
+  end
+
+  @doc """
+  Returns the output that takes the client from the last rendered frame to
+  `buffer`, resizing the context first if the buffer's size changed (which
+  repaints everything).
+  """
+  @spec render(t(), ScreenBuffer.t()) :: {:ok, binary()} | {:error, term()}
+  def render(ctx, %ScreenBuffer{width: width, height: height} = buffer) do
+    with :ok <- ensure_size(ctx, width, height),
+         written when is_integer(written) and written >= 0 <-
+           :termbox2_nif.tb_blit(ctx, 0, 0, width, height, pack_buffer(buffer)) do
+      :termbox2_nif.tb_present_binary(ctx)
+    else
+      {:error, _} = error -> error
+      code -> {:error, {:blit_failed, code}}
+    end
+  end
+
+  @doc """
+  Shuts the context down.
+  """
+  @spec close(t()) :: :ok
+  def close(ctx), do: :termbox2_nif.tb_close(ctx)
+
+  @doc """
+  Packs `buffer` into the row-major iodata layout expected by
+  `:termbox2_nif.tb_blit/6`, padding or cropping rows to the buffer's size.
+  """
+  @spec pack_buffer(ScreenBuffer.t()) :: iodata()
+  def pack_buffer(%ScreenBuffer{cells: rows, width: width, height: height}) do
+    blank = pack_cell(nil)
+
+    rows
+    |> Enum.take(height)
+    |> Enum.map(fn row ->
+      packed = row |> Enum.take(width) |> Enum.map(&pack_cell/1)
+      [packed | List.duplicate(blank, width - length(packed))]
+    end)
+    |> then(fn packed ->
+      [packed | List.duplicate(blank, width * (height - length(packed)))]
+    end)
+  end
+
+  @doc """
+  Returns the termbox `{fg, bg}` attrs for a cell style.
+  """
+  @spec attrs(map() | nil) :: {non_neg_integer(), non_neg_integer()}
+  def attrs(nil), do: {0, 0}
+
+  def attrs(style) when is_map(style) do
+    flags =
+      flag(style, :bold, @bold) ||| flag(style, :underline, @underline) |||
+        flag(style, :reverse, @reverse) ||| flag(style, :italic, @italic) |||
+        flag(style, :blink, @blink) ||| flag(style, :faint, @dim)
+
+    {color(Map.get(style, :foreground)) ||| flags, color(Map.get(style, :background))}
+  end
+
+  defp pack_cell(nil), do: <<?\s::native-32, 0::native-64, 0::native-64>>
+
+  defp pack_cell(cell) do
+    {fg, bg} = attrs(cell.style)
+    <<codepoint(cell.char)::native-32, fg::native-64, bg::native-64>>
+  end
+
+  defp codepoint(nil), do: ?\s
+  defp codepoint(""), do: ?\s
+  defp codepoint(<<cp::utf8, _::binary>>), do: cp
+  defp codepoint(_), do: ?\s
+
+  defp flag(style, key, bit), do: if(Map.get(style, key), do: bit, else: 0)
+
+  defp ensure_size(ctx, width, height) do
+    if :termbox2_nif.tb_width(ctx) == width and :termbox2_nif.tb_height(ctx) == height do
+      :ok
+    else
+      case :termbox2_nif.tb_resize(ctx, width, height) do
+        0 -> :ok
+        code -> {:error, {:resize_failed, code}}
+      end
+    end
+  end
+
+  # Palette index 0 needs TB_HI_BLACK, since a 0 color means the default
+  defp color(nil), do: 0
+  defp color(:default), do: 0
+  defp color(0), do: @hi_black
+  defp color(index) when is_integer(index) and index in 1..255, do: index
+
+  defp color(name) when is_atom(name) do
+    case Map.fetch(@named_colors, name) do
+      {:ok, index} -> color(index)
+      :error -> 0
+    end
+  end
+
+  defp color(%{r: r, g: g, b: b}), do: color({r, g, b})
+
+  defp color({r, g, b}) when is_integer(r) and is_integer(g) and is_integer(b),
+    do: 16 + 36 * cube_level(r) + 6 * cube_level(g) + cube_level(b)
+
+  defp color("#" <> hex), do: color(hex)
+
+  defp color(<<_::binary-size(6)>> = hex) do
+    case Integer.parse(hex, 16) do
+      {rgb, ""} -> color({rgb >>> 16 &&& 0xFF, rgb >>> 8 &&& 0xFF, rgb &&& 0xFF})
+      _ -> 0
+    end
+  end
+
+  defp color(_), do: 0
+
+  # Nearest of the cube's channel levels 0, 95, 135, 175, 215, 255
+  defp cube_level(v) when v < 48, do: 0
+  defp cube_level(v) when v < 115, do: 1
+  defp cube_level(v), do: min(div(v - 35, 40), 5)
+end
@@ -0,0 +1,20 @@
+defmodule Raxol.Terminal.Native do
+  @moduledoc """
+  Guards calls into the optional `:termbox2_nif` library.
+
+  The NIF is not built everywhere (e.g. on Windows), and a build that is
+  present can still fail to load. Modules with a native fast path open their
+  native state through `call/1` and fall back to Elixir on `{:error, _}`.
+  """
+
+  @doc """
+  Runs `fun`, returning `{:error, reason}` instead of raising if the NIF is
+  not available.
+  """
+  @spec call((-> result)) :: result | {:error, Exception.t()} when result: term()
+  def call(fun) when is_function(fun, 0) do
+    fun.()
+  rescue
+    e in [ErlangError, UndefinedFunctionError] -> {:error, e}
+  end
+end
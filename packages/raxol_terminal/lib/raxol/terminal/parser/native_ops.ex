@@ -0,0 +1,98 @@
+defmodule Raxol.Terminal.Parser.NativeOps do
+  @moduledoc """
+  Applies the ops from `Raxol.Terminal.ANSI.NativeParser` to the emulator,
+  through the same handlers the `Raxol.Terminal.Parser.States` modules call
+  once they have parsed a sequence.
+  """
+
+  alias Raxol.Terminal.ANSI.CharacterSets
+  alias Raxol.Terminal.ANSI.NativeParser
+  alias Raxol.Terminal.Commands.Executor
+  alias Raxol.Terminal.Commands.History
+  alias Raxol.Terminal.ControlCodes
+  alias Raxol.Terminal.Input.InputHandler
+
+  @doc """
+  Applies `ops` in order, returning the updated emulator and parser state.
+  The parser state carries single shifts (`ESC N`, `ESC O`) over to the next
+  printed character, which may come in a later chunk.
+  """
+  @spec apply_ops(map(), map(), [NativeParser.op()]) :: {map(), map()}
+  def apply_ops(emulator, parser_state, ops) do
+    Enum.reduce(ops, {emulator, parser_state}, &apply_op/2)
+  end
+
+  defp apply_op(text, acc) when is_binary(text), do: print(text, acc)
+
+  defp apply_op(10, {emulator, parser_state}) do
+    emulator = emulator |> History.maybe_add_to_history(10) |> ControlCodes.handle_c0(10)
+    {emulator, parser_state}
+  end
+
+  defp apply_op(byte, {emulator, parser_state}) when is_integer(byte),
+    do: {ControlCodes.handle_c0(emulator, byte), parser_state}
+
+  defp apply_op({:csi, params, intermediates, final}, {emulator, parser_state}),
+    do: {Executor.execute_csi_command(emulator, params, intermediates, final), parser_state}
+
+  defp apply_op({:osc, data}, {emulator, parser_state}),
+    do: {Executor.execute_osc_command(emulator, data), parser_state}
+
+  defp apply_op({:dcs, params, intermediates, final, data}, {emulator, parser_state}) do
+    {Executor.execute_dcs_command(emulator, params, intermediates, final, data), parser_state}
+  end
+
+  defp apply_op({:esc, "", ?N}, {emulator, parser_state}),
+    do: {emulator, Map.put(parser_state, :single_shift, :ss2)}
+
+  defp apply_op({:esc, "", ?O}, {emulator, parser_state}),
+    do: {emulator, Map.put(parser_state, :single_shift, :ss3)}
+
+  defp apply_op({:esc, "", final}, {emulator, parser_state}),
+    do: {ControlCodes.handle_escape(emulator, final), parser_state}
+
+  defp apply_op({:esc, <<designator>>, final}, {emulator, parser_state})
+       when designator in [?(, ?), ?*, ?+] do
+    charset_state =
+      CharacterSets.designate_charset(emulator.charset_state, gset(designator), final)
+
+    {%{emulator | charset_state: charset_state}, parser_state}
+  end
+
+  # SOS, PM and APC strings and other escape sequences have no handler
+  defp apply_op(_op, acc), do: acc
+
+  defp print(text, {%{bracketed_paste_active: true} = emulator, parser_state}) do
+    buffer = emulator.bracketed_paste_buffer <> text
+    {%{emulator | bracketed_paste_buffer: buffer}, parser_state}
+  end
+
+  defp print(text, acc), do: print_chars(text, acc)
+
+  defp print_chars(<<codepoint::utf8, rest::binary>>, {emulator, parser_state}) do
+    {emulator, _output_events} =
+      emulator
+      |> History.maybe_add_to_history(codepoint)
+      |> InputHandler.handle_printable_character(
+        codepoint,
+        Map.get(parser_state, :params, []),
+        Map.get(parser_state, :single_shift)
+      )
+
+    print_chars(rest, {emulator, clear_single_shift(parser_state)})
+  end
+
+  # Invalid UTF-8 prints as U+FFFD
+  defp print_chars(<<_byte, rest::binary>>, acc),
+    do: print_chars(<<0xFFFD::utf8, rest::binary>>, acc)
+
+  defp print_chars(<<>>, acc), do: acc
+
+  defp clear_single_shift(%{single_shift: nil} = parser_state), do: parser_state
+  defp clear_single_shift(parser_state), do: Map.put(parser_state, :single_shift, nil)
+
+  defp gset(?(), do: :g0
+  defp gset(?)), do: :g1
+  defp gset(?*), do: :g2
+  defp gset(?+), do: :g3
+end
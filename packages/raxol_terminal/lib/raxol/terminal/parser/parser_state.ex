@@ -1,6 +1,10 @@
 defmodule Raxol.Terminal.Parser.ParserState do
   @moduledoc """
   Parser state for the terminal emulator.
+
+  `native` holds the parser from `Raxol.Terminal.ANSI.NativeParser` when input
+  is parsed natively, in which case the remaining fields other than
+  `single_shift` are unused.
   """
 
   @type t :: %__MODULE__{
@@ -11,7 +15,8 @@ defmodule Raxol.Terminal.Parser.ParserState do
           payload_buffer: binary(),
           final_byte: byte() | nil,
           designating_gset: term() | nil,
-          single_shift: term() | nil
+          single_shift: term() | nil,
+          native: reference() | nil
         }
 
   defstruct state: :ground,
@@ -21,5 +26,6 @@ defmodule Raxol.Terminal.Parser.ParserState do
             payload_buffer: "",
             final_byte: nil,
             designating_gset: nil,
-            single_shift: nil
+            single_shift: nil,
+            native: nil
 end
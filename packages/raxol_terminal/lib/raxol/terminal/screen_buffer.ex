@@ -63,6 +63,8 @@ defmodule Raxol.Terminal.ScreenBuffer do
     WriteOps
   }
 
+  alias Raxol.Terminal.Scrollback.Ring
+
   defstruct [
     :cells,
     :scrollback,
@@ -419,6 +421,7 @@ defmodule Raxol.Terminal.ScreenBuffer do
 
   # === Scrollback Operations ===
 
+  def get_scrollback(%{scrollback: %Ring{} = ring}), do: Ring.to_list(ring)
   def get_scrollback(buffer), do: buffer.scrollback || []
 
   def set_scrollback(buffer, scrollback),
@@ -12,6 +12,7 @@ defmodule Raxol.Terminal.ScreenBuffer.EraseOperations do
 
   alias Raxol.Terminal.Cell
   alias Raxol.Terminal.Buffer.CharEditor
+  alias Raxol.Terminal.Buffer.Scrollback
   alias Raxol.Terminal.ScreenBuffer
   alias Raxol.Terminal.ScreenBuffer.BehaviourImpl
 
@@ -112,9 +113,9 @@ defmodule Raxol.Terminal.ScreenBuffer.EraseOperations do
           List.duplicate(
             List.duplicate(empty_cell, buffer.width),
             buffer.height
-          ),
-        scrollback: []
+          )
     }
+    |> Scrollback.clear()
   end
 
   @doc """
@@ -6,6 +6,7 @@ defmodule Raxol.Terminal.ScreenBuffer.Manager do
 
   @default_scrollback Raxol.Core.Defaults.scrollback_limit()
 
+  alias Raxol.Terminal.Buffer.Scrollback
   alias Raxol.Terminal.ScreenBuffer.Core
 
   defstruct [
@@ -257,14 +258,11 @@ defmodule Raxol.Terminal.ScreenBuffer.Manager do
       manager
     else
       # Trim scrollback from main buffer
-      main = %{
-        manager.main_buffer
-        | scrollback:
-            Enum.take(
-              manager.main_buffer.scrollback,
-              div(manager.main_buffer.scrollback_limit, 2)
-            )
-      }
+      main =
+        Scrollback.trim(
+          manager.main_buffer,
+          div(manager.main_buffer.scrollback_limit, 2)
+        )
 
       %{manager | main_buffer: main} |> update_memory_usage()
     end
@@ -350,7 +348,7 @@ defmodule Raxol.Terminal.ScreenBuffer.Manager do
   defp estimate_buffer_size(buffer) do
     # ~8 bytes per cell
     cells_size = buffer.width * buffer.height * 8
-    scrollback_size = length(buffer.scrollback || []) * buffer.width * 8
+    scrollback_size = Scrollback.size(buffer) * buffer.width * 8
     cells_size + scrollback_size
   end
 
@@ -462,7 +460,7 @@ defmodule Raxol.Terminal.ScreenBuffer.Manager do
   @spec get_total_lines(t()) :: non_neg_integer()
   def get_total_lines(manager) do
     buffer = get_active_buffer(manager)
-    length(buffer.cells) + length(buffer.scrollback)
+    length(buffer.cells) + Scrollback.size(buffer)
   end
 
   @doc """
@@ -6,6 +6,8 @@ defmodule Raxol.Terminal.ScreenBuffer.MemoryUtils do
   including cells, scrollback, selection state, and other buffer elements.
   """
 
+  alias Raxol.Terminal.Scrollback.Ring
+
   @doc """
   Gets the estimated memory usage of the screen buffer.
   """
@@ -20,7 +22,7 @@ defmodule Raxol.Terminal.ScreenBuffer.MemoryUtils do
     cells_usage = calculate_cells_memory_usage(cells)
 
     # Calculate memory usage for scrollback
-    scrollback_usage = calculate_cells_memory_usage(scrollback)
+    scrollback_usage = calculate_scrollback_memory_usage(scrollback)
 
     # Calculate memory usage for other components
     # 4 integers * 8 bytes
@@ -62,4 +64,8 @@ defmodule Raxol.Terminal.ScreenBuffer.MemoryUtils do
   end
 
   defp calculate_cells_memory_usage(_), do: 0
+
+  # A native ring knows what its lines take up
+  defp calculate_scrollback_memory_usage(%Ring{} = ring), do: Ring.bytes(ring)
+  defp calculate_scrollback_memory_usage(scrollback), do: calculate_cells_memory_usage(scrollback)
 end
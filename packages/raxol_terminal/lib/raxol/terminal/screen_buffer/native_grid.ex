@@ -0,0 +1,573 @@
+defmodule Raxol.Terminal.ScreenBuffer.NativeGrid do
+  @moduledoc """
+  Screen buffer whose cells live in a native grid (see
+  `:termbox2_nif.tb_grid_new/2`) rather than in lists of `Cell` structs.
+
+  The grid has termbox's cell layout and is updated in place, so writing a run
+  of text, erasing, inserting or deleting characters or lines and scrolling a
+  region each cost one NIF call however large the screen is, where
+  `Raxol.Terminal.ScreenBuffer` rebuilds every row it touches. Cells are read
+  back a row at a time, as `Cell` structs, by `get_line/2` and the other
+  queries.
+
+  Styles are interned: the grid stores a small integer per cell, and a table
+  kept with the grid maps it back to the style.
+
+  Unlike `ScreenBuffer`, the struct is a handle, not a value. The grid and its
+  style table are one mutable resource shared by every copy of the struct:
+  an edit through any copy is seen through all of them, and keeping an older
+  copy does not keep the cells it had. Only the fields of the struct itself,
+  such as the cursor, scroll region and size, belong to each copy. A copy
+  made before `resize/3` keeps its old size: it reads rows the grid no longer
+  has as `[]`, and the others at the grid's new width.
+
+  Operations at the cursor use `cursor_position`, as in `ScreenBuffer`. Blanked
+  cells get the default style. Positions outside the grid are ignored.
+
+  This is a standalone buffer for callers that create one with `open/2`. The
+  emulator does not use it: it keeps `ScreenBuffer`, whose `cells` it reads
+  directly in many places.
+  """
+
+  @behaviour Raxol.Terminal.ScreenBufferBehaviour
+
+  alias Raxol.Terminal.ANSI.TextFormatting
+  alias Raxol.Terminal.{Cell, Native}
+  alias Raxol.Terminal.ScreenBuffer.{Attributes, BehaviourImpl}
+
+  @default_width Raxol.Core.Defaults.terminal_width()
+  @default_height Raxol.Core.Defaults.terminal_height()
+
+  defstruct [
+    :grid,
+    :width,
+    :height,
+    :default_style,
+    selection: nil,
+    scroll_region: nil,
+    scroll_position: 0,
+    damage_regions: [],
+    cursor_position: {0, 0},
+    cursor_style: :block,
+    cursor_visible: true,
+    cursor_blink: true,
+    alternate_screen: false,
+    output_buffer: "",
+    saved_states: [],
+    state_stack: [],
+    current_state: %{}
+  ]
+
+  @type t :: %__MODULE__{
+          grid: reference(),
+          width: pos_integer(),
+          height: pos_integer(),
+          default_style: TextFormatting.text_style(),
+          selection: {integer(), integer(), integer(), integer()} | nil,
+          scroll_region: {non_neg_integer(), non_neg_integer()} | nil,
+          scroll_position: non_neg_integer(),
+          damage_regions: list(tuple()),
+          cursor_position: {non_neg_integer(), non_neg_integer()},
+          cursor_style: atom(),
+          cursor_visible: boolean(),
+          cursor_blink: boolean(),
+          alternate_screen: boolean(),
+          output_buffer: String.t(),
+          saved_states: [map()],
+          state_stack: [map()],
+          current_state: map()
+        }
+
+  # Id 0 is the default style, which blank cells have
+  @blank 0
+
+  # TB_ERR_OUT_OF_BOUNDS
+  @out_of_bounds -9
+
+  @doc """
+  Creates a `width`x`height` buffer of blank cells, or returns
+  `{:error, reason}` if the NIF is not available.
+  """
+  @spec open(pos_integer(), pos_integer()) :: {:ok, t()} | {:error, term()}
+  def open(width, height) do
+    blank = TextFormatting.new()
+
+    case Native.call(fn -> :termbox2_nif.tb_grid_new(width, height) end) do
+      {:ok, grid} ->
+        # The first style interned gets the id blanks are filled with
+        @blank = :termbox2_nif.tb_grid_intern(grid, blank)
+        {:ok, %__MODULE__{grid: grid, width: width, height: height, default_style: blank}}
+
+      {:error, code} when is_integer(code) ->
+        {:error, {:grid_failed, code}}
+
+      {:error, reason} ->
+        {:error, reason}
+    end
+  end
+
+  @doc """
+  Creates a `width`x`height` buffer of blank cells. Raises if the NIF is not
+  available; see `open/2`.
+  """
+  @impl Raxol.Terminal.ScreenBufferBehaviour
+  def new(width \\ @default_width, height \\ @default_height) do
+    case open(width, height) do
+      {:ok, buffer} -> buffer
+      {:error, reason} -> raise ArgumentError, "cannot create native grid: #{inspect(reason)}"
+    end
+  end
+
+  @doc """
+  Resizes the buffer, keeping its upper-left part. Like `ScreenBuffer.resize/3`
+  this drops the selection and scroll region.
+  """
+  @spec resize(t(), pos_integer(), pos_integer()) :: t()
+  def resize(%__MODULE__{} = buffer, width, height) do
+    case :termbox2_nif.tb_grid_resize(buffer.grid, width, height, @blank, 0) do
+      0 ->
+        {x, y} = buffer.cursor_position
+
+        %{
+          buffer
+          | width: width,
+            height: height,
+            selection: nil,
+            scroll_region: nil,
+            cursor_position: {min(x, width - 1), min(y, height - 1)}
+        }
+
+      code ->
+        raise ArgumentError,
+              "cannot resize native grid to #{width}x#{height}: error #{code}"
+    end
+  end
+
+  # === Content ===
+
+  @doc """
+  Writes as much of `text` along row `y` from column `x` as fits before the
+  right edge, returning the buffer, the number of columns written and the
+  rest of the text, which the caller wraps onto the next line or drops.
+  """
+  @spec write_run(t(), non_neg_integer(), non_neg_integer(), binary(), map() | nil) ::
+          {t(), non_neg_integer(), binary()}
+  def write_run(%__MODULE__{} = buffer, x, y, text, style) do
+    id = intern(buffer, style)
+
+    case :termbox2_nif.tb_grid_print(buffer.grid, x, y, id, 0, text) do
+      {columns, bytes} -> {buffer, columns, binary_part(text, bytes, byte_size(text) - bytes)}
+      _out_of_bounds -> {buffer, 0, text}
+    end
+  end
+
+  @impl Raxol.Terminal.ScreenBufferBehaviour
+  def write_char(buffer, x, y, char, style), do: write_string(buffer, x, y, char, style)
+
+  def write_char(buffer, x, y, char), do: write_char(buffer, x, y, char, nil)
+
+  @doc """
+  Writes `string` along row `y` from column `x`, dropping whatever doesn't fit.
+  """
+  @impl Raxol.Terminal.ScreenBufferBehaviour
+  def write_string(buffer, x, y, string, style) do
+    {buffer, _columns, _rest} = write_run(buffer, x, y, string, style)
+    buffer
+  end
+
+  def write_string(buffer, x, y, string), do: write_string(buffer, x, y, string, nil)
+
+  @impl Raxol.Terminal.ScreenBufferBehaviour
+  def get_char(buffer, x, y) do
+    case :termbox2_nif.tb_grid_cell(buffer.grid, x, y) do
+      # The trailing column of a wide character reads as a placeholder's blank
+      {"", _style} -> " "
+      {text, _style} -> text
+      _out_of_bounds -> " "
+    end
+  end
+
+  @impl Raxol.Terminal.ScreenBufferBehaviour
+  def get_cell(buffer, x, y) do
+    cell =
+      case :termbox2_nif.tb_grid_cell(buffer.grid, x, y) do
+        {"", style} -> Cell.new_wide_placeholder(style)
+        {text, style} -> Cell.new(text, style)
+        _out_of_bounds -> Cell.new()
+      end
+
+    Map.from_struct(cell)
+  end
+
+  @doc """
+  Returns row `y` as a list of cells, with `Cell.new_wide_placeholder/1` cells
+  in the trailing columns of wide characters, or `[]` for a row outside the
+  buffer or the grid.
+  """
+  @spec get_line(t(), integer()) :: [Cell.t()]
+  def get_line(%__MODULE__{} = buffer, y) when y >= 0 and y < buffer.height do
+    case :termbox2_nif.tb_grid_row(buffer.grid, y) do
+      {cells, clusters, styles} ->
+        decode_row(cells, Map.new(clusters), Map.new(styles))
+
+      # A copy from before a resize may ask for a row the grid no longer has
+      @out_of_bounds ->
+        []
+
+      code ->
+        raise ArgumentError, "cannot read native grid row #{y}: error #{code}"
+    end
+  end
+
+  def get_line(_buffer, _y), do: []
+
+  @doc """
+  Returns all rows as lists of cells, like `ScreenBuffer.get_lines/1`.
+  """
+  @spec get_lines(t()) :: [[Cell.t()]]
+  def get_lines(%__MODULE__{} = buffer),
+    do: Enum.map(0..(buffer.height - 1), &get_line(buffer, &1))
+
+  @doc """
+  Returns the text on screen, like `ScreenBuffer.get_content/1`: rows joined
+  with newlines, trailing spaces and blank rows at the bottom dropped.
+  """
+  @spec get_content(t()) :: String.t()
+  def get_content(%__MODULE__{} = buffer) do
+    0..(buffer.height - 1)
+    |> Enum.map(fn y ->
+      buffer
+      |> get_line(y)
+      |> Enum.reject(& &1.wide_placeholder)
+      |> Enum.map_join("", & &1.char)
+      |> String.trim_trailing()
+    end)
+    |> Enum.reverse()
+    |> Enum.drop_while(&(&1 == ""))
+    |> Enum.reverse()
+    |> Enum.join("\n")
+  end
+
+  @doc """
+  Returns true if every cell is blank.
+  """
+  @impl Raxol.Terminal.ScreenBufferBehaviour
+  def empty?(%__MODULE__{} = buffer) do
+    Enum.all?(0..(buffer.height - 1), fn y ->
+      buffer |> get_line(y) |> Enum.all?(&Cell.empty?/1)
+    end)
+  end
+
+  def empty?(cell), do: Cell.empty?(cell)
+
+  # === Dimensions ===
+
+  @impl Raxol.Terminal.ScreenBufferBehaviour
+  def get_dimensions(buffer), do: {buffer.width, buffer.height}
+
+  @impl Raxol.Terminal.ScreenBufferBehaviour
+  def get_width(buffer), do: buffer.width
+
+  @impl Raxol.Terminal.ScreenBufferBehaviour
+  def get_height(buffer), do: buffer.height
+
+  @impl Raxol.Terminal.ScreenBufferBehaviour
+  def get_size(buffer), do: {buffer.width, buffer.height}
+
+  # === Scrolling ===
+
+  @doc """
+  Scrolls the scroll region up by `lines`, returning `{buffer, scrolled_out}`
+  with the rows that left the top, as `ScreenBuffer.scroll_up/2` does.
+  """
+  @impl Raxol.Terminal.ScreenBufferBehaviour
+  def scroll_up(buffer, lines) when lines > 0 do
+    {top, bottom} = get_scroll_region_boundaries(buffer)
+
+    if top < bottom do
+      count = min(lines, bottom - top + 1)
+      scrolled_out = Enum.map(top..(top + count - 1), &get_line(buffer, &1))
+      {grid_scroll(buffer, top, bottom, count), scrolled_out}
+    else
+      {buffer, []}
+    end
+  end
+
+  def scroll_up(buffer, _lines), do: {buffer, []}
+
+  @impl Raxol.Terminal.ScreenBufferBehaviour
+  def scroll_down(buffer, lines) when lines > 0 do
+    {top, bottom} = get_scroll_region_boundaries(buffer)
+    if top < bottom, do: grid_scroll(buffer, top, bottom, -lines), else: buffer
+  end
+
+  def scroll_down(buffer, _lines), do: buffer
+
+  @impl Raxol.Terminal.ScreenBufferBehaviour
+  def set_scroll_region(buffer, top, bottom)
+      when is_integer(top) and is_integer(bottom) and top >= 0 and top < bottom and
+             bottom < buffer.height,
+      do: %{buffer | scroll_region: {top, bottom}}
+
+  def set_scroll_region(buffer, _top, _bottom), do: %{buffer | scroll_region: nil}
+
+  @impl Raxol.Terminal.ScreenBufferBehaviour
+  def clear_scroll_region(buffer), do: %{buffer | scroll_region: nil}
+
+  @impl Raxol.Terminal.ScreenBufferBehaviour
+  def get_scroll_region_boundaries(%{scroll_region: nil} = buffer), do: {0, buffer.height - 1}
+  def get_scroll_region_boundaries(%{scroll_region: {top, bottom}}), do: {top, bottom}
+
+  @impl Raxol.Terminal.ScreenBufferBehaviour
+  def get_scroll_position(buffer), do: buffer.scroll_position
+
+  # === Line and character editing at the cursor ===
+
+  @doc """
+  Inserts `count` blank lines at the cursor row, pushing the rows below it
+  down within the scroll region. Does nothing outside the region.
+  """
+  @spec insert_lines(t(), non_neg_integer()) :: t()
+  def insert_lines(buffer, count), do: edit_lines(buffer, -count)
+
+  @doc """
+  Deletes `count` lines at the cursor row, pulling the rows below it up
+  within the scroll region. Does nothing outside the region.
+  """
+  @spec delete_lines(t(), non_neg_integer()) :: t()
+  def delete_lines(buffer, count), do: edit_lines(buffer, count)
+
+  @doc """
+  Inserts `count` blank cells at the cursor, shifting the rest of the line
+  right.
+  """
+  @spec insert_chars(t(), non_neg_integer()) :: t()
+  def insert_chars(buffer, count) do
+    {x, y} = buffer.cursor_position
+    buffer.grid |> :termbox2_nif.tb_grid_insert_cells(x, y, count, @blank, 0) |> check!(buffer)
+  end
+
+  @doc """
+  Deletes `count` cells at the cursor, shifting the rest of the line left.
+  """
+  @spec delete_chars(t(), non_neg_integer()) :: t()
+  def delete_chars(buffer, count) do
+    {x, y} = buffer.cursor_position
+    buffer.grid |> :termbox2_nif.tb_grid_delete_cells(x, y, count, @blank, 0) |> check!(buffer)
+  end
+
+  @doc """
+  Blanks `count` cells from the cursor, up to the end of the line.
+  """
+  @spec erase_chars(t(), non_neg_integer()) :: t()
+  def erase_chars(buffer, count) do
+    {x, y} = buffer.cursor_position
+    erase(buffer, x, y, min(count, buffer.width - x))
+  end
+
+  # === Erasing ===
+
+  @impl Raxol.Terminal.ScreenBufferBehaviour
+  def clear_screen(buffer), do: erase_all(buffer)
+
+  @impl Raxol.Terminal.ScreenBufferBehaviour
+  def clear_line(buffer, line), do: erase(buffer, 0, line, buffer.width)
+
+  @impl Raxol.Terminal.ScreenBufferBehaviour
+  def erase_from_cursor_to_end(buffer) do
+    {x, y} = buffer.cursor_position
+    erase(buffer, x, y, buffer.width * buffer.height)
+  end
+
+  @impl Raxol.Terminal.ScreenBufferBehaviour
+  def erase_from_start_to_cursor(buffer) do
+    {x, y} = buffer.cursor_position
+    erase(buffer, 0, 0, y * buffer.width + x + 1)
+  end
+
+  @impl Raxol.Terminal.ScreenBufferBehaviour
+  def erase_all(buffer), do: erase(buffer, 0, 0, buffer.width * buffer.height)
+
+  @impl Raxol.Terminal.ScreenBufferBehaviour
+  def erase_all_with_scrollback(buffer), do: erase_all(buffer)
+
+  @impl Raxol.Terminal.ScreenBufferBehaviour
+  def erase_from_cursor_to_end_of_line(buffer) do
+    {x, y} = buffer.cursor_position
+    erase(buffer, x, y, buffer.width - x)
+  end
+
+  @impl Raxol.Terminal.ScreenBufferBehaviour
+  def erase_from_start_of_line_to_cursor(buffer) do
+    {x, y} = buffer.cursor_position
+    erase(buffer, 0, y, x + 1)
+  end
+
+  @impl Raxol.Terminal.ScreenBufferBehaviour
+  def erase_line(buffer) do
+    {_x, y} = buffer.cursor_position
+    clear_line(buffer, y)
+  end
+
+  # === Charset and formatting state (as in ScreenBuffer) ===
+
+  @impl Raxol.Terminal.ScreenBufferBehaviour
+  defdelegate designate_charset(buffer, slot, charset), to: Attributes
+  @impl Raxol.Terminal.ScreenBufferBehaviour
+  defdelegate get_designated_charset(buffer, slot), to: Attributes
+  @impl Raxol.Terminal.ScreenBufferBehaviour
+  defdelegate invoke_g_set(buffer, slot), to: Attributes
+  @impl Raxol.Terminal.ScreenBufferBehaviour
+  defdelegate get_current_g_set(buffer), to: Attributes
+  @impl Raxol.Terminal.ScreenBufferBehaviour
+  defdelegate apply_single_shift(buffer, slot), to: Attributes
+  @impl Raxol.Terminal.ScreenBufferBehaviour
+  defdelegate get_single_shift(buffer), to: Attributes
+  @impl Raxol.Terminal.ScreenBufferBehaviour
+  defdelegate get_style(buffer), to: Attributes
+  @impl Raxol.Terminal.ScreenBufferBehaviour
+  defdelegate update_style(buffer, style), to: Attributes
+  @impl Raxol.Terminal.ScreenBufferBehaviour
+  defdelegate set_attribute(buffer, attribute), to: Attributes
+  @impl Raxol.Terminal.ScreenBufferBehaviour
+  defdelegate reset_attribute(buffer, attribute), to: Attributes
+  @impl Raxol.Terminal.ScreenBufferBehaviour
+  defdelegate set_foreground(buffer, color), to: Attributes
+  @impl Raxol.Terminal.ScreenBufferBehaviour
+  defdelegate set_background(buffer, color), to: Attributes
+  @impl Raxol.Terminal.ScreenBufferBehaviour
+  defdelegate reset_all_attributes(buffer), to: Attributes
+  @impl Raxol.Terminal.ScreenBufferBehaviour
+  defdelegate get_foreground(buffer), to: Attributes
+  @impl Raxol.Terminal.ScreenBufferBehaviour
+  defdelegate get_background(buffer), to: Attributes
+  @impl Raxol.Terminal.ScreenBufferBehaviour
+  defdelegate attribute_set?(buffer, attribute), to: Attributes
+  @impl Raxol.Terminal.ScreenBufferBehaviour
+  defdelegate get_set_attributes(buffer), to: Attributes
+
+  # === Behaviour callbacks with no grid involvement (as in ScreenBuffer) ===
+
+  @impl Raxol.Terminal.ScreenBufferBehaviour
+  defdelegate cleanup_file_watching(buffer), to: BehaviourImpl
+  @impl Raxol.Terminal.ScreenBufferBehaviour
+  defdelegate clear_output_buffer(buffer), to: BehaviourImpl
+  @impl Raxol.Terminal.ScreenBufferBehaviour
+  defdelegate clear_saved_states(buffer), to: BehaviourImpl
+  @impl Raxol.Terminal.ScreenBufferBehaviour
+  defdelegate collect_metrics(buffer, type), to: BehaviourImpl
+  @impl Raxol.Terminal.ScreenBufferBehaviour
+  defdelegate create_chart(buffer, type, options), to: BehaviourImpl
+  @impl Raxol.Terminal.ScreenBufferBehaviour
+  defdelegate current_theme(), to: BehaviourImpl
+  @impl Raxol.Terminal.ScreenBufferBehaviour
+  defdelegate enqueue_control_sequence(buffer, sequence), to: BehaviourImpl
+  @impl Raxol.Terminal.ScreenBufferBehaviour
+  defdelegate flush_output(buffer), to: BehaviourImpl
+  @impl Raxol.Terminal.ScreenBufferBehaviour
+  defdelegate get_config(), to: BehaviourImpl
+  @impl Raxol.Terminal.ScreenBufferBehaviour
+  defdelegate get_current_state(buffer), to: BehaviourImpl
+  @impl Raxol.Terminal.ScreenBufferBehaviour
+  defdelegate get_metric(buffer, type, name), to: BehaviourImpl
+  @impl Raxol.Terminal.ScreenBufferBehaviour
+  defdelegate get_metric_value(buffer, name), to: BehaviourImpl
+  @impl Raxol.Terminal.ScreenBufferBehaviour
+  defdelegate get_metrics_by_type(buffer, type), to: BehaviourImpl
+  @impl Raxol.Terminal.ScreenBufferBehaviour
+  defdelegate get_output_buffer(buffer), to: BehaviourImpl
+  @impl Raxol.Terminal.ScreenBufferBehaviour
+  defdelegate get_preferences(), to: BehaviourImpl
+  @impl Raxol.Terminal.ScreenBufferBehaviour
+  defdelegate get_saved_states_count(buffer), to: BehaviourImpl
+  @impl Raxol.Terminal.ScreenBufferBehaviour
+  defdelegate get_state_stack(buffer), to: BehaviourImpl
+  @impl Raxol.Terminal.ScreenBufferBehaviour
+  defdelegate get_update_settings(), to: BehaviourImpl
+  @impl Raxol.Terminal.ScreenBufferBehaviour
+  defdelegate handle_csi_sequence(buffer, command, params), to: BehaviourImpl
+  @impl Raxol.Terminal.ScreenBufferBehaviour
+  defdelegate handle_debounced_events(buffer, events, delay), to: BehaviourImpl
+  @impl Raxol.Terminal.ScreenBufferBehaviour
+  defdelegate handle_file_event(buffer, event), to: BehaviourImpl
+  @impl Raxol.Terminal.ScreenBufferBehaviour
+  defdelegate handle_mode(buffer, mode, value), to: BehaviourImpl
+  @impl Raxol.Terminal.ScreenBufferBehaviour
+  defdelegate has_saved_states?(buffer), to: BehaviourImpl
+  @impl Raxol.Terminal.ScreenBufferBehaviour
+  defdelegate light_theme(), to: BehaviourImpl
+  @impl Raxol.Terminal.ScreenBufferBehaviour
+  defdelegate mark_damaged(buffer, x, y, width, height), to: BehaviourImpl
+  @impl Raxol.Terminal.ScreenBufferBehaviour
+  defdelegate record_metric(buffer, type, name, value), to: BehaviourImpl
+  @impl Raxol.Terminal.ScreenBufferBehaviour
+  defdelegate record_operation(buffer, operation, duration), to: BehaviourImpl
+  @impl Raxol.Terminal.ScreenBufferBehaviour
+  defdelegate record_performance(buffer, metric, value), to: BehaviourImpl
+  @impl Raxol.Terminal.ScreenBufferBehaviour
+  defdelegate record_resource(buffer, type, value), to: BehaviourImpl
+  @impl Raxol.Terminal.ScreenBufferBehaviour
+  defdelegate reset_state(buffer), to: BehaviourImpl
+  @impl Raxol.Terminal.ScreenBufferBehaviour
+  defdelegate restore_state(buffer), to: BehaviourImpl
+  @impl Raxol.Terminal.ScreenBufferBehaviour
+  defdelegate save_state(buffer), to: BehaviourImpl
+  @impl Raxol.Terminal.ScreenBufferBehaviour
+  defdelegate set_config(config), to: BehaviourImpl
+  @impl Raxol.Terminal.ScreenBufferBehaviour
+  defdelegate set_preferences(preferences), to: BehaviourImpl
+  @impl Raxol.Terminal.ScreenBufferBehaviour
+  defdelegate update_current_state(buffer, updates), to: BehaviourImpl
+  @impl Raxol.Terminal.ScreenBufferBehaviour
+  defdelegate update_state_stack(buffer, stack), to: BehaviourImpl
+  @impl Raxol.Terminal.ScreenBufferBehaviour
+  defdelegate verify_metrics(buffer, type), to: BehaviourImpl
+  @impl Raxol.Terminal.ScreenBufferBehaviour
+  defdelegate write(buffer, data), to: BehaviourImpl
+
+  # === Private helpers ===
+
+  defp erase(buffer, x, y, count) when count > 0,
+    do: buffer.grid |> :termbox2_nif.tb_grid_erase(x, y, count, @blank, 0) |> check!(buffer)
+
+  defp erase(buffer, _x, _y, _count), do: buffer
+
+  defp edit_lines(buffer, count) do
+    {_x, y} = buffer.cursor_position
+    {top, bottom} = get_scroll_region_boundaries(buffer)
+    if y >= top and y <= bottom, do: grid_scroll(buffer, y, bottom, count), else: buffer
+  end
+
+  defp grid_scroll(buffer, top, bottom, count) do
+    buffer.grid
+    |> :termbox2_nif.tb_grid_scroll(top, bottom, count, @blank, 0)
+    |> check!(buffer)
+  end
+
+  # Edits outside the grid change nothing, as in ScreenBuffer
+  defp check!(0, buffer), do: buffer
+  defp check!(@out_of_bounds, buffer), do: buffer
+  defp check!(code, _buffer), do: raise(ArgumentError, "native grid edit failed: error #{code}")
+
+  defp intern(_buffer, nil), do: @blank
+
+  defp intern(buffer, style) do
+    case :termbox2_nif.tb_grid_intern(buffer.grid, style) do
+      id when id >= 0 -> id
+      code -> raise ArgumentError, "cannot intern style in native grid: error #{code}"
+    end
+  end
+
+  defp decode_row(cells, clusters, styles) do
+    {row, _x} =
+      for <<ch::native-32, fg::native-64, _bg::native-64 <- cells>>, reduce: {[], 0} do
+        {row, x} -> {[decode_cell(ch, Map.get(clusters, x), Map.get(styles, fg)) | row], x + 1}
+      end
+
+    Enum.reverse(row)
+  end
+
+  defp decode_cell(0, _cluster, style), do: Cell.new_wide_placeholder(style)
+  defp decode_cell(ch, nil, style), do: Cell.new(<<ch::utf8>>, style)
+  defp decode_cell(_ch, cluster, style), do: Cell.new(cluster, style)
+end
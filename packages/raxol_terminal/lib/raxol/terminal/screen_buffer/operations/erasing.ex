@@ -6,8 +6,10 @@ defmodule Raxol.Terminal.ScreenBuffer.Operations.Erasing do
   erase in display and erase in line with different modes.
   """
 
+  alias Raxol.Terminal.Buffer.Scrollback
   alias Raxol.Terminal.Cell
   alias Raxol.Terminal.ScreenBuffer
+  alias Raxol.Terminal.Scrollback.Ring
 
   @doc """
   Erases in display based on mode.
@@ -152,6 +154,9 @@ defmodule Raxol.Terminal.ScreenBuffer.Operations.Erasing do
     %{buffer | cells: empty_cells}
   end
 
+  defp clear_display_with_scrollback(%{scrollback: %Ring{}} = buffer),
+    do: buffer |> clear_display() |> Scrollback.clear()
+
   defp clear_display_with_scrollback(buffer) do
     buffer
     |> clear_display()
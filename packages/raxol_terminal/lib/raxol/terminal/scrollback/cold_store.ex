@@ -0,0 +1,423 @@
+defmodule Raxol.Terminal.Scrollback.ColdStore do
+  @moduledoc """
+  Compressed storage for scrollback lines that have left the hot window of
+  `Raxol.Terminal.Scrollback.Manager`. Only a manager created with
+  `cold_storage: true` has one; the emulator's scrollback,
+  `Raxol.Terminal.Buffer.Scrollback`, keeps cell lines with their styles and
+  doesn't use it, as blocks hold text only.
+
+  Lines collect in an open block until it holds `block_lines` of them, then
+  the block is sealed: its lines are packed into one binary and compressed
+  with `:zlib`. Since every sealed block holds the same number of lines, the
+  block and offset of any line follow from its index alone.
+
+  Sealed blocks are decompressed only when a read or search touches them, and
+  the most recently used few are kept decompressed in a small LRU. The LRU
+  lives in an ETS table owned by the process that created the store, so
+  reads that don't return the store still keep it warm. Each sealed block
+  gets a unique key for the LRU, so copies of the store that have sealed
+  different blocks under the same id never read each other's. Call `close/1`
+  to delete the table once the store is no longer needed; a closed store, or
+  one read from another process, still works, just without the LRU.
+  Compressed blocks are dropped oldest first once they, with their filters,
+  take up more than `max_bytes`, which bounds the memory a store holds
+  however long the session runs.
+
+  With `trigrams: true`, each block also keeps a trigram filter (see
+  `Raxol.Terminal.Scrollback.Matcher`), so searches skip the blocks that
+  cannot match without decompressing them. Filters are sized to their
+  block's distinct trigrams and count towards `max_bytes`.
+
+  Indexes count back from the newest line, which is 0.
+  """
+
+  alias Raxol.Terminal.Scrollback.Matcher
+
+  @default_block_lines 1024
+  @default_max_bytes 32 * 1024 * 1024
+  @default_cache_blocks 4
+
+  defstruct [
+    :cache,
+    block_lines: @default_block_lines,
+    max_bytes: @default_max_bytes,
+    cache_blocks: @default_cache_blocks,
+    trigrams: false,
+    open: [],
+    open_count: 0,
+    blocks: %{},
+    filters: %{},
+    first_block: 0,
+    next_block: 0,
+    bytes: 0
+  ]
+
+  @type t :: %__MODULE__{
+          cache: :ets.tid(),
+          block_lines: pos_integer(),
+          max_bytes: pos_integer(),
+          cache_blocks: pos_integer(),
+          trigrams: boolean(),
+          open: [binary()],
+          open_count: non_neg_integer(),
+          blocks: %{non_neg_integer() => {integer(), binary()}},
+          filters: %{non_neg_integer() => bitstring()},
+          first_block: non_neg_integer(),
+          next_block: non_neg_integer(),
+          bytes: non_neg_integer()
+        }
+
+  @doc """
+  Creates an empty store.
+
+  ## Options
+
+    * `:block_lines` - lines per sealed block (default: #{@default_block_lines})
+    * `:max_bytes` - bytes of compressed blocks and filters kept
+      (default: #{@default_max_bytes})
+    * `:cache_blocks` - decompressed blocks kept in the LRU
+      (default: #{@default_cache_blocks})
+    * `:trigrams` - keep a trigram filter per block (default: false)
+  """
+  @spec new(keyword()) :: t()
+  def new(opts \\ []) do
+    %__MODULE__{
+      cache: new_cache(),
+      block_lines: Keyword.get(opts, :block_lines, @default_block_lines),
+      max_bytes: Keyword.get(opts, :max_bytes, @default_max_bytes),
+      cache_blocks: Keyword.get(opts, :cache_blocks, @default_cache_blocks),
+      trigrams: Keyword.get(opts, :trigrams, false)
+    }
+  end
+
+  @doc """
+  Adds `lines`, oldest first, sealing blocks as they fill.
+  """
+  @spec push(t(), [binary()]) :: t()
+  def push(%__MODULE__{} = store, lines), do: Enum.reduce(lines, store, &push_line/2)
+
+  @doc """
+  Returns the number of lines held, sealed or not.
+  """
+  @spec size(t()) :: non_neg_integer()
+  def size(%__MODULE__{} = store),
+    do: store.open_count + (store.next_block - store.first_block) * store.block_lines
+
+  @doc """
+  Returns the bytes held by sealed blocks and their filters.
+  """
+  @spec bytes(t()) :: non_neg_integer()
+  def bytes(%__MODULE__{bytes: bytes}), do: bytes
+
+  @doc """
+  Returns line `index`, or nil if there are not that many lines.
+  """
+  @spec get(t(), non_neg_integer()) :: binary() | nil
+  def get(store, index) do
+    case range(store, index, 1) do
+      [line] -> line
+      [] -> nil
+    end
+  end
+
+  @doc """
+  Returns up to `count` lines from `index` back towards the oldest, newest
+  first, decompressing only the blocks they fall in.
+  """
+  @spec range(t(), non_neg_integer(), non_neg_integer()) :: [binary()]
+  def range(%__MODULE__{} = store, index, count) when index >= 0 and count > 0 do
+    open = Enum.slice(store.open, index, count)
+    sealed_index = max(index - store.open_count, 0)
+    open ++ sealed_range(store, sealed_index, count - length(open), [])
+  end
+
+  def range(_store, _index, _count), do: []
+
+  @doc """
+  Returns the indexes of the lines containing `pattern`, newest first.
+  """
+  @spec search(t(), binary()) :: [non_neg_integer()]
+  def search(%__MODULE__{} = store, pattern) when byte_size(pattern) > 0 do
+    store
+    |> search(Matcher.compile(pattern), 0, size(store))
+    |> Enum.map(&elem(&1, 0))
+    |> Enum.dedup()
+  end
+
+  def search(_store, _pattern), do: []
+
+  @doc """
+  Searches up to `count` lines from `index` back towards the oldest, returning
+  `{index, column, text}` per match, newest line first. Each sealed block in
+  range is searched as a whole, decompressed through the LRU, unless its
+  trigram filter rules it out.
+  """
+  @spec search(t(), Matcher.t(), non_neg_integer(), non_neg_integer()) :: [Matcher.line_match()]
+  def search(%__MODULE__{} = store, %Matcher{} = matcher, index, count)
+      when index >= 0 and count > 0 do
+    last = index + count - 1
+
+    open =
+      for {line, i} <- store.open |> Enum.slice(index, count) |> Enum.with_index(index),
+          {column, text} <- Matcher.line_matches(matcher, line),
+          do: {i, column, text}
+
+    first_sealed = max(index - store.open_count, 0)
+    open ++ sealed_search(store, matcher, first_sealed, last - store.open_count)
+  end
+
+  def search(_store, _matcher, _index, _count), do: []
+
+  @doc """
+  Drops every line. The LRU's table is deleted and a new one started, so
+  copies of the store from before the clear read without it.
+  """
+  @spec clear(t()) :: t()
+  def clear(%__MODULE__{} = store) do
+    close(store)
+
+    %{
+      store
+      | cache: new_cache(),
+        open: [],
+        open_count: 0,
+        blocks: %{},
+        filters: %{},
+        first_block: store.next_block,
+        bytes: 0
+    }
+  end
+
+  @doc """
+  Deletes the LRU's table. The store and its copies can still be read, each
+  read decompressing the blocks it touches.
+  """
+  @spec close(t()) :: :ok
+  def close(%__MODULE__{cache: cache}) do
+    :ets.delete(cache)
+    :ok
+  rescue
+    ArgumentError -> :ok
+  end
+
+  # === Private helpers ===
+
+  defp new_cache, do: :ets.new(__MODULE__, [:set, :public])
+
+  defp push_line(line, %{open_count: count, block_lines: block_lines} = store)
+       when count + 1 >= block_lines,
+       do: seal(%{store | open: [line | store.open], open_count: count + 1})
+
+  defp push_line(line, store),
+    do: %{store | open: [line | store.open], open_count: store.open_count + 1}
+
+  # Packs the open lines, oldest first, as their end offsets followed by their
+  # text, so a decompressed block can be searched in one piece
+  defp seal(store) do
+    lines = Enum.reverse(store.open)
+
+    {ends, _} =
+      Enum.map_reduce(lines, 0, fn line, offset ->
+        offset = offset + byte_size(line)
+        {<<offset::32>>, offset}
+      end)
+
+    block = :zlib.compress([<<store.open_count::32>>, ends | lines])
+    filter = new_filter(store, lines)
+    key = System.unique_integer()
+
+    %{
+      store
+      | open: [],
+        open_count: 0,
+        blocks: Map.put(store.blocks, store.next_block, {key, block}),
+        filters: add_filter(store.filters, store.next_block, filter),
+        next_block: store.next_block + 1,
+        bytes: store.bytes + byte_size(block) + filter_bytes(filter)
+    }
+    |> drop_oldest_blocks()
+  end
+
+  defp drop_oldest_blocks(%{bytes: bytes, max_bytes: max, first_block: first} = store)
+       when bytes > max and first < store.next_block do
+    {{key, block}, blocks} = Map.pop(store.blocks, first)
+    {filter, filters} = Map.pop(store.filters, first)
+    uncache(store, key)
+
+    drop_oldest_blocks(%{
+      store
+      | blocks: blocks,
+        filters: filters,
+        first_block: first + 1,
+        bytes: bytes - byte_size(block) - filter_bytes(filter)
+    })
+  end
+
+  defp drop_oldest_blocks(store), do: store
+
+  defp new_filter(%{trigrams: false}, _lines), do: nil
+  defp new_filter(_store, lines), do: Matcher.filter(IO.iodata_to_binary(lines))
+
+  defp add_filter(filters, _id, nil), do: filters
+  defp add_filter(filters, id, filter), do: Map.put(filters, id, filter)
+
+  defp filter_bytes(nil), do: 0
+  defp filter_bytes(filter), do: byte_size(filter)
+
+  # k counts back from the newest sealed line
+  defp sealed_range(_store, _k, count, acc) when count <= 0,
+    do: acc |> Enum.reverse() |> List.flatten()
+
+  defp sealed_range(store, k, count, acc) do
+    id = store.next_block - 1 - div(k, store.block_lines)
+
+    if id < store.first_block do
+      sealed_range(store, k, 0, acc)
+    else
+      {text, ends} = block(store, id)
+      # Position within the block counting back from its newest line
+      from = rem(k, store.block_lines)
+      to = min(store.block_lines - 1, from + count - 1)
+
+      # Copied, so a line kept by the caller doesn't pin the whole block
+      lines =
+        for back <- from..to do
+          text |> line(ends, store.block_lines - 1 - back) |> :binary.copy()
+        end
+
+      taken = to - from + 1
+      sealed_range(store, k + taken, count - taken, [lines | acc])
+    end
+  end
+
+  defp line(text, ends, i) do
+    start = if i == 0, do: 0, else: elem(ends, i - 1)
+    binary_part(text, start, elem(ends, i) - start)
+  end
+
+  # Searches the sealed lines first..last, counting back from the newest
+  # sealed line, block by block from the newest
+  defp sealed_search(store, matcher, first, last) when first <= last do
+    newest = store.next_block - 1 - div(first, store.block_lines)
+    oldest = max(store.next_block - 1 - div(last, store.block_lines), store.first_block)
+
+    if newest < oldest do
+      []
+    else
+      Enum.flat_map(newest..oldest//-1, fn id ->
+        # k of the block's newest line
+        base = (store.next_block - 1 - id) * store.block_lines
+
+        store
+        |> block_matches(id, matcher)
+        |> Enum.flat_map(fn {back, column, text} ->
+          k = base + back
+          if k >= first and k <= last, do: [{k + store.open_count, column, text}], else: []
+        end)
+      end)
+    end
+  end
+
+  defp sealed_search(_store, _matcher, _first, _last), do: []
+
+  # Returns {back, column, text} per match in the block, where back counts
+  # from the block's newest line, newest first
+  defp block_matches(store, id, matcher) do
+    if filtered_out?(store, id, matcher) do
+      []
+    else
+      {text, ends} = block(store, id)
+      last = tuple_size(ends) - 1
+      located = Enum.map(Matcher.offsets(matcher, text), &locate(&1, ends, last))
+
+      # A match running into the next line can hide one that starts in it,
+      # so such blocks are searched line by line instead
+      if Enum.any?(located, &(&1 == :spans)) do
+        for back <- 0..last,
+            {column, found} <- Matcher.line_matches(matcher, line(text, ends, last - back)),
+            do: {back, column, found}
+      else
+        located
+        |> Enum.reverse()
+        |> Enum.chunk_by(&elem(&1, 0))
+        |> Enum.flat_map(&Enum.reverse/1)
+        |> Enum.map(fn {i, offset, length} ->
+          start = if i == 0, do: 0, else: elem(ends, i - 1)
+          found = :binary.copy(binary_part(text, offset, length))
+          {last - i, Matcher.column(text, start, offset - start), found}
+        end)
+      end
+    end
+  end
+
+  defp filtered_out?(store, id, matcher) do
+    case store.filters do
+      %{^id => filter} -> not Matcher.may_match?(matcher, filter)
+      _ -> false
+    end
+  end
+
+  defp locate({offset, length}, ends, last) do
+    i = line_containing(ends, offset, 0, last)
+    if offset + length <= elem(ends, i), do: {i, offset, length}, else: :spans
+  end
+
+  # Binary search for the first line ending after offset
+  defp line_containing(_ends, _offset, low, high) when low >= high, do: low
+
+  defp line_containing(ends, offset, low, high) do
+    mid = div(low + high, 2)
+
+    if elem(ends, mid) > offset,
+      do: line_containing(ends, offset, low, mid),
+      else: line_containing(ends, offset, mid + 1, high)
+  end
+
+  # A decompressed block as {text, end offsets}, through the LRU
+  defp block(store, id) do
+    {key, block} = Map.fetch!(store.blocks, id)
+    cached_block(store, key, block)
+  end
+
+  defp cached_block(store, key, block) do
+    case :ets.lookup(store.cache, key) do
+      [{^key, _used, decoded}] ->
+        :ets.update_element(store.cache, key, {2, System.unique_integer([:monotonic])})
+        decoded
+
+      [] ->
+        decoded = decompress(block)
+        cache_block(store, key, decoded)
+        decoded
+    end
+  rescue
+    # The table is gone once the store is closed or its creator exits
+    ArgumentError -> decompress(block)
+  end
+
+  defp decompress(block) do
+    <<count::32, rest::binary>> = :zlib.uncompress(block)
+    <<ends::binary-size(count * 4), text::binary>> = rest
+    {text, List.to_tuple(for <<offset::32 <- ends>>, do: offset)}
+  end
+
+  defp cache_block(store, key, decoded) do
+    :ets.insert(store.cache, {key, System.unique_integer([:monotonic]), decoded})
+
+    if :ets.info(store.cache, :size) > store.cache_blocks do
+      # Only the keys and last uses, not the blocks, are copied out
+      {oldest, _used} =
+        store.cache
+        |> :ets.select([{{:"$1", :"$2", :_}, [], [{{:"$1", :"$2"}}]}])
+        |> Enum.min_by(fn {_key, used} -> used end)
+
+      :ets.delete(store.cache, oldest)
+    end
+  end
+
+  defp uncache(store, key) do
+    :ets.delete(store.cache, key)
+  rescue
+    ArgumentError -> true
+  end
+end
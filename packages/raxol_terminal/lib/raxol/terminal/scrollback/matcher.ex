@@ -0,0 +1,152 @@
+defmodule Raxol.Terminal.Scrollback.Matcher do
+  @moduledoc """
+  Literal pattern matching shared by the scrollback tiers and
+  `Raxol.Terminal.Scrollback.Search`.
+
+  A matcher is compiled once per search. Case-sensitive matchers use
+  `:binary.matches/2`; case-insensitive ones fold ASCII letters only, the
+  same as the native ring's `:termbox2_nif.sb_search/5`, so every tier
+  agrees on what matches. Matches within a line don't overlap.
+
+  A match is `{column, text}`, where column counts the UTF-8 characters
+  before it in its line and text is what matched.
+
+  Trigram filters let a tier skip a block of text without reading it: the
+  filter has a bit set for every (case-folded) three-byte sequence in the
+  block, so a block whose filter lacks any of the pattern's trigrams cannot
+  contain it. Patterns shorter than three bytes can't be filtered. A filter
+  is sized to its block's distinct trigrams, a power of two bits, so a
+  trigram's bit is the low bits of its hash whatever the size.
+  """
+
+  import Bitwise
+
+  # Filter bits per distinct trigram, which keeps a trigram the block lacks
+  # to about a 1 in 16 chance of hitting a set bit, and the smallest filter
+  @bits_per_trigram 16
+  @min_filter_bits 64
+  # :erlang.phash2/1 hashes are below this, so larger filters gain nothing
+  @hash_range 1 <<< 27
+
+  defstruct [:pattern, :fold, :compiled, trigrams: []]
+
+  @type t :: %__MODULE__{
+          pattern: binary(),
+          fold: boolean(),
+          compiled: term(),
+          trigrams: [non_neg_integer()]
+        }
+
+  @type match :: {non_neg_integer(), binary()}
+
+  @typedoc "A match with the index of its line: `{index, column, text}`"
+  @type line_match :: {non_neg_integer(), non_neg_integer(), binary()}
+
+  @doc """
+  Compiles a non-empty `pattern`, folding ASCII case if `fold` is true.
+  """
+  @spec compile(binary(), boolean()) :: t()
+  def compile(pattern, fold \\ false) when is_binary(pattern) and byte_size(pattern) > 0 do
+    compiled =
+      if fold do
+        {:ok, re} = :re.compile(Regex.escape(pattern), [:caseless])
+        {:re, re}
+      else
+        {:binary, :binary.compile_pattern(pattern)}
+      end
+
+    %__MODULE__{
+      pattern: pattern,
+      fold: fold,
+      compiled: compiled,
+      trigrams: pattern |> trigram_hashes(%{}) |> Map.keys()
+    }
+  end
+
+  @doc """
+  Returns the `{offset, length}` of every match in `text`, in bytes.
+  """
+  @spec offsets(t(), binary()) :: [{non_neg_integer(), non_neg_integer()}]
+  def offsets(%__MODULE__{compiled: {:binary, pattern}}, text),
+    do: :binary.matches(text, pattern)
+
+  def offsets(%__MODULE__{compiled: {:re, re}}, text) do
+    case :re.run(text, re, [:global, {:capture, :first, :index}]) do
+      {:match, matches} -> Enum.map(matches, &hd/1)
+      :nomatch -> []
+    end
+  end
+
+  @doc """
+  Returns the matches in one line, left to right.
+  """
+  @spec line_matches(t(), binary()) :: [match()]
+  def line_matches(%__MODULE__{} = matcher, line) do
+    matcher
+    |> offsets(line)
+    |> Enum.map(fn {offset, length} ->
+      {column(line, 0, offset), :binary.copy(binary_part(line, offset, length))}
+    end)
+  end
+
+  @doc """
+  Counts the UTF-8 characters in the `length` bytes of `text` from `start`.
+  """
+  @spec column(binary(), non_neg_integer(), non_neg_integer()) :: non_neg_integer()
+  def column(text, start, length) do
+    # Continuation bytes are 0b10xxxxxx; every other byte starts a character
+    for <<byte <- binary_part(text, start, length)>>,
+        (byte &&& 0xC0) != 0x80,
+        reduce: 0,
+        do: (n -> n + 1)
+  end
+
+  @doc """
+  Builds the trigram filter of `text`.
+  """
+  @spec filter(binary()) :: bitstring()
+  def filter(text) do
+    hashes = trigram_hashes(text, %{})
+    mask = filter_bits(map_size(hashes) * @bits_per_trigram, @min_filter_bits) - 1
+
+    # Appends the gap before each set bit, so the cost follows the trigrams
+    # rather than the filter's size
+    {filter, next} =
+      hashes
+      |> Enum.map(fn {hash, true} -> hash &&& mask end)
+      |> Enum.sort()
+      |> Enum.dedup()
+      |> Enum.reduce({<<>>, 0}, fn bit, {filter, next} ->
+        {<<filter::bitstring, 0::size(bit - next), 1::1>>, bit + 1}
+      end)
+
+    <<filter::bitstring, 0::size(mask + 1 - next)>>
+  end
+
+  @doc """
+  Returns false if text with `filter` cannot contain the matcher's pattern.
+  """
+  @spec may_match?(t(), bitstring()) :: boolean()
+  def may_match?(%__MODULE__{trigrams: trigrams}, filter) do
+    mask = bit_size(filter) - 1
+
+    Enum.all?(trigrams, fn hash ->
+      bit = hash &&& mask
+      match?(<<_::size(bit), 1::1, _::bitstring>>, filter)
+    end)
+  end
+
+  defp filter_bits(wanted, bits) when bits >= wanted or bits >= @hash_range, do: bits
+  defp filter_bits(wanted, bits), do: filter_bits(wanted, bits * 2)
+
+  defp trigram_hashes(<<a, b, c, _::binary>> = text, acc) do
+    <<_, rest::binary>> = text
+    hash = :erlang.phash2(<<fold(a), fold(b), fold(c)>>)
+    trigram_hashes(rest, Map.put(acc, hash, true))
+  end
+
+  defp trigram_hashes(_text, acc), do: acc
+
+  defp fold(byte) when byte in ?A..?Z, do: byte + (?a - ?A)
+  defp fold(byte), do: byte
+end
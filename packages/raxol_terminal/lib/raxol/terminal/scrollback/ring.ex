@@ -0,0 +1,309 @@
+defmodule Raxol.Terminal.Scrollback.Ring do
+  @moduledoc """
+  Native ring buffer for scrollback (see `:termbox2_nif.sb_new/2`).
+
+  Each line is stored in C as its UTF-8 text plus run-length style spans
+  rather than as a list of `Cell` structs, and the ring is bounded by bytes as
+  well as by lines. Appending a line and reading one by index are O(1), so
+  reading a page of a long scrollback costs the same however much is kept.
+
+  A line is either a binary or a list of cells. Cell lines keep their chars,
+  styles and wide-character placeholders; other cell fields come back as
+  `Cell.new/2` sets them. Each cell is expected to hold one grapheme, as the
+  screen buffer writes them. Runs of cells in one style share a span, with
+  the placeholders after their wide characters left implicit.
+
+  Styles are interned as in `Raxol.Terminal.ScreenBuffer.NativeGrid`: the ring
+  stores an id per span, and the table mapping ids back to styles lives in C
+  with the lines, so every copy of the struct reads the same thing.
+
+  Indexes count back from the newest line, which is 0.
+  """
+
+  alias Raxol.Terminal.{Cell, CharacterHandling, Native}
+
+  @default_scrollback Raxol.Core.Defaults.scrollback_limit()
+
+  # Set in a span's style id for a run whose wide characters are each
+  # followed by a placeholder, or with no text, for a lone placeholder
+  @placeholder 0x80000000
+
+  defstruct [:ring, max_lines: @default_scrollback, max_bytes: 0]
+
+  @type line :: binary() | [Cell.t()]
+
+  @typedoc """
+  A line as the ring hands it back: UTF-8 text, its spans, each
+  `<<style_id::native-32, bytes::native-32>>`, and `{style_id, style}` for the
+  ids in the spans. Text lines have no spans.
+  """
+  @type record :: {binary(), binary(), [{non_neg_integer(), term()}]}
+
+  @type t :: %__MODULE__{
+          ring: reference(),
+          max_lines: non_neg_integer(),
+          max_bytes: non_neg_integer()
+        }
+
+  @doc """
+  Creates an empty ring, or returns `{:error, reason}` if the NIF is not
+  available.
+
+  ## Options
+
+    * `:max_lines` - lines kept (default: the scrollback limit)
+    * `:max_bytes` - bytes of text and spans kept, 0 for no limit (default: 0)
+  """
+  @spec open(keyword()) :: {:ok, t()} | {:error, term()}
+  def open(opts \\ []) do
+    max_lines = Keyword.get(opts, :max_lines, @default_scrollback)
+    max_bytes = Keyword.get(opts, :max_bytes, 0)
+
+    case Native.call(fn -> :termbox2_nif.sb_new(max_lines, max_bytes) end) do
+      {:ok, ring} -> {:ok, %__MODULE__{ring: ring, max_lines: max_lines, max_bytes: max_bytes}}
+      {:error, code} when is_integer(code) -> {:error, {:scrollback_failed, code}}
+      {:error, reason} -> {:error, reason}
+    end
+  end
+
+  @doc """
+  Appends `lines`, oldest first, dropping the oldest lines over the limits.
+  Raises if the ring runs out of memory; the lines before the one that failed
+  are kept.
+  """
+  @spec push(t(), [line()]) :: t()
+  def push(%__MODULE__{} = ring, lines) do
+    sb_push(ring, lines, false)
+    ring
+  end
+
+  @doc """
+  Appends `lines` like `push/2`, returning the lines it drops, oldest first,
+  as records for `decode/2`.
+  """
+  @spec push_evicting(t(), [line()]) :: {t(), [record()]}
+  def push_evicting(%__MODULE__{} = ring, lines), do: {ring, sb_push(ring, lines, true)}
+
+  @doc """
+  Returns line `index`, or nil if there are not that many lines.
+  """
+  @spec get(t(), non_neg_integer()) :: line() | nil
+  def get(%__MODULE__{} = ring, index) when is_integer(index) and index >= 0 do
+    case ring.ring |> :termbox2_nif.sb_get(index) |> check!() do
+      nil -> nil
+      record -> decode(ring, record)
+    end
+  end
+
+  def get(_ring, _index), do: nil
+
+  @doc """
+  Returns up to `count` lines from `index` back towards the oldest, newest
+  first.
+  """
+  @spec range(t(), non_neg_integer(), non_neg_integer()) :: [line()]
+  def range(%__MODULE__{} = ring, index, count)
+      when is_integer(index) and index >= 0 and is_integer(count) and count > 0 do
+    ring.ring |> :termbox2_nif.sb_range(index, count) |> check!() |> Enum.map(&decode(ring, &1))
+  end
+
+  def range(_ring, _index, _count), do: []
+
+  @doc """
+  Searches the text of up to `count` lines from `index` back towards the
+  oldest, in C, returning `{index, column, text}` per match, newest line
+  first. Pass `fold: true` to match ASCII letters in either case.
+  """
+  @spec search(t(), binary(), non_neg_integer(), non_neg_integer(), boolean()) :: [
+          Raxol.Terminal.Scrollback.Matcher.line_match()
+        ]
+  def search(ring, pattern, index, count, fold \\ false)
+
+  def search(%__MODULE__{} = ring, pattern, index, count, fold)
+      when byte_size(pattern) > 0 and is_integer(index) and index >= 0 and
+             is_integer(count) and count > 0,
+      do: :termbox2_nif.sb_search(ring.ring, pattern, index, count, fold)
+
+  def search(_ring, _pattern, _index, _count, _fold), do: []
+
+  @doc """
+  Returns every line, newest first.
+  """
+  @spec to_list(t()) :: [line()]
+  def to_list(%__MODULE__{} = ring), do: range(ring, 0, size(ring))
+
+  @doc """
+  Returns the number of lines held.
+  """
+  @spec size(t()) :: non_neg_integer()
+  def size(%__MODULE__{} = ring) do
+    {lines, _bytes} = :termbox2_nif.sb_info(ring.ring)
+    lines
+  end
+
+  @doc """
+  Returns the bytes the held lines take up, which is what `:max_bytes` limits.
+  """
+  @spec bytes(t()) :: non_neg_integer()
+  def bytes(%__MODULE__{} = ring) do
+    {_lines, bytes} = :termbox2_nif.sb_info(ring.ring)
+    bytes
+  end
+
+  @doc """
+  Drops every line.
+  """
+  @spec clear(t()) :: t()
+  def clear(%__MODULE__{} = ring) do
+    :termbox2_nif.sb_clear(ring.ring)
+    ring
+  end
+
+  @doc """
+  Changes the limits, dropping the oldest lines over them.
+  """
+  @spec set_limits(t(), non_neg_integer(), non_neg_integer()) :: t()
+  def set_limits(%__MODULE__{} = ring, max_lines, max_bytes) do
+    :termbox2_nif.sb_set_limits(ring.ring, max_lines, max_bytes, false)
+    %{ring | max_lines: max_lines, max_bytes: max_bytes}
+  end
+
+  @doc """
+  Changes the limits like `set_limits/3`, returning the lines it drops, oldest
+  first, as records for `decode/2`.
+  """
+  @spec set_limits_evicting(t(), non_neg_integer(), non_neg_integer()) :: {t(), [record()]}
+  def set_limits_evicting(%__MODULE__{} = ring, max_lines, max_bytes) do
+    evicted = ring.ring |> :termbox2_nif.sb_set_limits(max_lines, max_bytes, true) |> check!()
+    {%{ring | max_lines: max_lines, max_bytes: max_bytes}, evicted}
+  end
+
+  @doc """
+  Decodes a record from this ring back into its line.
+  """
+  @spec decode(t(), record()) :: line()
+  def decode(_ring, {text, <<>>, _styles}), do: text
+
+  def decode(_ring, {text, spans, styles}), do: decode_spans(text, spans, Map.new(styles), [])
+
+  # === Private helpers ===
+
+  # Spans are pushed with indexes into a list of the styles in this push,
+  # which the NIF swaps for ids in the ring's table
+  defp sb_push(ring, lines, keep_evicted) do
+    {records, {_ids, styles}} = Enum.map_reduce(lines, {%{}, []}, &encode/2)
+
+    ring.ring
+    |> :termbox2_nif.sb_push(records, Enum.reverse(styles), keep_evicted)
+    |> check!()
+  end
+
+  # A push that runs out of memory part way also hands back what it evicted
+  defp check!({:error, code, _evicted}), do: check!({:error, code})
+
+  defp check!({:error, code}),
+    do: raise(RuntimeError, "scrollback ring out of memory (error #{code})")
+
+  defp check!(result), do: result
+
+  defp encode(text, acc) when is_binary(text), do: {{text, <<>>}, acc}
+
+  # An empty line still gets a span, so it decodes as a cell list. Its style
+  # is never read.
+  defp encode([], acc) do
+    {acc, id} = intern(acc, nil)
+    {{<<>>, <<id::native-32, 0::native-32>>}, acc}
+  end
+
+  defp encode(cells, acc) when is_list(cells) do
+    {acc, runs} = add_cells(cells, acc, [])
+
+    {text, spans} =
+      runs
+      |> Enum.reverse()
+      |> Enum.map_reduce([], fn {id, kind, chars}, spans ->
+        text = chars |> Enum.reverse() |> IO.iodata_to_binary()
+        id = if kind in [:paired, :lone], do: Bitwise.bor(id, @placeholder), else: id
+        {text, [spans, <<id::native-32, byte_size(text)::native-32>>]}
+      end)
+
+    {{IO.iodata_to_binary(text), IO.iodata_to_binary(spans)}, acc}
+  end
+
+  # Runs are {id, kind, chars}: :narrow runs hold only single-width chars,
+  # :paired runs wide chars whose placeholders are left implicit,
+  # :unpaired runs wide chars that had no placeholder of their style after
+  # them, and :lone runs a placeholder with no wide char before it.
+  defp add_cells([], acc, runs), do: {acc, runs}
+
+  defp add_cells([%{wide_placeholder: true} = cell | cells], acc, runs) do
+    {acc, id} = intern(acc, Map.get(cell, :style))
+    add_cells(cells, acc, [{id, :lone, []} | runs])
+  end
+
+  defp add_cells([cell | cells], acc, runs) do
+    style = Map.get(cell, :style)
+    {acc, id} = intern(acc, style)
+    char = Map.get(cell, :char) || " "
+    {kind, cells} = classify(char, style, cells)
+    add_cells(cells, acc, add_char(runs, id, kind, char))
+  end
+
+  defp classify(char, style, [%{wide_placeholder: true} = next | rest] = cells) do
+    if CharacterHandling.get_char_width(char) == 2 and Map.get(next, :style) == style,
+      do: {:paired, rest},
+      else: {width_kind(char), cells}
+  end
+
+  defp classify(char, _style, cells), do: {width_kind(char), cells}
+
+  defp width_kind(char),
+    do: if(CharacterHandling.get_char_width(char) == 2, do: :unpaired, else: :narrow)
+
+  # A run can't mix wide chars with and without placeholders, as the decoder
+  # goes by the run's kind
+  defp add_char([{id, run_kind, chars} | runs], id, kind, char)
+       when run_kind != :lone and (kind == :narrow or run_kind in [:narrow, kind]) do
+    kind = if kind == :narrow, do: run_kind, else: kind
+    [{id, kind, [char | chars]} | runs]
+  end
+
+  defp add_char(runs, id, kind, char), do: [{id, kind, [char]} | runs]
+
+  defp intern({ids, styles} = acc, style) do
+    case ids do
+      %{^style => id} -> {acc, id}
+      _ -> {{Map.put(ids, style, map_size(ids)), [style | styles]}, map_size(ids)}
+    end
+  end
+
+  defp decode_spans(_text, <<>>, _styles, acc), do: acc |> Enum.reverse() |> List.flatten()
+
+  defp decode_spans(text, <<id::native-32, 0::native-32, spans::binary>>, styles, acc)
+       when id >= @placeholder do
+    cell = Cell.new_wide_placeholder(Map.get(styles, id - @placeholder))
+    decode_spans(text, spans, styles, [cell | acc])
+  end
+
+  defp decode_spans(text, <<id::native-32, n::native-32, spans::binary>>, styles, acc)
+       when id >= @placeholder do
+    <<run::binary-size(n), rest::binary>> = text
+    style = Map.get(styles, id - @placeholder)
+
+    cells =
+      for char <- String.graphemes(run) do
+        if CharacterHandling.get_char_width(char) == 2,
+          do: [Cell.new(char, style), Cell.new_wide_placeholder(style)],
+          else: Cell.new(char, style)
+      end
+
+    decode_spans(rest, spans, styles, [cells | acc])
+  end
+
+  defp decode_spans(text, <<id::native-32, n::native-32, spans::binary>>, styles, acc) do
+    <<run::binary-size(n), rest::binary>> = text
+    style = Map.get(styles, id)
+    cells = run |> String.graphemes() |> Enum.map(&Cell.new(&1, style))
+    decode_spans(rest, spans, styles, [cells | acc])
+  end
+end
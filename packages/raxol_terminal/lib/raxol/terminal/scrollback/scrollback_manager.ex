@@ -1,35 +1,83 @@
 defmodule Raxol.Terminal.Scrollback.Manager do
   @moduledoc """
   Manages terminal scrollback buffer operations.
+
+  Lines are kept newest first, in a list or, with `native: true`, in a
+  `Raxol.Terminal.Scrollback.Ring`, which holds them outside the process heap
+  and can also be bounded in bytes. Positions and ranges count back from the
+  newest line either way.
+
+  With `cold_storage: true`, lines pushed out of that hot window are not
+  dropped but sealed into zlib-compressed blocks in a
+  `Raxol.Terminal.Scrollback.ColdStore`. Sizes, positions, ranges and searches
+  then cover both tiers, the cold one decompressing blocks only as they are
+  read. Cold storage is opt-in, and the emulator's own scrollback doesn't go
+  through this module.
   """
 
+  alias Raxol.Terminal.Scrollback.{ColdStore, Matcher, Ring}
+
   @default_scrollback Raxol.Core.Defaults.scrollback_limit()
 
+  # new/1 options passed on to ColdStore.new/1
+  @cold_options [
+    cold_block_lines: :block_lines,
+    cold_max_bytes: :max_bytes,
+    cold_cache_blocks: :cache_blocks,
+    cold_trigrams: :trigrams
+  ]
+
   defstruct scrollback_buffer: [],
             scrollback_limit: @default_scrollback,
-            current_position: 0
+            current_position: 0,
+            cold: nil
 
   @type scrollback_line :: String.t()
-  @type scrollback_buffer :: [scrollback_line()]
+  @type scrollback_buffer :: [scrollback_line()] | Ring.t()
 
   @type t :: %__MODULE__{
           scrollback_buffer: scrollback_buffer(),
           scrollback_limit: pos_integer(),
-          current_position: non_neg_integer()
+          current_position: non_neg_integer(),
+          cold: ColdStore.t() | nil
         }
 
   @doc """
   Creates a new scrollback manager instance.
+
+  ## Options
+
+    * `:scrollback_limit` - lines kept
+    * `:native` - keep lines in a native ring when the NIF is available
+      (default: false)
+    * `:scrollback_bytes` - with `native: true`, also bound the lines kept by
+      the bytes they take up (default: no limit)
+    * `:cold_storage` - compress lines leaving the hot window instead of
+      dropping them (default: false)
+    * `:cold_block_lines`, `:cold_max_bytes`, `:cold_cache_blocks`,
+      `:cold_trigrams` - the cold store's `:block_lines`, `:max_bytes`,
+      `:cache_blocks` and `:trigrams`
   """
   def new(opts \\ []) do
-    %__MODULE__{
-      scrollback_limit: Keyword.get(opts, :scrollback_limit, @default_scrollback)
-    }
+    limit = Keyword.get(opts, :scrollback_limit, @default_scrollback)
+    state = %__MODULE__{scrollback_limit: limit, cold: new_cold(opts)}
+
+    with true <- Keyword.get(opts, :native, false),
+         {:ok, ring} <-
+           Ring.open(max_lines: limit, max_bytes: Keyword.get(opts, :scrollback_bytes, 0)) do
+      %{state | scrollback_buffer: ring}
+    else
+      _ -> state
+    end
   end
 
   @doc """
-  Gets the current scrollback buffer.
+  Gets the current scrollback buffer, newest line first. Only the hot window
+  is returned; read cold lines with `get_scrollback_range/3`.
   """
+  def get_scrollback_buffer(%__MODULE__{scrollback_buffer: %Ring{} = ring}),
+    do: Ring.to_list(ring)
+
   def get_scrollback_buffer(%__MODULE__{} = state) do
     state.scrollback_buffer
   end
@@ -37,28 +85,51 @@ defmodule Raxol.Terminal.Scrollback.Manager do
   @doc """
   Adds a line to the scrollback buffer.
   """
+  def add_to_scrollback(%__MODULE__{scrollback_buffer: %Ring{} = ring, cold: nil} = state, line)
+      when is_binary(line),
+      do: %{state | scrollback_buffer: Ring.push(ring, [line])}
+
+  def add_to_scrollback(%__MODULE__{scrollback_buffer: %Ring{} = ring} = state, line)
+      when is_binary(line) do
+    {ring, evicted} = Ring.push_evicting(ring, [line])
+    freeze(%{state | scrollback_buffer: ring}, ring, evicted)
+  end
+
   def add_to_scrollback(%__MODULE__{} = state, line) when is_binary(line) do
     new_buffer = [line | state.scrollback_buffer]
 
-    trimmed_buffer =
-      case length(new_buffer) > state.scrollback_limit do
-        true ->
-          Enum.take(new_buffer, state.scrollback_limit)
-
-        false ->
-          new_buffer
-      end
+    case length(new_buffer) > state.scrollback_limit do
+      true ->
+        {kept, dropped} = Enum.split(new_buffer, state.scrollback_limit)
+        freeze(%{state | scrollback_buffer: kept}, dropped)
 
-    %{state | scrollback_buffer: trimmed_buffer}
+      false ->
+        %{state | scrollback_buffer: new_buffer}
+    end
   end
 
   @doc """
   Clears the scrollback buffer.
   """
   def clear_scrollback(%__MODULE__{} = state) do
-    %{state | scrollback_buffer: [], current_position: 0}
+    buffer =
+      case state.scrollback_buffer do
+        %Ring{} = ring -> Ring.clear(ring)
+        _ -> []
+      end
+
+    cold = state.cold && ColdStore.clear(state.cold)
+    %{state | scrollback_buffer: buffer, current_position: 0, cold: cold}
   end
 
+  @doc """
+  Releases the cold store's cache, if there is one. Call it when the manager
+  is discarded; a closed manager can still be read.
+  """
+  @spec close(t()) :: :ok
+  def close(%__MODULE__{cold: nil}), do: :ok
+  def close(%__MODULE__{cold: cold}), do: ColdStore.close(cold)
+
   @doc """
   Gets the scrollback limit.
   """
@@ -69,16 +140,20 @@ defmodule Raxol.Terminal.Scrollback.Manager do
   @doc """
   Sets the scrollback limit.
   """
+  def set_scrollback_limit(%__MODULE__{scrollback_buffer: %Ring{} = ring} = state, limit)
+      when is_integer(limit) and limit > 0 do
+    {ring, evicted} = Ring.set_limits_evicting(ring, limit, ring.max_bytes)
+    freeze(%{state | scrollback_limit: limit, scrollback_buffer: ring}, ring, evicted)
+  end
+
   def set_scrollback_limit(%__MODULE__{} = state, limit)
       when is_integer(limit) and limit > 0 do
     new_state = %{state | scrollback_limit: limit}
 
     case length(new_state.scrollback_buffer) > limit do
       true ->
-        %{
-          new_state
-          | scrollback_buffer: Enum.take(new_state.scrollback_buffer, limit)
-        }
+        {kept, dropped} = Enum.split(new_state.scrollback_buffer, limit)
+        freeze(%{new_state | scrollback_buffer: kept}, dropped)
 
       false ->
         new_state
@@ -86,29 +161,74 @@ defmodule Raxol.Terminal.Scrollback.Manager do
   end
 
   @doc """
-  Gets a range of lines from the scrollback buffer.
+  Gets a range of lines from the scrollback buffer, reading on into cold
+  storage past the hot window.
   """
   def get_scrollback_range(%__MODULE__{} = state, start_line, end_line)
       when is_integer(start_line) and is_integer(end_line) and
              start_line >= 0 and end_line >= start_line do
-    case Enum.slice(state.scrollback_buffer, start_line..end_line) do
+    hot = slice(state.scrollback_buffer, start_line, end_line)
+    count = end_line - start_line + 1
+    cold_start = max(start_line - hot_size(state), 0)
+
+    case hot ++ cold_range(state.cold, cold_start, count - length(hot)) do
       [] -> {:error, :invalid_range}
       lines -> {:ok, lines}
     end
   end
 
   @doc """
-  Gets the current size of the scrollback buffer.
+  Gets the current size of the scrollback buffer, cold lines included.
   """
-  def get_scrollback_size(%__MODULE__{} = state) do
-    length(state.scrollback_buffer)
+  def get_scrollback_size(%__MODULE__{cold: nil} = state), do: hot_size(state)
+  def get_scrollback_size(%__MODULE__{} = state), do: hot_size(state) + ColdStore.size(state.cold)
+
+  @doc """
+  Returns the positions of the lines containing `pattern`, newest first,
+  across the hot window and cold storage.
+  """
+  def search_scrollback(%__MODULE__{} = state, pattern)
+      when is_binary(pattern) and byte_size(pattern) > 0 do
+    state
+    |> search_page(Matcher.compile(pattern), 0, get_scrollback_size(state))
+    |> Enum.map(&elem(&1, 0))
+    |> Enum.dedup()
+  end
+
+  @doc """
+  Searches up to `count` lines from position `index` back towards the oldest,
+  returning `{position, column, text}` per match, newest line first. A native
+  hot window is searched in C; cold storage is searched block by block.
+  """
+  @spec search_page(t(), Matcher.t(), non_neg_integer(), non_neg_integer()) :: [
+          Matcher.line_match()
+        ]
+  def search_page(%__MODULE__{} = state, %Matcher{} = matcher, index, count)
+      when is_integer(index) and index >= 0 and is_integer(count) and count > 0 do
+    hot_size = hot_size(state)
+    hot_count = min(count, max(hot_size - index, 0))
+    hot = hot_search(state.scrollback_buffer, matcher, index, hot_count)
+
+    case {state.cold, count - hot_count} do
+      {nil, _} ->
+        hot
+
+      {_cold, 0} ->
+        hot
+
+      {cold, cold_count} ->
+        cold_matches = ColdStore.search(cold, matcher, max(index - hot_size, 0), cold_count)
+        hot ++ Enum.map(cold_matches, fn {i, column, text} -> {i + hot_size, column, text} end)
+    end
   end
 
+  def search_page(%__MODULE__{}, _matcher, _index, _count), do: []
+
   @doc """
   Checks if the scrollback buffer is empty.
   """
   def scrollback_empty?(%__MODULE__{} = state) do
-    state.scrollback_buffer == []
+    get_scrollback_size(state) == 0
   end
 
   @doc """
@@ -123,7 +243,7 @@ defmodule Raxol.Terminal.Scrollback.Manager do
   """
   def set_current_position(%__MODULE__{} = state, position)
       when is_integer(position) and position >= 0 do
-    max_position = length(state.scrollback_buffer) - 1
+    max_position = get_scrollback_size(state) - 1
     new_position = min(position, max_position)
     %{state | current_position: new_position}
   end
@@ -134,7 +254,7 @@ defmodule Raxol.Terminal.Scrollback.Manager do
   def scroll_up(%__MODULE__{} = state, lines \\ 1)
       when is_integer(lines) and lines > 0 do
     new_position =
-      min(state.current_position + lines, length(state.scrollback_buffer) - 1)
+      min(state.current_position + lines, get_scrollback_size(state) - 1)
 
     %{state | current_position: new_position}
   end
@@ -152,9 +272,54 @@ defmodule Raxol.Terminal.Scrollback.Manager do
   Gets the current line from the scrollback buffer.
   """
   def get_current_line(%__MODULE__{} = state) do
-    case Enum.at(state.scrollback_buffer, state.current_position) do
-      nil -> {:error, :invalid_position}
-      line -> {:ok, line}
+    case get_scrollback_range(state, state.current_position, state.current_position) do
+      {:ok, [line]} -> {:ok, line}
+      _ -> {:error, :invalid_position}
     end
   end
+
+  defp new_cold(opts) do
+    if Keyword.get(opts, :cold_storage, false) do
+      cold_opts =
+        for {key, cold_key} <- @cold_options, Keyword.has_key?(opts, key),
+          do: {cold_key, Keyword.fetch!(opts, key)}
+
+      ColdStore.new(cold_opts)
+    end
+  end
+
+  defp hot_size(%__MODULE__{scrollback_buffer: %Ring{} = ring}), do: Ring.size(ring)
+  defp hot_size(%__MODULE__{scrollback_buffer: lines}), do: length(lines)
+
+  defp slice(%Ring{} = ring, first, last), do: Ring.range(ring, first, last - first + 1)
+  defp slice(lines, first, last), do: Enum.slice(lines, first..last)
+
+  defp hot_search(_buffer, _matcher, _index, 0), do: []
+
+  defp hot_search(%Ring{} = ring, matcher, index, count),
+    do: Ring.search(ring, matcher.pattern, index, count, matcher.fold)
+
+  defp hot_search(lines, matcher, index, count) do
+    for {line, i} <- lines |> Enum.slice(index, count) |> Enum.with_index(index),
+        {column, text} <- Matcher.line_matches(matcher, line),
+        do: {i, column, text}
+  end
+
+  defp cold_range(nil, _index, _count), do: []
+  defp cold_range(cold, index, count), do: ColdStore.range(cold, index, count)
+
+  # Moves lines leaving the hot window into cold storage, if there is one.
+  # dropped is newest first, as the list keeps it.
+  defp freeze(%{cold: nil} = state, _dropped), do: state
+
+  defp freeze(state, dropped),
+    do: %{state | cold: ColdStore.push(state.cold, Enum.reverse(dropped))}
+
+  # Evicted ring records come oldest first
+  defp freeze(%{cold: nil} = state, _ring, _evicted), do: state
+
+  defp freeze(state, ring, evicted) do
+    lines = Enum.map(evicted, &Ring.decode(ring, &1))
+    %{state | cold: ColdStore.push(state.cold, lines)}
+  end
 end
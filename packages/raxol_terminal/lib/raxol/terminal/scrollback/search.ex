@@ -0,0 +1,240 @@
+defmodule Raxol.Terminal.Scrollback.Search do
+  @moduledoc """
+  Incremental search over the screen and a scrollback: a screen buffer's,
+  through `Raxol.Terminal.Buffer.Scrollback`, or a
+  `Raxol.Terminal.Scrollback.Manager`'s.
+
+  Nothing is scanned up front. The screen is searched whole with `screen/2`,
+  since it is small, and the scrollback a page of lines at a time with
+  `next_page/2`, newest first, so the first matches show up at once however
+  long the history is. Each tier does the scanning itself: a native ring in
+  C, cold storage a compressed block at a time, skipping blocks its trigram
+  filters rule out.
+
+  The functions taking a `t:source/0` read the scrollback through it each
+  call, so pass the buffer or manager as it is now.
+
+  As lines scroll into the scrollback, `lines_added/3` scans just those lines
+  and moves the matches already found back by as many positions, so the
+  live tail never causes a rescan. The shift is kept as one offset rather
+  than applied to every match. Likewise `scroll_screen/5` scans only the rows
+  that came in at the bottom of the screen and moves the matches above them.
+
+  Matches are `SearchBuffer` matches: `line` counts back from the newest
+  scrollback line, which is 0, and the rows of a screen of height `h` are
+  lines `-h` (top) to `-1` (bottom). `start` and `length` are in characters.
+  """
+
+  alias Raxol.Terminal.Buffer.Scrollback
+  alias Raxol.Terminal.ScreenBuffer
+  alias Raxol.Terminal.Scrollback.{Manager, Matcher}
+
+  @default_page_lines 4096
+
+  defstruct [
+    :matcher,
+    page_lines: @default_page_lines,
+    next: 0,
+    shift: 0,
+    count: 0,
+    screen: [],
+    chunks: :queue.new()
+  ]
+
+  @typedoc "Where the scrollback is searched: a screen buffer or a manager"
+  @type source :: ScreenBuffer.t() | Manager.t()
+
+  @type match :: %{
+          line: integer(),
+          start: non_neg_integer(),
+          length: non_neg_integer(),
+          text: String.t()
+        }
+
+  @type t :: %__MODULE__{
+          matcher: Matcher.t(),
+          page_lines: pos_integer(),
+          next: non_neg_integer(),
+          shift: non_neg_integer(),
+          count: non_neg_integer(),
+          screen: [match()],
+          chunks: :queue.queue([{integer(), non_neg_integer(), binary()}])
+        }
+
+  @doc """
+  Starts a search for a non-empty `pattern`. Nothing is scanned yet.
+
+  ## Options
+
+    * `:case_sensitive` - match ASCII letters exactly (default: false)
+    * `:page_lines` - scrollback lines scanned per `next_page/2`
+      (default: #{@default_page_lines})
+  """
+  @spec new(String.t(), keyword()) :: t()
+  def new(pattern, opts \\ []) when is_binary(pattern) and byte_size(pattern) > 0 do
+    fold = not Keyword.get(opts, :case_sensitive, false)
+
+    %__MODULE__{
+      matcher: Matcher.compile(pattern, fold),
+      page_lines: Keyword.get(opts, :page_lines, @default_page_lines)
+    }
+  end
+
+  @doc """
+  Searches the screen, given as its rows' text from the top, replacing any
+  earlier screen matches.
+  """
+  @spec screen(t(), [String.t()]) :: t()
+  def screen(%__MODULE__{} = search, rows),
+    do: put_screen(search, scan_rows(search, rows, -length(rows)))
+
+  @doc """
+  Follows the screen, of `height` rows, scrolling its rows `top..bottom` up by
+  `count`. Matches in the rows that left are dropped and the rest of the
+  region's move up, so only `rows`, the text of the `count` rows that came in
+  at the bottom of the region, are searched.
+  """
+  @spec scroll_screen(
+          t(),
+          {non_neg_integer(), non_neg_integer()},
+          non_neg_integer(),
+          [String.t()],
+          pos_integer()
+        ) :: t()
+  def scroll_screen(%__MODULE__{} = search, _region, 0, _rows, _height), do: search
+
+  def scroll_screen(%__MODULE__{} = search, {top, bottom}, count, rows, height) do
+    # Screen matches run from the bottom row up
+    {below, rest} = Enum.split_while(search.screen, &(&1.line > bottom - height))
+    {region, above} = Enum.split_while(rest, &(&1.line >= top - height))
+
+    moved =
+      for %{line: line} = match <- region,
+          line - count >= top - height,
+          do: %{match | line: line - count}
+
+    added = scan_rows(search, rows, bottom - count + 1 - height)
+    put_screen(search, below ++ added ++ moved ++ above)
+  end
+
+  @doc """
+  Scans the next page of older scrollback lines, returning the search and the
+  matches the page added, newest first.
+  """
+  @spec next_page(t(), source()) :: {t(), [match()]}
+  def next_page(%__MODULE__{} = search, source) do
+    case done?(search, source) do
+      true ->
+        {search, []}
+
+      false ->
+        found = search_page(source, search.matcher, search.next, search.page_lines)
+        search = %{add_chunk(search, found, &:queue.in/2) | next: search.next + search.page_lines}
+        {search, Enum.map(found, &to_match/1)}
+    end
+  end
+
+  @doc """
+  Accounts for `count` lines just added to the scrollback: scans
+  them, moves the earlier matches back and drops those whose lines have left
+  the scrollback. Returns the search and the matches in the new lines, newest
+  first.
+  """
+  @spec lines_added(t(), source(), non_neg_integer()) :: {t(), [match()]}
+  def lines_added(%__MODULE__{} = search, _source, 0), do: {search, []}
+
+  def lines_added(%__MODULE__{} = search, source, count)
+      when is_integer(count) and count > 0 do
+    found = search_page(source, search.matcher, 0, count)
+    search = %{search | shift: search.shift + count, next: search.next + count}
+
+    search =
+      search
+      |> add_chunk(found, &:queue.in_r/2)
+      |> prune(scrollback_size(source))
+
+    {search, Enum.map(found, &to_match/1)}
+  end
+
+  @doc """
+  Returns true once the whole scrollback has been scanned.
+  """
+  @spec done?(t(), source()) :: boolean()
+  def done?(%__MODULE__{next: next}, source), do: next >= scrollback_size(source)
+
+  @doc """
+  Returns every match found so far, newest first: the screen from the
+  bottom, then the scrollback.
+  """
+  @spec matches(t()) :: [match()]
+  def matches(%__MODULE__{} = search) do
+    scrollback =
+      search.chunks
+      |> :queue.to_list()
+      |> Enum.flat_map(fn chunk -> Enum.map(chunk, &to_match(&1, search.shift)) end)
+
+    search.screen ++ scrollback
+  end
+
+  @doc """
+  Returns the number of matches found so far.
+  """
+  @spec count(t()) :: non_neg_integer()
+  def count(%__MODULE__{count: count}), do: count
+
+  # === Private helpers ===
+
+  defp search_page(%Manager{} = manager, matcher, index, count),
+    do: Manager.search_page(manager, matcher, index, count)
+
+  defp search_page(buffer, matcher, index, count),
+    do: Scrollback.search_page(buffer, matcher, index, count)
+
+  defp scrollback_size(%Manager{} = manager), do: Manager.get_scrollback_size(manager)
+  defp scrollback_size(buffer), do: Scrollback.size(buffer)
+
+  # Matches in rows whose first is line first, bottom row first
+  defp scan_rows(search, rows, first) do
+    for {row, line} <- rows |> Enum.with_index(first) |> Enum.reverse(),
+        {column, text} <- Matcher.line_matches(search.matcher, row),
+        do: to_match({line, column, text})
+  end
+
+  defp put_screen(search, screen),
+    do: %{search | count: search.count - length(search.screen) + length(screen), screen: screen}
+
+  # Chunks keep positions as they were when found, less the shift then, so
+  # later shifts need not touch them
+  defp add_chunk(search, [], _insert), do: search
+
+  defp add_chunk(search, found, insert) do
+    chunk = Enum.map(found, fn {line, column, text} -> {line - search.shift, column, text} end)
+    %{search | chunks: insert.(chunk, search.chunks), count: search.count + length(chunk)}
+  end
+
+  # Drops matches at or past size, which sit in the oldest chunks
+  defp prune(search, size) do
+    limit = size - search.shift
+
+    case :queue.peek_r(search.chunks) do
+      {:value, chunk} ->
+        case Enum.split_while(chunk, fn {line, _, _} -> line < limit end) do
+          {_kept, []} ->
+            search
+
+          {kept, dropped} ->
+            chunks = :queue.drop_r(search.chunks)
+            chunks = if kept == [], do: chunks, else: :queue.in(kept, chunks)
+            prune(%{search | chunks: chunks, count: search.count - length(dropped)}, size)
+        end
+
+      :empty ->
+        search
+    end
+  end
+
+  defp to_match({line, column, text}, shift \\ 0) do
+    length = Matcher.column(text, 0, byte_size(text))
+    %{line: line + shift, start: column, length: length, text: text}
+  end
+end
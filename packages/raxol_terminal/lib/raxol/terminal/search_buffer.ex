@@ -1,8 +1,18 @@
 defmodule Raxol.Terminal.SearchBuffer do
   @moduledoc """
   Manages search state, options, matches, and history for terminal search operations.
+
+  Searches started with `start_search/4` run over the screen and a scrollback
+  (a screen buffer's or a `Raxol.Terminal.Scrollback.Manager`'s) through
+  `Raxol.Terminal.Scrollback.Search`: they load the screen and the newest
+  page of scrollback matches at once, older pages with `load_more/2`, and
+  keep up with new scrollback lines and a scrolling screen through
+  `lines_added/3` and `screen_scrolled/5` rather than searching again.
+  `matches` holds the matches loaded so far, newest first.
   """
 
+  alias Raxol.Terminal.Scrollback.Search
+
   @type match :: %{
           line: integer(),
           start: integer(),
@@ -16,14 +26,16 @@ defmodule Raxol.Terminal.SearchBuffer do
           options: options(),
           matches: [match()],
           current_index: integer(),
-          history: [String.t()]
+          history: [String.t()],
+          search: Search.t() | nil
         }
 
   defstruct pattern: nil,
             options: %{case_sensitive: false, regex: false},
             matches: [],
             current_index: -1,
-            history: []
+            history: [],
+            search: nil
 
   @doc """
   Starts a new search with the given pattern.
@@ -38,10 +50,12 @@ defmodule Raxol.Terminal.SearchBuffer do
   end
 
   defp handle_search_pattern(false, buffer, pattern) do
-    # For now, just clear matches; real impl would search buffer content
+    # Without a screen and scrollback there is nothing to search; see
+    # start_search/4
     new_buffer = %{
       buffer
       | pattern: pattern,
+        search: nil,
         matches: [],
         current_index: -1,
         history: add_pattern_to_history(buffer.history, pattern)
@@ -50,6 +64,106 @@ defmodule Raxol.Terminal.SearchBuffer do
     {:ok, new_buffer}
   end
 
+  @doc """
+  Starts a new search with the given pattern over the screen, given as its
+  rows' text from the top, and the scrollback of `source`. The screen and
+  the first page of scrollback are searched now; see `load_more/2`.
+  """
+  @spec start_search(t(), String.t(), Search.source(), [String.t()]) ::
+          {:ok, t()} | {:error, term()}
+  def start_search(_buffer, "", _source, _rows), do: {:error, :empty_pattern}
+
+  def start_search(buffer, pattern, source, rows) when is_binary(pattern) do
+    opts = [case_sensitive: buffer.options.case_sensitive]
+    search = pattern |> Search.new(opts) |> Search.screen(rows)
+    {search, _page} = Search.next_page(search, source)
+
+    new_buffer = %{
+      buffer
+      | pattern: pattern,
+        search: search,
+        matches: Search.matches(search),
+        current_index: -1,
+        history: add_pattern_to_history(buffer.history, pattern)
+    }
+
+    {:ok, new_buffer}
+  end
+
+  @doc """
+  Loads the next page of older scrollback matches. Returns `{:ok, buffer}`,
+  or `{:error, :done}` once the whole scrollback has been searched.
+  """
+  @spec load_more(t(), Search.source()) :: {:ok, t()} | {:error, term()}
+  def load_more(%__MODULE__{search: nil}, _source), do: {:error, :no_search}
+
+  def load_more(%__MODULE__{search: search} = buffer, source) do
+    case Search.done?(search, source) do
+      true ->
+        {:error, :done}
+
+      false ->
+        {search, _page} = Search.next_page(search, source)
+        {:ok, %{buffer | search: search, matches: Search.matches(search)}}
+    end
+  end
+
+  @doc """
+  Takes in `count` lines just added to the scrollback of `source`, searching
+  only those, and searches the screen rows as they now are. The current
+  scrollback match stays current.
+  """
+  @spec lines_added(t(), Search.source(), non_neg_integer(), [String.t()]) :: t()
+  def lines_added(%__MODULE__{search: nil} = buffer, _source, _count, _rows), do: buffer
+
+  def lines_added(%__MODULE__{} = buffer, source, count, rows) do
+    buffer = lines_added(buffer, source, count)
+    put_screen(buffer, Search.screen(buffer.search, rows))
+  end
+
+  @doc """
+  Takes in `count` lines just added to the scrollback of `source`, searching
+  only those. Their matches go in ahead of the older scrollback matches,
+  which move back by `count` lines. The current match stays current.
+  """
+  @spec lines_added(t(), Search.source(), non_neg_integer()) :: t()
+  def lines_added(%__MODULE__{search: nil} = buffer, _source, _count), do: buffer
+
+  def lines_added(%__MODULE__{search: search} = buffer, source, count) do
+    screen_count = length(search.screen)
+    {search, added} = Search.lines_added(search, source, count)
+    {screen, older} = Enum.split(buffer.matches, screen_count)
+
+    # Search.lines_added/3 has dropped the oldest matches whose lines left
+    # the scrollback
+    older =
+      older
+      |> Enum.take(Search.count(search) - screen_count - length(added))
+      |> Enum.map(&%{&1 | line: &1.line + count})
+
+    idx = buffer.current_index
+    idx = if idx >= screen_count, do: idx + length(added), else: idx
+    put_matches(buffer, search, screen ++ added ++ older, idx)
+  end
+
+  @doc """
+  Follows the screen, of `height` rows, scrolling its rows `top..bottom` up by
+  `count`, searching only `rows`, the text of the rows that came in at the
+  bottom of the region. See `Search.scroll_screen/5`.
+  """
+  @spec screen_scrolled(
+          t(),
+          {non_neg_integer(), non_neg_integer()},
+          non_neg_integer(),
+          [String.t()],
+          pos_integer()
+        ) :: t()
+  def screen_scrolled(%__MODULE__{search: nil} = buffer, _region, _count, _rows, _height),
+    do: buffer
+
+  def screen_scrolled(%__MODULE__{search: search} = buffer, region, count, rows, height),
+    do: put_screen(buffer, Search.scroll_screen(search, region, count, rows, height))
+
   @doc """
   Finds the next match in the search.
   """
@@ -128,7 +242,7 @@ defmodule Raxol.Terminal.SearchBuffer do
   """
   @spec clear(t()) :: t()
   def clear(buffer) do
-    %{buffer | pattern: nil, matches: [], current_index: -1}
+    %{buffer | pattern: nil, matches: [], current_index: -1, search: nil}
   end
 
   @doc """
@@ -151,7 +265,23 @@ defmodule Raxol.Terminal.SearchBuffer do
   @spec clear_history(t()) :: t()
   def clear_history(buffer), do: %{buffer | history: []}
 
-  # Helper
+  # Helpers
+
+  # Swaps in the screen matches of search, leaving the scrollback's
+  defp put_screen(buffer, search) do
+    old_count = length(buffer.search.screen)
+    matches = search.screen ++ Enum.drop(buffer.matches, old_count)
+    idx = buffer.current_index
+    idx = if idx >= old_count, do: idx + length(search.screen) - old_count, else: idx
+    put_matches(buffer, search, matches, idx)
+  end
+
+  # Search.count/1 is the length of matches, without walking it
+  defp put_matches(buffer, search, matches, idx) do
+    idx = min(idx, Search.count(search) - 1)
+    %{buffer | search: search, matches: matches, current_index: idx}
+  end
+
   defp add_pattern_to_history(history, pattern) do
     [pattern | Enum.reject(history, &(&1 == pattern))]
     # Limit history size
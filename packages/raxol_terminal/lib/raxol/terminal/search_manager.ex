@@ -4,7 +4,7 @@ defmodule Raxol.Terminal.SearchManager do
   This module is responsible for handling all search-related operations in the terminal.
   """
 
-  alias Raxol.Terminal.SearchBuffer
+  alias Raxol.Terminal.{Emulator, ScreenBuffer, SearchBuffer}
   require Raxol.Core.Runtime.Log
 
   @doc """
@@ -25,10 +25,15 @@ defmodule Raxol.Terminal.SearchManager do
 
   @doc """
   Starts a new search with the given pattern.
+  Searches the active screen and the newest page of its scrollback now,
+  leaving older pages to `load_more_matches/1`.
   Returns {:ok, updated_emulator} or {:error, reason}.
   """
   def start_search(emulator, pattern) do
-    case SearchBuffer.start_search(emulator.search_buffer, pattern) do
+    screen = Emulator.get_screen_buffer(emulator)
+    rows = screen_rows(screen)
+
+    case SearchBuffer.start_search(emulator.search_buffer, pattern, screen, rows) do
       {:ok, new_buffer} ->
         {:ok, update_buffer(emulator, new_buffer)}
 
@@ -37,6 +42,51 @@ defmodule Raxol.Terminal.SearchManager do
     end
   end
 
+  @doc """
+  Loads the next page of older scrollback matches.
+  Returns {:ok, updated_emulator} or {:error, reason}.
+  """
+  def load_more_matches(emulator) do
+    screen = Emulator.get_screen_buffer(emulator)
+
+    case SearchBuffer.load_more(emulator.search_buffer, screen) do
+      {:ok, new_buffer} -> {:ok, update_buffer(emulator, new_buffer)}
+      {:error, reason} -> {:error, "Failed to load more matches: #{inspect(reason)}"}
+    end
+  end
+
+  @doc """
+  Updates the current search for `count` lines just added to the active
+  screen's scrollback and for the screen having scrolled `scrolled` rows up
+  within its scroll region. Only those lines and the rows that came in at the
+  bottom of the region are searched. Does nothing without a search.
+  Returns the updated emulator.
+  """
+  def lines_added(emulator, count, scrolled \\ 0)
+
+  def lines_added(%{search_buffer: %SearchBuffer{search: search}} = emulator, count, scrolled)
+      when search != nil do
+    screen = Emulator.get_screen_buffer(emulator)
+    {top, bottom} = ScreenBuffer.get_scroll_region_boundaries(screen)
+    # The scroll itself stops at the screen's last row
+    bottom = min(bottom, screen.height - 1)
+
+    rows =
+      screen
+      |> ScreenBuffer.get_lines()
+      |> Enum.slice(bottom - scrolled + 1, scrolled)
+      |> Enum.map(&row_text/1)
+
+    buffer =
+      emulator.search_buffer
+      |> SearchBuffer.screen_scrolled({top, bottom}, scrolled, rows, screen.height)
+      |> SearchBuffer.lines_added(screen, count)
+
+    update_buffer(emulator, buffer)
+  end
+
+  def lines_added(emulator, _count, _scrolled), do: emulator
+
   @doc """
   Finds the next match in the search.
   Returns {:ok, updated_emulator, match} or {:error, reason}.
@@ -157,4 +207,8 @@ defmodule Raxol.Terminal.SearchManager do
     buffer = SearchBuffer.clear_history(emulator.search_buffer)
     update_buffer(emulator, buffer)
   end
+
+  defp screen_rows(screen), do: screen |> ScreenBuffer.get_lines() |> Enum.map(&row_text/1)
+
+  defp row_text(line), do: Enum.map_join(line, "", &(Map.get(&1, :char) || " "))
 end
@@ -0,0 +1,191 @@
+#include "scrollback.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// Slots allocated for the first line; the slot array then doubles as needed
+#define SB_MIN_CAP 64
+
+void sb_init(struct sb_ring *r, size_t max_lines, size_t max_bytes)
+{
+  memset(r, 0, sizeof(*r));
+  r->max_lines = max_lines;
+  r->max_bytes = max_bytes;
+}
+
+void sb_clear(struct sb_ring *r)
+{
+  size_t k;
+  for (k = 0; k < r->count; k++)
+  {
+    free(r->lines[(r->head + k) % r->cap]);
+  }
+  r->head = 0;
+  r->count = 0;
+  r->bytes = 0;
+}
+
+void sb_free(struct sb_ring *r)
+{
+  sb_clear(r);
+  free(r->lines);
+  r->lines = NULL;
+  r->cap = 0;
+}
+
+// Reallocate the slots in order, oldest first, so the ring can grow
+static int grow(struct sb_ring *r)
+{
+  size_t cap = r->cap < SB_MIN_CAP ? SB_MIN_CAP : r->cap * 2;
+  size_t k;
+  struct sb_line **lines;
+  if (cap > SIZE_MAX / sizeof(*lines))
+  {
+    return -1;
+  }
+  lines = malloc(cap * sizeof(*lines));
+  if (lines == NULL)
+  {
+    return -1;
+  }
+  for (k = 0; k < r->count; k++)
+  {
+    lines[k] = r->lines[(r->head + k) % r->cap];
+  }
+  free(r->lines);
+  r->lines = lines;
+  r->cap = cap;
+  r->head = 0;
+  return 0;
+}
+
+int sb_push(struct sb_ring *r, const uint8_t *text, size_t ntext, const uint8_t *spans,
+            size_t nspans)
+{
+  struct sb_line *l;
+  if (ntext > UINT32_MAX || nspans > UINT32_MAX - ntext)
+  {
+    return -1;
+  }
+  if (r->count == r->cap && grow(r) != 0)
+  {
+    return -1;
+  }
+  l = malloc(sizeof(*l) + ntext + nspans);
+  if (l == NULL)
+  {
+    return -1;
+  }
+  l->ntext = (uint32_t)ntext;
+  l->nspans = (uint32_t)nspans;
+  if (ntext > 0)
+  {
+    memcpy(l->data, text, ntext);
+  }
+  if (nspans > 0)
+  {
+    memcpy(l->data + ntext, spans, nspans);
+  }
+  r->lines[(r->head + r->count) % r->cap] = l;
+  r->count++;
+  r->bytes += SB_LINE_SIZE(l);
+  return 0;
+}
+
+struct sb_line *sb_evict(struct sb_ring *r)
+{
+  struct sb_line *l;
+  int over = r->count > r->max_lines ||
+             (r->max_bytes > 0 && r->bytes > r->max_bytes && r->count > 1);
+  if (r->count == 0 || !over)
+  {
+    return NULL;
+  }
+  l = r->lines[r->head];
+  r->head = (r->head + 1) % r->cap;
+  r->count--;
+  r->bytes -= SB_LINE_SIZE(l);
+  return l;
+}
+
+void sb_set_limits(struct sb_ring *r, size_t max_lines, size_t max_bytes)
+{
+  r->max_lines = max_lines;
+  r->max_bytes = max_bytes;
+}
+
+const struct sb_line *sb_get(const struct sb_ring *r, size_t i)
+{
+  if (i >= r->count)
+  {
+    return NULL;
+  }
+  return r->lines[(r->head + r->count - 1 - i) % r->cap];
+}
+
+static uint8_t fold_byte(uint8_t c)
+{
+  return c >= 'A' && c <= 'Z' ? (uint8_t)(c + ('a' - 'A')) : c;
+}
+
+static int same(const uint8_t *a, const uint8_t *b, size_t m, int fold)
+{
+  size_t k;
+  if (!fold)
+  {
+    return memcmp(a, b, m) == 0;
+  }
+  for (k = 0; k < m; k++)
+  {
+    if (fold_byte(a[k]) != fold_byte(b[k]))
+    {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+// The first b in p..end, or end if there is none
+static const uint8_t *next_byte(const uint8_t *p, const uint8_t *end, uint8_t b)
+{
+  const uint8_t *c = memchr(p, b, (size_t)(end - p));
+  return c != NULL ? c : end;
+}
+
+size_t sb_find(const uint8_t *hay, size_t n, const uint8_t *needle, size_t m, int fold)
+{
+  const uint8_t *end, *c, *next_first, *next_other;
+  uint8_t first, other;
+  if (m == 0)
+  {
+    return 0;
+  }
+  if (m > n)
+  {
+    return SB_NOT_FOUND;
+  }
+  // Last place a match can start, plus one
+  end = hay + (n - m + 1);
+  first = fold ? fold_byte(needle[0]) : needle[0];
+  other = fold && first >= 'a' && first <= 'z' ? (uint8_t)(first - ('a' - 'A')) : first;
+  // The next candidate of each case, so each is scanned for once per
+  // occurrence however rare the other is
+  next_first = next_byte(hay, end, first);
+  next_other = other != first ? next_byte(hay, end, other) : end;
+  while ((c = next_first < next_other ? next_first : next_other) < end)
+  {
+    if (same(c + 1, needle + 1, m - 1, fold))
+    {
+      return (size_t)(c - hay);
+    }
+    if (c == next_first)
+    {
+      next_first = next_byte(c + 1, end, first);
+    }
+    else
+    {
+      next_other = next_byte(c + 1, end, other);
+    }
+  }
+  return SB_NOT_FOUND;
+}
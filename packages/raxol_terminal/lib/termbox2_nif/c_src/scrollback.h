@@ -0,0 +1,74 @@
+#ifndef SCROLLBACK_H
+#define SCROLLBACK_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Scrollback for the emulator: a ring of the lines that scrolled off the top
+// of the screen, newest last. Each line is a single allocation holding its
+// UTF-8 text followed by its style spans, which the ring stores as opaque
+// bytes; the caller decides their encoding. Appending and looking a line up
+// by index are O(1).
+//
+// The ring is bounded by a number of lines and, optionally, by the bytes its
+// lines take up (counting each line's header). sb_push never drops anything
+// itself: after pushing, the caller takes the lines over a limit with
+// sb_evict, oldest first, so it can keep them elsewhere or free them. The
+// newest line is never evicted for the byte limit alone, so a line bigger
+// than the whole budget is still kept until the next one arrives.
+
+struct sb_line
+{
+  uint32_t ntext;
+  uint32_t nspans;
+  // ntext bytes of text, then nspans bytes of spans
+  uint8_t data[];
+};
+
+struct sb_ring
+{
+  struct sb_line **lines;
+  size_t cap;
+  // Slot of the oldest line
+  size_t head;
+  size_t count;
+  size_t bytes;
+  size_t max_lines;
+  // 0 for no byte limit
+  size_t max_bytes;
+};
+
+// Bytes a line counts against the byte limit
+#define SB_LINE_SIZE(l) (sizeof(struct sb_line) + (l)->ntext + (l)->nspans)
+
+void sb_init(struct sb_ring *r, size_t max_lines, size_t max_bytes);
+void sb_free(struct sb_ring *r);
+void sb_clear(struct sb_ring *r);
+
+// Appends a copy of a line as the newest. Returns 0, or -1 if out of memory
+// or the line is too long to store.
+int sb_push(struct sb_ring *r, const uint8_t *text, size_t ntext, const uint8_t *spans,
+            size_t nspans);
+
+// Removes and returns the oldest line if the ring is over a limit, or returns
+// NULL. The caller frees the line with free().
+struct sb_line *sb_evict(struct sb_ring *r);
+
+// Changes the limits. Lines over the new limits stay until evicted.
+void sb_set_limits(struct sb_ring *r, size_t max_lines, size_t max_bytes);
+
+// Returns line i, counting back from the newest (0), or NULL if there are
+// not that many lines. The line stays owned by the ring and is only valid
+// until the next push, evict or clear.
+const struct sb_line *sb_get(const struct sb_ring *r, size_t i);
+
+// Returned by sb_find when there is no match
+#define SB_NOT_FOUND SIZE_MAX
+
+// Returns the offset of the first occurrence of needle (m bytes) in hay (n
+// bytes), or SB_NOT_FOUND. With fold set, ASCII letters match either case.
+// Candidates are found with memchr, which libc vectorizes, so the scan runs
+// at memory speed on the usual patterns whose first byte is not everywhere.
+size_t sb_find(const uint8_t *hay, size_t n, const uint8_t *needle, size_t m, int fold);
+
+#endif
@@ -67,6 +67,12 @@ main() {
     local IFS=$'\n'
     local codegen_type=$1
 
+    if [ "$codegen_type" == "wcwidth" ]; then
+        echo "/* Produced by $0 on $(date -uR) */"
+        wcwidth_stages termbox2.h
+        return
+    fi
+
     # codegen terminfo_cap_indexes
     # codegen #define TB_CAP_*
     # codegen #define TB_KEY_*
@@ -151,6 +157,77 @@ main() {
     fi
 }
 
+# Flatten the wcwidth_table ranges below 0x40000 into the two-stage table
+# tb_iswprint_ex reads: wcwidth_stage1 maps each 256-codepoint block to one of
+# the distinct blocks in wcwidth_stage2, which packs a 2-bit width per
+# codepoint (3 standing for -1), 16 codepoints to a word, low bits first.
+# Fails if there are more distinct blocks than a uint8_t stage1 entry indexes.
+wcwidth_stages() {
+    awk '
+    function hex(s,    i, n) {
+        n = 0
+        s = tolower(substr(s, 3))
+        for (i = 1; i <= length(s); i++) {
+            n = n * 16 + index("0123456789abcdef", substr(s, i, 1)) - 1
+        }
+        return n
+    }
+    /wcwidth_table\[\] = \{/ { in_table = 1; next }
+    in_table && /^};/ { in_table = 0 }
+    in_table {
+        line = $0
+        while (match(line, /\{0x[0-9a-f]+, 0x[0-9a-f]+, *-?[0-9]\}/)) {
+            split(substr(line, RSTART + 1, RLENGTH - 2), f, /, */)
+            line = substr(line, RSTART + RLENGTH)
+            hi = hex(f[2])
+            if (hi >= limit) hi = limit - 1
+            for (c = hex(f[1]); c <= hi; c++) width[c] = f[3] + 0
+        }
+    }
+    BEGIN { limit = 262144 }
+    END {
+        nblocks = 0
+        for (b = 0; b < limit / 256; b++) {
+            key = ""
+            for (w = 0; w < 16; w++) {
+                word = 0
+                for (i = 15; i >= 0; i--) {
+                    c = b * 256 + w * 16 + i
+                    v = (c in width) ? width[c] : -1
+                    if (v < 0) v = 3
+                    word = word * 4 + v
+                }
+                words[b, w] = word
+                key = key " " word
+            }
+            if (!(key in block_of)) {
+                if (nblocks > 255) {
+                    print "wcwidth_stages: more than 256 distinct blocks" > "/dev/stderr"
+                    exit 1
+                }
+                block_of[key] = nblocks
+                for (w = 0; w < 16; w++) uniq[nblocks * 16 + w] = words[b, w]
+                nblocks++
+            }
+            stage1[b] = block_of[key]
+        }
+        printf "#define WCWIDTH_STAGED_LIMIT 0x%x\n", limit
+        printf "static const uint8_t wcwidth_stage1[%d] = {\n", limit / 256
+        for (b = 0; b < limit / 256; b++) {
+            printf "%s%d,%s", (b % 16 == 0 ? "    " : " "), stage1[b], \
+                (b % 16 == 15 ? "\n" : "")
+        }
+        printf "};\n"
+        printf "static const uint32_t wcwidth_stage2[%d * 16] = {\n", nblocks
+        for (i = 0; i < nblocks * 16; i++) {
+            printf "%s0x%08x,%s", (i % 6 == 0 ? "    " : " "), uniq[i], \
+                (i % 6 == 5 || i == nblocks * 16 - 1 ? "\n" : "")
+        }
+        printf "};\n"
+    }
+    ' "$1"
+}
+
 terminfo_string_index() {
     local string_name=$1
     infocmp -E | grep -w $string_name | awk '{print $2}' | sed 's|:$||g'
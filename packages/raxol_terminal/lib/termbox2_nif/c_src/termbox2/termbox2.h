@@ -37,6 +37,7 @@ SOFTWARE.
 #include <errno.h>
 #include <fcntl.h>
 #include <limits.h>
+#include <poll.h>
 #include <signal.h>
 #include <stdarg.h>
 #include <stdint.h>
@@ -44,7 +45,6 @@ SOFTWARE.
 #include <stdlib.h>
 #include <string.h>
 #include <sys/ioctl.h>
-#include <sys/select.h>
 #include <sys/stat.h>
 #include <sys/time.h>
 #include <sys/types.h>
@@ -92,6 +92,30 @@ extern "C" {
  *                    libc's are locale-dependent and the caller must
  *                    `setlocale(3)` `LC_CTYPE` to UTF-8. Defaults to built-in.
  *
+ *    TB_OPT_NO_SIMD: If set, never use SSE2/AVX2 to compare front and back
+ *                    buffer rows in `tb_present`. By default vector compares
+ *                    are used when the compiler targets SSE2 and either
+ *                    `TB_OPT_SOA` is set or `TB_OPT_ATTR_W` is 64.
+ *
+ *        TB_OPT_SOA: If set, store the front and back buffers as separate
+ *                    `ch`, `fg`, and `bg` arrays, with grapheme clusters kept
+ *                    in a sparse side table, instead of arrays of
+ *                    `struct tb_cell`. Uses less than half the memory per cell
+ *                    with `TB_OPT_EGC` and 64-bit attributes. `tb_get_cell`
+ *                    then returns a copy of the cell and `tb_cell_buffer`
+ *                    returns NULL. Defaults off.
+ *
+ *  TB_OPT_NO_SCROLL: If set, `tb_present` never scrolls a region of the
+ *                    terminal (DECSTBM plus SU/SD) to apply a vertical shift
+ *                    of rows, and repaints the shifted rows instead. Defaults
+ *                    off.
+ *
+ *     TB_OPT_NO_RLE: If set, `tb_present` always writes runs of identical
+ *                    cells out in full. By default such runs are sent as
+ *                    erase-to-EOL (EL), erase-characters (ECH), or repeat
+ *                    (REP) sequences when the terminal supports them and they
+ *                    are shorter. Defaults off.
+ *
  *  TB_OPT_TRUECOLOR: Deprecated. Sets TB_OPT_ATTR_W to 32 if not already set.
  */
 
@@ -467,6 +491,104 @@ int tb_init_fd(int ttyfd);
 int tb_init_rwfd(int rfd, int wfd);
 int tb_shutdown(void);
 
+/* Initialize termbox without a terminal, with a `w` by `h` back buffer. Caps
+ * come from `TERM` as usual, falling back to xterm's. Output that would be
+ * written to the terminal accumulates in memory until collected with
+ * `tb_take_output` or `tb_swap_output`, so it can be sent elsewhere, e.g. over
+ * a network connection. No input or resize events arrive; use `tb_resize` to
+ * change the size.
+ */
+int tb_init_memory(int w, int h);
+
+/* Point `*buf` at the output accumulated since the last call and set `*nbuf`
+ * to its length, then empty the buffer. After `tb_present` this is exactly
+ * the diff against the previous frame, plus anything queued in between, such
+ * as mode changes or a clear after `tb_resize`. `*buf` stays valid until the
+ * next call that produces output. Only useful after `tb_init_memory`, since
+ * other contexts write their output out as it is flushed.
+ */
+int tb_take_output(const char **buf, size_t *nbuf);
+
+/* Like `tb_take_output`, but hands over the buffer itself rather than a view
+ * into it, so the output never has to be copied. On entry `*buf` and `*cap`
+ * describe a buffer from `tb_malloc` (or NULL and 0) for termbox to build
+ * further output in; on return they describe the old buffer, whose first
+ * `*nbuf` bytes are the output. The caller owns the old buffer and releases
+ * it with `tb_free`, or passes it back in a later call. Alternating between
+ * two buffers this way costs neither a copy nor an allocation per frame.
+ */
+int tb_swap_output(char **buf, size_t *nbuf, size_t *cap);
+
+/* Resize the back buffer to `w` by `h`, as if the terminal had reported that
+ * size. For terminals whose size termbox can't query itself, e.g. a remote
+ * session that reports its window size out of band.
+ */
+int tb_resize(int w, int h);
+
+/* Every other function operates on the calling thread's current context, which
+ * starts out as a built-in one. A context holds its own fds, caps, cell
+ * buffers and output buffer, so several terminals can be driven at once from
+ * different threads, one context per thread at a time.
+ *
+ * `tb_context_new` returns an uninitialized context, or NULL if out of memory.
+ * `tb_context_set` makes `ctx` current for the calling thread and returns the
+ * previously current one; NULL stands for the built-in context both ways.
+ * `tb_context_free` shuts `ctx` down if it was initialized and frees it; it
+ * must not be current on any thread.
+ *
+ * Only the built-in context handles `SIGWINCH`. Others keep their size until
+ * `tb_resize` is called.
+ */
+struct tb_context;
+struct tb_context *tb_context_new(void);
+struct tb_context *tb_context_set(struct tb_context *ctx);
+void tb_context_free(struct tb_context *ctx);
+
+/* A grid is a standalone cell buffer laid out like the back buffer, for
+ * callers that keep a screen of their own, e.g. a terminal emulator. It needs
+ * no `tb_init`, belongs to no context and is not thread safe. A new grid is
+ * `w` by `h` spaces with zero attributes.
+ *
+ * `tb_grid_print_n` prints at most `nstr` bytes of UTF-8 along row `y` from
+ * column `x`, as `tb_print_n` would, but stops at the first character that
+ * doesn't fit in the row. `out_w` receives the number of columns printed and
+ * `out_n` the number of bytes consumed, so the caller can wrap the rest. The
+ * trailing columns of a wide character hold codepoint 0, and a wide character
+ * cut in two by the print is blanked. A combining character at the start of
+ * `str` is added to the cell before `x`.
+ *
+ * `tb_grid_erase` blanks `n` cells in reading order from `x`,`y`, continuing
+ * onto the following rows up to the end of the grid. `tb_grid_insert_cells`
+ * and `tb_grid_delete_cells` shift the rest of row `y` from column `x` right
+ * or left by `n` cells. `tb_grid_scroll` moves rows `top` through `bot` up by
+ * `n` rows, or down if `n` is negative; inserting or deleting lines is a
+ * scroll of the region from the cursor row down. `tb_grid_resize` keeps the
+ * upper-left part of the grid. Blanked cells, and the cells these open up, are
+ * set to spaces with attributes `fg` and `bg`.
+ *
+ * `tb_grid_get_cell` works like `tb_get_cell`. All functions return
+ * `TB_ERR_OUT_OF_BOUNDS` if a position or region lies outside the grid.
+ */
+struct tb_grid;
+int tb_grid_new(int w, int h, struct tb_grid **out);
+void tb_grid_free(struct tb_grid *g);
+int tb_grid_resize(struct tb_grid *g, int w, int h, uintattr_t fg,
+    uintattr_t bg);
+int tb_grid_width(struct tb_grid *g);
+int tb_grid_height(struct tb_grid *g);
+int tb_grid_get_cell(struct tb_grid *g, int x, int y, struct tb_cell **cell);
+int tb_grid_print_n(struct tb_grid *g, int x, int y, uintattr_t fg,
+    uintattr_t bg, size_t *out_w, size_t *out_n, const char *str,
+    size_t nstr);
+int tb_grid_erase(struct tb_grid *g, int x, int y, size_t n, uintattr_t fg,
+    uintattr_t bg);
+int tb_grid_insert_cells(struct tb_grid *g, int x, int y, int n,
+    uintattr_t fg, uintattr_t bg);
+int tb_grid_delete_cells(struct tb_grid *g, int x, int y, int n,
+    uintattr_t fg, uintattr_t bg);
+int tb_grid_scroll(struct tb_grid *g, int top, int bot, int n, uintattr_t fg,
+    uintattr_t bg);
+
 /* Return the size of the internal back buffer (which is the same as terminal's
  * window size in rows and columns). The internal buffer can be resized after
  * `tb_clear` or `tb_present` calls. Both dimensions have an unspecified
@@ -481,8 +603,82 @@ int tb_height(void);
 int tb_clear(void);
 int tb_set_clear_attrs(uintattr_t fg, uintattr_t bg);
 
-/* Synchronize the internal back buffer with the terminal by writing to tty. */
+/* Synchronize the internal back buffer with the terminal by writing to tty.
+ *
+ * If a run of rows in the back buffer matches rows of the front buffer shifted
+ * up or down, the terminal's scroll region is used to move them first, and
+ * only what still differs is written afterwards. This needs the terminfo caps
+ * `indn` (to scroll up) or `rin` (down), plus `csr` for less than the whole
+ * screen.
+ *
+ * `tb_present_ex` does the same and, if `stats` is non-NULL, fills it in with
+ * what the call wrote. `spans` holds one entry per row that had at least one
+ * changed cell, in ascending `y` order, covering columns `[x0, x1)`. Span
+ * memory is owned by termbox and is only valid until the next call to
+ * `tb_present_ex`, `tb_present`, or `tb_shutdown`. If a scroll was sent, rows
+ * `scroll_top` to `scroll_bottom` were moved up by `scroll` rows (down, if
+ * negative) before any spans were written; otherwise `scroll` is 0.
+ */
+struct tb_damage_span {
+    int y;  // row
+    int x0; // first changed column
+    int x1; // one past the last changed column (includes wide-char extent)
+};
+struct tb_present_stats {
+    size_t bytes;                       // bytes written to the tty
+    size_t cells;                       // cells sent to the tty
+    const struct tb_damage_span *spans; // changed row spans
+    size_t nspans;                      // number of elements in spans
+    int scroll;                         // rows scrolled up (<0: down), or 0
+    int scroll_top;                     // first row of the scrolled region
+    int scroll_bottom;                  // last row of the scrolled region
+    size_t pending;                     // bytes still queued, see below
+};
 int tb_present(void);
+int tb_present_ex(struct tb_present_stats *stats);
+
+/* Write output without blocking if `nonblock` is nonzero. Output the terminal
+ * won't take yet then stays queued instead of blocking the caller: `tb_present`
+ * returns as soon as nothing more can be written, reporting what is left in
+ * `stats->pending`, and `tb_flush_output` writes more of it once the fd from
+ * `tb_get_output_fd` is writable again. Later output is queued behind it, so
+ * nothing is lost, and a caller that is falling behind can simply skip frames
+ * until the queue drains: the next `tb_present` sends everything that changed
+ * in the meantime.
+ *
+ * This sets `O_NONBLOCK` on the output fd, and clears it again (unless it was
+ * already set) when switched off or on shutdown, which waits for the queue to
+ * be written. Without it, termbox waits for the terminal instead, including
+ * on an fd the caller made non-blocking.
+ */
+int tb_set_output_nonblock(int nonblock);
+
+/* Write as much queued output as the terminal takes without blocking, and set
+ * `*pending`, if non-NULL, to the number of bytes still queued.
+ */
+int tb_flush_output(size_t *pending);
+
+/* Queue output instead of writing it, as for a context without a terminal,
+ * until `tb_release_output`. The caller takes the queued output with
+ * `tb_swap_output` and writes it to the fd from `tb_get_output_fd` itself,
+ * e.g. after releasing a lock other threads would otherwise wait on while the
+ * terminal catches up. Returns `TB_ERR` and changes nothing if output is
+ * already held, or would not block anyway: with `tb_set_output_nonblock`, or
+ * without an output fd. Shutting down releases held output.
+ */
+int tb_hold_output(void);
+
+/* Stop holding output, and write whatever is still queued.
+ */
+int tb_release_output(void);
+
+/* Shut down like `tb_shutdown`, but instead of writing the output still queued
+ * and the exit sequences, hand them over in `*buf`, `*nbuf` bytes long, for the
+ * caller to write and release with `tb_free`, e.g. once other threads no
+ * longer wait on it. Shutting down closes the tty `tb_init` opened, so `dup`
+ * the fd from `tb_get_output_fd` beforehand to write to.
+ */
+int tb_shutdown_output(char **buf, size_t *nbuf);
 
 /* Clear the internal front buffer effectively forcing a complete re-render of
  * the back buffer to the tty. It is not necessary to call this under normal
@@ -512,6 +708,28 @@ int tb_set_cell_ex(int x, int y, uint32_t *ch, size_t nch, uintattr_t fg,
     uintattr_t bg);
 int tb_extend_cell(int x, int y, uint32_t ch);
 
+/* Set many cells in the internal back buffer in one call.
+ *
+ * `tb_set_cells` reads `nbuf / TB_PACKED_CELL_SIZE` native-endian records of
+ * the form `{uint16_t x, uint16_t y, uint32_t ch, uint64_t fg, uint64_t bg}`
+ * from `buf`. Records that fall outside the back buffer are skipped.
+ *
+ * `tb_blit` reads a row-major `w`x`h` rectangle of native-endian
+ * `{uint32_t ch, uint64_t fg, uint64_t bg}` records (`TB_PACKED_RECT_SIZE`
+ * bytes each) and places it with its upper-left corner at `x`,`y`. Portions of
+ * the rectangle outside the back buffer are clipped.
+ *
+ * `fg` and `bg` are truncated to `uintattr_t`. Any grapheme cluster previously
+ * set on an overwritten cell is dropped. If `out_n` is non-NULL, it receives
+ * the number of cells written. If `nbuf` does not match the record layout,
+ * `TB_ERR` is returned and nothing is written.
+ */
+#define TB_PACKED_CELL_SIZE 24
+#define TB_PACKED_RECT_SIZE 20
+int tb_set_cells(const void *buf, size_t nbuf, size_t *out_n);
+int tb_blit(int x, int y, int w, int h, const void *buf, size_t nbuf,
+    size_t *out_n);
+
 /* Return a pointer to the cell at the specified position.
  *
  * Cell memory may be invalid or freed after subsequent library calls, so
@@ -520,7 +738,8 @@ int tb_extend_cell(int x, int y, uint32_t ch);
  *
  * Callers may use pointer math to access cells relative to the requested one.
  * The cell grid memory layout is a contiguous array indexable by the expression
- * `(y * width) + x`.
+ * `(y * width) + x`. This does not hold when built with `TB_OPT_SOA`, where the
+ * returned cell is a copy that is only valid until the next call.
  *
  * If `back` is non-zero, return cell from the internal back buffer. Otherwise,
  * return cell from the front buffer. Note the front buffer is updated on each
@@ -649,7 +868,7 @@ int tb_set_output_mode(int mode);
 
 /* Wait for an event up to `timeout_ms` milliseconds and populate `event` with
  * it. If no event is available within the timeout period, `TB_ERR_NO_EVENT`
- * is returned. On a resize event, the underlying `select(2)` call may be
+ * is returned. On a resize event, the underlying `poll(2)` call may be
  * interrupted, yielding a return code of `TB_ERR_POLL`. In this case, you may
  * check `errno` via `tb_last_errno`. If it's `EINTR`, you may elect to ignore
  * that and call `tb_peek_event` again.
@@ -659,12 +878,37 @@ int tb_peek_event(struct tb_event *event, int timeout_ms);
 /* Same as `tb_peek_event` except no timeout. */
 int tb_poll_event(struct tb_event *event);
 
+/* Same as `tb_peek_event`, but also wait on the caller's `nfds` entries in
+ * `fds`, as for `poll(2)`. If one of them becomes ready before an event
+ * arrives, `TB_ERR_NO_EVENT` is returned and its `revents` say why. A negative
+ * `timeout_ms` waits indefinitely.
+ */
+int tb_peek_event_fds(struct tb_event *event, int timeout_ms,
+    struct pollfd *fds, size_t nfds);
+
+/* Collect up to `cap` events into `events` without blocking, setting `*n` to
+ * the number collected. Input is read a chunk at a time as it is consumed, so
+ * a large paste or a burst of mouse reports costs one call per `cap` events
+ * instead of one `poll(2)` and `read(2)` per event. A trailing incomplete
+ * escape sequence stays buffered for the next call. Returns
+ * `TB_ERR_NO_EVENT` if no event was available. If an error stops collection,
+ * it is returned, and the `*n` events collected before it are still valid.
+ * End of input is returned as `TB_ERR_READ` with `tb_last_errno` 0.
+ */
+int tb_drain_events(struct tb_event *events, size_t cap, size_t *n);
+
 /* Internal termbox fds that can be used with `poll(2)`, `select(2)`, etc.
- * externally. Callers must invoke `tb_poll_event` or `tb_peek_event` if
- * fds become readable.
+ * externally. Callers must invoke `tb_poll_event`, `tb_peek_event`, or
+ * `tb_drain_events` if fds become readable.
  */
 int tb_get_fds(int *ttyfd, int *resizefd);
 
+/* The fd termbox writes output to, for waiting until it is writable when
+ * output is non-blocking (see `tb_set_output_nonblock`). -1 without a
+ * terminal.
+ */
+int tb_get_output_fd(int *wfd);
+
 /* Print and printf functions. Specify param `out_w` to determine width of
  * printed string. Strings are interpreted as UTF-8.
  *
@@ -678,12 +922,33 @@ int tb_get_fds(int *ttyfd, int *resizefd);
  * returned. If the starting coordinate is in bounds, but goes out of bounds,
  * then the out-of-bounds portions of the string are ignored.
  *
+ * `tb_print_n` prints at most `nstr` bytes of `str`, which need not be
+ * NUL-terminated. A multi-byte sequence cut off by `nstr` counts as truncated.
+ *
  * For finer control, use `tb_set_cell`.
  */
 int tb_print(int x, int y, uintattr_t fg, uintattr_t bg, const char *str);
 int tb_printf(int x, int y, uintattr_t fg, uintattr_t bg, const char *fmt, ...);
 int tb_print_ex(int x, int y, uintattr_t fg, uintattr_t bg, size_t *out_w,
     const char *str);
+int tb_print_n(int x, int y, uintattr_t fg, uintattr_t bg, size_t *out_w,
+    const char *str, size_t nstr);
+
+/* Print many runs of text in one call.
+ *
+ * `buf` holds back-to-back native-endian records, each a
+ * `{uint16_t x, uint16_t y, uint32_t len, uint64_t fg, uint64_t bg}` header
+ * (`TB_PACKED_RUN_SIZE` bytes) followed by `len` bytes of UTF-8, which are
+ * printed as by `tb_print_n`. `fg` and `bg` are truncated to `uintattr_t`.
+ *
+ * `out_w`, if non-NULL, must have room for `nbuf / TB_PACKED_RUN_SIZE`
+ * entries. It receives the width of each run, or `TB_ERR_OUT_OF_BOUNDS` for a
+ * run starting outside the back buffer, which is skipped. `out_n` receives the
+ * number of runs. If `buf` does not match the record layout, `TB_ERR` is
+ * returned and nothing is printed.
+ */
+#define TB_PACKED_RUN_SIZE 24
+int tb_print_runs(const void *buf, size_t nbuf, int *out_w, size_t *out_n);
 int tb_printf_ex(int x, int y, uintattr_t fg, uintattr_t bg, size_t *out_w,
     const char *fmt, ...);
 
@@ -736,6 +1001,16 @@ const char *tb_version(void);
 int tb_iswprint(uint32_t ch);
 int tb_wcwidth(uint32_t ch);
 
+/* Expose the two-stage table behind `tb_wcwidth` for codepoints below
+ * `*limit`, so callers elsewhere (e.g. another language runtime) can share it.
+ * The width of `ch` is the 2-bit field at bit `2 * (ch & 0xf)` of word
+ * `stage2[stage1[ch >> 8] * 16 + ((ch >> 4) & 0xf)]`, with 3 meaning -1.
+ * `*nstage2` is the number of words in `stage2`. Returns `TB_ERR` when built
+ * with `TB_OPT_LIBC_WCHAR`.
+ */
+int tb_wcwidth_table(const uint8_t **stage1, const uint32_t **stage2,
+    size_t *nstage2, uint32_t *limit);
+
 /* Deprecation notice!
  *
  * The following will be removed in version 3.x (ABI version 3):
@@ -787,25 +1062,121 @@ int tb_wcwidth(uint32_t ch);
 #define if_not_init_return()                                                   \
     if (!global.initialized) return TB_ERR_NOT_INIT
 
+// Optional output features, read from terminfo, that `tb_present` can use to
+// shorten its output
+#define TB_TERM_ECH 0x01 // ech: erase n characters, `CSI n X`
+#define TB_TERM_REP 0x02 // rep: repeat the preceding character, `CSI n b`
+#define TB_TERM_BCE 0x04 // bce: erased cells take the current background
+#define TB_TERM_SGR 0x08 // attribute caps are plain ECMA-48 SGR sequences
+#define TB_TERM_XENL 0x10 // xenl: writing the last column defers the wrap
+#define TB_TERM_CSR 0x20 // csr: set the scroll region, `CSI t ; b r`
+#define TB_TERM_INDN 0x40 // indn: scroll up n rows, `CSI n S`
+#define TB_TERM_RIN 0x80 // rin: scroll down n rows, `CSI n T`
+#define TB_TERM_HPA 0x100 // hpa: move to column n, `CSI n G`
+#define TB_TERM_VPA 0x200 // vpa: move to row n, `CSI n d`
+#define TB_TERM_CUF 0x400 // cuf: move right n columns, `CSI n C`
+#define TB_TERM_CUB 0x800 // cub: move left n columns, `CSI n D`
+#define TB_TERM_CUU 0x1000 // cuu: move up n rows, `CSI n A`
+#define TB_TERM_CUD 0x2000 // cud: move down n rows, `CSI n B`
+
+// Which of the above xterm has that plain SGR doesn't cover, for output that
+// assumes xterm without its terminfo entry
+#define TB_TERM_XTERM                                                          \
+    (TB_TERM_CSR | TB_TERM_INDN | TB_TERM_RIN | TB_TERM_HPA | TB_TERM_VPA |    \
+        TB_TERM_CUF | TB_TERM_CUB | TB_TERM_CUU | TB_TERM_CUD)
+
+// terminfo indexes of the above (bce and xenl are booleans, the rest strings)
+#define TB_TERMINFO_ECH 37
+#define TB_TERMINFO_REP 121
+#define TB_TERMINFO_CSR 3
+#define TB_TERMINFO_INDN 109
+#define TB_TERMINFO_RIN 113
+#define TB_TERMINFO_HPA 8
+#define TB_TERMINFO_VPA 127
+#define TB_TERMINFO_CUF 112
+#define TB_TERMINFO_CUB 111
+#define TB_TERMINFO_CUU 114
+#define TB_TERMINFO_CUD 107
+#define TB_TERMINFO_BCE 28
+#define TB_TERMINFO_XENL 4
+
+// Vector cell compares on `struct tb_cell` arrays assume the 64-bit attribute
+// layout (ch at 0, fg at 8, bg at 16). AVX2 loads 32 bytes per cell, which is
+// only in bounds when `TB_OPT_EGC` pads the struct out past that. With
+// `TB_OPT_SOA` the compares run over plain arrays and have no such limits.
+#if !defined(TB_OPT_NO_SIMD) && (defined(TB_OPT_SOA) || TB_OPT_ATTR_W == 64)
+#if defined(__AVX2__) && (defined(TB_OPT_SOA) || defined(TB_OPT_EGC))
+#include <immintrin.h>
+#define TB_SIMD_AVX2
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define TB_SIMD_SSE2
+#endif
+#endif
+#if !defined(TB_OPT_SOA) && (defined(TB_SIMD_AVX2) || defined(TB_SIMD_SSE2))
+#include <stddef.h>
+typedef char tb_simd_cell_layout_check[(offsetof(struct tb_cell, fg) == 8 &&
+                                           offsetof(struct tb_cell, bg) == 16)
+                                           ? 1
+                                           : -1];
+#endif
+
 struct bytebuf {
     char *buf;
     size_t len;
     size_t cap;
 };
 
+#ifdef TB_OPT_SOA
+// A stored `ch` of this form marks a cell whose grapheme cluster lives in the
+// side table. Codepoints that would collide are stored as U+FFFD.
+#define TB_SOA_EGC_BIT 0x40000000
+#define TB_SOA_TAG_MASK 0xc0000000
+#define TB_SOA_NO_EGC UINT32_MAX
+
+struct cellbuf_egc {
+    uint32_t idx; // cell index, or TB_SOA_NO_EGC if the slot is free
+    uint32_t *ech;
+    size_t nech;
+    size_t cech;
+};
+#endif
+
 struct cellbuf {
     int width;
     int height;
+#ifdef TB_OPT_SOA
+    uint32_t *ch;
+    uintattr_t *fg;
+    uintattr_t *bg;
+    struct cellbuf_egc *egc; // open-addressed by cell index
+    size_t negc;
+    size_t cegc;         // 0 or a power of 2
+    struct tb_cell view; // cell handed out by `cellbuf_get`
+#else
     struct tb_cell *cells;
+#endif
+    uint8_t *dirty; // per-row flag: row may differ from what's on the tty
 };
 
-struct cap_trie {
-    char c;
-    struct cap_trie *children;
-    size_t nchildren;
-    int is_leaf;
+struct cap_trie_node {
     uint16_t key;
     uint8_t mod;
+    uint8_t is_leaf;
+    uint8_t has_children;
+};
+
+// Escape sequence matcher compiled from the key caps. Bytes that occur in
+// some cap get their own column in a dense `nstates` by `nclasses`
+// transition table; every other byte maps to column 0, which never leads
+// anywhere. State 0 is the root, so a transition of 0 means no match. The
+// table and nodes share one allocation.
+struct cap_trie {
+    uint8_t class_of[256];
+    size_t nclasses;
+    size_t nstates;
+    uint16_t *next;
+    struct cap_trie_node *nodes;
 };
 
 struct tb_global {
@@ -824,26 +1195,63 @@ struct tb_global {
     uintattr_t bg;
     uintattr_t last_fg;
     uintattr_t last_bg;
+    int last_attr_known; // whether last_fg/last_bg are the terminal's state
     int input_mode;
     int output_mode;
     char *terminfo;
     size_t nterminfo;
     const char *caps[TB_CAP__COUNT];
+    int term_features; // TB_TERM_* bits
     struct cap_trie cap_trie;
     struct bytebuf in;
     struct bytebuf out;
     struct cellbuf back;
     struct cellbuf front;
+    struct tb_damage_span *damage;
+    size_t cdamage;
+    uint64_t *rowhash; // per-row back and front hashes for scroll detection
+    size_t crowhash;
+    int fronthash_ok; // the front hashes in `rowhash` are up to date
+    int backhash_ok; // the back hashes were taken by this present
     struct termios orig_tios;
     int has_orig_tios;
     int last_errno;
+    int out_nonblock; // see tb_set_output_nonblock
+    int out_set_nonblock; // whether termbox set O_NONBLOCK on wfd
+    int out_hold; // see tb_hold_output
     int initialized;
     int (*fn_extract_esc_pre)(struct tb_event *, size_t *);
     int (*fn_extract_esc_post)(struct tb_event *, size_t *);
     char errbuf[1024];
 };
 
-static struct tb_global global = {0};
+// The current context is per thread. Leave the TLS model at the compiler's
+// default (global-dynamic under -fPIC): initial-exec is not safe in a shared
+// object loaded with dlopen, such as a NIF, and fails outright on musl. Without
+// thread-local storage contexts would race, so refuse to build instead.
+#ifndef TB_THREAD_LOCAL
+#if defined(__GNUC__) || defined(__clang__)
+#define TB_THREAD_LOCAL __thread
+#elif defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L && \
+    !defined(__STDC_NO_THREADS__)
+#define TB_THREAD_LOCAL _Thread_local
+#else
+#error "termbox2 needs thread-local storage; define TB_THREAD_LOCAL"
+#endif
+#endif
+
+struct tb_context {
+    struct tb_global g;
+};
+
+struct tb_grid {
+    struct cellbuf c;
+};
+
+// `global` is the calling thread's current context, see `tb_context_set`
+static struct tb_context tb_default_context = {0};
+static TB_THREAD_LOCAL struct tb_global *tb_cur = &tb_default_context.g;
+#define global (*tb_cur)
 
 /* BEGIN codegen c */
 /* Produced by ./codegen.sh on Tue, 03 Sep 2024 04:17:48 +0000 */
@@ -2268,6 +2676,496 @@ static struct {
     // clang-format on
 };
 #define WCWIDTH_TABLE_LENGTH 2143
+
+// The ranges above flattened into a two-stage table, so a width is two loads
+// instead of a binary search. It stops at WCWIDTH_STAGED_LIMIT, past which
+// only tags, variation selectors and private use remain. Run `make wcwidth`
+// after changing wcwidth_table.
+// clang-format off
+/* BEGIN codegen wcwidth */
+/* Produced by ./codegen.sh on Fri, 16 Oct 2026 09:13:29 +0000 */
+#define WCWIDTH_STAGED_LIMIT 0x40000
+static const uint8_t wcwidth_stage1[1024] = {
+    0, 1, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14,
+    15, 16, 17, 18, 1, 1, 19, 20, 21, 22, 23, 24, 25, 26, 1, 27,
+    28, 29, 1, 30, 31, 32, 33, 34, 1, 1, 1, 35, 36, 37, 38, 39,
+    40, 41, 42, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43,
+    43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43,
+    43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43,
+    43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43,
+    43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43,
+    43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43,
+    43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43,
+    43, 43, 43, 43, 44, 1, 45, 46, 47, 48, 49, 50, 43, 43, 43, 43,
+    43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43,
+    43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43,
+    43, 43, 43, 43, 43, 43, 43, 51, 52, 52, 52, 52, 52, 52, 52, 52,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 43, 53, 54, 1, 55, 56, 57,
+    58, 59, 60, 61, 62, 63, 1, 64, 65, 66, 67, 68, 69, 70, 71, 72,
+    73, 74, 75, 76, 77, 78, 79, 80, 81, 82, 83, 84, 85, 86, 87, 88,
+    1, 1, 1, 89, 90, 91, 52, 52, 52, 52, 52, 52, 52, 52, 52, 92,
+    1, 1, 1, 1, 93, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 94, 1, 1, 95, 52, 52, 52, 52, 52, 52, 52, 52, 52,
+    52, 52, 52, 52, 52, 52, 52, 52, 52, 52, 52, 52, 52, 52, 52, 52,
+    52, 96, 52, 52, 52, 52, 52, 52, 1, 1, 97, 98, 52, 99, 100, 101,
+    43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43,
+    43, 43, 43, 43, 43, 43, 43, 102, 43, 43, 43, 43, 103, 104, 52, 52,
+    52, 52, 52, 52, 52, 52, 52, 52, 52, 52, 52, 52, 52, 52, 52, 52,
+    52, 52, 52, 52, 52, 52, 52, 52, 52, 52, 52, 52, 52, 52, 52, 105,
+    43, 106, 107, 52, 52, 52, 52, 52, 52, 52, 52, 52, 108, 52, 52, 52,
+    52, 52, 52, 52, 52, 52, 52, 52, 52, 52, 52, 52, 109, 1, 110, 111,
+    112, 113, 114, 115, 116, 117, 118, 119, 1, 1, 120, 52, 52, 52, 52, 121,
+    122, 123, 124, 52, 125, 126, 52, 127, 128, 129, 52, 52, 130, 131, 132, 52,
+    133, 134, 135, 136, 137, 138, 139, 140, 141, 142, 143, 144, 52, 52, 52, 52,
+    43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43,
+    43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43,
+    43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43,
+    43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43,
+    43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43,
+    43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43,
+    43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43,
+    43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43,
+    43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43,
+    43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43,
+    43, 43, 43, 43, 43, 43, 145, 43, 43, 43, 43, 43, 43, 43, 43, 43,
+    43, 43, 43, 43, 43, 43, 43, 146, 147, 43, 43, 43, 43, 43, 43, 43,
+    43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 148, 43,
+    43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43,
+    43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 149, 43, 43, 150, 52,
+    52, 52, 52, 52, 52, 52, 52, 52, 43, 43, 151, 52, 52, 52, 52, 52,
+    43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43,
+    43, 43, 43, 152, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43, 43,
+    43, 43, 43, 153, 52, 52, 52, 52, 52, 52, 52, 52, 52, 52, 52, 52,
+    52, 52, 52, 52, 52, 52, 52, 52, 52, 52, 52, 52, 52, 52, 52, 52,
+    52, 52, 52, 52, 52, 52, 52, 52, 52, 52, 52, 52, 52, 52, 52, 52,
+    52, 52, 52, 52, 52, 52, 52, 52, 52, 52, 52, 52, 52, 52, 52, 52,
+    52, 52, 52, 52, 52, 52, 52, 52, 52, 52, 52, 52, 52, 52, 52, 52,
+    52, 52, 52, 52, 52, 52, 52, 52, 52, 52, 52, 52, 52, 52, 52, 52,
+    52, 52, 52, 52, 52, 52, 52, 52, 52, 52, 52, 52, 52, 52, 52, 52,
+    52, 52, 52, 52, 52, 52, 52, 52, 52, 52, 52, 52, 52, 52, 52, 52,
+    52, 52, 52, 52, 52, 52, 52, 52, 52, 52, 52, 52, 52, 52, 52, 52,
+    52, 52, 52, 52, 52, 52, 52, 52, 52, 52, 52, 52, 52, 52, 52, 52,
+    52, 52, 52, 52, 52, 52, 52, 52, 52, 52, 52, 52, 52, 52, 52, 52,
+    52, 52, 52, 52, 52, 52, 52, 52, 52, 52, 52, 52, 52, 52, 52, 52,
+    52, 52, 52, 52, 52, 52, 52, 52, 52, 52, 52, 52, 52, 52, 52, 52,
+    52, 52, 52, 52, 52, 52, 52, 52, 52, 52, 52, 52, 52, 52, 52, 52,
+};
+static const uint32_t wcwidth_stage2[154 * 16] = {
+    0xffffffff, 0xffffffff, 0x55555555, 0x55555555, 0x55555555, 0x55555555,
+    0x55555555, 0xd5555555, 0xffffffff, 0xffffffff, 0x55555555, 0x55555555,
+    0x55555555, 0x55555555, 0x55555555, 0x55555555, 0x55555555, 0x55555555,
+    0x55555555, 0x55555555, 0x55555555, 0x55555555, 0x55555555, 0x55555555,
+    0x55555555, 0x55555555, 0x55555555, 0x55555555, 0x55555555, 0x55555555,
+    0x55555555, 0x55555555, 0x00000000, 0x00000000, 0x00000000, 0x00000000,
+    0x00000000, 0x00000000, 0x00000000, 0x555f5555, 0x5dd555ff, 0x55555555,
+    0x55555575, 0x55555555, 0x55555555, 0x55555555, 0x55555555, 0x55555555,
+    0x55555555, 0x55555555, 0x55555555, 0x55555555, 0x55555555, 0x55555555,
+    0x55555555, 0x55555555, 0x55500015, 0x55555555, 0x55555555, 0x55555555,
+    0x55555555, 0x55555555, 0x55555555, 0x55555555, 0x55555555, 0x55555555,
+    0x55555555, 0x55555557, 0x55555555, 0x5557d555, 0x55555555, 0x55555555,
+    0x57d55555, 0x00000003, 0x00000000, 0x10000000, 0xffff1041, 0x55555555,
+    0x7fd55555, 0xfffffd55, 0x55555555, 0x54400000, 0x55555555, 0x55555555,
+    0x00155555, 0x00000000, 0x55555555, 0x55555554, 0x55555555, 0x55555555,
+    0x55555555, 0x55555555, 0x55555555, 0x14000555, 0x50041400, 0x55555555,
+    0x75555555, 0x55555551, 0x55555555, 0x00000000, 0x57c00000, 0x55555555,
+    0x55555555, 0x55555555, 0x55555555, 0x55555555, 0x00000555, 0xfffffff4,
+    0x55555555, 0x55555555, 0x00155555, 0x53d55500, 0x55555555, 0x00100555,
+    0xf0010100, 0xd5555555, 0x55555555, 0xdf015555, 0xffd55555, 0x55555555,
+    0xd5555555, 0x00003ff5, 0x55555555, 0x55555555, 0x00055555, 0x00000000,
+    0x00000010, 0x00000000, 0x55555540, 0x55555555, 0x55555555, 0x54455555,
+    0x51540001, 0x55550001, 0x55555505, 0x55555555, 0x7d555751, 0x5555557d,
+    0x555d5555, 0x54f55fdd, 0xd17d7c01, 0x75ff7fff, 0x55555f05, 0xc5555555,
+    0x7fd55743, 0x5555557d, 0x555d5555, 0x5cf5d75d, 0xf03c3fc1, 0xdd57fff3,
+    0x55555fff, 0xffffd150, 0x75555743, 0x55555575, 0x555d5555, 0x54f5575d,
+    0xf1743001, 0xfffffffd, 0x55555f05, 0x0007fff5, 0x7d555753, 0x5555557d,
+    0x555d5555, 0x14f5575d, 0xf17d7c01, 0x75ff43ff, 0x55555f05, 0xffff5555,
+    0x5fd5574f, 0x5dd7f55d, 0x5fd5fd7f, 0x5ff55555, 0xf15d5fd4, 0xffff7ffd,
+    0x55555fff, 0xffd55555, 0x5d555454, 0x5555555d, 0x555d5555, 0x04f55555,
+    0xf00c0d54, 0xf7d5c3ff, 0x55555f05, 0x55557fff, 0x5d555551, 0x5555555d,
+    0x555d5555, 0x14f55755, 0xf05d4d55, 0xd7ffd7ff, 0x55555f05, 0xffffff57,
+    0x5d555550, 0x5555555d, 0x55555555, 0x54155555, 0x515d5c01, 0x555555ff,
+    0x55555f05, 0x55555555, 0x55555753, 0x555fd555, 0x55555555, 0xf7555575,
+    0x7fcfd555, 0x5555cc05, 0x55555fff, 0xfffffd5f, 0x55555557, 0x55555555,
+    0x55555555, 0x7fc00051, 0x40001555, 0xff555555, 0xffffffff, 0xffffffff,
+    0x55d55dd7, 0x55555555, 0x55557755, 0xf4000051, 0xc000dd55, 0x55f55555,
+    0xffffffff, 0xffffffff, 0x55555555, 0x55505555, 0x55555555, 0x55511155,
+    0x55575555, 0x55555555, 0xfd555555, 0x40000003, 0x01550400, 0x00030000,
+    0x00000000, 0x5c000000, 0x5d554555, 0xffd55555, 0xffffffff, 0xffffffff,
+    0x55555555, 0x55555555, 0x01555555, 0x41410004, 0x55555555, 0x05505555,
+    0x55555554, 0x55555401, 0x51554145, 0x51555555, 0x55555555, 0x55555555,
+    0xf7ff7555, 0x55555555, 0x55555555, 0x55555555, 0xaaaaaaaa, 0xaaaaaaaa,
+    0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0x00000000, 0x00000000,
+    0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000,
+    0x00000000, 0x00000000, 0x55555555, 0x55555555, 0x55555555, 0x55555555,
+    0xf55d5555, 0xf55dd555, 0x55555555, 0x55555555, 0xf55d5555, 0x55555555,
+    0x55555555, 0xd555f55d, 0x5555f55d, 0x5555d555, 0x55555555, 0x55555555,
+    0x55555555, 0x5555f55d, 0x55555555, 0x55555555, 0x55555555, 0x03d55555,
+    0x55555555, 0xfd555555, 0x55555555, 0xfff55555, 0x55555555, 0x55555555,
+    0x55555555, 0x55555555, 0x55555555, 0xf555f555, 0x55555555, 0x55555555,
+    0x55555555, 0x55555555, 0x55555555, 0x55555555, 0x55555555, 0x55555555,
+    0x55555555, 0xfd555555, 0x55555555, 0x55555555, 0x55555555, 0x55555555,
+    0x55555555, 0xfffd5555, 0x55555555, 0x7ffff405, 0x55555555, 0xffffd505,
+    0x55555555, 0xffffff05, 0x5d555555, 0xffffff0d, 0x55555555, 0x55555555,
+    0x55555555, 0x50001055, 0x00014555, 0xf1555500, 0xfff55555, 0xfff55555,
+    0x00155555, 0xfff55555, 0x55555555, 0x55555555, 0x55555555, 0x55555555,
+    0x55555555, 0xfffd5555, 0x55554155, 0x55555555, 0xffd15555, 0x55555555,
+    0x55555555, 0x55555555, 0x55555555, 0xfffff555, 0x55555555, 0xd5555555,
+    0xff541540, 0xff015545, 0x555555fd, 0x55555555, 0xf5555555, 0xfffffd55,
+    0x55555555, 0x55555555, 0xff555555, 0x55555555, 0xfff55555, 0x5fd55555,
+    0x55555555, 0x55555555, 0x55555555, 0x5f141555, 0x55555555, 0x55555555,
+    0x55555555, 0xc0004555, 0x54000144, 0x3c000015, 0xfff55555, 0xfff55555,
+    0xf5555555, 0x00000000, 0xc0000000, 0xffffffff, 0xffffffff, 0xffffffff,
+    0x55555500, 0x55555555, 0x55555555, 0x54400455, 0x5d555545, 0x55555555,
+    0x00155555, 0x55555500, 0x55555550, 0x55555555, 0x50105005, 0x55555555,
+    0x55555555, 0x55555555, 0x11504555, 0x55ffff50, 0x55555555, 0x55555555,
+    0x00555555, 0x557f0500, 0x57f55555, 0x55555555, 0x55555555, 0x55555555,
+    0xffd55555, 0x55555555, 0x55555555, 0x57d55555, 0xffff5555, 0x00000040,
+    0x51540004, 0xffd05455, 0x55555555, 0x55555555, 0x55555555, 0x55555555,
+    0x55555555, 0x55555555, 0x55555555, 0x55555555, 0x55555555, 0x55555555,
+    0x55555555, 0x55555555, 0x00000000, 0x00000000, 0x00000000, 0x00000000,
+    0x55555555, 0xf555f555, 0x55555555, 0x55555555, 0xf555f555, 0x77775555,
+    0x55555555, 0xf5555555, 0x55555555, 0x55555555, 0x55555555, 0x55555d55,
+    0x55555d55, 0x57555f55, 0x55555555, 0xd5555d5f, 0x00155555, 0x55555555,
+    0x400f5555, 0x55555555, 0x55555555, 0x55555555, 0x00000c00, 0x555555f5,
+    0xd5555555, 0xfd555555, 0x55555555, 0x55555555, 0xfffffffd, 0x00000000,
+    0x00000000, 0xfffffffc, 0x55555555, 0x55555555, 0x55555555, 0x55555555,
+    0x55555555, 0x55555555, 0x55555555, 0x55555555, 0xff555555, 0x55555555,
+    0x55555555, 0x55555555, 0x55555555, 0x55555555, 0x55555555, 0x55555555,
+    0x55555555, 0x55a55555, 0x55695555, 0x55555555, 0x55555555, 0x55555555,
+    0x55555555, 0x55555555, 0x55555555, 0x55555555, 0x55555555, 0x55555555,
+    0x55555555, 0x55555555, 0x56a95555, 0x55555596, 0x55555555, 0x55555555,
+    0xfff55555, 0xffffffff, 0xffd55555, 0xffffffff, 0x55555555, 0x55555555,
+    0x55555555, 0x55555555, 0x55555555, 0x55555555, 0x55555555, 0x55555555,
+    0x55555555, 0x55555555, 0x55555555, 0x55555555, 0x55555555, 0x55555555,
+    0x55555555, 0x55555555, 0x55555555, 0x55555555, 0x55555555, 0x55555555,
+    0x55555555, 0x55555555, 0x55555555, 0x55555555, 0x55555555, 0x69555555,
+    0x55555555, 0x55555a55, 0x55555555, 0x5555aaaa, 0xaaaa5555, 0x555555aa,
+    0x55555555, 0x95555555, 0xaaa55555, 0x55555595, 0x55a55559, 0x69555555,
+    0x65555a55, 0x55555655, 0x55655555, 0x596559a5, 0x55a55955, 0x55555555,
+    0x55565555, 0x55555555, 0x66555555, 0x55559a95, 0x55555555, 0x55555555,
+    0x55555555, 0x5555a955, 0x55555555, 0x95555556, 0x55555555, 0x55555555,
+    0x55555555, 0x55555555, 0x55555555, 0x56955555, 0x55555555, 0x55555555,
+    0x55555555, 0x55555956, 0x55555555, 0x55555f55, 0x55555555, 0x55557555,
+    0x55555555, 0x55555555, 0x55555555, 0x55555555, 0x55555555, 0x55555555,
+    0x55555555, 0x55555555, 0x55555555, 0x55555555, 0x55555555, 0x55555555,
+    0x55555555, 0x55555555, 0x55555555, 0x55555555, 0x55555555, 0x55555555,
+    0x55555555, 0x55555555, 0x15555555, 0x5557ff50, 0x55555555, 0x55555555,
+    0xf7ff7555, 0x55555555, 0x55555555, 0x55555555, 0x7fff5555, 0x3ffffffd,
+    0x55555555, 0xffffd555, 0xd555d555, 0xd555d555, 0xd555d555, 0xd555d555,
+    0x00000000, 0x00000000, 0x55555555, 0x55555555, 0x55555555, 0x55555555,
+    0x55555555, 0xf5555555, 0xffffffff, 0xffffffff, 0xaaaaaaaa, 0xaabaaaaa,
+    0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xffffffaa,
+    0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa,
+    0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa,
+    0xaaaaaaaa, 0xfffffaaa, 0xffffffff, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa,
+    0xa00aaaaa, 0x6aaaaaaa, 0xaaaaaaab, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa,
+    0xaaaaaaaa, 0xaa83eaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa,
+    0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaabff, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaab,
+    0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaa8aa, 0xaaaaaaaa, 0xeaaaaaaa, 0xaaaaaaaa,
+    0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xbffffaaa, 0xaaaaaaaa,
+    0xaaaaaaaa, 0xeaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa,
+    0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa,
+    0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa,
+    0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa,
+    0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa,
+    0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa,
+    0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xfeaaaaaa, 0xaaaaaaaa,
+    0xaaaaaaaa, 0xaaaaaaaa, 0xffffeaaa, 0x55555555, 0x55555555, 0x55555555,
+    0x55555555, 0x55555555, 0xff555555, 0xffffffff, 0x55555555, 0x55555555,
+    0x15555555, 0x50000040, 0x55555555, 0x05555555, 0x55555555, 0x55555555,
+    0x55555555, 0x55555555, 0x55555555, 0xffff5550, 0x55555555, 0x55555555,
+    0x55555555, 0x55555555, 0x55555555, 0x55555555, 0x55555555, 0x55555555,
+    0x55555555, 0x55555555, 0x55555555, 0x55555555, 0xf5555555, 0xfd555775,
+    0xffffffff, 0x5555555f, 0x55154545, 0x55555555, 0xfc554155, 0xfff55555,
+    0x55555555, 0x55555555, 0x55555555, 0xffff5555, 0x55555555, 0x55555555,
+    0x55555555, 0x55555555, 0x5ffff055, 0xfff55555, 0x00000000, 0x15555550,
+    0x55555555, 0x55555555, 0x50000555, 0x55555555, 0x00001555, 0x7fffff50,
+    0xaaaaaaaa, 0xfeaaaaaa, 0x55555540, 0x55555555, 0x55555555, 0x50500515,
+    0x75555555, 0x5ff55555, 0x55555155, 0xd5555555, 0x55555555, 0x55555555,
+    0x40015555, 0xffffc141, 0xf4555515, 0x55f55555, 0x55555555, 0x54555555,
+    0x55555555, 0x55555555, 0x55555555, 0x05541404, 0xffffffd1, 0x557fffff,
+    0x50555555, 0xffffc555, 0xd557d557, 0xffffd557, 0xd555d555, 0x55555555,
+    0x55555555, 0x55555555, 0xff555555, 0x55555555, 0x55555555, 0x55555555,
+    0x55555555, 0x55555555, 0x55555555, 0x55555555, 0xf1545155, 0xfff55555,
+    0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa,
+    0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xffffffaa, 0x00000000,
+    0x003fc000, 0x00000000, 0x00000000, 0xff000000, 0xffffffff, 0xffffffff,
+    0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff,
+    0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff,
+    0xffffffff, 0xffffffff, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa,
+    0xaaaaaaaa, 0xaaaaaaaa, 0xfaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa,
+    0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xfffaaaaa, 0xffffffff, 0xffffffff,
+    0xffffd555, 0x47ff557f, 0x55555555, 0xdd55d555, 0x55555d75, 0x55555555,
+    0x55555555, 0x55555555, 0x55555555, 0x55555555, 0x55555555, 0x55555555,
+    0xffffffd5, 0x5555557f, 0x55555555, 0x55555555, 0x55555555, 0x55555555,
+    0x55555555, 0x55555555, 0x55555555, 0x55555555, 0x55555555, 0x55555555,
+    0x55555555, 0x5555555f, 0x55555555, 0x55555555, 0x7fff5555, 0xffffffff,
+    0xffffffff, 0x55555555, 0x00000000, 0xfffaaaaa, 0x00000000, 0xaaaaaaaa,
+    0xaaaaaaaa, 0xaaaaaaea, 0xffaaeaaa, 0x55555d55, 0x55555555, 0x55555555,
+    0x55555555, 0x55555555, 0x55555555, 0x55555555, 0x55555555, 0x3d555555,
+    0xaaaaaaab, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa,
+    0x55555556, 0x55555555, 0x55555555, 0x55555555, 0x55555554, 0xd5555555,
+    0x555f555f, 0xfd5f555f, 0xd555eaaa, 0xf557ffff, 0x57555555, 0x55555555,
+    0x5555d555, 0x75d55555, 0xf5555555, 0xf5555555, 0xffffffff, 0xffffffff,
+    0x55555555, 0x55555555, 0x55555555, 0x55555555, 0x55555555, 0x55555555,
+    0x55555555, 0xffd55555, 0x55557fd5, 0x55555555, 0x55555555, 0x55557f55,
+    0x55555555, 0x55555555, 0x55555555, 0x55555555, 0xd5555555, 0xfd555555,
+    0xfffffffd, 0xffffffff, 0xffffffff, 0x55555555, 0x55555555, 0xf1555555,
+    0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff,
+    0xffffffff, 0xffffffff, 0x55555555, 0xfd555555, 0x55555555, 0x55555555,
+    0x55555555, 0xfffffffd, 0x55555554, 0xff555555, 0x55555555, 0x55555555,
+    0x57ffff55, 0x55555555, 0xffd55555, 0x55555555, 0x55555555, 0xffc00555,
+    0x55555555, 0x75555555, 0x55555555, 0x55555555, 0x5555ff55, 0xfffff555,
+    0xffffffff, 0xffffffff, 0x55555555, 0x55555555, 0x55555555, 0x55555555,
+    0x55555555, 0x55555555, 0x55555555, 0x55555555, 0x55555555, 0xf5555555,
+    0xfff55555, 0x55555555, 0x55555555, 0x5555ff55, 0x55555555, 0xff555555,
+    0x55555555, 0x55555555, 0xffff5555, 0x55555555, 0x55555555, 0x55555555,
+    0x7fffff55, 0x55d55555, 0x55d55555, 0x555575d5, 0x55555575, 0xfd755575,
+    0x55555555, 0x55555555, 0x55555555, 0xffffff55, 0x55555555, 0x55555555,
+    0x55555555, 0xffffd555, 0x55555555, 0xfffff555, 0xffff5555, 0xffffffff,
+    0x55557555, 0x55555555, 0x55555555, 0xffd5555d, 0xffffffff, 0xffffffff,
+    0xffffffff, 0xffffffff, 0x555df555, 0x55555555, 0x55555555, 0x7dfd7555,
+    0x55555555, 0x55557555, 0x55555555, 0x55555555, 0x55555555, 0xd5555555,
+    0x55557fff, 0xffffffff, 0xffffffff, 0xffffffff, 0x55555555, 0x557ff5d5,
+    0x55555555, 0x7f555555, 0x55555555, 0x7ff55555, 0xffffffff, 0xffffffff,
+    0xffffffff, 0xffffffff, 0x55555555, 0x55555555, 0x55555555, 0x55ff5555,
+    0x55555555, 0x5555555f, 0x55555555, 0x55555555, 0x00ffc301, 0x55575755,
+    0x55555555, 0x3fc0f555, 0xfffd5555, 0xfffd5555, 0x55555555, 0x55555555,
+    0x55555555, 0x55555555, 0xffffffff, 0xffffffff, 0x55555555, 0x55555555,
+    0x557fc155, 0xffffd555, 0x55555555, 0x55555555, 0x55555555, 0x5557f555,
+    0x55555555, 0x5555f555, 0x55555555, 0x5555ffd5, 0x55555555, 0xfd57fff5,
+    0x5557ffff, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff,
+    0x55555555, 0x55555555, 0x55555555, 0x55555555, 0xfffd5555, 0xffffffff,
+    0xffffffff, 0xffffffff, 0x55555555, 0x55555555, 0x55555555, 0xffffffd5,
+    0x55555555, 0x55555555, 0x55555555, 0x555fffd5, 0x55555555, 0x55555555,
+    0xffff0055, 0xfff55555, 0x55555555, 0x55555555, 0x5003f555, 0x55555555,
+    0x5ffff555, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff,
+    0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff,
+    0xffffffff, 0xffffffff, 0x55555555, 0xd5555555, 0x55555555, 0x55555555,
+    0xf4355555, 0xfffffff5, 0xfffffd5f, 0xffffffff, 0xffffffff, 0x00ffffff,
+    0x55555555, 0x55555555, 0xffff5555, 0x55555555, 0x00000555, 0xfff55554,
+    0xffffffff, 0x55555555, 0xfff55005, 0xffffffff, 0xffffffff, 0x55555555,
+    0xff555555, 0xffffffff, 0x55555555, 0xffffd555, 0x55555551, 0x55555555,
+    0x55555555, 0x00005555, 0xf5554000, 0x5555555f, 0x55555555, 0x3ffff414,
+    0x55555550, 0x55555555, 0x55555555, 0x55414015, 0xf7ffffc5, 0x55555555,
+    0xfffd5555, 0xfff55555, 0x55555540, 0x55555555, 0x01001555, 0x55555c00,
+    0xffff5555, 0x55555555, 0x55555555, 0xffffd515, 0x55555550, 0x55555555,
+    0x55555555, 0x40000555, 0x14015555, 0x55555555, 0x55555557, 0xfffffd55,
+    0x55555555, 0x55555575, 0x15555555, 0x45550450, 0xfffffff1, 0xffffffff,
+    0xffffffff, 0xffffffff, 0x755dd555, 0x75555555, 0xfff55555, 0x55555555,
+    0x55555555, 0x15555555, 0xffc00015, 0xfff55555, 0x7d555750, 0x5555557d,
+    0x555d5555, 0x5435575d, 0xf57d7d54, 0x57ff7ffd, 0xfc000f55, 0xfffffc00,
+    0xdf755555, 0x55555555, 0x55555555, 0x00157555, 0x45d577dc, 0xfffd7544,
+    0xffffffc3, 0xffffffff, 0x55555555, 0x55555555, 0x55555555, 0x00005555,
+    0x55554405, 0x47555555, 0xfffffff5, 0xffffffff, 0x55555555, 0x55555555,
+    0x55555555, 0x15440015, 0xffff5504, 0xfff55555, 0xffffffff, 0xffffffff,
+    0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff,
+    0xffffffff, 0xffffffff, 0x55555555, 0x55555555, 0x55555555, 0x1055f005,
+    0x55555554, 0xf0555555, 0xffffffff, 0xffffffff, 0x55555555, 0x55555555,
+    0x55555555, 0x11400015, 0xfffffd54, 0xfff55555, 0xfd555555, 0xffffffff,
+    0x55555555, 0x55555555, 0x51155555, 0xfff51000, 0xfff55555, 0x55555555,
+    0xffffff55, 0xffffffff, 0x55555555, 0x13d55555, 0xff001005, 0x55555555,
+    0xffffd555, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff,
+    0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff,
+    0x55555555, 0x55555555, 0x15555555, 0xff410000, 0xffffffff, 0xffffffff,
+    0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0x55555555, 0x55555555,
+    0x55555555, 0x55555555, 0x55555555, 0x7fffffd5, 0x55f7d555, 0x5555d755,
+    0x55555555, 0x443d7555, 0xffffd515, 0xfff55555, 0xffffffff, 0xffffffff,
+    0xffffffff, 0xffffffff, 0x555f5555, 0x55555555, 0x55555555, 0x550f0055,
+    0xfffffd54, 0xffffffff, 0x55400001, 0x55555555, 0x55555555, 0x40140015,
+    0xffff1555, 0x55014001, 0x55555555, 0x55555555, 0x00055555, 0x55504000,
+    0xffffffd5, 0x55555555, 0x55555555, 0x55555555, 0x55555555, 0xfffd5555,
+    0xfff55555, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff,
+    0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff,
+    0x55555555, 0x55555555, 0xfffffff5, 0xfff55555, 0x555d5555, 0x55555555,
+    0x55555555, 0x1000c000, 0xfffff555, 0x55555555, 0xfd555555, 0x55555555,
+    0x55555555, 0x0000000f, 0x00070000, 0xffffc104, 0xffffffff, 0xffffffff,
+    0xffffffff, 0xffffffff, 0x5575d555, 0x55555555, 0x55555555, 0x30cfc001,
+    0xffff1000, 0xfff55555, 0x555d7555, 0x55555555, 0xd5555555, 0xfffd1170,
+    0xfff55555, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff,
+    0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff,
+    0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff,
+    0xffffffff, 0xffffffff, 0x55555555, 0xfffd5415, 0x55555550, 0x5555555d,
+    0x55555555, 0x5fc00555, 0x55555544, 0xffc55555, 0xffffffff, 0xffffffff,
+    0xffffffff, 0xffffffff, 0xffffffff, 0xfffffffd, 0x55555555, 0x55555555,
+    0x55555555, 0x7ffffff5, 0x55555555, 0x55555555, 0x55555555, 0x55555555,
+    0x55555555, 0x55555555, 0x55555555, 0x55555555, 0x55555555, 0xfff55555,
+    0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff,
+    0x55555555, 0x55555555, 0x55555555, 0x55555555, 0x55555555, 0x55555555,
+    0xd5555555, 0xfffffd55, 0x55555555, 0x55555555, 0x55555555, 0x55555555,
+    0x55555555, 0x55555555, 0x55555555, 0x55555555, 0x55555555, 0x55555555,
+    0x55555555, 0x55555555, 0xffffff55, 0xffffffff, 0xffffffff, 0xffffffff,
+    0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff,
+    0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff,
+    0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0x55555555,
+    0x55555555, 0x55555555, 0x55555555, 0x55555555, 0x55555555, 0xffffffd5,
+    0x55555555, 0x55555555, 0x55555555, 0x55555555, 0x00001554, 0xfffff000,
+    0x55555555, 0x55555555, 0x55555555, 0x55555555, 0x55555555, 0x55555555,
+    0x55555555, 0x55555555, 0x55555555, 0x55555555, 0x55555555, 0x55555555,
+    0x55555555, 0x55555555, 0x55555555, 0x55555555, 0x55555555, 0x55555555,
+    0x55555555, 0x55555555, 0x55555555, 0x55555555, 0x55555555, 0x55555555,
+    0x55555555, 0xffd55555, 0x55555555, 0x55555555, 0x55555555, 0x55555555,
+    0xffffd555, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff,
+    0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff,
+    0x55555555, 0x05555555, 0x01500000, 0xfff55555, 0xffffffff, 0xffffffff,
+    0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff,
+    0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0x55555555, 0x55555555,
+    0x55555555, 0xfffd5555, 0x55555555, 0xd5555555, 0x5ff55555, 0x55555555,
+    0x55555555, 0x55555555, 0x55555555, 0xd5555555, 0xfff55555, 0x55555555,
+    0xf5555555, 0xfffff400, 0x55555555, 0x55555555, 0x55555555, 0x55554000,
+    0xfffff555, 0x55755555, 0x55555575, 0x57ff5555, 0x55555555, 0xffffffff,
+    0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff,
+    0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0x55555555, 0x55555555,
+    0x55555555, 0xfff55555, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff,
+    0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff,
+    0xffffffff, 0xffffffff, 0x55555555, 0x55555555, 0x55555555, 0x55555555,
+    0x55555555, 0xffd55555, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff,
+    0xffffffff, 0xffffffff, 0x55555555, 0x55555555, 0x55555555, 0x55555555,
+    0x3fd55555, 0x55555555, 0x55555555, 0x55555555, 0x3fff5555, 0x55555540,
+    0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0xfffffcaa, 0xfffffffa,
+    0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa,
+    0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa,
+    0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xffffaaaa, 0xaaaaaaaa, 0xaaaaaaaa,
+    0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa,
+    0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xfffffaaa,
+    0xffffffff, 0xbfffffff, 0xfffeaaaa, 0xffffffff, 0xffffffff, 0xffffffff,
+    0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff,
+    0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff,
+    0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff,
+    0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff,
+    0xffffffff, 0xffffffff, 0xffffffff, 0xebaaabaa, 0xaaaaaaaa, 0xaaaaaaaa,
+    0xffffffea, 0xffffffef, 0xffffffff, 0xfffffbea, 0xffffaaff, 0xaaaaaaaa,
+    0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa,
+    0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa,
+    0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa,
+    0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xffaaaaaa,
+    0x55555555, 0x55555555, 0x55555555, 0x55555555, 0x55555555, 0x55555555,
+    0xffd55555, 0xfd555555, 0xfffd5555, 0x41f55555, 0xffffff00, 0xffffffff,
+    0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0x55555555, 0x55555555,
+    0x55555555, 0x55555555, 0x55555555, 0x55555555, 0x55555555, 0x55555555,
+    0x55555555, 0x55555555, 0x55555555, 0x55555555, 0x55555555, 0x55555555,
+    0x55555555, 0xfff55555, 0x55555555, 0x55555555, 0x55555555, 0x55555555,
+    0x55555555, 0x55555555, 0x55555555, 0x55555555, 0x55555555, 0x55555555,
+    0x55555555, 0xffffff55, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff,
+    0x00000000, 0x00000000, 0xf0000000, 0x00000000, 0xffffc000, 0x55555555,
+    0x55555555, 0x55555555, 0x55555555, 0x55555555, 0x55555555, 0x55555555,
+    0xffffff55, 0xffffffff, 0xffffffff, 0xffffffff, 0x55555555, 0x55555555,
+    0x55555555, 0x55555555, 0x55555555, 0x55555555, 0x55555555, 0x55555555,
+    0x55555555, 0x55555555, 0x55555555, 0x55555555, 0x55555555, 0x55555555,
+    0x55555555, 0xfffff555, 0x55555555, 0x55555555, 0x5557d555, 0x55555555,
+    0x55555555, 0x55555555, 0x55501555, 0x00000015, 0x55000140, 0x55555555,
+    0x50055555, 0x55555555, 0x55555555, 0x55555555, 0xffd55555, 0xffffffff,
+    0x55555555, 0x55555555, 0x55555555, 0x55555555, 0xfffff405, 0xffffffff,
+    0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff,
+    0x55555555, 0xffffff55, 0x55555555, 0xffffff55, 0xaaaaaaaa, 0xaaaaaaaa,
+    0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xffffeaaa, 0xaaaaaaaa, 0xfffd6aaa,
+    0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff,
+    0xffffffff, 0xffffffff, 0x55555555, 0x55555555, 0x55555555, 0x55555555,
+    0x55555555, 0x55555d55, 0x55555555, 0x55555555, 0x55555555, 0x5d555555,
+    0x5d57d7df, 0x57755555, 0x55555755, 0x55555555, 0x55555555, 0x55555555,
+    0x57d57555, 0x5d555d55, 0x55555555, 0xd5755555, 0x555fdd55, 0x5555555d,
+    0x55555555, 0x55555555, 0x55555555, 0x55555555, 0x55555555, 0x55555555,
+    0x55555555, 0x55555555, 0x55555555, 0x55555555, 0x55555555, 0x55555555,
+    0x55555555, 0x55555555, 0x55555555, 0x55555555, 0x55555555, 0x55555555,
+    0x55555555, 0x55555555, 0x5555f555, 0x55555555, 0x55555555, 0x55555555,
+    0x55555555, 0x55555555, 0x55555555, 0x55555555, 0x55555555, 0x55555555,
+    0x55555555, 0x55555555, 0x55555555, 0x55555555, 0x55555555, 0x55555555,
+    0x55555555, 0x55555555, 0x5f555555, 0x55555555, 0x55555555, 0x55555555,
+    0x00000000, 0x00000000, 0x00000000, 0x00154000, 0x00000000, 0x00000000,
+    0x54000000, 0x55555155, 0xff555455, 0x003fffff, 0x00000003, 0xffffffff,
+    0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0x55555555, 0xd5555555,
+    0xffd557ff, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff,
+    0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff,
+    0xffffffff, 0xffffffff, 0x0000c000, 0x003c0000, 0xffc00c30, 0x55555555,
+    0x55555555, 0x55555555, 0xf5555555, 0xffffffff, 0x3fffffff, 0xffffffff,
+    0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff,
+    0x55555555, 0x55555555, 0xfd555555, 0xf5554000, 0x5ff55555, 0xffffffff,
+    0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff,
+    0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff,
+    0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff,
+    0xffffffff, 0x55555555, 0xc5555555, 0xffffffff, 0x55555555, 0x55555555,
+    0x00555555, 0x7ff55555, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff,
+    0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff,
+    0xffffffff, 0xffffffff, 0xffffffff, 0x55555555, 0x00555555, 0xfff55555,
+    0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff,
+    0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff,
+    0xffffffff, 0x55555555, 0x05555555, 0x7fd55555, 0xffffffff, 0xffffffff,
+    0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff,
+    0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff,
+    0xd755d555, 0xd5555555, 0x55555555, 0x55555555, 0x55555555, 0x55555555,
+    0x55555555, 0x55555555, 0x55555555, 0x55555555, 0x55555555, 0x55555555,
+    0x55555555, 0x55555555, 0x55557d55, 0xffffc000, 0xffffffff, 0xffffffff,
+    0x55555555, 0x55555555, 0x55555555, 0x55555555, 0xff400055, 0x5ff55555,
+    0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff,
+    0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff,
+    0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0x55555557,
+    0x55555555, 0x55555555, 0x55555555, 0xfffffd55, 0xffffffff, 0xffffffff,
+    0xffffffff, 0xffffffff, 0x55555557, 0x55555555, 0x55555555, 0xf5555555,
+    0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff,
+    0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff,
+    0x55555755, 0x55555555, 0x55577dd7, 0xff7755d5, 0x57777fdf, 0x77777dd7,
+    0x55d57dd7, 0xdd5755d5, 0x55755555, 0xff555555, 0x55755757, 0xff555555,
+    0xffffffff, 0xffffffff, 0xffffffff, 0xfffffff5, 0x55555655, 0x55555555,
+    0xff555555, 0x55555555, 0x55555555, 0x55555555, 0x55555555, 0x55555555,
+    0x55555555, 0xffffff55, 0xd5555555, 0x55555557, 0x95555557, 0x55555557,
+    0x55555555, 0xfffff555, 0x55555555, 0x55555555, 0x55555555, 0x55555555,
+    0x55555555, 0x55555555, 0x55555555, 0x55555555, 0x65555555, 0x556aaaa9,
+    0xf5555555, 0xffffffff, 0xffffffff, 0xffffffff, 0x55555fff, 0x55555555,
+    0xffffffea, 0xaaaaaaaa, 0xaaaaaaaa, 0xffaaaaaa, 0xfffeaaaa, 0xfffffffa,
+    0xfffffaaa, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff,
+    0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0xaaaaaaaa, 0xaaaaaaaa,
+    0xa9555556, 0xaaaa9aaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xa6aaaaaa,
+    0xaaaaaaaa, 0x555555aa, 0xaaaaaaaa, 0xaaaaaaaa, 0x956aaaaa, 0x555555aa,
+    0xaaaaaaaa, 0xaaaa5656, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0x6aaaaaaa,
+    0xaaaaaaa6, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa,
+    0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0x96aaaaaa,
+    0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0x5aaaaaaa, 0x6a955555, 0xaaaaaaaa,
+    0x5555aaaa, 0x55655555, 0x55555555, 0x55556955, 0x55555655, 0x55555555,
+    0x55555555, 0x55555555, 0x55555555, 0xaa955555, 0xaaaaaaaa, 0xaaaaaaaa,
+    0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0x55555555, 0x55555555, 0x55555555,
+    0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0x56555aaa, 0xaaffa96a,
+    0xfe955555, 0xfeaaaa55, 0x55555555, 0x55555555, 0x55555555, 0x55555555,
+    0x55555555, 0x55555555, 0x55555555, 0x557fd555, 0x55555555, 0x55555555,
+    0x55555555, 0x55555555, 0x55555555, 0xfff55555, 0xffaaaaaa, 0xfffffffe,
+    0xff555555, 0x55555555, 0x55555555, 0x55555555, 0xffff5555, 0xfff55555,
+    0x55555555, 0x55555555, 0xffff5555, 0x55555555, 0xf5555555, 0xff555555,
+    0xfffffff5, 0xffffffff, 0xffffffff, 0xffffffff, 0xaa555555, 0xaaaaaaaa,
+    0xaaaaaaaa, 0xaa6aaaaa, 0xaaaa9aaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa,
+    0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa,
+    0xaaaaaaaa, 0xaaaaaaaa, 0x55555555, 0x55555555, 0x55555555, 0x55555555,
+    0x55555555, 0xffffff55, 0xf5555555, 0xfeaaaaaa, 0xbffaaaaa, 0xaaaaaaaa,
+    0xaaaaaaaa, 0xaaaaaaaa, 0xafffeaaa, 0xbeaaaaaa, 0xfffaaaaa, 0xfffeaaaa,
+    0x55555555, 0x55555555, 0x55555555, 0x55555555, 0x55555555, 0x55555555,
+    0x55555555, 0x55555555, 0x55555555, 0x555555d5, 0x55555555, 0x55555555,
+    0x55555555, 0x55555555, 0x55555555, 0xfff55555, 0xaaaaaaaa, 0xaaaaaaaa,
+    0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa,
+    0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa,
+    0xffffffff, 0xffffffff, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xfffaaaaa,
+    0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa,
+    0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa,
+    0xaaaaaaaa, 0xfaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa,
+    0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa,
+    0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa,
+    0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa,
+    0xaaaaaaaa, 0xaaaaaaaa, 0xfffffffa, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa,
+    0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa,
+    0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa,
+    0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xfffffffe, 0xaaaaaaaa,
+    0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xfaaaaaaa,
+    0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff,
+    0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0xaaaaaaaa, 0xfaaaaaaa,
+    0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff,
+    0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff,
+    0xffffffff, 0xffffffff, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa,
+    0xffeaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa,
+    0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa,
+    0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa,
+    0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xaaaaaaaa, 0xffffffff,
+    0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff,
+};
+/* END codegen wcwidth */
+// clang-format on
 #endif // ifndef TB_OPT_LIBC_WCHAR
 
 static int tb_reset(void);
@@ -2275,11 +3173,13 @@ static int tb_printf_inner(int x, int y, uintattr_t fg, uintattr_t bg,
     size_t *out_w, const char *fmt, va_list vl);
 static int init_term_attrs(void);
 static int init_term_caps(void);
+static int caps_are_sgr(void);
 static int init_cap_trie(void);
 static int cap_trie_add(const char *cap, uint16_t key, uint8_t mod);
-static int cap_trie_find(const char *buf, size_t nbuf, struct cap_trie **last,
+static int cap_trie_find(const char *buf, size_t nbuf,
+    struct cap_trie_node **last,
     size_t *depth);
-static int cap_trie_deinit(struct cap_trie *node);
+static int cap_trie_deinit(struct cap_trie *t);
 static int init_resize_handler(void);
 static int send_init_escape_codes(void);
 static int send_clear(void);
@@ -2287,6 +3187,8 @@ static int update_term_size(void);
 static int update_term_size_via_esc(void);
 static int init_cellbuf(void);
 static int tb_deinit(void);
+static int tb_deinit_to(struct bytebuf *rest);
+static int set_output_nonblock(int nonblock);
 static int load_terminfo(void);
 static int load_terminfo_from_path(const char *path, const char *term);
 static int read_terminfo_path(const char *path);
@@ -2295,7 +3197,8 @@ static int load_builtin_caps(void);
 static const char *get_terminfo_string(int16_t offsets_pos, int16_t offsets_len,
     int16_t table_pos, int16_t table_size, int16_t index);
 static int get_terminfo_int16(int offset, int16_t *val);
-static int wait_event(struct tb_event *event, int timeout);
+static int wait_event(struct tb_event *event, int timeout,
+    struct pollfd *extra, size_t nextra);
 static int extract_event(struct tb_event *event);
 static int extract_esc(struct tb_event *event);
 static int extract_esc_user(struct tb_event *event, int is_post);
@@ -2306,22 +3209,79 @@ static void handle_resize(int sig);
 static int send_attr(uintattr_t fg, uintattr_t bg);
 static int send_sgr(uint32_t fg, uint32_t bg, int fg_is_default,
     int bg_is_default);
+static int send_sgr_delta(uintattr_t fg, uintattr_t bg);
+static size_t sgr_put_delta(char *buf, size_t n, uintattr_t fg, uintattr_t bg,
+    int from_last);
+static uintattr_t sgr_flags(uintattr_t fg, uintattr_t bg);
+static size_t sgr_put_color(char *buf, size_t n, uint32_t c, int is_bg);
+static size_t sgr_put(char *buf, size_t n, uint32_t num);
+static uint32_t attr_color(uintattr_t attr, int is_bg);
+static int attr_is_default(uintattr_t attr);
 static int send_cursor_if(int x, int y);
+static int send_move(int x, int y);
+static int send_motion(int cx, int cy, int x, int y, int dry, int *cost);
+static int rewrite_cost(int x0, int x1, int y, int limit);
+static int csi_cost(int n);
+static int send_csi(int n, const char *final);
 static int send_char(int x, int y, uint32_t ch);
 static int send_cluster(int x, int y, uint32_t *ch, size_t nch);
+#ifndef TB_OPT_NO_RLE
+static int send_run(int x, int y, int *n);
+static int run_is_erasable(uintattr_t fg, uintattr_t bg);
+#endif
+#ifndef TB_OPT_NO_SCROLL
+static int find_scroll(int *n, int *top, int *bot);
+static void update_front_hash(int y);
+static int send_scroll(int n, int top, int bot);
+#endif
 static int convert_num(uint32_t num, char *buf);
 static int cell_cmp(struct tb_cell *a, struct tb_cell *b);
+static int cell_width(struct tb_cell *cell);
+static int front_row_head(int y, int x);
+#ifdef TB_OPT_SOA
+#ifdef TB_OPT_EGC
+static struct cellbuf_egc *cellbuf_egc_probe(struct cellbuf *c, uint32_t idx);
+static int cellbuf_egc_insert(struct cellbuf *c, uint32_t idx,
+    struct cellbuf_egc **out);
+static int cellbuf_egc_reserve(struct cellbuf_egc *e, size_t n);
+static int cellbuf_egc_remove(struct cellbuf *c, uint32_t idx);
+static int cellbuf_egc_clear(struct cellbuf *c);
+#endif
+static int cellbuf_cell_maybe_differs(size_t i);
+static int cellbuf_block_maybe_differs(size_t i);
+#else
+static int cell_maybe_differs(const struct tb_cell *a, const struct tb_cell *b);
 static int cell_copy(struct tb_cell *dst, struct tb_cell *src);
 static int cell_set(struct tb_cell *cell, uint32_t *ch, size_t nch,
     uintattr_t fg, uintattr_t bg);
 static int cell_reserve_ech(struct tb_cell *cell, size_t n);
 static int cell_free(struct tb_cell *cell);
+#endif
+static int cellbuf_row_span(int y, int *first, int *last);
 static int cellbuf_init(struct cellbuf *c, int w, int h);
 static int cellbuf_free(struct cellbuf *c);
 static int cellbuf_clear(struct cellbuf *c);
 static int cellbuf_get(struct cellbuf *c, int x, int y, struct tb_cell **out);
+static int cellbuf_put(struct cellbuf *c, int x, int y, uint32_t *ch,
+    size_t nch, uintattr_t fg, uintattr_t bg);
+static int cellbuf_put_cell(struct cellbuf *c, int x, int y,
+    struct tb_cell *src);
+#ifdef TB_OPT_EGC
+static int cellbuf_extend(struct cellbuf *c, int x, int y, uint32_t ch);
+#endif
 static int cellbuf_in_bounds(struct cellbuf *c, int x, int y);
+#ifndef TB_OPT_NO_SCROLL
+static uint64_t cellbuf_row_hash(struct cellbuf *c, int y);
+static int cellbuf_row_eq(struct cellbuf *a, int ay, struct cellbuf *b, int by);
+static int cellbuf_scroll(struct cellbuf *c, int top, int bot, int n);
+#endif
+static int cellbuf_mark_dirty(struct cellbuf *c, int y, int n);
 static int cellbuf_resize(struct cellbuf *c, int w, int h);
+static int cellbuf_blank(struct cellbuf *c, size_t i, size_t n,
+    uintattr_t fg, uintattr_t bg);
+static int cellbuf_shift(struct cellbuf *c, size_t i, size_t n, int d,
+    uintattr_t fg, uintattr_t bg);
+static int cellbuf_unsplit(struct cellbuf *c, int x, int y, int whole);
 static int bytebuf_puts(struct bytebuf *b, const char *str);
 static int bytebuf_nputs(struct bytebuf *b, const char *str, size_t nstr);
 static int bytebuf_shift(struct bytebuf *b, size_t n);
@@ -2375,12 +3335,320 @@ int tb_init_rwfd(int rfd, int wfd) {
     return rv;
 }
 
+int tb_init_memory(int w, int h) {
+    int rv;
+
+    if (global.initialized) return TB_ERR_INIT_ALREADY;
+    if (w < 1 || h < 1) return TB_ERR_OUT_OF_BOUNDS;
+
+    tb_reset();
+
+    do {
+        if (init_term_caps() != TB_OK) {
+            // `TERM` describes the host, not whoever reads the output
+            memcpy(global.caps, xterm_caps, sizeof(global.caps));
+            global.term_features = caps_are_sgr() ? TB_TERM_SGR : 0;
+            global.term_features |= TB_TERM_XTERM;
+        }
+        if_err_break(rv, init_cap_trie());
+        if_err_break(rv, send_init_escape_codes());
+        if_err_break(rv, send_clear());
+        global.width = w;
+        global.height = h;
+        if_err_break(rv, init_cellbuf());
+        global.initialized = 1;
+    } while (0);
+
+    if (rv != TB_OK) tb_deinit();
+
+    return rv;
+}
+
 int tb_shutdown(void) {
     if_not_init_return();
     tb_deinit();
     return TB_OK;
 }
 
+int tb_shutdown_output(char **buf, size_t *nbuf) {
+    struct bytebuf rest = {0};
+    if_not_init_return();
+    tb_deinit_to(&rest);
+    *buf = rest.buf;
+    *nbuf = rest.len;
+    return TB_OK;
+}
+
+int tb_take_output(const char **buf, size_t *nbuf) {
+    if_not_init_return();
+    *buf = global.out.buf;
+    *nbuf = global.out.len;
+    global.out.len = 0;
+    return TB_OK;
+}
+
+int tb_swap_output(char **buf, size_t *nbuf, size_t *cap) {
+    if_not_init_return();
+    struct bytebuf old = global.out;
+    global.out.buf = *buf;
+    global.out.cap = *buf ? *cap : 0;
+    global.out.len = 0;
+    *buf = old.buf;
+    *nbuf = old.len;
+    *cap = old.cap;
+    return TB_OK;
+}
+
+int tb_resize(int w, int h) {
+    int rv;
+    if_not_init_return();
+    if (w < 1 || h < 1) return TB_ERR_OUT_OF_BOUNDS;
+    global.width = w;
+    global.height = h;
+    if_err_return(rv, resize_cellbufs());
+    return TB_OK;
+}
+
+struct tb_context *tb_context_new(void) {
+    struct tb_context *ctx = (struct tb_context *)tb_malloc(sizeof(*ctx));
+    if (!ctx) return NULL;
+    struct tb_global *prev = tb_cur;
+    tb_cur = &ctx->g;
+    global.ttyfd_open = 0;
+    tb_reset();
+    tb_cur = prev;
+    return ctx;
+}
+
+struct tb_context *tb_context_set(struct tb_context *ctx) {
+    struct tb_global *prev = tb_cur;
+    tb_cur = ctx ? &ctx->g : &tb_default_context.g;
+    if (prev == &tb_default_context.g) return NULL;
+    return (struct tb_context *)prev;
+}
+
+void tb_context_free(struct tb_context *ctx) {
+    if (!ctx) return;
+    struct tb_global *prev = tb_cur;
+    tb_cur = &ctx->g;
+    if (global.initialized) tb_deinit();
+    tb_cur = prev;
+    tb_free(ctx);
+}
+
+int tb_grid_new(int w, int h, struct tb_grid **out) {
+    int rv;
+    struct tb_grid *g;
+    *out = NULL;
+    if (w < 1 || h < 1) return TB_ERR_OUT_OF_BOUNDS;
+    g = (struct tb_grid *)tb_malloc(sizeof(*g));
+    if (!g) return TB_ERR_MEM;
+    memset(g, 0, sizeof(*g));
+    rv = cellbuf_init(&g->c, w, h);
+    if (rv == TB_OK) rv = cellbuf_blank(&g->c, 0, (size_t)w * h, 0, 0);
+    if (rv != TB_OK) {
+        tb_grid_free(g);
+        return rv;
+    }
+    *out = g;
+    return TB_OK;
+}
+
+void tb_grid_free(struct tb_grid *g) {
+    if (!g) return;
+    cellbuf_free(&g->c);
+    tb_free(g);
+}
+
+int tb_grid_resize(struct tb_grid *g, int w, int h, uintattr_t fg,
+    uintattr_t bg) {
+    int rv, x, y, minw, minh;
+    struct cellbuf next;
+    struct tb_cell *src;
+    if (w < 1 || h < 1) return TB_ERR_OUT_OF_BOUNDS;
+    if (w == g->c.width && h == g->c.height) return TB_OK;
+    memset(&next, 0, sizeof(next));
+    if_err_return(rv, cellbuf_init(&next, w, h));
+    rv = cellbuf_blank(&next, 0, (size_t)w * h, fg, bg);
+    minw = w < g->c.width ? w : g->c.width;
+    minh = h < g->c.height ? h : g->c.height;
+    for (y = 0; y < minh && rv == TB_OK; y++) {
+        for (x = 0; x < minw && rv == TB_OK; x++) {
+            cellbuf_get(&g->c, x, y, &src);
+            rv = cellbuf_put_cell(&next, x, y, src);
+        }
+        // A wide character cut off by the new right edge can't be shown
+        cellbuf_get(&next, minw - 1, y, &src);
+        if (rv == TB_OK && cell_width(src) > 1) {
+            rv = cellbuf_blank(&next, ((size_t)y * w) + minw - 1, 1, src->fg,
+                src->bg);
+        }
+    }
+    if (rv != TB_OK) {
+        cellbuf_free(&next);
+        return rv;
+    }
+    cellbuf_free(&g->c);
+    g->c = next;
+    return TB_OK;
+}
+
+int tb_grid_width(struct tb_grid *g) {
+    return g->c.width;
+}
+
+int tb_grid_height(struct tb_grid *g) {
+    return g->c.height;
+}
+
+int tb_grid_get_cell(struct tb_grid *g, int x, int y, struct tb_cell **cell) {
+    return cellbuf_get(&g->c, x, y, cell);
+}
+
+int tb_grid_print_n(struct tb_grid *g, int x, int y, uintattr_t fg,
+    uintattr_t bg, size_t *out_w, size_t *out_n, const char *str,
+    size_t nstr) {
+    struct cellbuf *c = &g->c;
+    int rv, w, i, x0 = x, x_prev = x - 1;
+    uint32_t uni, cont = 0;
+    struct tb_cell *cell;
+    const char *s = str, *end = str + nstr, *next;
+
+    if (out_w) *out_w = 0;
+    if (out_n) *out_n = 0;
+    if (!cellbuf_in_bounds(c, x, y)) return TB_ERR_OUT_OF_BOUNDS;
+    if_err_return(rv, cellbuf_unsplit(c, x, y, 1));
+
+    while (s < end) {
+        if (tb_utf8_char_length(*s) > end - s) {
+            rv = (int)(s - end); // sequence runs past `nstr`
+        } else {
+            rv = tb_utf8_char_to_unicode(&uni, s);
+        }
+        if (rv < 0) {
+            uni = 0xfffd; // replace invalid UTF-8 char with U+FFFD
+            next = s - rv;
+        } else if (rv > 0) {
+            next = s + rv;
+        } else {
+            uni = 0; // a NUL byte, replaced below
+            next = s + 1;
+        }
+
+        if (!tb_iswprint_ex(uni, &w)) {
+            uni = 0xfffd; // replace non-printable with U+FFFD
+            w = 1;
+        }
+
+        if (w == 0) { // combining character
+            if (x_prev < x0) {
+                // Belongs to the character before the print, which may be
+                // wide
+                for (x_prev = x0 - 1; x_prev > 0; x_prev--) {
+                    cellbuf_get(c, x_prev, y, &cell);
+                    if (cell->ch != 0) break;
+                }
+            }
+#ifdef TB_OPT_EGC
+            if (x_prev >= 0) {
+                if_err_return(rv, cellbuf_extend(c, x_prev, y, uni));
+            }
+#endif
+        } else {
+            if (x + w > c->width) break;
+            if_err_return(rv, cellbuf_put(c, x, y, &uni, 1, fg, bg));
+            for (i = 1; i < w; i++) {
+                if_err_return(rv, cellbuf_put(c, x + i, y, &cont, 1, fg, bg));
+            }
+            x_prev = x;
+            x += w;
+        }
+        s = next;
+    }
+
+    if (x > x0) {
+        if_err_return(rv, cellbuf_unsplit(c, x, y, 0));
+    }
+    cellbuf_mark_dirty(c, y, 1);
+    if (out_w) *out_w = (size_t)(x - x0);
+    if (out_n) *out_n = (size_t)(s - str);
+    return TB_OK;
+}
+
+int tb_grid_erase(struct tb_grid *g, int x, int y, size_t n, uintattr_t fg,
+    uintattr_t bg) {
+    struct cellbuf *c = &g->c;
+    int rv;
+    size_t i, total;
+    if (!cellbuf_in_bounds(c, x, y)) return TB_ERR_OUT_OF_BOUNDS;
+    i = ((size_t)y * c->width) + x;
+    total = (size_t)c->width * c->height;
+    if (n > total - i) n = total - i;
+    if (n == 0) return TB_OK;
+    if_err_return(rv, cellbuf_unsplit(c, x, y, 1));
+    if (i + n < total) {
+        if_err_return(rv, cellbuf_unsplit(c, (int)((i + n) % c->width),
+                              (int)((i + n) / c->width), 1));
+    }
+    if_err_return(rv, cellbuf_blank(c, i, n, fg, bg));
+    return cellbuf_mark_dirty(c, y, (int)((i + n - 1) / c->width) - y + 1);
+}
+
+int tb_grid_insert_cells(struct tb_grid *g, int x, int y, int n,
+    uintattr_t fg, uintattr_t bg) {
+    struct cellbuf *c = &g->c;
+    int rv;
+    struct tb_cell *cell;
+    if (!cellbuf_in_bounds(c, x, y)) return TB_ERR_OUT_OF_BOUNDS;
+    if (n > c->width - x) n = c->width - x;
+    if (n < 1) return TB_OK;
+    if_err_return(rv, cellbuf_unsplit(c, x, y, 1));
+    if_err_return(rv, cellbuf_shift(c, ((size_t)y * c->width) + x,
+                          (size_t)(c->width - x - n), n, fg, bg));
+    // A wide character pushed against the right edge lost its other half
+    cellbuf_get(c, c->width - 1, y, &cell);
+    if (cell_width(cell) > 1) {
+        if_err_return(rv, cellbuf_blank(c,
+                              ((size_t)y * c->width) + c->width - 1, 1,
+                              cell->fg, cell->bg));
+    }
+    return cellbuf_mark_dirty(c, y, 1);
+}
+
+int tb_grid_delete_cells(struct tb_grid *g, int x, int y, int n,
+    uintattr_t fg, uintattr_t bg) {
+    struct cellbuf *c = &g->c;
+    int rv;
+    if (!cellbuf_in_bounds(c, x, y)) return TB_ERR_OUT_OF_BOUNDS;
+    if (n > c->width - x) n = c->width - x;
+    if (n < 1) return TB_OK;
+    if_err_return(rv, cellbuf_unsplit(c, x, y, 1));
+    if_err_return(rv, cellbuf_unsplit(c, x + n, y, 1));
+    if_err_return(rv, cellbuf_shift(c, ((size_t)y * c->width) + x + n,
+                          (size_t)(c->width - x - n), -n, fg, bg));
+    return cellbuf_mark_dirty(c, y, 1);
+}
+
+int tb_grid_scroll(struct tb_grid *g, int top, int bot, int n, uintattr_t fg,
+    uintattr_t bg) {
+    struct cellbuf *c = &g->c;
+    int rv, rows = bot - top + 1;
+    size_t w = (size_t)c->width;
+    if (top < 0 || bot >= c->height || top > bot) {
+        return TB_ERR_OUT_OF_BOUNDS;
+    }
+    if (n > rows) n = rows;
+    if (n < -rows) n = -rows;
+    if (n > 0) {
+        if_err_return(rv, cellbuf_shift(c, (top + n) * w, (rows - n) * w,
+                              -n * c->width, fg, bg));
+    } else if (n < 0) {
+        if_err_return(rv, cellbuf_shift(c, top * w, (rows + n) * w,
+                              -n * c->width, fg, bg));
+    }
+    return cellbuf_mark_dirty(c, top, rows);
+}
+
 int tb_width(void) {
     if_not_init_return();
     return global.width;
@@ -2404,51 +3672,134 @@ int tb_set_clear_attrs(uintattr_t fg, uintattr_t bg) {
 }
 
 int tb_present(void) {
+    return tb_present_ex(NULL);
+}
+
+int tb_present_ex(struct tb_present_stats *stats) {
     if_not_init_return();
 
     int rv;
 
+    size_t ncells = 0, nspans = 0;
+
+    if (stats) memset(stats, 0, sizeof(*stats));
+
     // TODO: Assert global.back.(width,height) == global.front.(width,height)
 
+    if (global.cdamage < (size_t)global.front.height) {
+        struct tb_damage_span *damage = (struct tb_damage_span *)tb_realloc(
+            global.damage, sizeof(*damage) * global.front.height);
+        if (!damage) return TB_ERR_MEM;
+        global.damage = damage;
+        global.cdamage = global.front.height;
+    }
+
     global.last_x = -1;
     global.last_y = -1;
 
-    int x, y, i;
+#ifndef TB_OPT_NO_SCROLL
+    {
+        // Let the terminal move rows that only shifted vertically, then diff
+        // against the shifted front buffer
+        int n = 0, top = 0, bot = 0, row;
+        global.backhash_ok = 0;
+        if (find_scroll(&n, &top, &bot)) {
+            if_err_return(rv, send_scroll(n, top, bot));
+            if_err_return(rv, cellbuf_scroll(&global.front, top, bot, n));
+            // Moved rows now equal the back rows; the rest are repainted
+            for (row = top; row <= bot; row++) {
+                global.rowhash[global.front.height + row] = global.rowhash[row];
+            }
+            if_err_return(rv, cellbuf_mark_dirty(&global.back, top,
+                                  bot - top + 1));
+            if (stats) {
+                stats->scroll = n;
+                stats->scroll_top = top;
+                stats->scroll_bottom = bot;
+            }
+        }
+    }
+#endif
+
+    int x, y, i, xs, xe;
     for (y = 0; y < global.front.height; y++) {
-        for (x = 0; x < global.front.width;) {
+        int x0 = -1, x1 = -1;
+        if (!global.back.dirty[y]) continue;
+
+        // Narrow the row to the span that can differ, starting the walk at
+        // the head of any wide char that covers `xs`
+        if (!cellbuf_row_span(y, &xs, &xe)) {
+            global.back.dirty[y] = 0;
+            continue;
+        }
+
+        // A cell only goes into the front buffer once its output is queued,
+        // and the row stays dirty until all of it is, so a row cut short by
+        // an error is diffed again by the next present
+        for (x = front_row_head(y, xs); x <= xe;) {
             struct tb_cell *back, *front;
             if_err_return(rv, cellbuf_get(&global.back, x, y, &back));
             if_err_return(rv, cellbuf_get(&global.front, x, y, &front));
 
-            int w;
-            {
-#ifdef TB_OPT_EGC
-                if (back->nech > 0)
-                    w = tb_wcswidth(back->ech, back->nech);
-                else
+            int w = cell_width(back);
+
+            if (x >= xs && cell_cmp(back, front) != 0) {
+                if (x0 < 0) x0 = x;
+                x1 = x + w > global.front.width ? global.front.width : x + w;
+                ncells++;
+
+                if_err_return(rv, send_attr(back->fg, back->bg));
+#ifndef TB_OPT_NO_RLE
+                int run;
+                if_err_return(rv, send_run(x, y, &run));
+                // Fetch again, as `send_run` may have reused the cell view
+                if_err_return(rv, cellbuf_get(&global.back, x, y, &back));
+                if (run > 0) {
+                    if_err_return(rv,
+                        cellbuf_put_cell(&global.front, x, y, back));
+                    // The run may reach into cells that were already equal;
+                    // only those that weren't count as damage
+                    for (i = 1; i < run; i++) {
+                        if_err_return(rv,
+                            cellbuf_get(&global.back, x + i, y, &back));
+                        if_err_return(rv,
+                            cellbuf_get(&global.front, x + i, y, &front));
+                        if (cell_cmp(back, front) == 0) continue;
+                        if_err_return(rv,
+                            cellbuf_put_cell(&global.front, x + i, y, back));
+                        x1 = x + i + 1;
+                        ncells++;
+                    }
+                    x += run;
+                    continue;
+                }
 #endif
-                    w = tb_wcwidth((wchar_t)back->ch);
-            }
-            if (w < 1) w = 1; // wcwidth qreturns -1 for invalid codepoints
-
-            if (cell_cmp(back, front) != 0) {
-                cell_copy(front, back);
-
-                send_attr(back->fg, back->bg);
                 if (w > 1 && x >= global.front.width - (w - 1)) {
                     // Not enough room for wide char, send spaces
                     for (i = x; i < global.front.width; i++) {
-                        send_char(i, y, ' ');
+                        if_err_return(rv, send_char(i, y, ' '));
+                    }
+                    if_err_return(rv,
+                        cellbuf_put_cell(&global.front, x, y, back));
+                    // Mark the covered cells as below, so `front_row_head`
+                    // never starts a walk on one
+                    for (i = x + 1; i < global.front.width; i++) {
+                        uint32_t invalid = -1;
+                        if_err_return(rv, cellbuf_put(&global.front, i, y,
+                                              &invalid, 1, -1, -1));
                     }
                 } else {
                     {
 #ifdef TB_OPT_EGC
                         if (back->nech > 0)
-                            send_cluster(x, y, back->ech, back->nech);
+                            rv = send_cluster(x, y, back->ech, back->nech);
                         else
 #endif
-                            send_char(x, y, back->ch);
+                            rv = send_char(x, y, back->ch);
+                        if (rv != TB_OK) return rv;
                     }
+                    if_err_return(rv,
+                        cellbuf_put_cell(&global.front, x, y, back));
 
                     // When wcwidth>1, we need to advance the cursor by more
                     // than 1, thereby skipping some cells. Set these skipped
@@ -2457,39 +3808,83 @@ int tb_present(void) {
                     // we'll get a cell_cmp diff for the skipped cells and
                     // properly re-render.
                     for (i = 1; i < w; i++) {
-                        struct tb_cell *front_wide;
                         uint32_t invalid = -1;
-                        if_err_return(rv,
-                            cellbuf_get(&global.front, x + i, y, &front_wide));
-                        if_err_return(rv,
-                            cell_set(front_wide, &invalid, 1, -1, -1));
+                        if_err_return(rv, cellbuf_put(&global.front, x + i, y,
+                                              &invalid, 1, -1, -1));
                     }
                 }
             }
             x += w;
         }
+        global.back.dirty[y] = 0;
+        if (x0 >= 0) {
+#ifndef TB_OPT_NO_SCROLL
+            update_front_hash(y);
+#endif
+            global.damage[nspans].y = y;
+            global.damage[nspans].x0 = x0;
+            global.damage[nspans].x1 = x1;
+            nspans++;
+        }
     }
 
-    if_err_return(rv, send_cursor_if(global.cursor_x, global.cursor_y));
+    if (global.cursor_x >= 0 && global.cursor_y >= 0) {
+        if_err_return(rv, send_move(global.cursor_x, global.cursor_y));
+    }
+    if (stats) {
+        stats->bytes = global.out.len;
+        stats->cells = ncells;
+        stats->spans = global.damage;
+        stats->nspans = nspans;
+    }
     if_err_return(rv, bytebuf_flush(&global.out, global.wfd));
+    if (stats) stats->pending = global.wfd >= 0 ? global.out.len : 0;
 
     return TB_OK;
 }
 
-int tb_invalidate(void) {
+int tb_set_output_nonblock(int nonblock) {
+    if_not_init_return();
+    return set_output_nonblock(nonblock);
+}
+
+int tb_flush_output(size_t *pending) {
     int rv;
     if_not_init_return();
-    if_err_return(rv, resize_cellbufs());
+    if_err_return(rv, bytebuf_flush(&global.out, global.wfd));
+    if (pending) *pending = global.wfd >= 0 ? global.out.len : 0;
     return TB_OK;
 }
 
-int tb_set_cursor(int cx, int cy) {
+int tb_hold_output(void) {
     if_not_init_return();
-    int rv;
-    if (cx < 0) cx = 0;
-    if (cy < 0) cy = 0;
-    if (global.cursor_x == -1) {
-        if_err_return(rv,
+    if (global.out_hold || global.out_nonblock || global.wfd < 0) {
+        return TB_ERR;
+    }
+    global.out_hold = 1;
+    return TB_OK;
+}
+
+int tb_release_output(void) {
+    if_not_init_return();
+    global.out_hold = 0;
+    return bytebuf_flush(&global.out, global.wfd);
+}
+
+int tb_invalidate(void) {
+    int rv;
+    if_not_init_return();
+    if_err_return(rv, resize_cellbufs());
+    return TB_OK;
+}
+
+int tb_set_cursor(int cx, int cy) {
+    if_not_init_return();
+    int rv;
+    if (cx < 0) cx = 0;
+    if (cy < 0) cy = 0;
+    if (global.cursor_x == -1) {
+        if_err_return(rv,
             bytebuf_puts(&global.out, global.caps[TB_CAP_SHOW_CURSOR]));
     }
     if_err_return(rv, send_cursor_if(cx, cy));
@@ -2518,9 +3913,8 @@ int tb_set_cell_ex(int x, int y, uint32_t *ch, size_t nch, uintattr_t fg,
     uintattr_t bg) {
     if_not_init_return();
     int rv;
-    struct tb_cell *cell;
-    if_err_return(rv, cellbuf_get(&global.back, x, y, &cell));
-    if_err_return(rv, cell_set(cell, ch, nch, fg, bg));
+    if_err_return(rv, cellbuf_put(&global.back, x, y, ch, nch, fg, bg));
+    global.back.dirty[y] = 1;
     return TB_OK;
 }
 
@@ -2534,21 +3928,8 @@ int tb_extend_cell(int x, int y, uint32_t ch) {
 #ifdef TB_OPT_EGC
     // TODO: iswprint ch?
     int rv;
-    struct tb_cell *cell;
-    size_t nech;
-    if_err_return(rv, cellbuf_get(&global.back, x, y, &cell));
-    if (cell->nech > 0) { // append to ech
-        nech = cell->nech + 1;
-        if_err_return(rv, cell_reserve_ech(cell, nech + 1));
-        cell->ech[nech - 1] = ch;
-    } else { // make new ech
-        nech = 2;
-        if_err_return(rv, cell_reserve_ech(cell, nech + 1));
-        cell->ech[0] = cell->ch;
-        cell->ech[1] = ch;
-    }
-    cell->ech[nech] = '\0';
-    cell->nech = nech;
+    if_err_return(rv, cellbuf_extend(&global.back, x, y, ch));
+    global.back.dirty[y] = 1;
     return TB_OK;
 #else
     (void)x;
@@ -2558,6 +3939,79 @@ int tb_extend_cell(int x, int y, uint32_t ch) {
 #endif
 }
 
+int tb_set_cells(const void *buf, size_t nbuf, size_t *out_n) {
+    if_not_init_return();
+    int rv;
+    const unsigned char *rec;
+    size_t i, n = 0;
+
+    if (out_n) *out_n = 0;
+    if (nbuf % TB_PACKED_CELL_SIZE != 0) return TB_ERR;
+
+    for (i = 0; i < nbuf; i += TB_PACKED_CELL_SIZE) {
+        uint16_t x, y;
+        uint32_t ch;
+        uint64_t fg, bg;
+        rec = (const unsigned char *)buf + i;
+        memcpy(&x, rec, sizeof(x));
+        memcpy(&y, rec + 2, sizeof(y));
+        if (!cellbuf_in_bounds(&global.back, x, y)) continue;
+        memcpy(&ch, rec + 4, sizeof(ch));
+        memcpy(&fg, rec + 8, sizeof(fg));
+        memcpy(&bg, rec + 16, sizeof(bg));
+        if_err_return(rv, cellbuf_put(&global.back, x, y, &ch, 1,
+                              (uintattr_t)fg, (uintattr_t)bg));
+        global.back.dirty[y] = 1;
+        n++;
+    }
+
+    if (out_n) *out_n = n;
+    return TB_OK;
+}
+
+int tb_blit(int x, int y, int w, int h, const void *buf, size_t nbuf,
+    size_t *out_n) {
+    if_not_init_return();
+    int rv;
+    int x0, x1, y0, y1, cx, cy;
+    size_t n = 0;
+
+    if (out_n) *out_n = 0;
+    if (w < 0 || h < 0 || nbuf != (size_t)w * h * TB_PACKED_RECT_SIZE) {
+        return TB_ERR;
+    }
+
+    // Clip the rectangle to the back buffer. `x + w` can overflow for a
+    // large positive offset, so that case compares `w > width - x`; a
+    // negative offset can't overflow the sum but can the difference.
+    x0 = x < 0 ? 0 : x;
+    y0 = y < 0 ? 0 : y;
+    x1 = (x < 0 ? x + w > global.back.width : w > global.back.width - x)
+        ? global.back.width : x + w;
+    y1 = (y < 0 ? y + h > global.back.height : h > global.back.height - y)
+        ? global.back.height : y + h;
+
+    for (cy = y0; cy < y1; cy++) {
+        const unsigned char *rec =
+            (const unsigned char *)buf +
+            ((size_t)(cy - y) * w + (x0 - x)) * TB_PACKED_RECT_SIZE;
+        for (cx = x0; cx < x1; cx++, rec += TB_PACKED_RECT_SIZE) {
+            uint32_t ch;
+            uint64_t fg, bg;
+            memcpy(&ch, rec, sizeof(ch));
+            memcpy(&fg, rec + 4, sizeof(fg));
+            memcpy(&bg, rec + 12, sizeof(bg));
+            if_err_return(rv, cellbuf_put(&global.back, cx, cy, &ch, 1,
+                                  (uintattr_t)fg, (uintattr_t)bg));
+            n++;
+        }
+        if (x0 < x1) global.back.dirty[cy] = 1;
+    }
+
+    if (out_n) *out_n = n;
+    return TB_OK;
+}
+
 int tb_set_input_mode(int mode) {
     if_not_init_return();
 
@@ -2598,6 +4052,7 @@ int tb_set_output_mode(int mode) {
 #endif
             global.last_fg = ~global.fg;
             global.last_bg = ~global.bg;
+            global.last_attr_known = 0;
             global.output_mode = mode;
             return TB_OK;
     }
@@ -2606,12 +4061,79 @@ int tb_set_output_mode(int mode) {
 
 int tb_peek_event(struct tb_event *event, int timeout_ms) {
     if_not_init_return();
-    return wait_event(event, timeout_ms);
+    return wait_event(event, timeout_ms, NULL, 0);
 }
 
 int tb_poll_event(struct tb_event *event) {
     if_not_init_return();
-    return wait_event(event, -1);
+    return wait_event(event, -1, NULL, 0);
+}
+
+int tb_peek_event_fds(struct tb_event *event, int timeout_ms,
+    struct pollfd *fds, size_t nfds) {
+    if_not_init_return();
+    return wait_event(event, timeout_ms, fds, nfds);
+}
+
+int tb_drain_events(struct tb_event *events, size_t cap, size_t *n) {
+    int rv;
+    char buf[TB_OPT_READ_BUF];
+
+    if_not_init_return();
+    *n = 0;
+
+    while (*n < cap) {
+        struct tb_event *event = &events[*n];
+        memset(event, 0, sizeof(*event));
+        if (extract_event(event) == TB_OK) {
+            (*n)++;
+            continue;
+        }
+
+        // Refill one read buffer at a time so that extracting an event never
+        // shifts more than that much of `global.in`
+        struct pollfd fds[2] = {
+            {global.rfd,               POLLIN, 0},
+            {global.resize_pipefd[0], POLLIN, 0},
+        };
+        int poll_rv = poll(fds, 2, 0);
+        if (poll_rv < 0) {
+            global.last_errno = errno;
+            if (*n > 0) break;
+            return TB_ERR_POLL;
+        } else if (poll_rv == 0) {
+            break;
+        }
+
+        if (fds[1].revents) {
+            int ignore = 0;
+            read(global.resize_pipefd[0], &ignore, sizeof(ignore));
+            if_err_return(rv, update_term_size());
+            if_err_return(rv, resize_cellbufs());
+            memset(event, 0, sizeof(*event));
+            event->type = TB_EVENT_RESIZE;
+            event->w = global.width;
+            event->h = global.height;
+            (*n)++;
+        }
+
+        if (fds[0].revents) {
+            ssize_t read_rv = read(global.rfd, buf, sizeof(buf));
+            if (read_rv < 0) {
+                global.last_errno = errno;
+                if (*n > 0) break;
+                return TB_ERR_READ;
+            } else if (read_rv == 0) {
+                // Readable with nothing to read: the tty hung up
+                global.last_errno = 0;
+                if (*n > 0) break;
+                return TB_ERR_READ;
+            }
+            if_err_return(rv, bytebuf_nputs(&global.in, buf, read_rv));
+        }
+    }
+
+    return *n > 0 ? TB_OK : TB_ERR_NO_EVENT;
 }
 
 int tb_get_fds(int *ttyfd, int *resizefd) {
@@ -2623,14 +4145,26 @@ int tb_get_fds(int *ttyfd, int *resizefd) {
     return TB_OK;
 }
 
+int tb_get_output_fd(int *wfd) {
+    if_not_init_return();
+    *wfd = global.wfd;
+    return TB_OK;
+}
+
 int tb_print(int x, int y, uintattr_t fg, uintattr_t bg, const char *str) {
     return tb_print_ex(x, y, fg, bg, NULL, str);
 }
 
 int tb_print_ex(int x, int y, uintattr_t fg, uintattr_t bg, size_t *out_w,
     const char *str) {
+    return tb_print_n(x, y, fg, bg, out_w, str, strlen(str));
+}
+
+int tb_print_n(int x, int y, uintattr_t fg, uintattr_t bg, size_t *out_w,
+    const char *str, size_t nstr) {
     int rv, w, ix, x_prev;
     uint32_t uni;
+    const char *end = str + nstr;
 
     if_not_init_return();
 
@@ -2642,8 +4176,12 @@ int tb_print_ex(int x, int y, uintattr_t fg, uintattr_t bg, size_t *out_w,
     x_prev = x;
     if (out_w) *out_w = 0;
 
-    while (*str) {
-        rv = tb_utf8_char_to_unicode(&uni, str);
+    while (str < end && *str) {
+        if (tb_utf8_char_length(*str) > end - str) {
+            rv = (int)(str - end); // sequence runs past `nstr`
+        } else {
+            rv = tb_utf8_char_to_unicode(&uni, str);
+        }
 
         if (rv < 0) {
             uni = 0xfffd; // replace invalid UTF-8 char with U+FFFD
@@ -2683,6 +4221,43 @@ int tb_print_ex(int x, int y, uintattr_t fg, uintattr_t bg, size_t *out_w,
     return TB_OK;
 }
 
+int tb_print_runs(const void *buf, size_t nbuf, int *out_w, size_t *out_n) {
+    if_not_init_return();
+    int rv;
+    const unsigned char *rec;
+    uint32_t len;
+    size_t i, n = 0;
+
+    if (out_n) *out_n = 0;
+
+    // Check the layout first so a malformed buffer prints nothing
+    for (i = 0; i < nbuf; i += TB_PACKED_RUN_SIZE + len, n++) {
+        rec = (const unsigned char *)buf + i;
+        if (nbuf - i < TB_PACKED_RUN_SIZE) return TB_ERR;
+        memcpy(&len, rec + 4, sizeof(len));
+        if (nbuf - i - TB_PACKED_RUN_SIZE < len) return TB_ERR;
+    }
+
+    for (i = 0; i < nbuf; i += TB_PACKED_RUN_SIZE + len) {
+        uint16_t x, y;
+        uint64_t fg, bg;
+        size_t w = 0;
+        rec = (const unsigned char *)buf + i;
+        memcpy(&x, rec, sizeof(x));
+        memcpy(&y, rec + 2, sizeof(y));
+        memcpy(&len, rec + 4, sizeof(len));
+        memcpy(&fg, rec + 8, sizeof(fg));
+        memcpy(&bg, rec + 16, sizeof(bg));
+        rv = tb_print_n(x, y, (uintattr_t)fg, (uintattr_t)bg, &w,
+            (const char *)rec + TB_PACKED_RUN_SIZE, len);
+        if (rv != TB_OK && rv != TB_ERR_OUT_OF_BOUNDS) return rv;
+        if (out_w) *out_w++ = rv == TB_OK ? (int)w : rv;
+    }
+
+    if (out_n) *out_n = n;
+    return TB_OK;
+}
+
 int tb_printf(int x, int y, uintattr_t fg, uintattr_t bg, const char *fmt,
     ...) {
     int rv;
@@ -2704,6 +4279,7 @@ int tb_printf_ex(int x, int y, uintattr_t fg, uintattr_t bg, size_t *out_w,
 }
 
 int tb_send(const char *buf, size_t nbuf) {
+    if_not_init_return();
     return bytebuf_nputs(&global.out, buf, nbuf);
 }
 
@@ -2734,7 +4310,14 @@ int tb_set_func(int fn_type, int (*fn)(struct tb_event *, size_t *)) {
 
 struct tb_cell *tb_cell_buffer(void) {
     if (!global.initialized) return NULL;
+    // Callers may write through the returned pointer, so the next present has
+    // to look at every row
+    cellbuf_mark_dirty(&global.back, 0, global.back.height);
+#ifdef TB_OPT_SOA
+    return NULL; // There is no `struct tb_cell` array to hand out
+#else
     return global.back.cells;
+#endif
 }
 
 int tb_utf8_char_length(char c) {
@@ -2925,14 +4508,74 @@ int tb_printf_inner(int x, int y, uintattr_t fg, uintattr_t bg, size_t *out_w,
 }
 
 static int init_term_caps(void) {
+    int rv;
+    // Built-in caps don't record ech, rep, bce, xenl, or the scroll and cursor
+    // motion caps, so only a terminfo entry enables them
+    global.term_features = 0;
     if (load_terminfo() == TB_OK) {
-        return parse_terminfo_caps();
+        if_err_return(rv, parse_terminfo_caps());
+    } else {
+        if_err_return(rv, load_builtin_caps());
+    }
+    if (caps_are_sgr()) global.term_features |= TB_TERM_SGR;
+    return TB_OK;
+}
+
+// Return whether every attribute cap is either missing or the plain SGR
+// sequence for it, so `send_attr` can merge and turn off attributes itself
+static int caps_are_sgr(void) {
+    static const struct {
+        int cap;
+        const char *sgr;
+    } attr_caps[] = {
+        {TB_CAP_BOLD,      "\x1b[1m"},
+        {TB_CAP_DIM,       "\x1b[2m"},
+        {TB_CAP_ITALIC,    "\x1b[3m"},
+        {TB_CAP_UNDERLINE, "\x1b[4m"},
+        {TB_CAP_BLINK,     "\x1b[5m"},
+        {TB_CAP_REVERSE,   "\x1b[7m"},
+        {TB_CAP_INVISIBLE, "\x1b[8m"},
+    };
+    size_t i;
+    for (i = 0; i < sizeof(attr_caps) / sizeof(attr_caps[0]); i++) {
+        const char *cap = global.caps[attr_caps[i].cap];
+        if (*cap && strcmp(cap, attr_caps[i].sgr) != 0) return 0;
     }
-    return load_builtin_caps();
+    return 1;
 }
 
 static int init_cap_trie(void) {
     int rv, i;
+    struct cap_trie *t = &global.cap_trie;
+    size_t bound = 1, nclasses = 1;
+    const char *cap;
+
+    // Give each byte used by a cap a column and bound the number of states
+    // by the total cap length
+    for (i = 0; i < TB_CAP__COUNT_KEYS; i++) {
+        for (cap = global.caps[i]; cap && *cap != '\0'; cap++, bound++) {
+            uint8_t c = (uint8_t)*cap;
+            if (!t->class_of[c]) t->class_of[c] = (uint8_t)nclasses++;
+        }
+    }
+    for (i = 0; builtin_mod_caps[i].cap != NULL; i++) {
+        for (cap = builtin_mod_caps[i].cap; *cap != '\0'; cap++, bound++) {
+            uint8_t c = (uint8_t)*cap;
+            if (!t->class_of[c]) t->class_of[c] = (uint8_t)nclasses++;
+        }
+    }
+    if (bound > UINT16_MAX) return TB_ERR_MEM;
+
+    size_t ntrans = bound * nclasses;
+    char *mem = (char *)tb_malloc(ntrans * sizeof(uint16_t) +
+                                  bound * sizeof(struct cap_trie_node));
+    if (!mem) return TB_ERR_MEM;
+    t->nclasses = nclasses;
+    t->nstates = 1;
+    t->next = (uint16_t *)mem;
+    t->nodes = (struct cap_trie_node *)(mem + ntrans * sizeof(uint16_t));
+    memset(t->next, 0, ntrans * sizeof(uint16_t));
+    memset(t->nodes, 0, bound * sizeof(struct cap_trie_node));
 
     // Add caps from terminfo or built-in
     //
@@ -2957,43 +4600,38 @@ static int init_cap_trie(void) {
         if (rv != TB_OK && rv != TB_ERR_CAP_COLLISION) return rv;
     }
 
+    // Pack the nodes right after the used part of the table and give back
+    // the rest
+    size_t nused = t->nstates * nclasses * sizeof(uint16_t);
+    memmove(mem + nused, t->nodes,
+        t->nstates * sizeof(struct cap_trie_node));
+    char *packed = (char *)tb_realloc(mem,
+        nused + t->nstates * sizeof(struct cap_trie_node));
+    if (packed) mem = packed;
+    t->next = (uint16_t *)mem;
+    t->nodes = (struct cap_trie_node *)(mem + nused);
+
     return TB_OK;
 }
 
 static int cap_trie_add(const char *cap, uint16_t key, uint8_t mod) {
-    struct cap_trie *next, *node = &global.cap_trie;
-    size_t i, j;
+    struct cap_trie *t = &global.cap_trie;
+    size_t state = 0;
 
     if (!cap || strlen(cap) <= 0) return TB_OK; // Nothing to do for empty caps
 
-    for (i = 0; cap[i] != '\0'; i++) {
-        char c = cap[i];
-        next = NULL;
-
-        // Check if c is already a child of node
-        for (j = 0; j < node->nchildren; j++) {
-            if (node->children[j].c == c) {
-                next = &node->children[j];
-                break;
-            }
-        }
-        if (!next) {
-            // We need to add a new child to node
-            node->nchildren += 1;
-            node->children = (struct cap_trie *)tb_realloc(node->children,
-                sizeof(*node) * node->nchildren);
-            if (!node->children) {
-                return TB_ERR_MEM;
-            }
-            next = &node->children[node->nchildren - 1];
-            memset(next, 0, sizeof(*next));
-            next->c = c;
+    for (; *cap != '\0'; cap++) {
+        uint16_t *next =
+            &t->next[state * t->nclasses + t->class_of[(uint8_t)*cap]];
+        if (!*next) {
+            // init_cap_trie sized the table for every cap byte
+            *next = (uint16_t)t->nstates++;
+            t->nodes[state].has_children = 1;
         }
-
-        // Continue
-        node = next;
+        state = *next;
     }
 
+    struct cap_trie_node *node = &t->nodes[state];
     if (node->is_leaf) {
         // Already a leaf here
         return TB_ERR_CAP_COLLISION;
@@ -3005,44 +4643,33 @@ static int cap_trie_add(const char *cap, uint16_t key, uint8_t mod) {
     return TB_OK;
 }
 
-static int cap_trie_find(const char *buf, size_t nbuf, struct cap_trie **last,
-    size_t *depth) {
-    struct cap_trie *next, *node = &global.cap_trie;
-    size_t i, j;
-    *last = node;
+static int cap_trie_find(const char *buf, size_t nbuf,
+    struct cap_trie_node **last, size_t *depth) {
+    struct cap_trie *t = &global.cap_trie;
+    size_t i, state = 0;
+    *last = &t->nodes[0];
     *depth = 0;
+    if (!t->next) return TB_OK;
     for (i = 0; i < nbuf; i++) {
-        char c = buf[i];
-        next = NULL;
-
-        // Find c in node.children
-        for (j = 0; j < node->nchildren; j++) {
-            if (node->children[j].c == c) {
-                next = &node->children[j];
-                break;
-            }
-        }
+        size_t next =
+            t->next[state * t->nclasses + t->class_of[(uint8_t)buf[i]]];
         if (!next) {
             // Not found
             return TB_OK;
         }
-        node = next;
-        *last = node;
+        state = next;
+        *last = &t->nodes[state];
         *depth += 1;
-        if (node->is_leaf && node->nchildren < 1) {
+        if ((*last)->is_leaf && !(*last)->has_children) {
             break;
         }
     }
     return TB_OK;
 }
 
-static int cap_trie_deinit(struct cap_trie *node) {
-    size_t j;
-    for (j = 0; j < node->nchildren; j++) {
-        cap_trie_deinit(&node->children[j]);
-    }
-    if (node->children) tb_free(node->children);
-    memset(node, 0, sizeof(*node));
+static int cap_trie_deinit(struct cap_trie *t) {
+    if (t->next) tb_free(t->next);
+    memset(t, 0, sizeof(*t));
     return TB_OK;
 }
 
@@ -3052,6 +4679,9 @@ static int init_resize_handler(void) {
         return TB_ERR_RESIZE_PIPE;
     }
 
+    // A signal can't tell which context's terminal changed
+    if (tb_cur != &tb_default_context.g) return TB_OK;
+
     struct sigaction sa;
     memset(&sa, 0, sizeof(sa));
     sa.sa_handler = handle_resize;
@@ -3124,17 +4754,10 @@ static int update_term_size_via_esc(void) {
         return TB_ERR_RESIZE_WRITE;
     }
 
-    fd_set fds;
-    FD_ZERO(&fds);
-    FD_SET(global.rfd, &fds);
+    struct pollfd fds = {global.rfd, POLLIN, 0};
+    int poll_rv = poll(&fds, 1, TB_RESIZE_FALLBACK_MS);
 
-    struct timeval timeout;
-    timeout.tv_sec = 0;
-    timeout.tv_usec = TB_RESIZE_FALLBACK_MS * 1000;
-
-    int select_rv = select(global.rfd + 1, &fds, NULL, NULL, &timeout);
-
-    if (select_rv != 1) {
+    if (poll_rv != 1) {
         global.last_errno = errno;
         return TB_ERR_RESIZE_POLL;
     }
@@ -3159,6 +4782,7 @@ static int update_term_size_via_esc(void) {
 
 static int init_cellbuf(void) {
     int rv;
+    global.fronthash_ok = 0;
     if_err_return(rv, cellbuf_init(&global.back, global.width, global.height));
     if_err_return(rv, cellbuf_init(&global.front, global.width, global.height));
     if_err_return(rv, cellbuf_clear(&global.back));
@@ -3167,6 +4791,16 @@ static int init_cellbuf(void) {
 }
 
 static int tb_deinit(void) {
+    return tb_deinit_to(NULL);
+}
+
+// Shut down, writing out whatever is still queued along with the exit
+// sequences, or handing it all over in `rest` if non-NULL
+static int tb_deinit_to(struct bytebuf *rest) {
+    global.out_hold = 0;
+    if (global.wfd >= 0) {
+        set_output_nonblock(0);
+    }
     if (global.caps[0] != NULL && global.wfd >= 0) {
         bytebuf_puts(&global.out, global.caps[TB_CAP_SHOW_CURSOR]);
         bytebuf_puts(&global.out, global.caps[TB_CAP_SGR0]);
@@ -3174,6 +4808,11 @@ static int tb_deinit(void) {
         bytebuf_puts(&global.out, global.caps[TB_CAP_EXIT_CA]);
         bytebuf_puts(&global.out, global.caps[TB_CAP_EXIT_KEYPAD]);
         bytebuf_puts(&global.out, TB_HARDCAP_EXIT_MOUSE);
+    }
+    if (rest) {
+        *rest = global.out;
+        memset(&global.out, 0, sizeof(global.out));
+    } else if (global.wfd >= 0) {
         bytebuf_flush(&global.out, global.wfd);
     }
     if (global.ttyfd >= 0) {
@@ -3186,10 +4825,12 @@ static int tb_deinit(void) {
         }
     }
 
-    struct sigaction sa;
-    memset(&sa, 0, sizeof(sa));
-    sa.sa_handler = SIG_DFL;
-    sigaction(SIGWINCH, &sa, NULL);
+    if (tb_cur == &tb_default_context.g) {
+        struct sigaction sa;
+        memset(&sa, 0, sizeof(sa));
+        sa.sa_handler = SIG_DFL;
+        sigaction(SIGWINCH, &sa, NULL);
+    }
     if (global.resize_pipefd[0] >= 0) close(global.resize_pipefd[0]);
     if (global.resize_pipefd[1] >= 0) close(global.resize_pipefd[1]);
 
@@ -3197,6 +4838,8 @@ static int tb_deinit(void) {
     cellbuf_free(&global.front);
     bytebuf_free(&global.in);
     bytebuf_free(&global.out);
+    if (global.damage) tb_free(global.damage);
+    if (global.rowhash) tb_free(global.rowhash);
 
     if (global.terminfo) tb_free(global.terminfo);
 
@@ -3206,6 +4849,31 @@ static int tb_deinit(void) {
     return TB_OK;
 }
 
+static int set_output_nonblock(int nonblock) {
+    nonblock = nonblock ? 1 : 0;
+    if (global.wfd < 0 || nonblock == global.out_nonblock) {
+        global.out_nonblock = nonblock;
+        return TB_OK;
+    }
+    int flags = fcntl(global.wfd, F_GETFL);
+    if (flags < 0) {
+        global.last_errno = errno;
+        return TB_ERR;
+    }
+    if (nonblock && !(flags & O_NONBLOCK)) {
+        if (fcntl(global.wfd, F_SETFL, flags | O_NONBLOCK) < 0) {
+            global.last_errno = errno;
+            return TB_ERR;
+        }
+        global.out_set_nonblock = 1;
+    } else if (!nonblock && global.out_set_nonblock) {
+        fcntl(global.wfd, F_SETFL, flags & ~O_NONBLOCK);
+        global.out_set_nonblock = 0;
+    }
+    global.out_nonblock = nonblock;
+    return TB_OK;
+}
+
 static int load_terminfo(void) {
     int rv;
     char tmp[TB_PATH_MAX];
@@ -3364,6 +5032,35 @@ static int parse_terminfo_caps(void) {
         global.caps[i] = cap;
     }
 
+    // Load output features
+    static const int feature_caps[][2] = {
+        {TB_TERMINFO_ECH, TB_TERM_ECH},
+        {TB_TERMINFO_REP, TB_TERM_REP},
+        {TB_TERMINFO_CSR, TB_TERM_CSR},
+        {TB_TERMINFO_INDN, TB_TERM_INDN},
+        {TB_TERMINFO_RIN, TB_TERM_RIN},
+        {TB_TERMINFO_HPA, TB_TERM_HPA},
+        {TB_TERMINFO_VPA, TB_TERM_VPA},
+        {TB_TERMINFO_CUF, TB_TERM_CUF},
+        {TB_TERMINFO_CUB, TB_TERM_CUB},
+        {TB_TERMINFO_CUU, TB_TERM_CUU},
+        {TB_TERMINFO_CUD, TB_TERM_CUD},
+    };
+    for (i = 0; i < (int)(sizeof(feature_caps) / sizeof(feature_caps[0]));
+         i++)
+    {
+        const char *cap = get_terminfo_string(pos_str_offsets, num_offsets,
+            pos_str_table, nbytes_strings, feature_caps[i][0]);
+        if (cap && *cap) global.term_features |= feature_caps[i][1];
+    }
+    const char *bools = global.terminfo + nbytes_header + nbytes_names;
+    if (TB_TERMINFO_BCE < nbytes_bools && bools[TB_TERMINFO_BCE] == 1) {
+        global.term_features |= TB_TERM_BCE;
+    }
+    if (TB_TERMINFO_XENL < nbytes_bools && bools[TB_TERMINFO_XENL] == 1) {
+        global.term_features |= TB_TERM_XENL;
+    }
+
     return TB_OK;
 }
 
@@ -3441,67 +5138,83 @@ static int get_terminfo_int16(int offset, int16_t *val) {
     return TB_OK;
 }
 
-static int wait_event(struct tb_event *event, int timeout) {
+static int wait_event(struct tb_event *event, int timeout,
+    struct pollfd *extra, size_t nextra) {
     int rv;
     char buf[TB_OPT_READ_BUF];
+    struct pollfd own[8], *fds = own;
+    size_t i, nfds = nextra + 2;
 
     memset(event, 0, sizeof(*event));
     if_ok_return(rv, extract_event(event));
 
-    fd_set fds;
-    struct timeval tv;
-    tv.tv_sec = timeout / 1000;
-    tv.tv_usec = (timeout - (tv.tv_sec * 1000)) * 1000;
+    if (nfds > sizeof(own) / sizeof(own[0])) {
+        fds = (struct pollfd *)tb_malloc(nfds * sizeof(*fds));
+        if (!fds) return TB_ERR_MEM;
+    }
 
     do {
-        FD_ZERO(&fds);
-        FD_SET(global.rfd, &fds);
-        FD_SET(global.resize_pipefd[0], &fds);
-
-        int maxfd = global.resize_pipefd[0] > global.rfd
-                        ? global.resize_pipefd[0]
-                        : global.rfd;
+        fds[0].fd = global.rfd;
+        fds[1].fd = global.resize_pipefd[0];
+        fds[0].events = fds[1].events = POLLIN;
+        for (i = 0; i < nextra; i++) {
+            fds[i + 2] = extra[i];
+        }
+        for (i = 0; i < nfds; i++) {
+            fds[i].revents = 0;
+        }
 
-        int select_rv =
-            select(maxfd + 1, &fds, NULL, NULL, (timeout < 0) ? NULL : &tv);
+        int poll_rv = poll(fds, (nfds_t)nfds, timeout);
 
-        if (select_rv < 0) {
+        if (poll_rv < 0) {
             // Let EINTR/EAGAIN bubble up
             global.last_errno = errno;
-            return TB_ERR_POLL;
-        } else if (select_rv == 0) {
-            return TB_ERR_NO_EVENT;
+            rv = TB_ERR_POLL;
+            break;
+        } else if (poll_rv == 0) {
+            rv = TB_ERR_NO_EVENT;
+            break;
         }
 
-        int tty_has_events = (FD_ISSET(global.rfd, &fds));
-        int resize_has_events = (FD_ISSET(global.resize_pipefd[0], &fds));
+        int extra_ready = 0;
+        for (i = 0; i < nextra; i++) {
+            extra[i].revents = fds[i + 2].revents;
+            if (extra[i].revents) extra_ready = 1;
+        }
 
-        if (tty_has_events) {
+        if (fds[0].revents) {
             ssize_t read_rv = read(global.rfd, buf, sizeof(buf));
             if (read_rv < 0) {
                 global.last_errno = errno;
-                return TB_ERR_READ;
+                rv = TB_ERR_READ;
+                break;
             } else if (read_rv > 0) {
                 bytebuf_nputs(&global.in, buf, read_rv);
             }
         }
 
-        if (resize_has_events) {
+        if (fds[1].revents) {
             int ignore = 0;
             read(global.resize_pipefd[0], &ignore, sizeof(ignore));
             // TODO: Harden against errors encountered mid-resize
-            if_err_return(rv, update_term_size());
-            if_err_return(rv, resize_cellbufs());
+            if_err_break(rv, update_term_size());
+            if_err_break(rv, resize_cellbufs());
             event->type = TB_EVENT_RESIZE;
             event->w = global.width;
             event->h = global.height;
-            return TB_OK;
+            break;
         }
 
         memset(event, 0, sizeof(*event));
-        if_ok_return(rv, extract_event(event));
-    } while (timeout == -1);
+        rv = extract_event(event);
+        if (rv == TB_OK) break;
+        if (extra_ready) {
+            rv = TB_ERR_NO_EVENT;
+            break;
+        }
+    } while (timeout < 0);
 
+    if (fds != own) tb_free(fds);
     return rv;
 }
 
@@ -3588,7 +5301,7 @@ static int extract_esc_user(struct tb_event *event, int is_post) {
 static int extract_esc_cap(struct tb_event *event) {
     int rv;
     struct bytebuf *in = &global.in;
-    struct cap_trie *node;
+    struct cap_trie_node *node;
     size_t depth;
 
     if_err_return(rv, cap_trie_find(in->buf, in->len, &node, &depth));
@@ -3600,7 +5313,7 @@ static int extract_esc_cap(struct tb_event *event) {
         event->mod = node->mod;
         bytebuf_shift(in, depth);
         return TB_OK;
-    } else if (node->nchildren > 0 && in->len <= depth) {
+    } else if (node->has_children && in->len <= depth) {
         // Found a branch node (not enough input)
         return TB_ERR_NEED_MORE;
     }
@@ -3759,18 +5472,21 @@ static int extract_esc_mouse(struct tb_event *event) {
 
 static int resize_cellbufs(void) {
     int rv;
+    global.fronthash_ok = 0;
     if_err_return(rv,
         cellbuf_resize(&global.back, global.width, global.height));
     if_err_return(rv,
         cellbuf_resize(&global.front, global.width, global.height));
     if_err_return(rv, cellbuf_clear(&global.front));
+    if_err_return(rv,
+        cellbuf_mark_dirty(&global.back, 0, global.back.height));
     if_err_return(rv, send_clear());
     return TB_OK;
 }
 
 static void handle_resize(int sig) {
     int errno_copy = errno;
-    write(global.resize_pipefd[1], &sig, sizeof(sig));
+    write(tb_default_context.g.resize_pipefd[1], &sig, sizeof(sig));
     errno = errno_copy;
 }
 
@@ -3781,55 +5497,16 @@ static int send_attr(uintattr_t fg, uintattr_t bg) {
         return TB_OK;
     }
 
-    if_err_return(rv, bytebuf_puts(&global.out, global.caps[TB_CAP_SGR0]));
-
-    uint32_t cfg, cbg;
-    switch (global.output_mode) {
-        default:
-        case TB_OUTPUT_NORMAL:
-            // The minus 1 below is because our colors are 1-indexed starting
-            // from black. Black is represented by a 30, 40, 90, or 100 for fg,
-            // bg, bright fg, or bright bg respectively. Red is 31, 41, 91,
-            // 101, etc.
-            cfg = (fg & TB_BRIGHT ? 90 : 30) + (fg & 0x0f) - 1;
-            cbg = (bg & TB_BRIGHT ? 100 : 40) + (bg & 0x0f) - 1;
-            break;
-
-        case TB_OUTPUT_256:
-            cfg = fg & 0xff;
-            cbg = bg & 0xff;
-            if (fg & TB_HI_BLACK) cfg = 0;
-            if (bg & TB_HI_BLACK) cbg = 0;
-            break;
-
-        case TB_OUTPUT_216:
-            cfg = fg & 0xff;
-            cbg = bg & 0xff;
-            if (cfg > 216) cfg = 216;
-            if (cbg > 216) cbg = 216;
-            cfg += 0x0f;
-            cbg += 0x0f;
-            break;
-
-        case TB_OUTPUT_GRAYSCALE:
-            cfg = fg & 0xff;
-            cbg = bg & 0xff;
-            if (cfg > 24) cfg = 24;
-            if (cbg > 24) cbg = 24;
-            cfg += 0xe7;
-            cbg += 0xe7;
-            break;
-
-#if TB_OPT_ATTR_W >= 32
-        case TB_OUTPUT_TRUECOLOR:
-            cfg = fg & 0xffffff;
-            cbg = bg & 0xffffff;
-            if (fg & TB_HI_BLACK) cfg = 0;
-            if (bg & TB_HI_BLACK) cbg = 0;
-            break;
-#endif
+    if (global.term_features & TB_TERM_SGR) {
+        if_err_return(rv, send_sgr_delta(fg, bg));
+        global.last_fg = fg;
+        global.last_bg = bg;
+        global.last_attr_known = 1;
+        return TB_OK;
     }
 
+    if_err_return(rv, bytebuf_puts(&global.out, global.caps[TB_CAP_SGR0]));
+
     if (fg & TB_BOLD)
         if_err_return(rv, bytebuf_puts(&global.out, global.caps[TB_CAP_BOLD]));
 
@@ -3866,23 +5543,12 @@ static int send_attr(uintattr_t fg, uintattr_t bg) {
         if_err_return(rv,
             bytebuf_puts(&global.out, global.caps[TB_CAP_REVERSE]));
 
-    int fg_is_default = (fg & 0xff) == 0;
-    int bg_is_default = (bg & 0xff) == 0;
-    if (global.output_mode == TB_OUTPUT_256) {
-        if (fg & TB_HI_BLACK) fg_is_default = 0;
-        if (bg & TB_HI_BLACK) bg_is_default = 0;
-    }
-#if TB_OPT_ATTR_W >= 32
-    if (global.output_mode == TB_OUTPUT_TRUECOLOR) {
-        fg_is_default = ((fg & 0xffffff) == 0) && ((fg & TB_HI_BLACK) == 0);
-        bg_is_default = ((bg & 0xffffff) == 0) && ((bg & TB_HI_BLACK) == 0);
-    }
-#endif
-
-    if_err_return(rv, send_sgr(cfg, cbg, fg_is_default, bg_is_default));
+    if_err_return(rv, send_sgr(attr_color(fg, 0), attr_color(bg, 1),
+                          attr_is_default(fg), attr_is_default(bg)));
 
     global.last_fg = fg;
     global.last_bg = bg;
+    global.last_attr_known = 1;
 
     return TB_OK;
 }
@@ -3890,75 +5556,223 @@ static int send_attr(uintattr_t fg, uintattr_t bg) {
 static int send_sgr(uint32_t cfg, uint32_t cbg, int fg_is_default,
     int bg_is_default) {
     int rv;
-    char nbuf[32];
+    char sgr[64];
+    size_t n = 0;
 
-    if (fg_is_default && bg_is_default) {
-        return TB_OK;
-    }
+    if (!fg_is_default) n = sgr_put_color(sgr, n, cfg, 0);
+    if (!bg_is_default) n = sgr_put_color(sgr, n, cbg, 1);
+    if (n == 0) return TB_OK;
 
-    switch (global.output_mode) {
-        default:
-        case TB_OUTPUT_NORMAL:
-            send_literal(rv, "\x1b[");
-            if (!fg_is_default) {
-                send_num(rv, nbuf, cfg);
-                if (!bg_is_default) {
-                    send_literal(rv, ";");
-                }
-            }
-            if (!bg_is_default) {
-                send_num(rv, nbuf, cbg);
-            }
-            send_literal(rv, "m");
-            break;
+    send_literal(rv, "\x1b[");
+    if_err_return(rv, bytebuf_nputs(&global.out, sgr, n));
+    send_literal(rv, "m");
+    return TB_OK;
+}
 
-        case TB_OUTPUT_256:
-        case TB_OUTPUT_216:
-        case TB_OUTPUT_GRAYSCALE:
-            send_literal(rv, "\x1b[");
-            if (!fg_is_default) {
-                send_literal(rv, "38;5;");
-                send_num(rv, nbuf, cfg);
-                if (!bg_is_default) {
-                    send_literal(rv, ";");
-                }
-            }
-            if (!bg_is_default) {
-                send_literal(rv, "48;5;");
-                send_num(rv, nbuf, cbg);
-            }
-            send_literal(rv, "m");
-            break;
+// Switch the terminal from `last_fg`,`last_bg` to `fg`,`bg` with a single SGR
+// sequence that only carries the attributes and colors that changed, or that
+// resets first if that is shorter. If the current state isn't known, reset
+// with the sgr0 cap instead.
+static int send_sgr_delta(uintattr_t fg, uintattr_t bg) {
+    int rv;
+    char delta[160], reset[160];
+    size_t ndelta, nreset;
 
-#if TB_OPT_ATTR_W >= 32
-        case TB_OUTPUT_TRUECOLOR:
-            send_literal(rv, "\x1b[");
-            if (!fg_is_default) {
-                send_literal(rv, "38;2;");
-                send_num(rv, nbuf, (cfg >> 16) & 0xff);
-                send_literal(rv, ";");
-                send_num(rv, nbuf, (cfg >> 8) & 0xff);
-                send_literal(rv, ";");
-                send_num(rv, nbuf, cfg & 0xff);
-                if (!bg_is_default) {
-                    send_literal(rv, ";");
-                }
-            }
-            if (!bg_is_default) {
-                send_literal(rv, "48;2;");
-                send_num(rv, nbuf, (cbg >> 16) & 0xff);
-                send_literal(rv, ";");
-                send_num(rv, nbuf, (cbg >> 8) & 0xff);
-                send_literal(rv, ";");
-                send_num(rv, nbuf, cbg & 0xff);
-            }
-            send_literal(rv, "m");
-            break;
-#endif
+    if (!global.last_attr_known) {
+        if_err_return(rv,
+            bytebuf_puts(&global.out, global.caps[TB_CAP_SGR0]));
+        ndelta = sgr_put_delta(delta, 0, fg, bg, 0);
+    } else {
+        ndelta = sgr_put_delta(delta, 0, fg, bg, 1);
+        nreset = sgr_put_delta(reset, sgr_put(reset, 0, 0), fg, bg, 0);
+        if (nreset < ndelta) {
+            memcpy(delta, reset, nreset);
+            ndelta = nreset;
+        }
     }
+    if (ndelta == 0) return TB_OK;
+
+    send_literal(rv, "\x1b[");
+    if_err_return(rv, bytebuf_nputs(&global.out, delta, ndelta));
+    send_literal(rv, "m");
     return TB_OK;
 }
 
+// Append the SGR parameters that take the terminal to `fg`,`bg`, either from
+// `last_fg`,`last_bg` or, if `from_last` is 0, from the reset state. Returns
+// the new length of `buf`.
+static size_t sgr_put_delta(char *buf, size_t n, uintattr_t fg, uintattr_t bg,
+    int from_last) {
+    uintattr_t to = sgr_flags(fg, bg), from = 0;
+    uint32_t cfg = attr_color(fg, 0), cbg = attr_color(bg, 1), pfg = 0,
+             pbg = 0;
+    int fgd = attr_is_default(fg), bgd = attr_is_default(bg), pfgd = 1,
+        pbgd = 1;
+
+    if (from_last) {
+        from = sgr_flags(global.last_fg, global.last_bg);
+        pfg = attr_color(global.last_fg, 0);
+        pbg = attr_color(global.last_bg, 1);
+        pfgd = attr_is_default(global.last_fg);
+        pbgd = attr_is_default(global.last_bg);
+    }
+
+    // 22 clears both bold and dim, and 24 both underline styles, so clear the
+    // pair and let the loop below turn the survivor back on
+#if TB_OPT_ATTR_W == 64
+    uintattr_t underlines = TB_UNDERLINE | TB_UNDERLINE_2;
+#else
+    uintattr_t underlines = TB_UNDERLINE;
+#endif
+    uintattr_t off = from & ~to;
+    if (off & (TB_BOLD | TB_DIM)) {
+        n = sgr_put(buf, n, 22);
+        from &= ~(TB_BOLD | TB_DIM);
+    }
+    if (off & underlines) {
+        n = sgr_put(buf, n, 24);
+        from &= ~underlines;
+    }
+    if (off & TB_ITALIC) n = sgr_put(buf, n, 23);
+    if (off & TB_BLINK) n = sgr_put(buf, n, 25);
+    if (off & TB_REVERSE) n = sgr_put(buf, n, 27);
+#if TB_OPT_ATTR_W == 64
+    if (off & TB_INVISIBLE) n = sgr_put(buf, n, 28);
+    if (off & TB_STRIKEOUT) n = sgr_put(buf, n, 29);
+    if (off & TB_OVERLINE) n = sgr_put(buf, n, 55);
+#endif
+
+    uintattr_t on = to & ~from;
+    if (on & TB_BOLD) n = sgr_put(buf, n, 1);
+    if (on & TB_DIM) n = sgr_put(buf, n, 2);
+    if (on & TB_ITALIC) n = sgr_put(buf, n, 3);
+    if (on & TB_UNDERLINE) n = sgr_put(buf, n, 4);
+    if (on & TB_BLINK) n = sgr_put(buf, n, 5);
+    if (on & TB_REVERSE) n = sgr_put(buf, n, 7);
+#if TB_OPT_ATTR_W == 64
+    if (on & TB_INVISIBLE) n = sgr_put(buf, n, 8);
+    if (on & TB_STRIKEOUT) n = sgr_put(buf, n, 9);
+    if (on & TB_UNDERLINE_2) n = sgr_put(buf, n, 21);
+    if (on & TB_OVERLINE) n = sgr_put(buf, n, 53);
+#endif
+
+    if (fgd != pfgd || (!fgd && cfg != pfg)) {
+        n = fgd ? sgr_put(buf, n, 39) : sgr_put_color(buf, n, cfg, 0);
+    }
+    if (bgd != pbgd || (!bgd && cbg != pbg)) {
+        n = bgd ? sgr_put(buf, n, 49) : sgr_put_color(buf, n, cbg, 1);
+    }
+    return n;
+}
+
+// Return the SGR attributes that `fg`,`bg` turn on, with TB_REVERSE standing
+// for reverse from either side and attributes the terminal lacks dropped
+static uintattr_t sgr_flags(uintattr_t fg, uintattr_t bg) {
+    uintattr_t flags = fg & (TB_BOLD | TB_UNDERLINE | TB_ITALIC | TB_BLINK |
+                                TB_DIM);
+#if TB_OPT_ATTR_W == 64
+    flags |= fg & (TB_STRIKEOUT | TB_UNDERLINE_2 | TB_OVERLINE | TB_INVISIBLE);
+    if (!*global.caps[TB_CAP_INVISIBLE]) flags &= ~TB_INVISIBLE;
+#endif
+    if ((fg & TB_REVERSE) || (bg & TB_REVERSE)) flags |= TB_REVERSE;
+    if (!*global.caps[TB_CAP_BOLD]) flags &= ~TB_BOLD;
+    if (!*global.caps[TB_CAP_UNDERLINE]) flags &= ~TB_UNDERLINE;
+    if (!*global.caps[TB_CAP_ITALIC]) flags &= ~TB_ITALIC;
+    if (!*global.caps[TB_CAP_BLINK]) flags &= ~TB_BLINK;
+    if (!*global.caps[TB_CAP_DIM]) flags &= ~TB_DIM;
+    if (!*global.caps[TB_CAP_REVERSE]) flags &= ~TB_REVERSE;
+    return flags;
+}
+
+// Append an SGR color parameter for the output mode. Returns the new length.
+static size_t sgr_put_color(char *buf, size_t n, uint32_t c, int is_bg) {
+    switch (global.output_mode) {
+        default:
+        case TB_OUTPUT_NORMAL:
+            n = sgr_put(buf, n, c);
+            break;
+
+        case TB_OUTPUT_256:
+        case TB_OUTPUT_216:
+        case TB_OUTPUT_GRAYSCALE:
+            n = sgr_put(buf, n, is_bg ? 48 : 38);
+            n = sgr_put(buf, n, 5);
+            n = sgr_put(buf, n, c);
+            break;
+
+#if TB_OPT_ATTR_W >= 32
+        case TB_OUTPUT_TRUECOLOR:
+            n = sgr_put(buf, n, is_bg ? 48 : 38);
+            n = sgr_put(buf, n, 2);
+            n = sgr_put(buf, n, (c >> 16) & 0xff);
+            n = sgr_put(buf, n, (c >> 8) & 0xff);
+            n = sgr_put(buf, n, c & 0xff);
+            break;
+#endif
+    }
+    return n;
+}
+
+// Append `num` to a `;`-separated SGR parameter list. Returns the new length.
+static size_t sgr_put(char *buf, size_t n, uint32_t num) {
+    if (n > 0) buf[n++] = ';';
+    return n + (size_t)convert_num(num, buf + n);
+}
+
+// Return the SGR color number of `attr` for the output mode
+static uint32_t attr_color(uintattr_t attr, int is_bg) {
+    uint32_t c;
+    switch (global.output_mode) {
+        default:
+        case TB_OUTPUT_NORMAL:
+            // The minus 1 below is because our colors are 1-indexed starting
+            // from black. Black is represented by a 30, 40, 90, or 100 for fg,
+            // bg, bright fg, or bright bg respectively. Red is 31, 41, 91,
+            // 101, etc.
+            c = (attr & TB_BRIGHT ? 90 : 30) + (attr & 0x0f) - 1;
+            if (is_bg) c += 10;
+            break;
+
+        case TB_OUTPUT_256:
+            c = attr & 0xff;
+            if (attr & TB_HI_BLACK) c = 0;
+            break;
+
+        case TB_OUTPUT_216:
+            c = attr & 0xff;
+            if (c > 216) c = 216;
+            c += 0x0f;
+            break;
+
+        case TB_OUTPUT_GRAYSCALE:
+            c = attr & 0xff;
+            if (c > 24) c = 24;
+            c += 0xe7;
+            break;
+
+#if TB_OPT_ATTR_W >= 32
+        case TB_OUTPUT_TRUECOLOR:
+            c = attr & 0xffffff;
+            if (attr & TB_HI_BLACK) c = 0;
+            break;
+#endif
+    }
+    return c;
+}
+
+// Return whether `attr` selects the terminal's default color
+static int attr_is_default(uintattr_t attr) {
+#if TB_OPT_ATTR_W >= 32
+    if (global.output_mode == TB_OUTPUT_TRUECOLOR) {
+        return ((attr & 0xffffff) == 0) && ((attr & TB_HI_BLACK) == 0);
+    }
+#endif
+    if (global.output_mode == TB_OUTPUT_256 && (attr & TB_HI_BLACK)) {
+        return 0;
+    }
+    return (attr & 0xff) == 0;
+}
+
 static int send_cursor_if(int x, int y) {
     int rv;
     char nbuf[32];
@@ -3977,15 +5791,192 @@ static int send_char(int x, int y, uint32_t ch) {
     return send_cluster(x, y, &ch, 1);
 }
 
+// Move the cursor to `x`,`y` unless the last write left it there
+static int send_move(int x, int y) {
+    int rv;
+    if (global.last_x != x - 1 || global.last_y != y) {
+        if (global.last_y < 0 || global.last_x < -1) {
+            if_err_return(rv, send_cursor_if(x, y));
+        } else {
+            if_err_return(rv,
+                send_motion(global.last_x + 1, global.last_y, x, y, 0, NULL));
+        }
+    }
+    global.last_x = x - 1;
+    global.last_y = y;
+    return TB_OK;
+}
+
+// Move the cursor from `cx`,`cy` to `x`,`y` with whichever is shortest of CUP
+// or a vertical move (LF, CUU/CUD, VPA) combined with a horizontal one (CR,
+// BS, CUF/CUB, HPA, or writing the front buffer cells in between again).
+// `cx` equal to the width means a wrap is pending in the last column, which
+// only CR, HPA, and CUP are trusted to clear, and only if the terminal is
+// known to defer wrapping (xenl). With `dry` set nothing is sent. Sets `cost`
+// (if not NULL) to the number of bytes the move takes.
+static int send_motion(int cx, int cy, int x, int y, int dry, int *cost) {
+    int rv, c;
+    char nbuf[32];
+    int pending = cx >= global.front.width;
+    int cup = 4 + convert_num(y + 1, nbuf) + convert_num(x + 1, nbuf);
+
+    if (pending && !(global.term_features & TB_TERM_XENL)) {
+        if (cost) *cost = cup;
+        return dry ? TB_OK : send_cursor_if(x, y);
+    }
+
+    // Vertical moves keep the column. A move the terminal has no sequence
+    // for costs as much as CUP, so CUP wins.
+    int f = global.term_features;
+    int dy = y - cy, vn = dy < 0 ? -dy : dy, v = 0, vcost = 0;
+    if (dy != 0) {
+        vcost = cup;
+        if ((f & (dy > 0 ? TB_TERM_CUD : TB_TERM_CUU)) &&
+            (c = csi_cost(vn)) < vcost)
+        {
+            v = dy > 0 ? 'B' : 'A';
+            vcost = c;
+        }
+        if (dy > 0 && vn < vcost) {
+            v = '\n';
+            vcost = vn;
+        }
+        if ((f & TB_TERM_VPA) && (c = 3 + convert_num(y + 1, nbuf)) < vcost) {
+            v = 'd';
+            vcost = c;
+        }
+    }
+
+    // Horizontal moves, optionally from column 0 after a CR
+    int h = 0, hcost = 0, cr = 0, from = cx;
+    if (pending || x != cx) {
+        cr = 1;
+        from = 0;
+        hcost = x > 0 ? cup : 1;
+        if (x > 0 && (f & TB_TERM_CUF) && (c = 1 + csi_cost(x)) < hcost) {
+            h = 'C';
+            hcost = c;
+        }
+        if (x > 0 && (c = rewrite_cost(0, x, y, hcost - 1)) >= 0) {
+            h = 'w';
+            hcost = 1 + c;
+        }
+        if ((f & TB_TERM_HPA) && (c = 3 + convert_num(x + 1, nbuf)) < hcost) {
+            cr = 0;
+            h = 'G';
+            hcost = c;
+        }
+        if (!pending && x > cx) {
+            if ((f & TB_TERM_CUF) && (c = csi_cost(x - cx)) < hcost) {
+                cr = 0;
+                from = cx;
+                h = 'C';
+                hcost = c;
+            }
+            if ((c = rewrite_cost(cx, x, y, hcost - 1)) >= 0) {
+                cr = 0;
+                from = cx;
+                h = 'w';
+                hcost = c;
+            }
+        } else if (!pending && x < cx) {
+            if (cx - x < hcost) {
+                cr = 0;
+                h = '\b';
+                hcost = cx - x;
+            }
+            if ((f & TB_TERM_CUB) && (c = csi_cost(cx - x)) < hcost) {
+                cr = 0;
+                h = 'D';
+                hcost = c;
+            }
+        }
+    }
+
+    if (cost) *cost = cup <= vcost + hcost ? cup : vcost + hcost;
+    if (dry) return TB_OK;
+    if (cup <= vcost + hcost) return send_cursor_if(x, y);
+
+    // Absolute column moves go first so they clear a pending wrap
+    if (cr) send_literal(rv, "\r");
+    if (h == 'G') if_err_return(rv, send_csi(x + 1, "G"));
+    if (v == '\n') {
+        for (c = 0; c < vn; c++) send_literal(rv, "\n");
+    } else if (v == 'd') {
+        if_err_return(rv, send_csi(y + 1, "d"));
+    } else if (v) {
+        if_err_return(rv, send_csi(vn, v == 'A' ? "A" : "B"));
+    }
+    if (h == '\b') {
+        for (c = 0; c < cx - x; c++) send_literal(rv, "\b");
+    } else if (h == 'C') {
+        if_err_return(rv, send_csi(x - from, "C"));
+    } else if (h == 'D') {
+        if_err_return(rv, send_csi(cx - x, "D"));
+    } else if (h == 'w') {
+        char chu8[8];
+        struct tb_cell *cell;
+        for (c = from; c < x; c++) {
+            if_err_return(rv, cellbuf_get(&global.front, c, y, &cell));
+            if_err_return(rv,
+                bytebuf_nputs(&global.out, chu8,
+                    (size_t)tb_utf8_unicode_to_char(chu8, cell->ch)));
+        }
+    }
+    return TB_OK;
+}
+
+// Return the number of bytes it takes to write front buffer cells `x0` up to
+// `x1` of row `y` again, or -1 if that can't be done with the current
+// attributes or would take more than `limit` bytes
+static int rewrite_cost(int x0, int x1, int y, int limit) {
+    int x, cost = 0;
+    char chu8[8];
+    struct tb_cell *cell;
+    if (!global.last_attr_known || x1 - x0 > limit) return -1;
+    for (x = x0; x < x1; x++) {
+        if (cellbuf_get(&global.front, x, y, &cell) != TB_OK) return -1;
+#ifdef TB_OPT_EGC
+        if (cell->nech > 0) return -1;
+#endif
+        if (cell->fg != global.last_fg || cell->bg != global.last_bg ||
+            !tb_iswprint(cell->ch) || tb_wcwidth(cell->ch) != 1)
+        {
+            return -1;
+        }
+        cost += tb_utf8_unicode_to_char(chu8, cell->ch);
+        if (cost > limit) return -1;
+    }
+    return cost;
+}
+
+// Return the length of `CSI n <final>`, where `n` is left out when it's 1
+static int csi_cost(int n) {
+    char nbuf[32];
+    return n == 1 ? 3 : 3 + convert_num(n, nbuf);
+}
+
+static int send_csi(int n, const char *final) {
+    int rv;
+    char nbuf[32];
+    send_literal(rv, "\x1b[");
+    if (n != 1) send_num(rv, nbuf, n);
+    if_err_return(rv, bytebuf_puts(&global.out, final));
+    return TB_OK;
+}
+
 static int send_cluster(int x, int y, uint32_t *ch, size_t nch) {
     int rv;
     char chu8[8];
 
-    if (global.last_x != x - 1 || global.last_y != y) {
-        if_err_return(rv, send_cursor_if(x, y));
-    }
+    if_err_return(rv, send_move(x, y));
     global.last_x = x;
-    global.last_y = y;
+    if (tb_wcswidth(ch, nch) != 1) {
+        // Terminals disagree on how far wide and zero-width characters move
+        // the cursor, so position it absolutely before the next write
+        global.last_x = -1;
+        global.last_y = -1;
+    }
 
     int i;
     for (i = 0; i < (int)nch; i++) {
@@ -4000,6 +5991,213 @@ static int send_cluster(int x, int y, uint32_t *ch, size_t nch) {
     return TB_OK;
 }
 
+#ifndef TB_OPT_NO_RLE
+// Send the run of identical narrow cells that starts at `x`,`y` in the back
+// buffer as a single sequence if that is shorter than writing it out: EL when
+// blanks reach the end of the row, else ECH for blanks or REP for anything
+// else. Sets `n` to the number of cells sent, or 0 if nothing was sent and
+// the caller should write the cell as usual. Attributes must already be set.
+static int send_run(int x, int y, int *n) {
+    int rv, r, len, cost;
+    char chu8[8];
+    char nbuf[32];
+    struct tb_cell *cell;
+
+    *n = 0;
+    if_err_return(rv, cellbuf_get(&global.back, x, y, &cell));
+#ifdef TB_OPT_EGC
+    if (cell->nech > 0) return TB_OK;
+#endif
+    if (cell_width(cell) != 1 || !tb_iswprint(cell->ch)) return TB_OK;
+    uint32_t ch = cell->ch;
+    uintattr_t fg = cell->fg, bg = cell->bg;
+
+    for (r = 1; x + r < global.back.width; r++) {
+        if_err_return(rv, cellbuf_get(&global.back, x + r, y, &cell));
+        if (cell->ch != ch || cell->fg != fg || cell->bg != bg) break;
+#ifdef TB_OPT_EGC
+        if (cell->nech > 0) break;
+#endif
+    }
+    if (r < 2) return TB_OK;
+
+    len = tb_utf8_unicode_to_char(chu8, ch);
+    int eol = x + r == global.back.width;
+
+    if (ch == ' ' && run_is_erasable(fg, bg)) {
+        if (eol && r * len > 3) {
+            if_err_return(rv, send_move(x, y));
+            send_literal(rv, "\x1b[K");
+            *n = r;
+            return TB_OK;
+        }
+        if (global.term_features & TB_TERM_ECH) {
+            // ECH leaves the cursor at `x`, so count moving past the run
+            cost = 3 + convert_num(r, nbuf);
+            if (!eol) {
+                int move;
+                if_err_return(rv, send_motion(x, y, x + r, y, 1, &move));
+                cost += move;
+            }
+            if (cost < r * len) {
+                if_err_return(rv, send_move(x, y));
+                send_literal(rv, "\x1b[");
+                send_num(rv, nbuf, r);
+                send_literal(rv, "X");
+                *n = r;
+                return TB_OK;
+            }
+        }
+    }
+
+    if (global.term_features & TB_TERM_REP) {
+        cost = len + 3 + convert_num(r - 1, nbuf);
+        if (cost < r * len) {
+            if_err_return(rv, send_char(x, y, ch));
+            send_literal(rv, "\x1b[");
+            send_num(rv, nbuf, r - 1);
+            send_literal(rv, "b");
+            global.last_x = x + r - 1;
+            *n = r;
+        }
+    }
+    return TB_OK;
+}
+
+// Return whether blanks with these attributes look the same as erased cells
+static int run_is_erasable(uintattr_t fg, uintattr_t bg) {
+    uintattr_t visible = TB_UNDERLINE | TB_REVERSE;
+#if TB_OPT_ATTR_W == 64
+    visible |= TB_STRIKEOUT | TB_UNDERLINE_2 | TB_OVERLINE;
+#endif
+    if ((fg & visible) || (bg & TB_REVERSE)) return 0;
+    // Without bce, terminals erase to the default background
+    return (global.term_features & TB_TERM_BCE) || attr_is_default(bg);
+}
+#endif
+
+#ifndef TB_OPT_NO_SCROLL
+// Look for a run of back buffer rows that equal front buffer rows shifted by
+// `n` (up if positive, down if negative) and would save repainting at least 2
+// rows if the terminal scrolled rows `top`..`bot` instead. Only scrolls the
+// terminfo entry has sequences for are considered. Returns 1 if found.
+//
+// Front buffer row hashes are kept from one present to the next (see
+// `update_front_hash`), so only dirty back rows are hashed here.
+static int find_scroll(int *n, int *top, int *bot) {
+    int h = global.front.height;
+    int y, k, dir, ndirty = 0, best = 1;
+    int up = global.term_features & TB_TERM_INDN;
+    int down = global.term_features & TB_TERM_RIN;
+    int csr = global.term_features & TB_TERM_CSR;
+    uint64_t *bh, *fh;
+
+    if (!up && !down) return 0;
+    for (y = 0; y < h; y++) ndirty += global.back.dirty[y] != 0;
+    if (ndirty < 2) return 0;
+
+    if (global.crowhash < (size_t)h * 2) {
+        uint64_t *rowhash = (uint64_t *)tb_realloc(global.rowhash,
+            sizeof(*rowhash) * h * 2);
+        if (!rowhash) return 0;
+        global.rowhash = rowhash;
+        global.crowhash = (size_t)h * 2;
+        global.fronthash_ok = 0;
+    }
+    bh = global.rowhash;
+    fh = global.rowhash + h;
+    if (!global.fronthash_ok) {
+        for (y = 0; y < h; y++) fh[y] = cellbuf_row_hash(&global.front, y);
+        global.fronthash_ok = 1;
+    }
+    for (y = 0; y < h; y++) {
+        // A clean back row is known to match what's on screen
+        bh[y] = global.back.dirty[y] ? cellbuf_row_hash(&global.back, y)
+                                     : fh[y];
+    }
+    global.backhash_ok = 1;
+
+    *n = 0;
+    for (k = 1; k < h - 1; k++) {
+        for (dir = 1; dir >= -1; dir -= 2) {
+            if (!(dir > 0 ? up : down)) continue;
+            int lo = dir > 0 ? 0 : k, hi = dir > 0 ? h - k : h;
+            int start = -1, saved = 0;
+            for (y = lo; y <= hi; y++) {
+                if (y < hi && bh[y] == fh[y + (dir * k)]) {
+                    if (start < 0) {
+                        start = y;
+                        saved = 0;
+                    }
+                    saved += bh[y] != fh[y];
+                    continue;
+                }
+                if (start < 0) continue;
+
+                // Rows scrolled in must be repainted, even if they matched
+                int i, e0 = dir > 0 ? y : start - k, net = saved;
+                int t = dir > 0 ? start : start - k;
+                int b = dir > 0 ? y - 1 + k : y - 1;
+                for (i = e0; i < e0 + k; i++) net -= bh[i] == fh[i];
+                // Without csr only the whole screen can scroll
+                if (net > best && (csr || (t == 0 && b == h - 1))) {
+                    best = net;
+                    *n = dir * k;
+                    *top = t;
+                    *bot = b;
+                }
+                start = -1;
+            }
+        }
+    }
+    if (*n == 0) return 0;
+
+    // Hashes can collide; make sure the moved rows really match
+    int first = *n > 0 ? *top : *top - *n;
+    int last = *n > 0 ? *bot - *n : *bot;
+    for (y = first; y <= last; y++) {
+        if (!cellbuf_row_eq(&global.back, y, &global.front, y + *n)) return 0;
+    }
+    return 1;
+}
+
+// Record the hash of front buffer row `y` after `tb_present` rewrote it. The
+// row now equals the back row, so a hash taken by `find_scroll` this present
+// is reused.
+static void update_front_hash(int y) {
+    if (!global.fronthash_ok) return;
+    global.rowhash[global.front.height + y] =
+        global.backhash_ok ? global.rowhash[y]
+                           : cellbuf_row_hash(&global.front, y);
+}
+
+// Scroll rows `top`..`bot` of the terminal up by `n` rows (down if negative).
+// Setting the scroll region homes the cursor, so forget where it is.
+static int send_scroll(int n, int top, int bot) {
+    int rv;
+    char nbuf[32];
+    int region = top > 0 || bot < global.front.height - 1;
+    if (region) {
+        send_literal(rv, "\x1b[");
+        send_num(rv, nbuf, top + 1);
+        send_literal(rv, ";");
+        send_num(rv, nbuf, bot + 1);
+        send_literal(rv, "r");
+    }
+    send_literal(rv, "\x1b[");
+    send_num(rv, nbuf, n > 0 ? n : -n);
+    if (n > 0) {
+        send_literal(rv, "S");
+    } else {
+        send_literal(rv, "T");
+    }
+    if (region) send_literal(rv, "\x1b[r");
+    global.last_x = -1;
+    global.last_y = -1;
+    return TB_OK;
+}
+#endif
+
 static int convert_num(uint32_t num, char *buf) {
     int i, l = 0;
     char ch;
@@ -4029,6 +6227,59 @@ static int cell_cmp(struct tb_cell *a, struct tb_cell *b) {
     return 0;
 }
 
+// Number of columns `cell` takes on screen (at least 1)
+static int cell_width(struct tb_cell *cell) {
+    int w;
+#ifdef TB_OPT_EGC
+    if (cell->nech > 0)
+        w = tb_wcswidth(cell->ech, cell->nech);
+    else
+#endif
+        w = tb_wcwidth((wchar_t)cell->ch);
+    return w < 1 ? 1 : w; // wcwidth returns -1 for invalid codepoints
+}
+
+// Back up from column `x` of row `y` past the cells a wide char covers, to a
+// column `tb_present_ex` would reach walking the row from 0. Cells left of
+// the first that may differ are the same in both buffers, and the front
+// buffer holds an invalid codepoint in every cell a wide char covers.
+static int front_row_head(int y, int x) {
+    struct tb_cell *front;
+    while (x > 0 && cellbuf_get(&global.front, x, y, &front) == TB_OK &&
+           front->ch == (uint32_t)-1) {
+        x--;
+    }
+    return x;
+}
+
+#ifndef TB_OPT_SOA
+// Cheap pre-check for `cell_cmp`: returns 0 only if `a` and `b` are certainly
+// equal. Cells carrying a grapheme cluster always report a possible difference
+// and are left to `cell_cmp`.
+static int cell_maybe_differs(const struct tb_cell *a,
+    const struct tb_cell *b) {
+#ifdef TB_OPT_EGC
+    if (a->nech > 0 || b->nech > 0) return 1;
+#endif
+#if defined(TB_SIMD_AVX2)
+    // Bytes 0-3 (ch) and 8-23 (fg, bg); skip padding and the ech pointer
+    const int mask = 0x00ffff0f;
+    __m256i va = _mm256_loadu_si256((const __m256i *)a);
+    __m256i vb = _mm256_loadu_si256((const __m256i *)b);
+    int eq = _mm256_movemask_epi8(_mm256_cmpeq_epi8(va, vb));
+    return (eq & mask) != mask;
+#elif defined(TB_SIMD_SSE2)
+    // Bytes 0-3 (ch) and 8-15 (fg) in one compare, then bg
+    const int mask = 0xff0f;
+    __m128i va = _mm_loadu_si128((const __m128i *)a);
+    __m128i vb = _mm_loadu_si128((const __m128i *)b);
+    int eq = _mm_movemask_epi8(_mm_cmpeq_epi8(va, vb));
+    return (eq & mask) != mask || a->bg != b->bg;
+#else
+    return a->ch != b->ch || a->fg != b->fg || a->bg != b->bg;
+#endif
+}
+
 static int cell_copy(struct tb_cell *dst, struct tb_cell *src) {
 #ifdef TB_OPT_EGC
     if (src->nech > 0) {
@@ -4087,6 +6338,13 @@ static int cellbuf_init(struct cellbuf *c, int w, int h) {
     c->cells = (struct tb_cell *)tb_malloc(sizeof(struct tb_cell) * w * h);
     if (!c->cells) return TB_ERR_MEM;
     memset(c->cells, 0, sizeof(struct tb_cell) * w * h);
+    c->dirty = (uint8_t *)tb_malloc(h > 0 ? h : 1);
+    if (!c->dirty) {
+        tb_free(c->cells);
+        c->cells = NULL;
+        return TB_ERR_MEM;
+    }
+    memset(c->dirty, 1, h > 0 ? h : 1);
     c->width = w;
     c->height = h;
     return TB_OK;
@@ -4100,6 +6358,7 @@ static int cellbuf_free(struct cellbuf *c) {
         }
         tb_free(c->cells);
     }
+    if (c->dirty) tb_free(c->dirty);
     memset(c, 0, sizeof(*c));
     return TB_OK;
 }
@@ -4111,7 +6370,7 @@ static int cellbuf_clear(struct cellbuf *c) {
         if_err_return(rv,
             cell_set(&c->cells[i], &space, 1, global.fg, global.bg));
     }
-    return TB_OK;
+    return cellbuf_mark_dirty(c, 0, c->height);
 }
 
 static int cellbuf_get(struct cellbuf *c, int x, int y,
@@ -4124,10 +6383,54 @@ static int cellbuf_get(struct cellbuf *c, int x, int y,
     return TB_OK;
 }
 
-static int cellbuf_in_bounds(struct cellbuf *c, int x, int y) {
-    if (x < 0 || x >= c->width || y < 0 || y >= c->height) {
-        return 0;
+static int cellbuf_put(struct cellbuf *c, int x, int y, uint32_t *ch,
+    size_t nch, uintattr_t fg, uintattr_t bg) {
+    if (!cellbuf_in_bounds(c, x, y)) return TB_ERR_OUT_OF_BOUNDS;
+    return cell_set(&c->cells[(y * c->width) + x], ch, nch, fg, bg);
+}
+
+static int cellbuf_put_cell(struct cellbuf *c, int x, int y,
+    struct tb_cell *src) {
+    if (!cellbuf_in_bounds(c, x, y)) return TB_ERR_OUT_OF_BOUNDS;
+    return cell_copy(&c->cells[(y * c->width) + x], src);
+}
+
+#ifdef TB_OPT_EGC
+static int cellbuf_extend(struct cellbuf *c, int x, int y, uint32_t ch) {
+    int rv;
+    struct tb_cell *cell;
+    size_t nech;
+    if_err_return(rv, cellbuf_get(c, x, y, &cell));
+    if (cell->nech > 0) { // append to ech
+        nech = cell->nech + 1;
+        if_err_return(rv, cell_reserve_ech(cell, nech + 1));
+        cell->ech[nech - 1] = ch;
+    } else { // make new ech
+        nech = 2;
+        if_err_return(rv, cell_reserve_ech(cell, nech + 1));
+        cell->ech[0] = cell->ch;
+        cell->ech[1] = ch;
     }
+    cell->ech[nech] = '\0';
+    cell->nech = nech;
+    return TB_OK;
+}
+#endif
+
+// Find the first and last columns of row `y` where the back and front buffers
+// may differ. Returns 0 if the whole row is certainly unchanged.
+static int cellbuf_row_span(int y, int *first, int *last) {
+    int w = global.front.width;
+    const struct tb_cell *b = &global.back.cells[y * global.back.width];
+    const struct tb_cell *f = &global.front.cells[y * w];
+    int lo = 0, hi = w - 1;
+
+    while (lo < w && !cell_maybe_differs(&b[lo], &f[lo])) lo++;
+    if (lo == w) return 0;
+    while (hi > lo && !cell_maybe_differs(&b[hi], &f[hi])) hi--;
+
+    *first = lo;
+    *last = hi;
     return 1;
 }
 
@@ -4148,6 +6451,7 @@ static int cellbuf_resize(struct cellbuf *c, int w, int h) {
     int minh = (h < oh) ? h : oh;
 
     struct tb_cell *prev = c->cells;
+    uint8_t *prev_dirty = c->dirty;
 
     if_err_return(rv, cellbuf_init(c, w, h));
     if_err_return(rv, cellbuf_clear(c));
@@ -4163,10 +6467,523 @@ static int cellbuf_resize(struct cellbuf *c, int w, int h) {
     }
 
     tb_free(prev);
+    if (prev_dirty) tb_free(prev_dirty);
+
+    return TB_OK;
+}
+
+#else // TB_OPT_SOA
+
+#ifdef TB_OPT_EGC
+static struct cellbuf_egc *cellbuf_egc_probe(struct cellbuf *c, uint32_t idx) {
+    // Return the slot holding `idx`, or the free slot where it would go
+    size_t mask, i;
+    if (!c->cegc) return NULL;
+    mask = c->cegc - 1;
+    i = (size_t)(idx * 2654435761u) & mask;
+    while (c->egc[i].idx != TB_SOA_NO_EGC && c->egc[i].idx != idx) {
+        i = (i + 1) & mask;
+    }
+    return &c->egc[i];
+}
+
+static int cellbuf_egc_insert(struct cellbuf *c, uint32_t idx,
+    struct cellbuf_egc **out) {
+    struct cellbuf_egc *e;
+    if ((c->negc + 1) * 4 > c->cegc * 3) { // keep load under 3/4
+        size_t i, ocegc = c->cegc;
+        size_t ncegc = ocegc ? ocegc * 2 : 16;
+        struct cellbuf_egc *oegc = c->egc;
+        struct cellbuf_egc *negc =
+            (struct cellbuf_egc *)tb_malloc(sizeof(*negc) * ncegc);
+        if (!negc) return TB_ERR_MEM;
+        for (i = 0; i < ncegc; i++) negc[i].idx = TB_SOA_NO_EGC;
+        c->egc = negc;
+        c->cegc = ncegc;
+        for (i = 0; i < ocegc; i++) {
+            if (oegc[i].idx == TB_SOA_NO_EGC) continue;
+            *cellbuf_egc_probe(c, oegc[i].idx) = oegc[i];
+        }
+        if (oegc) tb_free(oegc);
+    }
+    e = cellbuf_egc_probe(c, idx);
+    if (e->idx != idx) {
+        memset(e, 0, sizeof(*e));
+        e->idx = idx;
+        c->negc++;
+    }
+    *out = e;
+    return TB_OK;
+}
+
+static int cellbuf_egc_reserve(struct cellbuf_egc *e, size_t n) {
+    if (e->cech >= n) return TB_OK;
+    e->ech = (uint32_t *)tb_realloc(e->ech, n * sizeof(*e->ech));
+    if (!e->ech) return TB_ERR_MEM;
+    e->cech = n;
+    return TB_OK;
+}
+
+static int cellbuf_egc_remove(struct cellbuf *c, uint32_t idx) {
+    size_t mask, i, j;
+    struct cellbuf_egc *e = cellbuf_egc_probe(c, idx);
+    if (!e || e->idx != idx) return TB_OK;
+    if (e->ech) tb_free(e->ech);
+
+    // Backward-shift deletion: pull later entries of the probe chain into the
+    // hole unless that would move them in front of their home slot
+    mask = c->cegc - 1;
+    i = (size_t)(e - c->egc);
+    for (j = (i + 1) & mask; c->egc[j].idx != TB_SOA_NO_EGC;
+         j = (j + 1) & mask) {
+        size_t home = (size_t)(c->egc[j].idx * 2654435761u) & mask;
+        if (((j - home) & mask) >= ((j - i) & mask)) {
+            c->egc[i] = c->egc[j];
+            i = j;
+        }
+    }
+    c->egc[i].idx = TB_SOA_NO_EGC;
+    c->negc--;
+    return TB_OK;
+}
+
+static int cellbuf_egc_clear(struct cellbuf *c) {
+    size_t i;
+    for (i = 0; i < c->cegc; i++) {
+        if (c->egc[i].idx == TB_SOA_NO_EGC) continue;
+        if (c->egc[i].ech) tb_free(c->egc[i].ech);
+        c->egc[i].idx = TB_SOA_NO_EGC;
+    }
+    c->negc = 0;
+    return TB_OK;
+}
+#endif
+
+// Cheap pre-check for `cell_cmp` on cell index `i` of the back and front
+// buffers. Cells carrying a grapheme cluster (or the invalid marker, which
+// shares the tag bit) always report a possible difference.
+static int cellbuf_cell_maybe_differs(size_t i) {
+    uint32_t b = global.back.ch[i], f = global.front.ch[i];
+    return ((b | f) & TB_SOA_EGC_BIT) || b != f ||
+           global.back.fg[i] != global.front.fg[i] ||
+           global.back.bg[i] != global.front.bg[i];
+}
+
+// Like `cellbuf_cell_maybe_differs` for the 8 cells starting at index `i`
+#define TB_SOA_BLOCK 8
+static int cellbuf_block_maybe_differs(size_t i) {
+#if defined(TB_SIMD_AVX2) || defined(TB_SIMD_SSE2)
+    const __m128i tag = _mm_set1_epi32(TB_SOA_EGC_BIT);
+    const __m128i zero = _mm_setzero_si128();
+    const unsigned char *bfg = (const unsigned char *)&global.back.fg[i];
+    const unsigned char *ffg = (const unsigned char *)&global.front.fg[i];
+    const unsigned char *bbg = (const unsigned char *)&global.back.bg[i];
+    const unsigned char *fbg = (const unsigned char *)&global.front.bg[i];
+    __m128i eq = _mm_cmpeq_epi8(zero, zero);
+    __m128i tags = zero;
+    size_t k;
+    for (k = 0; k < TB_SOA_BLOCK; k += 4) {
+        __m128i vb = _mm_loadu_si128((const __m128i *)&global.back.ch[i + k]);
+        __m128i vf = _mm_loadu_si128((const __m128i *)&global.front.ch[i + k]);
+        eq = _mm_and_si128(eq, _mm_cmpeq_epi32(vb, vf));
+        tags = _mm_or_si128(tags, _mm_and_si128(_mm_or_si128(vb, vf), tag));
+    }
+    for (k = 0; k < sizeof(uintattr_t) * TB_SOA_BLOCK; k += 16) {
+        eq = _mm_and_si128(eq,
+            _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(bfg + k)),
+                _mm_loadu_si128((const __m128i *)(ffg + k))));
+        eq = _mm_and_si128(eq,
+            _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(bbg + k)),
+                _mm_loadu_si128((const __m128i *)(fbg + k))));
+    }
+    return _mm_movemask_epi8(eq) != 0xffff ||
+           _mm_movemask_epi8(_mm_cmpeq_epi32(tags, zero)) != 0xffff;
+#else
+    size_t k;
+    for (k = 0; k < TB_SOA_BLOCK; k++) {
+        if (cellbuf_cell_maybe_differs(i + k)) return 1;
+    }
+    return 0;
+#endif
+}
+
+// Find the first and last columns of row `y` where the back and front buffers
+// may differ. Returns 0 if the whole row is certainly unchanged.
+static int cellbuf_row_span(int y, int *first, int *last) {
+    int w = global.front.width;
+    size_t row = (size_t)y * w;
+    int lo = 0, hi = w - 1;
+
+    while (lo + TB_SOA_BLOCK <= w && !cellbuf_block_maybe_differs(row + lo)) {
+        lo += TB_SOA_BLOCK;
+    }
+    while (lo < w && !cellbuf_cell_maybe_differs(row + lo)) lo++;
+    if (lo == w) return 0;
+    while (hi - (TB_SOA_BLOCK - 1) > lo &&
+           !cellbuf_block_maybe_differs(row + hi - (TB_SOA_BLOCK - 1))) {
+        hi -= TB_SOA_BLOCK;
+    }
+    while (hi > lo && !cellbuf_cell_maybe_differs(row + hi)) hi--;
+
+    *first = lo;
+    *last = hi;
+    return 1;
+}
+
+static int cellbuf_init(struct cellbuf *c, int w, int h) {
+    size_t n = (size_t)w * h;
+    if (n < 1) n = 1;
+    memset(c, 0, sizeof(*c));
+    c->ch = (uint32_t *)tb_malloc(sizeof(*c->ch) * n);
+    c->fg = (uintattr_t *)tb_malloc(sizeof(*c->fg) * n);
+    c->bg = (uintattr_t *)tb_malloc(sizeof(*c->bg) * n);
+    c->dirty = (uint8_t *)tb_malloc(h > 0 ? h : 1);
+    if (!c->ch || !c->fg || !c->bg || !c->dirty) {
+        cellbuf_free(c);
+        return TB_ERR_MEM;
+    }
+    memset(c->ch, 0, sizeof(*c->ch) * n);
+    memset(c->fg, 0, sizeof(*c->fg) * n);
+    memset(c->bg, 0, sizeof(*c->bg) * n);
+    memset(c->dirty, 1, h > 0 ? h : 1);
+    c->width = w;
+    c->height = h;
+    return TB_OK;
+}
 
+static int cellbuf_free(struct cellbuf *c) {
+#ifdef TB_OPT_EGC
+    cellbuf_egc_clear(c);
+#endif
+    if (c->egc) tb_free(c->egc);
+    if (c->ch) tb_free(c->ch);
+    if (c->fg) tb_free(c->fg);
+    if (c->bg) tb_free(c->bg);
+    if (c->dirty) tb_free(c->dirty);
+    memset(c, 0, sizeof(*c));
     return TB_OK;
 }
 
+static int cellbuf_clear(struct cellbuf *c) {
+    size_t i, n = (size_t)c->width * c->height;
+    for (i = 0; i < n; i++) {
+        c->ch[i] = (uint32_t)' ';
+        c->fg[i] = global.fg;
+        c->bg[i] = global.bg;
+    }
+#ifdef TB_OPT_EGC
+    cellbuf_egc_clear(c);
+#endif
+    return cellbuf_mark_dirty(c, 0, c->height);
+}
+
+static int cellbuf_get(struct cellbuf *c, int x, int y,
+    struct tb_cell **out) {
+    size_t i;
+    if (!cellbuf_in_bounds(c, x, y)) {
+        *out = NULL;
+        return TB_ERR_OUT_OF_BOUNDS;
+    }
+    i = ((size_t)y * c->width) + x;
+    c->view.ch = c->ch[i];
+    c->view.fg = c->fg[i];
+    c->view.bg = c->bg[i];
+#ifdef TB_OPT_EGC
+    c->view.ech = NULL;
+    c->view.nech = 0;
+    c->view.cech = 0;
+    if ((c->view.ch & TB_SOA_TAG_MASK) == TB_SOA_EGC_BIT) {
+        struct cellbuf_egc *e = cellbuf_egc_probe(c, (uint32_t)i);
+        c->view.ch = e->ech[0];
+        c->view.ech = e->ech;
+        c->view.nech = e->nech;
+        c->view.cech = e->cech;
+    }
+#endif
+    *out = &c->view;
+    return TB_OK;
+}
+
+static int cellbuf_put(struct cellbuf *c, int x, int y, uint32_t *ch,
+    size_t nch, uintattr_t fg, uintattr_t bg) {
+    // TODO: iswprint ch?
+    size_t i;
+    uint32_t cp = ch ? *ch : 0;
+    if (!cellbuf_in_bounds(c, x, y)) return TB_ERR_OUT_OF_BOUNDS;
+    i = ((size_t)y * c->width) + x;
+    if ((cp & TB_SOA_TAG_MASK) == TB_SOA_EGC_BIT) cp = 0xfffd;
+#ifdef TB_OPT_EGC
+    if (nch > 1) {
+        int rv;
+        struct cellbuf_egc *e;
+        if_err_return(rv, cellbuf_egc_insert(c, (uint32_t)i, &e));
+        if_err_return(rv, cellbuf_egc_reserve(e, nch + 1));
+        memcpy(e->ech, ch, sizeof(*ch) * nch);
+        e->ech[nch] = '\0';
+        e->nech = nch;
+        cp = TB_SOA_EGC_BIT;
+    } else if ((c->ch[i] & TB_SOA_TAG_MASK) == TB_SOA_EGC_BIT) {
+        cellbuf_egc_remove(c, (uint32_t)i);
+    }
+#else
+    (void)nch;
+#endif
+    c->ch[i] = cp;
+    c->fg[i] = fg;
+    c->bg[i] = bg;
+    return TB_OK;
+}
+
+static int cellbuf_put_cell(struct cellbuf *c, int x, int y,
+    struct tb_cell *src) {
+#ifdef TB_OPT_EGC
+    if (src->nech > 0) {
+        return cellbuf_put(c, x, y, src->ech, src->nech, src->fg, src->bg);
+    }
+#endif
+    return cellbuf_put(c, x, y, &src->ch, 1, src->fg, src->bg);
+}
+
+#ifdef TB_OPT_EGC
+static int cellbuf_extend(struct cellbuf *c, int x, int y, uint32_t ch) {
+    int rv;
+    size_t i, nech;
+    struct cellbuf_egc *e;
+    if (!cellbuf_in_bounds(c, x, y)) return TB_ERR_OUT_OF_BOUNDS;
+    i = ((size_t)y * c->width) + x;
+    if ((c->ch[i] & TB_SOA_TAG_MASK) == TB_SOA_EGC_BIT) { // append to ech
+        e = cellbuf_egc_probe(c, (uint32_t)i);
+        nech = e->nech + 1;
+        if_err_return(rv, cellbuf_egc_reserve(e, nech + 1));
+        e->ech[nech - 1] = ch;
+    } else { // make new ech
+        nech = 2;
+        if_err_return(rv, cellbuf_egc_insert(c, (uint32_t)i, &e));
+        if_err_return(rv, cellbuf_egc_reserve(e, nech + 1));
+        e->ech[0] = c->ch[i];
+        e->ech[1] = ch;
+        c->ch[i] = TB_SOA_EGC_BIT;
+    }
+    e->ech[nech] = '\0';
+    e->nech = nech;
+    return TB_OK;
+}
+#endif
+
+static int cellbuf_resize(struct cellbuf *c, int w, int h) {
+    int rv;
+
+    int ow = c->width;
+    int oh = c->height;
+
+    if (ow == w && oh == h) {
+        return TB_OK;
+    }
+
+    w = w < 1 ? 1 : w;
+    h = h < 1 ? 1 : h;
+
+    int minw = (w < ow) ? w : ow;
+    int minh = (h < oh) ? h : oh;
+
+    struct cellbuf prev = *c;
+
+    if_err_return(rv, cellbuf_init(c, w, h));
+    if_err_return(rv, cellbuf_clear(c));
+
+    int y;
+    for (y = 0; y < minh; y++) {
+        size_t src = (size_t)y * ow, dst = (size_t)y * w;
+        memcpy(&c->ch[dst], &prev.ch[src], sizeof(*c->ch) * minw);
+        memcpy(&c->fg[dst], &prev.fg[src], sizeof(*c->fg) * minw);
+        memcpy(&c->bg[dst], &prev.bg[src], sizeof(*c->bg) * minw);
+    }
+
+#ifdef TB_OPT_EGC
+    // Move surviving clusters over to the new indices
+    size_t i;
+    for (i = 0; i < prev.cegc; i++) {
+        struct cellbuf_egc *src = &prev.egc[i], *dst;
+        int x;
+        if (src->idx == TB_SOA_NO_EGC) continue;
+        x = (int)(src->idx % ow);
+        y = (int)(src->idx / ow);
+        if (x >= minw || y >= minh) continue;
+        if_err_return(rv,
+            cellbuf_egc_insert(c, (uint32_t)((y * w) + x), &dst));
+        dst->ech = src->ech;
+        dst->nech = src->nech;
+        dst->cech = src->cech;
+        src->ech = NULL;
+    }
+#endif
+
+    cellbuf_free(&prev);
+
+    return TB_OK;
+}
+
+#endif // TB_OPT_SOA
+
+static int cellbuf_in_bounds(struct cellbuf *c, int x, int y) {
+    if (x < 0 || x >= c->width || y < 0 || y >= c->height) {
+        return 0;
+    }
+    return 1;
+}
+
+static int cellbuf_mark_dirty(struct cellbuf *c, int y, int n) {
+    if (!c->dirty) return TB_OK;
+    if (y < 0) {
+        n += y;
+        y = 0;
+    }
+    if (y + n > c->height) n = c->height - y;
+    if (n > 0) memset(c->dirty + y, 1, (size_t)n);
+    return TB_OK;
+}
+
+// Set the `n` cells from index `i` (in row-major order) to spaces
+static int cellbuf_blank(struct cellbuf *c, size_t i, size_t n,
+    uintattr_t fg, uintattr_t bg) {
+    int rv;
+    uint32_t space = (uint32_t)' ';
+    int x = (int)(i % c->width), y = (int)(i / c->width);
+    for (; n > 0; n--) {
+        if_err_return(rv, cellbuf_put(c, x, y, &space, 1, fg, bg));
+        if (++x == c->width) {
+            x = 0;
+            y++;
+        }
+    }
+    return TB_OK;
+}
+
+// Move the `n` cells from index `i` by `d` places, dropping the cells they
+// land on and blanking the `|d|` cells left behind. Callers keep the source,
+// the destination and anything between them within one contiguous span.
+static int cellbuf_shift(struct cellbuf *c, size_t i, size_t n, int d,
+    uintattr_t fg, uintattr_t bg) {
+    size_t dist = (size_t)(d < 0 ? -d : d);
+    size_t dst = d < 0 ? i - dist : i + dist;
+    size_t gap = d < 0 ? i + n - dist : i;
+#ifndef TB_OPT_SOA
+    // Cells own their grapheme clusters, so free the ones being dropped and
+    // move the rest wholesale
+    size_t k, drop = d < 0 ? dst : i + n;
+    for (k = 0; k < dist; k++) cell_free(&c->cells[drop + k]);
+    memmove(&c->cells[dst], &c->cells[i], sizeof(struct tb_cell) * n);
+    memset(&c->cells[gap], 0, sizeof(struct tb_cell) * dist);
+#else
+    int rv;
+    size_t k, from, to;
+    struct tb_cell *src;
+    for (k = 0; k < n; k++) {
+        from = d < 0 ? i + k : i + n - 1 - k;
+        to = from - i + dst;
+        cellbuf_get(c, (int)(from % c->width), (int)(from / c->width), &src);
+        if_err_return(rv, cellbuf_put_cell(c, (int)(to % c->width),
+                              (int)(to / c->width), src));
+    }
+#endif
+    return cellbuf_blank(c, gap, dist, fg, bg);
+}
+
+// If column `x` of row `y` is a trailing column of a wide character, blank
+// what's left of the character: all of it if `whole`, or else the trailing
+// columns from `x` on, the character itself having been overwritten
+static int cellbuf_unsplit(struct cellbuf *c, int x, int y, int whole) {
+    int rv, end;
+    uint32_t space = (uint32_t)' ';
+    struct tb_cell *cell;
+    if (!cellbuf_in_bounds(c, x, y)) return TB_OK;
+    cellbuf_get(c, x, y, &cell);
+    if (cell->ch != 0) return TB_OK;
+    for (end = x + 1; end < c->width; end++) {
+        cellbuf_get(c, end, y, &cell);
+        if (cell->ch != 0) break;
+    }
+    while (whole && x > 0) {
+        cellbuf_get(c, --x, y, &cell);
+        if (cell->ch != 0) break;
+    }
+    for (; x < end; x++) {
+        cellbuf_get(c, x, y, &cell);
+        if_err_return(rv,
+            cellbuf_put(c, x, y, &space, 1, cell->fg, cell->bg));
+    }
+    return TB_OK;
+}
+
+#ifndef TB_OPT_NO_SCROLL
+// Hash the cells of row `y` that start a character, skipping the columns that
+// wide characters cover (those differ between the back and front buffers)
+static uint64_t cellbuf_row_hash(struct cellbuf *c, int y) {
+    uint64_t h = 14695981039346656037ULL; // FNV-1a, one word at a time
+    struct tb_cell *cell;
+    int x;
+    for (x = 0; x < c->width; x += cell_width(cell)) {
+        cellbuf_get(c, x, y, &cell);
+        h = (h ^ cell->ch) * 1099511628211ULL;
+        h = (h ^ (uint64_t)cell->fg) * 1099511628211ULL;
+        h = (h ^ (uint64_t)cell->bg) * 1099511628211ULL;
+#ifdef TB_OPT_EGC
+        size_t i;
+        for (i = 0; i < cell->nech; i++) {
+            h = (h ^ cell->ech[i]) * 1099511628211ULL;
+        }
+#endif
+    }
+    return h;
+}
+
+// Compare row `ay` of `a` with row `by` of `b` the way `cellbuf_row_hash`
+// sees them
+static int cellbuf_row_eq(struct cellbuf *a, int ay, struct cellbuf *b,
+    int by) {
+    struct tb_cell *ca, *cb;
+    int x;
+    if (a->width != b->width) return 0;
+    for (x = 0; x < a->width; x += cell_width(ca)) {
+        cellbuf_get(a, x, ay, &ca);
+        cellbuf_get(b, x, by, &cb);
+        if (cell_cmp(ca, cb) != 0) return 0;
+    }
+    return 1;
+}
+
+// Move rows `top`..`bot` of `c` up by `n` rows (down if negative) the way a
+// terminal scrolls a region. Rows scrolled in are filled with the invalid
+// codepoint so the next diff repaints them.
+static int cellbuf_scroll(struct cellbuf *c, int top, int bot, int n) {
+    int rv, x, y, from, to, step;
+    uint32_t invalid = -1;
+    struct tb_cell *src;
+
+    if (n > 0) {
+        from = top;
+        to = bot - n + 1;
+        step = 1;
+    } else {
+        from = bot;
+        to = top - n - 1;
+        step = -1;
+    }
+    for (y = from; y != to; y += step) {
+        for (x = 0; x < c->width; x++) {
+            if_err_return(rv, cellbuf_get(c, x, y + n, &src));
+            if_err_return(rv, cellbuf_put_cell(c, x, y, src));
+        }
+    }
+    for (; y != from + ((bot - top + 1) * step); y += step) {
+        for (x = 0; x < c->width; x++) {
+            if_err_return(rv, cellbuf_put(c, x, y, &invalid, 1, -1, -1));
+        }
+    }
+    return TB_OK;
+}
+#endif
+
 static int bytebuf_puts(struct bytebuf *b, const char *str) {
     if (!str || strlen(str) <= 0) return TB_OK; // Nothing to do for empty caps
     return bytebuf_nputs(b, str, (size_t)strlen(str));
@@ -4191,14 +7008,36 @@ static int bytebuf_shift(struct bytebuf *b, size_t n) {
 
 static int bytebuf_flush(struct bytebuf *b, int fd) {
     if (b->len <= 0) return TB_OK;
-    ssize_t write_rv = write(fd, b->buf, b->len);
-    if (write_rv < 0 || (size_t)write_rv != b->len) {
-        // Note, errno will be 0 on partial write
-        global.last_errno = errno;
-        return TB_ERR;
+    // Without a terminal, or while the caller writes it itself, output waits
+    // for `tb_take_output`/`tb_swap_output`
+    if (fd < 0 || global.out_hold) return TB_OK;
+    int rv = TB_OK;
+    size_t off = 0;
+    while (off < b->len) {
+        ssize_t write_rv = write(fd, b->buf + off, b->len - off);
+        if (write_rv >= 0) {
+            off += (size_t)write_rv;
+            continue;
+        }
+        if (errno == EINTR) continue;
+        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            global.last_errno = errno;
+            rv = TB_ERR;
+            break;
+        }
+        // The terminal is full. Keep the rest for `tb_flush_output`, or wait
+        // for room if output is blocking.
+        if (global.out_nonblock) break;
+        struct pollfd pfd = {fd, POLLOUT, 0};
+        if (poll(&pfd, 1, -1) < 0 && errno != EINTR) {
+            global.last_errno = errno;
+            rv = TB_ERR_POLL;
+            break;
+        }
     }
-    b->len = 0;
-    return TB_OK;
+    // Drop only what was written, so nothing is sent twice or lost
+    bytebuf_shift(b, off);
+    return rv;
 }
 
 static int bytebuf_reserve(struct bytebuf *b, size_t sz) {
@@ -4244,6 +7083,23 @@ int tb_wcwidth(uint32_t ch) {
 #endif
 }
 
+int tb_wcwidth_table(const uint8_t **stage1, const uint32_t **stage2,
+    size_t *nstage2, uint32_t *limit) {
+#ifdef TB_OPT_LIBC_WCHAR
+    (void)stage1;
+    (void)stage2;
+    (void)nstage2;
+    (void)limit;
+    return TB_ERR;
+#else
+    *stage1 = wcwidth_stage1;
+    *stage2 = wcwidth_stage2;
+    *nstage2 = sizeof(wcwidth_stage2) / sizeof(wcwidth_stage2[0]);
+    *limit = WCWIDTH_STAGED_LIMIT;
+    return TB_OK;
+#endif
+}
+
 static int tb_wcswidth(uint32_t *ch, size_t nch) {
 #ifdef TB_OPT_LIBC_WCHAR
     return wcswidth((wchar_t *)ch, nch);
@@ -4272,6 +7128,13 @@ static int tb_iswprint_ex(uint32_t ch, int *w) {
     } else if (ch == 0) { // Special case for null, which is not represented in
         if (w) *w = 0;    // wcwidth_table since it's the only codepoint that is
         return 0;         // iswprint==0 but not wcwidth==-1. (It's wcwidth==0.)
+    } else if (ch < WCWIDTH_STAGED_LIMIT) {
+        uint32_t word = wcwidth_stage2[wcwidth_stage1[ch >> 8] * 16 +
+                                       ((ch >> 4) & 0xf)];
+        int width = (int)((word >> ((ch & 0xf) * 2)) & 3);
+        if (width == 3) width = -1;
+        if (w) *w = width;
+        return width >= 0 ? 1 : 0;
     }
     while (lo <= hi) {
         int i = (lo + hi) / 2;
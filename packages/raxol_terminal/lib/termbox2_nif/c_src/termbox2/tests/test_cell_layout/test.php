@@ -0,0 +1,48 @@
+<?php
+declare(strict_types=1);
+
+if (!$test->ffi->tb_has_egc()) {
+    // This will only work with extended grapheme cluster support
+    $test->skip();
+}
+
+// Cells read back and present the same whatever the cell buffer layout
+// (e.g. with TB_OPT_SOA in cflags)
+$test->initMemory(10, 1);
+$cellp = $test->ffi->new('struct tb_cell *');
+$cells = function (int $back, array $xs) use ($test, $cellp): string {
+    $out = [];
+    foreach ($xs as $x) {
+        // read right away, the cell may be a copy valid until the next call
+        $test->ffi->tb_get_cell($x, 0, $back, FFI::addr($cellp));
+        $out[] = sprintf('%d:%x/%d/%d', $x, $cellp->ch, $cellp->nech, $cellp->fg);
+    }
+    return implode(' ', $out);
+};
+
+$result = [];
+$test->ffi->tb_set_cell(0, 0, ord('a'), $test->defines['TB_GREEN'], 0);
+$test->ffi->tb_set_cell(1, 0, ord('e'), 0, 0);
+$test->ffi->tb_extend_cell(1, 0, 0x301); // combining acute accent
+$test->ffi->tb_set_cell(2, 0, 0x4e2d, 0, 0); // wide
+$test->ffi->tb_set_cell(4, 0, ord('b'), $test->defines['TB_BOLD'], 0);
+$result['back'] = $cells(1, [0, 1, 2, 4]);
+$test->ffi->tb_present();
+$result['present'] = $test->escape($test->takeOutput());
+$result['front'] = $cells(0, [0, 1, 2, 4]);
+
+// replacing a cluster drops it
+$test->ffi->tb_set_cell(1, 0, ord('c'), 0, 0);
+$test->ffi->tb_present();
+$result['replace'] = $test->escape($test->takeOutput());
+$result['front2'] = $cells(0, [1]);
+$test->ffi->tb_shutdown();
+
+// display results
+$test->ffi->tb_init();
+$y = 0;
+foreach ($result as $k => $v) {
+    $test->ffi->tb_printf(0, $y++, 0, 0, '%s=%s', $k, $v);
+}
+$test->ffi->tb_present();
+$test->screencap();
@@ -0,0 +1,53 @@
+<?php
+declare(strict_types=1);
+
+// init termbox with a "fake" tty backed by memfds, and xterm's key caps
+putenv('TERM=xterm');
+$libc = FFI::cdef(
+    'int memfd_create(const char *name, unsigned int flags);' .
+    'int close(int fd);'
+);
+$ttyin = $libc->memfd_create('ttyin', 0);
+$ttyout = $libc->memfd_create('ttyout', 0);
+$test->ffi->tb_init_rwfd($ttyin, $ttyout);
+$input_data =
+    "\x1bOP" .     // TB_KEY_F1 (kf1)
+    "\x1bOH" .     // TB_KEY_HOME (khome)
+    "\x1b[3~" .    // TB_KEY_DELETE (kdch1)
+    "\x1b[24~" .   // TB_KEY_F12 (kf12)
+    "\x1bOA" .     // TB_KEY_ARROW_UP (kcuu1)
+    "\x1b[1;2P" .  // TB_KEY_F1, TB_MOD_SHIFT (kf13)
+    "a" .
+    "\x1b[5;5~" .  // TB_KEY_PGUP, TB_MOD_CTRL (not a cap)
+    "\x1bOB" .     // TB_KEY_ARROW_DOWN (kcud1)
+    "\x1bb" .      // 'b', TB_MOD_ALT (no cap matches)
+    "b";
+$fttyin = fopen("php://fd/$ttyin", 'w');
+$nbytes = fwrite($fttyin, $input_data);
+fseek($fttyin, strlen($input_data) * -1, SEEK_CUR);
+
+// record events that termbox emits
+$events = [];
+$test->ffi->tb_set_input_mode($test->defines['TB_INPUT_ALT']);
+$e = $test->ffi->new('struct tb_event');
+do {
+    $rv = $test->ffi->tb_peek_event(FFI::addr($e), 1000);
+    if ($rv == 0) {
+        $events[] = [ $e->type, $e->mod, $e->key, $e->ch ];
+    }
+} while ($rv == 0);
+
+// close fake termbox setup
+fclose($fttyin);
+$libc->close($ttyin);
+$libc->close($ttyout);
+$test->ffi->tb_shutdown();
+
+// display events
+$test->ffi->tb_init();
+$y = 0;
+foreach ($events as $e) {
+    $test->ffi->tb_printf(0, $y++, 0, 0, "event=%s", implode(',', $e));
+}
+$test->ffi->tb_present();
+$test->screencap();
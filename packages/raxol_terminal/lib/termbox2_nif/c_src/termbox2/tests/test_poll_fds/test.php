@@ -0,0 +1,76 @@
+<?php
+declare(strict_types=1);
+
+$libc = FFI::cdef(
+    'struct pollfd { int fd; short events; short revents; };' .
+    'struct rlimit { unsigned long rlim_cur; unsigned long rlim_max; };' .
+    'int memfd_create(const char *name, unsigned int flags);' .
+    'int pipe(int *pipefd);' .
+    'int dup2(int oldfd, int newfd);' .
+    'int close(int fd);' .
+    'long write(int fd, const char *buf, unsigned long count);' .
+    'int getrlimit(int resource, struct rlimit *rlim);' .
+    'int setrlimit(int resource, const struct rlimit *rlim);'
+);
+$rlimit_nofile = 7;
+$high_fd = 1500; // above FD_SETSIZE
+
+// make room for the high fd up front
+$rl = $libc->new('struct rlimit');
+$libc->getrlimit($rlimit_nofile, FFI::addr($rl));
+if ($rl->rlim_cur <= $high_fd) {
+    $rl->rlim_cur = $high_fd + 1;
+    if ($libc->setrlimit($rlimit_nofile, FFI::addr($rl)) != 0) {
+        $test->skip();
+    }
+}
+
+// init termbox with a "fake" tty: a pipe for input, a memfd for output
+putenv('TERM=xterm');
+$ttyin = $libc->new('int[2]');
+$own = $libc->new('int[2]');
+$libc->pipe($ttyin);
+$libc->pipe($own);
+$ttyout = $libc->memfd_create('ttyout', 0);
+$test->ffi->tb_init_rwfd($ttyin[0], $ttyout);
+
+$fds = $libc->new('struct pollfd[1]');
+$fds[0]->fd = $own[0];
+$fds[0]->events = 1; // POLLIN
+$fdsp = $test->ffi->cast('struct pollfd *', FFI::addr($fds[0]));
+$e = $test->ffi->new('struct tb_event');
+$result = [];
+
+$result['timeout'] = $test->ffi->tb_peek_event(FFI::addr($e), 10);
+
+// a ready caller fd ends the wait, even without a timeout
+$libc->write($own[1], '!', 1);
+$rv = $test->ffi->tb_peek_event_fds(FFI::addr($e), -1, $fdsp, 1);
+$result['caller_fd'] = sprintf('%d revents=%d', $rv, $fds[0]->revents);
+
+// an event comes first
+$libc->write($ttyin[1], 'x', 1);
+$rv = $test->ffi->tb_peek_event_fds(FFI::addr($e), -1, $fdsp, 1);
+$result['both'] = sprintf('%d ch=%d revents=%d', $rv, $e->ch, $fds[0]->revents);
+$test->ffi->tb_shutdown();
+
+// a tty fd select() couldn't take
+$libc->dup2($ttyin[0], $high_fd);
+$test->ffi->tb_init_rwfd($high_fd, $ttyout);
+$libc->write($ttyin[1], 'y', 1);
+$rv = $test->ffi->tb_peek_event(FFI::addr($e), 1000);
+$result['high_fd'] = sprintf('%d ch=%d', $rv, $e->ch);
+$test->ffi->tb_shutdown();
+
+foreach ([$ttyin[0], $ttyin[1], $own[0], $own[1], $ttyout, $high_fd] as $fd) {
+    $libc->close($fd);
+}
+
+// display results
+$test->ffi->tb_init();
+$y = 0;
+foreach ($result as $k => $v) {
+    $test->ffi->tb_printf(0, $y++, 0, 0, '%s=%s', $k, "$v");
+}
+$test->ffi->tb_present();
+$test->screencap();
@@ -65,6 +65,24 @@ $test = new class() {
         }
     }
 
+    public function initMemory(int $w, int $h): void {
+        // pin caps so byte streams don't depend on the harness terminal
+        putenv('TERM=xterm');
+        $this->ffi->tb_init_memory($w, $h);
+        $this->takeOutput();
+    }
+
+    public function takeOutput(): string {
+        $buf = $this->ffi->new('const char *');
+        $nbuf = $this->ffi->new('size_t');
+        $this->ffi->tb_take_output(FFI::addr($buf), FFI::addr($nbuf));
+        return $nbuf->cdata > 0 ? FFI::string($buf, $nbuf->cdata) : '';
+    }
+
+    public function escape(string $bytes): string {
+        return addcslashes($bytes, "\0..\37\177..\377");
+    }
+
     public function screencap(): void {
         $this->log('screencap');
         sleep(PHP_INT_MAX);
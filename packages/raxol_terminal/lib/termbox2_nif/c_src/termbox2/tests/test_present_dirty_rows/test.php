@@ -0,0 +1,36 @@
+<?php
+declare(strict_types=1);
+
+// present into memory, recording the bytes and rows each frame sends
+$test->initMemory(8, 3);
+$stats = $test->ffi->new('struct tb_present_stats');
+$frames = [];
+$present = function (string $name) use ($test, $stats, &$frames) {
+    $test->ffi->tb_present_ex(FFI::addr($stats));
+    $frame = sprintf('%s=%s rows=%d', $name, $test->escape($test->takeOutput()),
+        $stats->nspans);
+    if ($stats->nspans > 0) {
+        $frame .= sprintf(' y=%d', $stats->spans[0]->y);
+    }
+    $frames[] = $frame;
+};
+
+$test->ffi->tb_print(0, 0, 0, 0, 'aaaa');
+$test->ffi->tb_print(0, 1, 0, 0, 'bbbb');
+$test->ffi->tb_print(0, 2, 0, 0, 'cccc');
+$present('first');
+$present('unchanged');
+$test->ffi->tb_set_cell(1, 1, ord('X'), 0, 0);
+$present('one_cell');
+$test->ffi->tb_set_cell(1, 1, ord('X'), 0, 0); // marks the row, changes nothing
+$present('same_cell');
+$test->ffi->tb_shutdown();
+
+// display frames
+$test->ffi->tb_init();
+$y = 0;
+foreach ($frames as $frame) {
+    $test->ffi->tb_print(0, $y++, 0, 0, $frame);
+}
+$test->ffi->tb_present();
+$test->screencap();
@@ -0,0 +1,48 @@
+<?php
+declare(strict_types=1);
+
+// present into memory, recording the bytes of each frame
+$test->initMemory(20, 4);
+$frames = [];
+$present = function (string $name) use ($test, &$frames) {
+    $test->ffi->tb_present();
+    $frames[] = sprintf('%s=%s', $name, $test->escape($test->takeOutput()));
+};
+$set = function (array $cells) use ($test) {
+    foreach ($cells as [$x, $y, $ch]) {
+        $test->ffi->tb_set_cell($x, $y, ord($ch), 0, 0);
+    }
+};
+
+for ($y = 0; $y < 4; $y++) {
+    for ($x = 0; $x < 20; $x++) {
+        $test->ffi->tb_set_cell($x, $y, ord('.'), 0, 0);
+    }
+}
+$test->ffi->tb_present();
+$test->takeOutput();
+
+// moves between changed cells take the shortest sequence xterm has
+$set([[0, 0, 'A'], [2, 0, 'B'], [15, 0, 'C']]);
+$present('same_row'); // rewrite, HPA
+$set([[5, 1, 'D'], [5, 2, 'E'], [0, 3, 'F']]);
+$present('next_rows'); // LF BS, CR LF
+$set([[10, 1, 'G'], [8, 2, 'H']]);
+$present('back');
+$set([[2, 0, 'I'], [2, 3, 'J']]);
+$present('down');
+$set([[19, 0, 'K'], [0, 1, 'L']]);
+$present('wrap'); // from the pending wrap, xterm has xenl
+$set([[7, 3, 'M']]);
+$test->ffi->tb_set_cursor(7, 0);
+$present('cursor'); // CUU back to the cursor
+$test->ffi->tb_shutdown();
+
+// display frames
+$test->ffi->tb_init();
+$y = 0;
+foreach ($frames as $frame) {
+    $test->ffi->tb_print(0, $y++, 0, 0, $frame);
+}
+$test->ffi->tb_present();
+$test->screencap();
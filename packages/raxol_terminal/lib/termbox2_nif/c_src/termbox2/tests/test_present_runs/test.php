@@ -0,0 +1,49 @@
+<?php
+declare(strict_types=1);
+
+if (isset($test->defines['TB_OPT_NO_RLE'])) {
+    // Run encoding is compiled out
+    $test->skip();
+}
+
+// present into memory, recording the bytes of each frame
+$test->initMemory(30, 1);
+$frames = [];
+$present = function (string $name) use ($test, &$frames) {
+    $test->ffi->tb_present();
+    $frames[] = sprintf('%s=%s', $name, $test->escape($test->takeOutput()));
+};
+$fill = function (int $x0, int $x1, int $ch, int $fg, int $bg) use ($test) {
+    for ($x = $x0; $x < $x1; $x++) {
+        $test->ffi->tb_set_cell($x, 0, $ch, $fg, $bg);
+    }
+};
+
+for ($x = 0; $x < 30; $x++) {
+    $test->ffi->tb_set_cell($x, 0, ord('a') + $x % 26, 0, 0);
+}
+$test->ffi->tb_present();
+$test->takeOutput();
+
+$fill(2, 22, ord('='), 0, 0);
+$present('rep'); // REP
+$fill(2, 22, ord(' '), 0, 0);
+$present('ech'); // ECH, text follows
+$fill(10, 30, ord(' '), 0, 0);
+$present('el'); // EL, only the cells that changed
+$fill(0, 30, ord(' '), 0, $test->defines['TB_BLUE']);
+$present('el_bg'); // EL, xterm has bce
+$fill(0, 30, ord(' '), $test->defines['TB_UNDERLINE'], 0);
+$present('underline'); // visible blanks can't be erased
+$fill(0, 3, ord('x'), 0, 0);
+$present('short'); // written out
+$test->ffi->tb_shutdown();
+
+// display frames
+$test->ffi->tb_init();
+$y = 0;
+foreach ($frames as $frame) {
+    $test->ffi->tb_print(0, $y++, 0, 0, $frame);
+}
+$test->ffi->tb_present();
+$test->screencap();
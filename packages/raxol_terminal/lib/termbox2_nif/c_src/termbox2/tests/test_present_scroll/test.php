@@ -0,0 +1,45 @@
+<?php
+declare(strict_types=1);
+
+if (isset($test->defines['TB_OPT_NO_SCROLL'])) {
+    // Scrolling is compiled out
+    $test->skip();
+}
+
+// present into memory, recording the bytes and scroll of each frame
+$test->initMemory(10, 6);
+$stats = $test->ffi->new('struct tb_present_stats');
+$frames = [];
+$present = function (string $name) use ($test, $stats, &$frames) {
+    $test->ffi->tb_present_ex(FFI::addr($stats));
+    $frames[] = sprintf('%s=%s scroll=%d,%d,%d', $name,
+        $test->escape($test->takeOutput()),
+        $stats->scroll, $stats->scroll_top, $stats->scroll_bottom);
+};
+$rows = function (array $rows) use ($test) {
+    foreach ($rows as $y => $row) {
+        $test->ffi->tb_printf(0, $y, 0, 0, '%-10s', $row);
+    }
+};
+
+$rows(['line 0', 'line 1', 'line 2', 'line 3', 'line 4', 'line 5']);
+$test->ffi->tb_present();
+$test->takeOutput();
+
+// whole screen up, then a region up and down
+$rows(['line 1', 'line 2', 'line 3', 'line 4', 'line 5', 'line 6']);
+$present('up');
+$rows(['line 1', 'line 3', 'line 4', 'line 5', 'new', 'line 6']);
+$present('region_up');
+$rows(['line 1', 'new', 'line 3', 'line 4', 'line 5', 'line 6']);
+$present('region_down');
+$test->ffi->tb_shutdown();
+
+// display frames
+$test->ffi->tb_init();
+$y = 0;
+foreach ($frames as $frame) {
+    $test->ffi->tb_print(0, $y++, 0, 0, $frame);
+}
+$test->ffi->tb_present();
+$test->screencap();
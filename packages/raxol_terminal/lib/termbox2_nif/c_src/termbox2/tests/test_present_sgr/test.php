@@ -0,0 +1,35 @@
+<?php
+declare(strict_types=1);
+
+// present one cell per frame into memory, recording the bytes of each
+$test->initMemory(20, 1);
+$d = $test->defines;
+$frames = [];
+$x = 0;
+$cell = function (string $name, int $fg, int $bg) use ($test, &$frames, &$x) {
+    $test->ffi->tb_set_cell($x++, 0, ord('x'), $fg, $bg);
+    $test->ffi->tb_present();
+    $frames[] = sprintf('%s=%s', $name, $test->escape($test->takeOutput()));
+};
+
+// each frame sends only the attributes and colors that changed
+$cell('bold_red', $d['TB_BOLD'] | $d['TB_RED'], 0);
+$cell('add_underline', $d['TB_BOLD'] | $d['TB_UNDERLINE'] | $d['TB_RED'], 0);
+$cell('drop_bold', $d['TB_UNDERLINE'] | $d['TB_RED'], 0);
+$cell('fg_green', $d['TB_UNDERLINE'] | $d['TB_GREEN'], 0);
+$cell('bg_blue', $d['TB_UNDERLINE'] | $d['TB_GREEN'], $d['TB_BLUE']);
+$cell('bold_dim', $d['TB_BOLD'] | $d['TB_DIM'] | $d['TB_GREEN'], $d['TB_BLUE']);
+$cell('drop_dim', $d['TB_BOLD'] | $d['TB_GREEN'], $d['TB_BLUE']); // 22 drops both
+$cell('reverse', $d['TB_REVERSE'] | $d['TB_GREEN'], $d['TB_BLUE']);
+$cell('default', 0, 0);
+$cell('same', 0, 0);
+$test->ffi->tb_shutdown();
+
+// display frames
+$test->ffi->tb_init();
+$y = 0;
+foreach ($frames as $frame) {
+    $test->ffi->tb_print(0, $y++, 0, 0, $frame);
+}
+$test->ffi->tb_present();
+$test->screencap();
@@ -0,0 +1,53 @@
+<?php
+declare(strict_types=1);
+
+// present into memory, recording the bytes and changed span of each frame
+$test->initMemory(40, 1);
+$stats = $test->ffi->new('struct tb_present_stats');
+$frames = [];
+$present = function (string $name) use ($test, $stats, &$frames) {
+    $test->ffi->tb_present_ex(FFI::addr($stats));
+    $frame = sprintf('%s=%s', $name, $test->escape($test->takeOutput()));
+    if ($stats->nspans > 0) {
+        $frame .= sprintf(' span=%d-%d', $stats->spans[0]->x0, $stats->spans[0]->x1);
+    }
+    $frames[] = $frame;
+};
+
+for ($x = 0; $x < 40; $x++) {
+    $test->ffi->tb_set_cell($x, 0, ord('a') + $x % 26, 0, 0);
+}
+$test->ffi->tb_present();
+$test->takeOutput();
+
+// only cells from the first to the last difference are compared and sent
+$test->ffi->tb_set_cell(3, 0, ord('X'), 0, 0);
+$test->ffi->tb_set_cell(30, 0, ord('Y'), 0, 0);
+$present('ends');
+$test->ffi->tb_set_cell(20, 0, ord('u'), $test->defines['TB_RED'], 0);
+$present('fg_only');
+$test->ffi->tb_set_cell(21, 0, ord('v'), 0, $test->defines['TB_BLUE']);
+$present('bg_only');
+$test->ffi->tb_set_cell(39, 0, ord('Z'), 0, 0);
+$present('last');
+
+// a walk starting inside the row still steps over the cells wide chars cover
+$test->ffi->tb_set_cell(10, 0, 0x4e2d, 0, 0);
+$test->ffi->tb_set_cell(12, 0, 0x4e2d, 0, 0);
+$present('wide');
+$test->ffi->tb_set_cell(14, 0, ord('W'), 0, 0);
+$present('after_wide');
+$test->ffi->tb_set_cell(10, 0, ord('N'), 0, 0);
+$present('narrow');
+$test->ffi->tb_set_cell(39, 0, ord('Z'), 0, 0);
+$present('same');
+$test->ffi->tb_shutdown();
+
+// display frames
+$test->ffi->tb_init();
+$y = 0;
+foreach ($frames as $frame) {
+    $test->ffi->tb_print(0, $y++, 0, 0, $frame);
+}
+$test->ffi->tb_present();
+$test->screencap();
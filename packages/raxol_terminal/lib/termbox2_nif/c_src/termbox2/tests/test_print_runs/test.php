@@ -0,0 +1,47 @@
+<?php
+declare(strict_types=1);
+
+$test->initMemory(10, 2);
+$d = $test->defines;
+
+// native-endian {uint16 x, uint16 y, uint32 len, uint64 fg, uint64 bg} + text
+$run = fn(int $x, int $y, string $text, int $fg, int $bg): string =>
+    pack('SSLQQ', $x, $y, strlen($text), $fg, $bg) . $text;
+$runs =
+    $run(0, 0, 'ab', $d['TB_GREEN'], 0) .
+    $run(3, 0, "\xe4\xb8\xad", 0, 0) .    // wide
+    $run(30, 0, 'off', 0, 0) .            // TB_ERR_OUT_OF_BOUNDS, skipped
+    $run(8, 0, 'cut', 0, 0) .             // clipped at the edge
+    $run(0, 1, "\xc3\xa9", $d['TB_BOLD'], 0);
+$nbuf = strlen($runs);
+$buf = $test->ffi->new("char[$nbuf]");
+FFI::memcpy($buf, $runs, $nbuf);
+$out_w = $test->ffi->new('int[5]');
+$out_n = $test->ffi->new('size_t');
+$result = [];
+
+$rv = $test->ffi->tb_print_runs($buf, $nbuf, $out_w, FFI::addr($out_n));
+$widths = [];
+for ($i = 0; $i < 5; $i++) {
+    $widths[] = $out_w[$i];
+}
+$result['rv'] = sprintf('%d n=%d widths=%s', $rv, $out_n->cdata, implode(',', $widths));
+$test->ffi->tb_present();
+$result['present'] = $test->escape($test->takeOutput());
+
+// a buffer that doesn't match the layout prints nothing
+$out_n->cdata = 0;
+$rv = $test->ffi->tb_print_runs($buf, $nbuf - 1, $out_w, FFI::addr($out_n));
+$result['truncated'] = sprintf('%d n=%d', $rv, $out_n->cdata);
+$test->ffi->tb_present();
+$result['present2'] = $test->escape($test->takeOutput());
+$test->ffi->tb_shutdown();
+
+// display results
+$test->ffi->tb_init();
+$y = 0;
+foreach ($result as $k => $v) {
+    $test->ffi->tb_printf(0, $y++, 0, 0, '%s=%s', $k, $v);
+}
+$test->ffi->tb_present();
+$test->screencap();
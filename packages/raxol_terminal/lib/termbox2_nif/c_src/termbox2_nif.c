@@ -1,186 +1,2596 @@
 #include <erl_nif.h>
+#include <errno.h>
+#include <poll.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+// Match the compile-time options termbox_impl.c builds the library with, so
+// uintattr_t and struct tb_cell agree on both sides of the link.
+#define TB_LIB_OPTS
 #include "termbox2/termbox2.h"
+#include "scrollback.h"
+#include "vt_parser.h"
+
+// termbox2 runs every call against the calling thread's current context, and
+// NIFs may be entered from several schedulers at once (plus the async present
+// worker below), so every call into the built-in context is serialized on
+// tb_lock. Contexts from tb_open/2 and tb_open_memory/2 have a lock of their
+// own, see ctx_lock. Presents hold output while they diff and write it after
+// unlocking, see output_write_unlocked, so no lock is held across write().
+static ErlNifMutex *tb_lock = NULL;
+
+// Async present worker. tb_present_async/0 hands the request to this thread
+// and returns immediately; the worker runs tb_present_ex and replies to the
+// caller with {:termbox, :presented, stats}.
+static ErlNifTid present_tid;
+static ErlNifCond *present_cond = NULL;
+static ErlNifPid present_pid;
+static int present_pending = 0;
+static int present_running = 0;
+static int present_exit = 0;
+
+typedef struct tb_ctx tb_ctx_t;
+
+// Native input watcher. tb_input_start/1 registers termbox's tty and resize
+// pipe with enif_select, so the owner receives {:select, res, ref,
+// :ready_input} as soon as either becomes readable and calls tb_input_poll/1,
+// which drains every pending event into one packed binary. Each context has at
+// most one active watcher, guarded by the context's lock; a watcher keeps its
+// context alive until it stops. With non-blocking output the watcher also
+// selects the output fd for writing on behalf of tb_flush/0,1 callers, since
+// ERTS wants every select on one fd made through the same resource.
+typedef struct
+{
+  ErlNifPid owner;
+  ErlNifMonitor monitor;
+  tb_ctx_t *ctx;
+  int ttyfd;
+  int resizefd;
+  int wfd;
+  int active;
+} tb_input_t;
+
+// An output buffer handed to Elixir by tb_present_binary/1. The frame's bytes
+// stay in the buffer termbox built them in, taken with tb_swap_output and
+// wrapped as a resource binary rather than copied. When the binary is garbage
+// collected the buffer goes back to its context as the spare the next frame is
+// built in, so steady-state frames alternate between two buffers.
+typedef struct
+{
+  tb_ctx_t *owner;
+  char *buf;
+  size_t cap;
+} tb_output_t;
+
+// A termbox context opened by tb_open/2 or tb_open_memory/2. Every NIF that
+// takes one as its first argument runs against it under its own lock instead
+// of the built-in context, so sessions never wait on each other. tb is only
+// freed by the destructor; tb_close/1 just shuts it down. The spare output
+// buffer has a lock of its own, since output buffers are returned from
+// whichever thread garbage collects their binary.
+struct tb_ctx
+{
+  ErlNifMutex *lock;
+  struct tb_context *tb;
+  tb_input_t *input;
+  ErlNifMutex *spare_lock;
+  char *spare;
+  size_t spare_cap;
+};
+
+static ErlNifResourceType *input_type = NULL;
+static ErlNifResourceType *ctx_type = NULL;
+static ErlNifResourceType *output_type = NULL;
+static tb_input_t *input_active = NULL;
+static ERL_NIF_TERM atom_undefined;
+static ERL_NIF_TERM atom_true;
+static ERL_NIF_TERM atom_false;
+static ERL_NIF_TERM atom_nil;
+static ErlNifResourceType *vt_type = NULL;
+static ErlNifResourceType *grid_type = NULL;
+static ErlNifResourceType *sb_type = NULL;
+static ERL_NIF_TERM atom_esc;
+static ERL_NIF_TERM atom_csi;
+static ERL_NIF_TERM atom_osc;
+static ERL_NIF_TERM atom_dcs;
+static ERL_NIF_TERM atom_sos;
+static ERL_NIF_TERM atom_pm;
+static ERL_NIF_TERM atom_apc;
+
+static void input_stop_locked(ErlNifEnv *env, tb_ctx_t *ctx);
+static int write_all(int fd, const char *buf, size_t len);
+static int output_fd_dup(void);
+
+// Resolve the context a NIF registered as both name/arity and name/arity+1
+// runs against: the built-in one, or the handle passed as the first argument.
+// Returns the index of the first remaining argument, or -1 for a bad handle.
+static int ctx_arg(ErlNifEnv *env, int argc, int arity, const ERL_NIF_TERM argv[],
+                   tb_ctx_t **ctx)
+{
+  *ctx = NULL;
+  if (argc == arity)
+  {
+    return 0;
+  }
+  if (!enif_get_resource(env, argv[0], ctx_type, (void **)ctx))
+  {
+    return -1;
+  }
+  return 1;
+}
+
+// Take ctx's lock (tb_lock for the built-in context) and make it current for
+// the calling thread until ctx_unlock.
+static void ctx_lock(tb_ctx_t *ctx)
+{
+  if (ctx == NULL)
+  {
+    enif_mutex_lock(tb_lock);
+    return;
+  }
+  enif_mutex_lock(ctx->lock);
+  tb_context_set(ctx->tb);
+}
+
+static void ctx_unlock(tb_ctx_t *ctx)
+{
+  if (ctx == NULL)
+  {
+    enif_mutex_unlock(tb_lock);
+    return;
+  }
+  // Scheduler threads are shared, so leave the built-in context current
+  tb_context_set(NULL);
+  enif_mutex_unlock(ctx->lock);
+}
+
+static tb_input_t **input_slot(tb_ctx_t *ctx)
+{
+  return ctx == NULL ? &input_active : &ctx->input;
+}
 
 // tb_init/0
 static ERL_NIF_TERM nif_tb_init(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[])
 {
   (void)argc;
-  (void)argv;
-  int result = tb_init();
-  return enif_make_int(env, result);
+  (void)argv;
+  enif_mutex_lock(tb_lock);
+  int result = tb_init();
+  enif_mutex_unlock(tb_lock);
+  return enif_make_int(env, result);
+}
+
+// Shut ctx down and release its lock before writing out the queued output and
+// exit sequences, which wait for the terminal. They go to a duplicate of the
+// output fd, since shutting down closes the tty tb_init opened; without one
+// they are written under the lock as before. Must be called with ctx's lock
+// held, and returns with it released.
+static void shutdown_unlock(ErlNifEnv *env, tb_ctx_t *ctx)
+{
+  char *buf = NULL;
+  size_t len = 0;
+  // The watcher's fds are about to be closed, so take them out of the poll set
+  input_stop_locked(env, ctx);
+  int wfd = output_fd_dup();
+  if (wfd < 0)
+  {
+    tb_shutdown();
+    ctx_unlock(ctx);
+    return;
+  }
+  tb_shutdown_output(&buf, &len);
+  ctx_unlock(ctx);
+  if (len > 0)
+  {
+    write_all(wfd, buf, len);
+  }
+  close(wfd);
+  if (buf != NULL)
+  {
+    tb_free(buf);
+  }
+}
+
+// tb_shutdown/0 (dirty I/O: the exit sequences wait for the terminal)
+static ERL_NIF_TERM nif_tb_shutdown(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[])
+{
+  (void)argc;
+  (void)argv;
+  enif_mutex_lock(tb_lock);
+  shutdown_unlock(env, NULL);
+  return enif_make_atom(env, "ok");
+}
+
+static void ctx_dtor(ErlNifEnv *env, void *obj)
+{
+  (void)env;
+  tb_ctx_t *ctx = (tb_ctx_t *)obj;
+  // Shuts the context down first if tb_close/1 was never called
+  tb_context_free(ctx->tb);
+  if (ctx->spare != NULL)
+  {
+    tb_free(ctx->spare);
+  }
+  if (ctx->lock != NULL)
+  {
+    enif_mutex_destroy(ctx->lock);
+  }
+  if (ctx->spare_lock != NULL)
+  {
+    enif_mutex_destroy(ctx->spare_lock);
+  }
+}
+
+// Keep buf as ctx's spare output buffer, or free it if there already is one.
+static void output_recycle(tb_ctx_t *ctx, char *buf, size_t cap)
+{
+  enif_mutex_lock(ctx->spare_lock);
+  if (ctx->spare == NULL)
+  {
+    ctx->spare = buf;
+    ctx->spare_cap = cap;
+    buf = NULL;
+  }
+  enif_mutex_unlock(ctx->spare_lock);
+  if (buf != NULL)
+  {
+    tb_free(buf);
+  }
+}
+
+static void output_dtor(ErlNifEnv *env, void *obj)
+{
+  (void)env;
+  tb_output_t *out = (tb_output_t *)obj;
+  output_recycle(out->owner, out->buf, out->cap);
+  enif_release_resource(out->owner);
+}
+
+// Allocate a context resource, run init against it and wrap the result as
+// {:ok, ctx} or {:error, code}. The context's lock is not needed yet, since no
+// other process can see it.
+static ERL_NIF_TERM ctx_open(ErlNifEnv *env, int (*init)(int, int), int a, int b)
+{
+  tb_ctx_t *ctx = enif_alloc_resource(ctx_type, sizeof(tb_ctx_t));
+  ctx->lock = enif_mutex_create("termbox2_nif.ctx_lock");
+  ctx->tb = tb_context_new();
+  ctx->input = NULL;
+  ctx->spare_lock = enif_mutex_create("termbox2_nif.ctx_spare_lock");
+  ctx->spare = NULL;
+  ctx->spare_cap = 0;
+  if (ctx->lock == NULL || ctx->tb == NULL || ctx->spare_lock == NULL)
+  {
+    enif_release_resource(ctx);
+    return enif_make_tuple2(env, enif_make_atom(env, "error"), enif_make_int(env, TB_ERR_MEM));
+  }
+
+  tb_context_set(ctx->tb);
+  int result = init(a, b);
+  tb_context_set(NULL);
+  if (result != TB_OK)
+  {
+    enif_release_resource(ctx);
+    return enif_make_tuple2(env, enif_make_atom(env, "error"), enif_make_int(env, result));
+  }
+
+  ERL_NIF_TERM res = enif_make_resource(env, ctx);
+  enif_release_resource(ctx);
+  return enif_make_tuple2(env, enif_make_atom(env, "ok"), res);
+}
+
+// tb_open/2 (rfd, wfd; dirty I/O: init talks to the terminal)
+// Opens a context on a terminal the caller already has open, e.g. a pty.
+static ERL_NIF_TERM nif_tb_open(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[])
+{
+  (void)argc;
+  int rfd, wfd;
+  if (!enif_get_int(env, argv[0], &rfd) || !enif_get_int(env, argv[1], &wfd))
+  {
+    return enif_make_badarg(env);
+  }
+  return ctx_open(env, tb_init_rwfd, rfd, wfd);
+}
+
+// tb_open_memory/2 (width, height)
+// Opens a context without a terminal, see tb_init_memory.
+static ERL_NIF_TERM nif_tb_open_memory(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[])
+{
+  (void)argc;
+  int w, h;
+  if (!enif_get_int(env, argv[0], &w) || !enif_get_int(env, argv[1], &h))
+  {
+    return enif_make_badarg(env);
+  }
+  return ctx_open(env, tb_init_memory, w, h);
+}
+
+// tb_close/1 (context)
+// Shuts the context down now rather than when it is garbage collected. Later
+// calls with it return TB_ERR_NOT_INIT.
+static ERL_NIF_TERM nif_tb_close(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[])
+{
+  (void)argc;
+  tb_ctx_t *ctx;
+  if (!enif_get_resource(env, argv[0], ctx_type, (void **)&ctx))
+  {
+    return enif_make_badarg(env);
+  }
+  ctx_lock(ctx);
+  shutdown_unlock(env, ctx);
+  return enif_make_atom(env, "ok");
+}
+
+// tb_resize/2, tb_resize/3 (optional context, then width, height)
+static ERL_NIF_TERM nif_tb_resize(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[])
+{
+  tb_ctx_t *ctx;
+  int w, h;
+  int i = ctx_arg(env, argc, 2, argv, &ctx);
+  if (i < 0 || !enif_get_int(env, argv[i], &w) || !enif_get_int(env, argv[i + 1], &h))
+  {
+    return enif_make_badarg(env);
+  }
+  ctx_lock(ctx);
+  int result = tb_resize(w, h);
+  ctx_unlock(ctx);
+  return enif_make_int(env, result);
+}
+
+// tb_width/0, tb_width/1 (context)
+static ERL_NIF_TERM nif_tb_width(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[])
+{
+  tb_ctx_t *ctx;
+  if (ctx_arg(env, argc, 0, argv, &ctx) < 0)
+  {
+    return enif_make_badarg(env);
+  }
+  ctx_lock(ctx);
+  int result = tb_width();
+  ctx_unlock(ctx);
+  return enif_make_int(env, result);
+}
+
+// tb_height/0, tb_height/1 (context)
+static ERL_NIF_TERM nif_tb_height(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[])
+{
+  tb_ctx_t *ctx;
+  if (ctx_arg(env, argc, 0, argv, &ctx) < 0)
+  {
+    return enif_make_badarg(env);
+  }
+  ctx_lock(ctx);
+  int result = tb_height();
+  ctx_unlock(ctx);
+  return enif_make_int(env, result);
+}
+
+// tb_clear/0, tb_clear/1 (context)
+static ERL_NIF_TERM nif_tb_clear(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[])
+{
+  tb_ctx_t *ctx;
+  if (ctx_arg(env, argc, 0, argv, &ctx) < 0)
+  {
+    return enif_make_badarg(env);
+  }
+  ctx_lock(ctx);
+  tb_clear();
+  ctx_unlock(ctx);
+  return enif_make_atom(env, "ok");
+}
+
+// Write all of buf to fd, waiting for room if fd is non-blocking.
+static int write_all(int fd, const char *buf, size_t len)
+{
+  while (len > 0)
+  {
+    ssize_t n = write(fd, buf, len);
+    if (n >= 0)
+    {
+      buf += n;
+      len -= (size_t)n;
+      continue;
+    }
+    if (errno == EINTR)
+    {
+      continue;
+    }
+    if (errno != EAGAIN && errno != EWOULDBLOCK)
+    {
+      return TB_ERR;
+    }
+    struct pollfd pfd = {fd, POLLOUT, 0};
+    if (poll(&pfd, 1, -1) < 0 && errno != EINTR)
+    {
+      return TB_ERR_POLL;
+    }
+  }
+  return TB_OK;
+}
+
+// Duplicate the current context's output fd, or return -1 without one. Output
+// written with the lock released goes to the duplicate: tb_close/1 or
+// tb_shutdown/0 may close the fd in the meantime, and its number may be
+// reused by an unrelated file, but the duplicate still refers to the
+// terminal. Must be called with the context's lock held.
+static int output_fd_dup(void)
+{
+  int wfd = -1;
+  if (tb_get_output_fd(&wfd) != TB_OK || wfd < 0)
+  {
+    return -1;
+  }
+  return dup(wfd);
+}
+
+// Write the output ctx queued while held (see tb_hold_output) with ctx's lock
+// released, so other callers only wait for the diff, never for the terminal.
+// Output other threads queue in the meantime is written in turn, keeping it in
+// order. Must be called with ctx's lock held; returns with it held again.
+static int output_write_unlocked(tb_ctx_t *ctx)
+{
+  char *buf = NULL;
+  size_t len = 0, cap = 0;
+  int rv = TB_OK;
+  int wfd = output_fd_dup();
+  if (wfd < 0)
+  {
+    // Held output implies an fd, so the dup failed: write under the lock
+    return tb_release_output();
+  }
+  for (int first = 1;; first = 0)
+  {
+    // Also hands the buffer just written back, to build the next frame in
+    if (tb_swap_output(&buf, &len, &cap) != TB_OK)
+    {
+      break;
+    }
+    if (len == 0)
+    {
+      if (first)
+      {
+        tb_swap_output(&buf, &len, &cap);
+      }
+      break;
+    }
+    ctx_unlock(ctx);
+    rv = write_all(wfd, buf, len);
+    ctx_lock(ctx);
+    if (rv != TB_OK)
+    {
+      break;
+    }
+  }
+  if (buf != NULL)
+  {
+    tb_free(buf);
+  }
+  close(wfd);
+  tb_release_output();
+  return rv;
+}
+
+// A context from tb_open_memory/2 has no terminal, so its output only leaves
+// through tb_present_binary/1. Other presents drop it, or it would pile up in
+// the context forever. Must be called with the context's lock held.
+static void output_discard_memory(void)
+{
+  const char *buf;
+  size_t len;
+  int wfd = -1;
+  if (tb_get_output_fd(&wfd) == TB_OK && wfd < 0)
+  {
+    tb_take_output(&buf, &len);
+  }
+}
+
+// tb_present/0, tb_present/1 (context; dirty I/O: a full-screen diff plus
+// write() can take well over the 1 ms budget of a normal scheduler)
+static ERL_NIF_TERM nif_tb_present(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[])
+{
+  tb_ctx_t *ctx;
+  if (ctx_arg(env, argc, 0, argv, &ctx) < 0)
+  {
+    return enif_make_badarg(env);
+  }
+  ctx_lock(ctx);
+  int held = tb_hold_output() == TB_OK;
+  tb_present();
+  if (held)
+  {
+    output_write_unlocked(ctx);
+  }
+  output_discard_memory();
+  ctx_unlock(ctx);
+  return enif_make_atom(env, "ok");
+}
+
+static ERL_NIF_TERM make_present_stats(ErlNifEnv *env, int result,
+                                       struct tb_present_stats *stats,
+                                       ErlNifTime duration_us)
+{
+  ERL_NIF_TERM keys[] = {
+      enif_make_atom(env, "result"),
+      enif_make_atom(env, "bytes"),
+      enif_make_atom(env, "cells"),
+      enif_make_atom(env, "duration_us")};
+  ERL_NIF_TERM values[] = {
+      enif_make_int(env, result),
+      enif_make_uint64(env, stats->bytes),
+      enif_make_uint64(env, stats->cells),
+      enif_make_int64(env, duration_us)};
+  ERL_NIF_TERM map;
+  enif_make_map_from_arrays(env, keys, values, 4, &map);
+  return map;
+}
+
+// Build [{y, x0, x1}] from the spans reported by tb_present_ex. Must be called
+// with the context's lock held, since span memory belongs to termbox.
+static ERL_NIF_TERM make_damage_spans(ErlNifEnv *env, struct tb_present_stats *stats)
+{
+  ERL_NIF_TERM list = enif_make_list(env, 0);
+  size_t i = stats->nspans;
+  while (i > 0)
+  {
+    const struct tb_damage_span *span = &stats->spans[--i];
+    ERL_NIF_TERM tuple = enif_make_tuple3(env,
+                                          enif_make_int(env, span->y),
+                                          enif_make_int(env, span->x0),
+                                          enif_make_int(env, span->x1));
+    list = enif_make_list_cell(env, tuple, list);
+  }
+  return list;
+}
+
+// tb_present_damage/0, tb_present_damage/1 (context; dirty I/O)
+// Like tb_present/0 but returns {:ok, %{bytes, cells, spans, scroll, pending}}
+// describing what was written, where spans is [{y, x0, x1}] with x1 exclusive,
+// scroll is {top, bottom, rows} if a region was scrolled first, else nil, and
+// pending is the number of bytes non-blocking output left queued.
+static ERL_NIF_TERM nif_tb_present_damage(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[])
+{
+  tb_ctx_t *ctx;
+  struct tb_present_stats stats;
+  if (ctx_arg(env, argc, 0, argv, &ctx) < 0)
+  {
+    return enif_make_badarg(env);
+  }
+  ctx_lock(ctx);
+  int held = tb_hold_output() == TB_OK;
+  int result = tb_present_ex(&stats);
+  ERL_NIF_TERM spans = result == TB_OK ? make_damage_spans(env, &stats) : atom_nil;
+  if (held)
+  {
+    int written = output_write_unlocked(ctx);
+    result = result == TB_OK ? written : result;
+    stats.pending = 0;
+  }
+  output_discard_memory();
+  ctx_unlock(ctx);
+  if (result != TB_OK)
+  {
+    return enif_make_tuple2(env, enif_make_atom(env, "error"), enif_make_int(env, result));
+  }
+
+  ERL_NIF_TERM scroll = enif_make_atom(env, "nil");
+  if (stats.scroll != 0)
+  {
+    scroll = enif_make_tuple3(env,
+                              enif_make_int(env, stats.scroll_top),
+                              enif_make_int(env, stats.scroll_bottom),
+                              enif_make_int(env, stats.scroll));
+  }
+
+  ERL_NIF_TERM keys[] = {
+      enif_make_atom(env, "bytes"),
+      enif_make_atom(env, "cells"),
+      enif_make_atom(env, "spans"),
+      enif_make_atom(env, "scroll"),
+      enif_make_atom(env, "pending")};
+  ERL_NIF_TERM values[] = {
+      enif_make_uint64(env, stats.bytes),
+      enif_make_uint64(env, stats.cells),
+      spans,
+      scroll,
+      enif_make_uint64(env, stats.pending)};
+  ERL_NIF_TERM map;
+  enif_make_map_from_arrays(env, keys, values, 5, &map);
+  return enif_make_tuple2(env, enif_make_atom(env, "ok"), map);
+}
+
+// tb_present_binary/1 (context; dirty CPU: nothing is written, but a
+// full-screen diff can still take well over 1 ms)
+// Presents a context from tb_open_memory/2 and returns {:ok, binary} with the
+// escape sequences that take the previous frame to this one, or {:error, code}.
+// The binary is termbox's output buffer itself, see tb_output_t.
+static ERL_NIF_TERM nif_tb_present_binary(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[])
+{
+  tb_ctx_t *ctx;
+  ERL_NIF_TERM bin;
+  if (ctx_arg(env, argc, 0, argv, &ctx) < 0)
+  {
+    return enif_make_badarg(env);
+  }
+  enif_mutex_lock(ctx->spare_lock);
+  char *buf = ctx->spare;
+  size_t cap = ctx->spare_cap;
+  size_t len = 0;
+  ctx->spare = NULL;
+  ctx->spare_cap = 0;
+  enif_mutex_unlock(ctx->spare_lock);
+
+  ctx_lock(ctx);
+  int result = tb_present();
+  if (result == TB_OK)
+  {
+    result = tb_swap_output(&buf, &len, &cap);
+  }
+  if (result == TB_OK && len == 0)
+  {
+    // Nothing changed, so carry on building in the same buffer
+    result = tb_swap_output(&buf, &len, &cap);
+  }
+  ctx_unlock(ctx);
+
+  if (result != TB_OK || len == 0)
+  {
+    if (buf != NULL)
+    {
+      output_recycle(ctx, buf, cap);
+    }
+    if (result != TB_OK)
+    {
+      return enif_make_tuple2(env, enif_make_atom(env, "error"), enif_make_int(env, result));
+    }
+    enif_make_new_binary(env, 0, &bin);
+    return enif_make_tuple2(env, enif_make_atom(env, "ok"), bin);
+  }
+
+  tb_output_t *out = enif_alloc_resource(output_type, sizeof(tb_output_t));
+  out->owner = ctx;
+  out->buf = buf;
+  out->cap = cap;
+  enif_keep_resource(ctx);
+  bin = enif_make_resource_binary(env, out, buf, len);
+  enif_release_resource(out);
+  return enif_make_tuple2(env, enif_make_atom(env, "ok"), bin);
+}
+
+static void *present_worker(void *arg)
+{
+  (void)arg;
+  ErlNifEnv *msg_env = enif_alloc_env();
+
+  enif_mutex_lock(tb_lock);
+  for (;;)
+  {
+    while (!present_pending && !present_exit)
+    {
+      enif_cond_wait(present_cond, tb_lock);
+    }
+    if (present_exit)
+    {
+      break;
+    }
+
+    ErlNifPid reply_to = present_pid;
+    struct tb_present_stats stats;
+    present_pending = 0;
+    present_running = 1;
+
+    ErlNifTime started = enif_monotonic_time(ERL_NIF_USEC);
+    int held = tb_hold_output() == TB_OK;
+    int result = tb_present_ex(&stats);
+    if (held)
+    {
+      int written = output_write_unlocked(NULL);
+      result = result == TB_OK ? written : result;
+    }
+    ErlNifTime duration_us = enif_monotonic_time(ERL_NIF_USEC) - started;
+
+    present_running = 0;
+    enif_mutex_unlock(tb_lock);
+
+    ERL_NIF_TERM msg = enif_make_tuple3(
+        msg_env,
+        enif_make_atom(msg_env, "termbox"),
+        enif_make_atom(msg_env, "presented"),
+        make_present_stats(msg_env, result, &stats, duration_us));
+    enif_send(NULL, &reply_to, msg_env, msg);
+    enif_clear_env(msg_env);
+
+    enif_mutex_lock(tb_lock);
+  }
+  enif_mutex_unlock(tb_lock);
+
+  enif_free_env(msg_env);
+  return NULL;
+}
+
+// tb_present_async/0
+// Returns :ok once the present is queued, or :busy if a previous async present
+// has not finished yet (callers may drop or coalesce the frame).
+static ERL_NIF_TERM nif_tb_present_async(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[])
+{
+  (void)argc;
+  (void)argv;
+  enif_mutex_lock(tb_lock);
+  if (present_pending || present_running)
+  {
+    enif_mutex_unlock(tb_lock);
+    return enif_make_atom(env, "busy");
+  }
+  enif_self(env, &present_pid);
+  present_pending = 1;
+  enif_cond_signal(present_cond);
+  enif_mutex_unlock(tb_lock);
+  return enif_make_atom(env, "ok");
+}
+
+// Deselect the active watcher's fds of ctx, if any. termbox owns the fds, so
+// the stop callback has nothing to close. Must be called with ctx's lock held.
+static void input_stop_locked(ErlNifEnv *env, tb_ctx_t *ctx)
+{
+  tb_input_t **slot = input_slot(ctx);
+  tb_input_t *in = *slot;
+  if (in == NULL)
+  {
+    return;
+  }
+  *slot = NULL;
+  in->active = 0;
+  enif_select(env, in->ttyfd, ERL_NIF_SELECT_STOP, in, NULL, atom_undefined);
+  enif_select(env, in->resizefd, ERL_NIF_SELECT_STOP, in, NULL, atom_undefined);
+  if (in->wfd >= 0 && in->wfd != in->ttyfd)
+  {
+    enif_select(env, in->wfd, ERL_NIF_SELECT_STOP, in, NULL, atom_undefined);
+  }
+  enif_demonitor_process(env, in, &in->monitor);
+  enif_release_resource(in);
+}
+
+static int input_select_locked(ErlNifEnv *env, tb_input_t *in)
+{
+  if (enif_select(env, in->ttyfd, ERL_NIF_SELECT_READ, in, &in->owner, atom_undefined) < 0 ||
+      enif_select(env, in->resizefd, ERL_NIF_SELECT_READ, in, &in->owner, atom_undefined) < 0)
+  {
+    return -1;
+  }
+  return 0;
+}
+
+static void input_stop(ErlNifEnv *env, void *obj, ErlNifEvent event, int is_direct_call)
+{
+  (void)env;
+  (void)obj;
+  (void)event;
+  (void)is_direct_call;
+}
+
+static void input_down(ErlNifEnv *env, void *obj, ErlNifPid *pid, ErlNifMonitor *mon)
+{
+  (void)pid;
+  (void)mon;
+  tb_ctx_t *ctx = ((tb_input_t *)obj)->ctx;
+  // Stopping may drop the last reference to the watcher, and with it to ctx,
+  // so hold ctx until its lock is released
+  if (ctx != NULL)
+  {
+    enif_keep_resource(ctx);
+  }
+  ctx_lock(ctx);
+  if (*input_slot(ctx) == obj)
+  {
+    input_stop_locked(env, ctx);
+  }
+  ctx_unlock(ctx);
+  if (ctx != NULL)
+  {
+    enif_release_resource(ctx);
+  }
+}
+
+static void input_dtor(ErlNifEnv *env, void *obj)
+{
+  (void)env;
+  tb_input_t *in = (tb_input_t *)obj;
+  if (in->ctx != NULL)
+  {
+    enif_release_resource(in->ctx);
+  }
+}
+
+// Size of one packed input event record, see pack_input_event
+#define INPUT_EVENT_SIZE 16
+
+// Number of events fetched from termbox per tb_drain_events call
+#define INPUT_DRAIN_BATCH 256
+
+// Pack a termbox event into a native-endian 16-byte record
+// <<type::8, mod::8, key::16, ch::32, x::32, y::32>> in the terms
+// Raxol.Terminal.Driver.EventTranslator expects: arrows as 65..68, F1..F12 as
+// 265..276, Insert, Delete, Home, End, PgUp and PgDn as their curses codes
+// (331, 330, 262, 360, 339, 338), BackTab as Tab with shift, Ctrl+letter as the letter with the ctrl bit set (other control
+// keys without it), mod bits as shift=1, ctrl=2, alt=4, mouse buttons in key
+// as 0..4 (left, right, middle, wheel up, wheel down) and a release as 5, and
+// a resize as its width and height in x and y.
+static void pack_input_event(unsigned char *rec, const struct tb_event *ev)
+{
+  uint8_t type = ev->type;
+  uint8_t mod = 0;
+  uint16_t key = ev->key;
+  uint32_t ch = ev->ch;
+  int32_t x = ev->x, y = ev->y;
+
+  if (ev->mod & TB_MOD_SHIFT)
+    mod |= 1;
+  if (ev->mod & TB_MOD_CTRL)
+    mod |= 2;
+  if (ev->mod & TB_MOD_ALT)
+    mod |= 4;
+
+  if (ev->type == TB_EVENT_RESIZE)
+  {
+    x = ev->w;
+    y = ev->h;
+  }
+  else if (ev->type == TB_EVENT_MOUSE)
+  {
+    if (key <= TB_KEY_MOUSE_LEFT && key >= TB_KEY_MOUSE_MIDDLE)
+      key = TB_KEY_MOUSE_LEFT - key;
+    else if (key == TB_KEY_MOUSE_WHEEL_UP)
+      key = 3;
+    else if (key == TB_KEY_MOUSE_WHEEL_DOWN)
+      key = 4;
+    else // TB_KEY_MOUSE_RELEASE
+      key = 5;
+  }
+  else if (key <= TB_KEY_ARROW_UP && key >= TB_KEY_ARROW_RIGHT)
+  {
+    static const uint16_t arrows[] = {65, 66, 68, 67};
+    key = arrows[TB_KEY_ARROW_UP - key];
+  }
+  else if (key >= TB_KEY_F12)
+  {
+    key = 265 + (TB_KEY_F1 - key);
+  }
+  else if (key <= TB_KEY_INSERT && key >= TB_KEY_PGDN)
+  {
+    static const uint16_t editing[] = {331, 330, 262, 360, 339, 338};
+    key = editing[TB_KEY_INSERT - key];
+  }
+  else if (key == TB_KEY_BACK_TAB)
+  {
+    key = TB_KEY_TAB;
+    mod |= 1;
+  }
+  else if (ch == 0 && (key < 0x20 || key == TB_KEY_BACKSPACE2))
+  {
+    // termbox tags every control byte with TB_MOD_CTRL; keep it only for
+    // Ctrl+letter, which is reported as the letter
+    mod &= ~2;
+    if (key >= TB_KEY_CTRL_A && key <= 0x1a && key != TB_KEY_BACKSPACE &&
+        key != TB_KEY_TAB && key != TB_KEY_ENTER)
+    {
+      ch = 'a' + (key - TB_KEY_CTRL_A);
+      mod |= 2;
+    }
+  }
+
+  rec[0] = type;
+  rec[1] = mod;
+  memcpy(rec + 2, &key, sizeof(key));
+  memcpy(rec + 4, &ch, sizeof(ch));
+  memcpy(rec + 8, &x, sizeof(x));
+  memcpy(rec + 12, &y, sizeof(y));
+}
+
+// tb_input_start/1, tb_input_start/2 (optional context, then owner pid)
+// Returns {:ok, resource}, or {:error, code} if termbox is not initialized.
+// Replaces the context's previous watcher; the watcher also stops if the owner
+// exits.
+static ERL_NIF_TERM nif_tb_input_start(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[])
+{
+  tb_ctx_t *ctx;
+  ErlNifPid owner;
+  int ttyfd, resizefd, wfd;
+  int i = ctx_arg(env, argc, 1, argv, &ctx);
+  if (i < 0 || !enif_get_local_pid(env, argv[i], &owner))
+  {
+    return enif_make_badarg(env);
+  }
+
+  ctx_lock(ctx);
+  int result = tb_get_fds(&ttyfd, &resizefd);
+  if (result == TB_OK)
+  {
+    result = tb_get_output_fd(&wfd);
+  }
+  if (result != TB_OK)
+  {
+    ctx_unlock(ctx);
+    return enif_make_tuple2(env, enif_make_atom(env, "error"), enif_make_int(env, result));
+  }
+  input_stop_locked(env, ctx);
+
+  tb_input_t *in = enif_alloc_resource(input_type, sizeof(tb_input_t));
+  in->owner = owner;
+  in->ctx = ctx;
+  if (ctx != NULL)
+  {
+    enif_keep_resource(ctx);
+  }
+  in->ttyfd = ttyfd;
+  in->resizefd = resizefd;
+  in->wfd = wfd;
+  in->active = 1;
+  if (enif_monitor_process(env, in, &owner, &in->monitor) != 0 ||
+      input_select_locked(env, in) != 0)
+  {
+    enif_select(env, ttyfd, ERL_NIF_SELECT_STOP, in, NULL, atom_undefined);
+    enif_select(env, resizefd, ERL_NIF_SELECT_STOP, in, NULL, atom_undefined);
+    ctx_unlock(ctx);
+    enif_release_resource(in);
+    return enif_make_tuple2(env, enif_make_atom(env, "error"), enif_make_int(env, TB_ERR_POLL));
+  }
+  // The context holds its own reference until input_stop_locked drops it
+  enif_keep_resource(in);
+  *input_slot(ctx) = in;
+  ctx_unlock(ctx);
+
+  ERL_NIF_TERM res = enif_make_resource(env, in);
+  enif_release_resource(in);
+  return enif_make_tuple2(env, enif_make_atom(env, "ok"), res);
+}
+
+// tb_input_poll/1 (resource, dirty I/O: a large paste may take a while)
+// Drains every event termbox can produce without blocking into one binary of
+// packed records (see pack_input_event) and re-arms the select. Returns the
+// binary, or {:error, :closed} if the watcher has been stopped. If the tty has
+// hung up, the watcher stops and its owner is sent {:termbox_input, :closed}
+// after the events read before that. The context is
+// only locked while a batch is decoded, so a long drain doesn't hold up
+// rendering, and events decoded before an error are still returned.
+static ERL_NIF_TERM nif_tb_input_poll(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[])
+{
+  (void)argc;
+  tb_input_t *in;
+  ErlNifBinary bin;
+  struct tb_event events[INPUT_DRAIN_BATCH];
+  size_t n, len = 0;
+  int more = 1, closed = 0;
+
+  if (!enif_get_resource(env, argv[0], input_type, (void **)&in))
+  {
+    return enif_make_badarg(env);
+  }
+  if (!enif_alloc_binary(INPUT_DRAIN_BATCH * INPUT_EVENT_SIZE, &bin))
+  {
+    return enif_make_tuple2(env, enif_make_atom(env, "error"), enif_make_atom(env, "enomem"));
+  }
+
+  while (more)
+  {
+    // Make room first so that drained events are never dropped
+    if (len + INPUT_DRAIN_BATCH * INPUT_EVENT_SIZE > bin.size &&
+        !enif_realloc_binary(&bin, bin.size * 2))
+    {
+      more = 0;
+    }
+    ctx_lock(in->ctx);
+    if (!in->active)
+    {
+      ctx_unlock(in->ctx);
+      closed = 1;
+      break;
+    }
+    n = 0;
+    if (more)
+    {
+      int result = tb_drain_events(events, INPUT_DRAIN_BATCH, &n);
+      more = result == TB_OK && n == INPUT_DRAIN_BATCH;
+      // The tty hung up or can't be read: re-arming would only report it
+      // readable again at once, so stop and tell the owner instead
+      if (result == TB_ERR_READ && tb_last_errno() != EINTR && tb_last_errno() != EAGAIN)
+      {
+        input_stop_locked(env, in->ctx);
+        enif_send(env, &in->owner, NULL,
+                  enif_make_tuple2(env, enif_make_atom(env, "termbox_input"),
+                                   enif_make_atom(env, "closed")));
+        more = 0;
+        closed = 1;
+      }
+    }
+    if (!more && !closed)
+    {
+      input_select_locked(env, in);
+    }
+    ctx_unlock(in->ctx);
+
+    for (size_t i = 0; i < n; i++, len += INPUT_EVENT_SIZE)
+    {
+      pack_input_event(bin.data + len, &events[i]);
+    }
+  }
+
+  if (closed && len == 0)
+  {
+    enif_release_binary(&bin);
+    return enif_make_tuple2(env, enif_make_atom(env, "error"), enif_make_atom(env, "closed"));
+  }
+  enif_realloc_binary(&bin, len);
+  return enif_make_binary(env, &bin);
+}
+
+// tb_input_stop/1 (resource)
+static ERL_NIF_TERM nif_tb_input_stop(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[])
+{
+  (void)argc;
+  tb_input_t *in;
+  if (!enif_get_resource(env, argv[0], input_type, (void **)&in))
+  {
+    return enif_make_badarg(env);
+  }
+  ctx_lock(in->ctx);
+  if (*input_slot(in->ctx) == in)
+  {
+    input_stop_locked(env, in->ctx);
+  }
+  ctx_unlock(in->ctx);
+  return enif_make_atom(env, "ok");
+}
+
+// tb_set_cursor/2, tb_set_cursor/3 (context first)
+static ERL_NIF_TERM nif_tb_set_cursor(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[])
+{
+  tb_ctx_t *ctx;
+  int x, y;
+  int i = ctx_arg(env, argc, 2, argv, &ctx);
+  if (i < 0 || !enif_get_int(env, argv[i], &x) || !enif_get_int(env, argv[i + 1], &y))
+  {
+    return enif_make_badarg(env);
+  }
+  ctx_lock(ctx);
+  tb_set_cursor(x, y);
+  ctx_unlock(ctx);
+  return enif_make_atom(env, "ok");
+}
+
+// tb_hide_cursor/0, tb_hide_cursor/1 (context)
+static ERL_NIF_TERM nif_tb_hide_cursor(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[])
+{
+  tb_ctx_t *ctx;
+  if (ctx_arg(env, argc, 0, argv, &ctx) < 0)
+  {
+    return enif_make_badarg(env);
+  }
+  ctx_lock(ctx);
+  int result = tb_hide_cursor();
+  ctx_unlock(ctx);
+  return enif_make_int(env, result);
+}
+
+// tb_set_cell/5, tb_set_cell/6 (context first)
+static ERL_NIF_TERM nif_tb_set_cell(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[])
+{
+  tb_ctx_t *ctx;
+  int x, y;
+  unsigned int ch;
+  unsigned int fg, bg;
+  int i = ctx_arg(env, argc, 5, argv, &ctx);
+  if (i < 0 ||
+      !enif_get_int(env, argv[i], &x) ||
+      !enif_get_int(env, argv[i + 1], &y) ||
+      !enif_get_uint(env, argv[i + 2], &ch) ||
+      !enif_get_uint(env, argv[i + 3], &fg) ||
+      !enif_get_uint(env, argv[i + 4], &bg))
+  {
+    return enif_make_badarg(env);
+  }
+  ctx_lock(ctx);
+  int result = tb_set_cell(x, y, ch, fg, bg);
+  ctx_unlock(ctx);
+  return enif_make_int(env, result);
+}
+
+// tb_set_cells/1, tb_set_cells/2 (optional context, then a packed binary or
+// iolist of 24-byte cell records)
+static ERL_NIF_TERM nif_tb_set_cells(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[])
+{
+  tb_ctx_t *ctx;
+  ErlNifBinary bin;
+  size_t written;
+  int i = ctx_arg(env, argc, 1, argv, &ctx);
+  if (i < 0 || !enif_inspect_iolist_as_binary(env, argv[i], &bin))
+  {
+    return enif_make_badarg(env);
+  }
+  ctx_lock(ctx);
+  int result = tb_set_cells(bin.data, bin.size, &written);
+  ctx_unlock(ctx);
+  if (result != TB_OK)
+  {
+    return enif_make_int(env, result);
+  }
+  return enif_make_int(env, (int)written);
+}
+
+// tb_blit/5, tb_blit/6 (optional context, then x, y, w, h and a packed
+// row-major rectangle of 20-byte records)
+static ERL_NIF_TERM nif_tb_blit(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[])
+{
+  tb_ctx_t *ctx;
+  int x, y, w, h;
+  ErlNifBinary bin;
+  size_t written;
+  int i = ctx_arg(env, argc, 5, argv, &ctx);
+  if (i < 0 ||
+      !enif_get_int(env, argv[i], &x) ||
+      !enif_get_int(env, argv[i + 1], &y) ||
+      !enif_get_int(env, argv[i + 2], &w) ||
+      !enif_get_int(env, argv[i + 3], &h) ||
+      !enif_inspect_iolist_as_binary(env, argv[i + 4], &bin))
+  {
+    return enif_make_badarg(env);
+  }
+  ctx_lock(ctx);
+  int result = tb_blit(x, y, w, h, bin.data, bin.size, &written);
+  ctx_unlock(ctx);
+  if (result != TB_OK)
+  {
+    return enif_make_int(env, result);
+  }
+  return enif_make_int(env, (int)written);
+}
+
+// tb_set_input_mode/1, tb_set_input_mode/2 (context first)
+static ERL_NIF_TERM nif_tb_set_input_mode(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[])
+{
+  tb_ctx_t *ctx;
+  int mode;
+  int i = ctx_arg(env, argc, 1, argv, &ctx);
+  if (i < 0 || !enif_get_int(env, argv[i], &mode))
+  {
+    return enif_make_badarg(env);
+  }
+  ctx_lock(ctx);
+  int result = tb_set_input_mode(mode);
+  ctx_unlock(ctx);
+  return enif_make_int(env, result);
+}
+
+// tb_set_output_mode/1, tb_set_output_mode/2 (context first)
+static ERL_NIF_TERM nif_tb_set_output_mode(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[])
+{
+  tb_ctx_t *ctx;
+  int mode;
+  int i = ctx_arg(env, argc, 1, argv, &ctx);
+  if (i < 0 || !enif_get_int(env, argv[i], &mode))
+  {
+    return enif_make_badarg(env);
+  }
+  ctx_lock(ctx);
+  int result = tb_set_output_mode(mode);
+  ctx_unlock(ctx);
+  return enif_make_int(env, result);
+}
+
+// tb_set_output_nonblock/1, tb_set_output_nonblock/2 (optional context, then
+// true | false)
+static ERL_NIF_TERM nif_tb_set_output_nonblock(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[])
+{
+  tb_ctx_t *ctx;
+  int i = ctx_arg(env, argc, 1, argv, &ctx);
+  if (i < 0 || (!enif_is_identical(argv[i], atom_true) && !enif_is_identical(argv[i], atom_false)))
+  {
+    return enif_make_badarg(env);
+  }
+  ctx_lock(ctx);
+  int result = tb_set_output_nonblock(enif_is_identical(argv[i], atom_true));
+  ctx_unlock(ctx);
+  return enif_make_int(env, result);
+}
+
+// tb_flush/0, tb_flush/1 (optional context; dirty I/O, since blocking output
+// waits for the terminal)
+// Writes as much queued output as the terminal takes. Returns :ok once nothing
+// is left, else {:pending, bytes} and the caller receives {:select, watcher,
+// :undefined, :ready_output} when the terminal has room again. That select
+// goes through the context's input watcher, so without one the rest of the
+// output is written blocking instead, like the unlocked writes to a duplicate
+// of the output fd, and the result is :ok unless that write fails.
+static ERL_NIF_TERM nif_tb_flush(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[])
+{
+  tb_ctx_t *ctx;
+  ErlNifPid caller;
+  size_t pending;
+  if (ctx_arg(env, argc, 0, argv, &ctx) < 0)
+  {
+    return enif_make_badarg(env);
+  }
+  ctx_lock(ctx);
+  int result = tb_flush_output(&pending);
+  tb_input_t *in = *input_slot(ctx);
+  if (result == TB_OK && pending > 0 && in != NULL && in->wfd >= 0)
+  {
+    enif_self(env, &caller);
+    enif_select(env, in->wfd, ERL_NIF_SELECT_WRITE, in, &caller, atom_undefined);
+  }
+  else if (result == TB_OK && pending > 0)
+  {
+    // Still under the lock: non-blocking presents write straight to the fd
+    // once nothing is queued, so releasing it could reorder frames
+    const char *buf;
+    int wfd = output_fd_dup();
+    tb_take_output(&buf, &pending);
+    result = wfd < 0 ? TB_ERR : write_all(wfd, buf, pending);
+    pending = 0;
+    if (wfd >= 0)
+    {
+      close(wfd);
+    }
+  }
+  ctx_unlock(ctx);
+  if (result != TB_OK)
+  {
+    return enif_make_tuple2(env, enif_make_atom(env, "error"), enif_make_int(env, result));
+  }
+  if (pending > 0)
+  {
+    return enif_make_tuple2(env, enif_make_atom(env, "pending"), enif_make_uint64(env, pending));
+  }
+  return enif_make_atom(env, "ok");
+}
+
+// tb_print/5, tb_print/6 (optional context, then x, y, fg, bg, string)
+static ERL_NIF_TERM nif_tb_print(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[])
+{
+  tb_ctx_t *ctx;
+  int x, y;
+  unsigned int fg, bg;
+  ErlNifBinary bin;
+  int i = ctx_arg(env, argc, 5, argv, &ctx);
+  if (i < 0 ||
+      !enif_get_int(env, argv[i], &x) ||
+      !enif_get_int(env, argv[i + 1], &y) ||
+      !enif_get_uint(env, argv[i + 2], &fg) ||
+      !enif_get_uint(env, argv[i + 3], &bg) ||
+      !enif_inspect_binary(env, argv[i + 4], &bin))
+  {
+    return enif_make_badarg(env);
+  }
+  ctx_lock(ctx);
+  int result = tb_print_n(x, y, fg, bg, NULL, (const char *)bin.data, bin.size);
+  ctx_unlock(ctx);
+  return enif_make_int(env, result);
+}
+
+// tb_print_runs/1, tb_print_runs/2 (optional context, then a packed binary or
+// iolist of runs, see tb_print_runs in termbox2.h)
+// Returns the list of run widths, or a negative error code.
+static ERL_NIF_TERM nif_tb_print_runs(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[])
+{
+  tb_ctx_t *ctx;
+  ErlNifBinary bin;
+  size_t n, k;
+  int i = ctx_arg(env, argc, 1, argv, &ctx);
+  if (i < 0 || !enif_inspect_iolist_as_binary(env, argv[i], &bin))
+  {
+    return enif_make_badarg(env);
+  }
+  // One allocation per call: the list cells, then the widths behind them
+  size_t max = bin.size / TB_PACKED_RUN_SIZE;
+  ERL_NIF_TERM *terms =
+      enif_alloc((max ? max : 1) * (sizeof(ERL_NIF_TERM) + sizeof(int)));
+  if (terms == NULL)
+  {
+    return enif_make_int(env, TB_ERR_MEM);
+  }
+  int *widths = (int *)(terms + max);
+  ctx_lock(ctx);
+  int result = tb_print_runs(bin.data, bin.size, widths, &n);
+  ctx_unlock(ctx);
+  if (result != TB_OK)
+  {
+    enif_free(terms);
+    return enif_make_int(env, result);
+  }
+  for (k = 0; k < n; k++)
+  {
+    terms[k] = enif_make_int(env, widths[k]);
+  }
+  ERL_NIF_TERM list = enif_make_list_from_array(env, terms, (unsigned)n);
+  enif_free(terms);
+  return list;
+}
+
+// tb_wcwidth_table/0
+// Returns {stage1, stage2, limit}: copies of the lookup table behind
+// tb_wcwidth (see tb_wcwidth_table in termbox2.h), with stage2 as native-endian
+// 32-bit words, or {:error, code} if termbox uses libc's wcwidth instead. Needs
+// no initialized context.
+static ERL_NIF_TERM nif_tb_wcwidth_table(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[])
+{
+  (void)argc;
+  (void)argv;
+  const uint8_t *stage1;
+  const uint32_t *stage2;
+  size_t nstage2;
+  uint32_t limit;
+  ERL_NIF_TERM bin1, bin2;
+  int result = tb_wcwidth_table(&stage1, &stage2, &nstage2, &limit);
+  if (result != TB_OK)
+  {
+    return enif_make_tuple2(env, enif_make_atom(env, "error"), enif_make_int(env, result));
+  }
+  memcpy(enif_make_new_binary(env, limit >> 8, &bin1), stage1, limit >> 8);
+  memcpy(enif_make_new_binary(env, nstage2 * sizeof(uint32_t), &bin2), stage2,
+         nstage2 * sizeof(uint32_t));
+  return enif_make_tuple3(env, bin1, bin2, enif_make_uint(env, limit));
+}
+
+// Parser for the output of programs run in the emulator (see vt_parser.h).
+// vt_parse/2 turns a chunk into a list of ops in stream order:
+//
+//   binary                                  printable text, a sub-binary of
+//                                           the chunk
+//   integer                                 a C0 control to execute
+//   {:esc, intermediates, final}
+//   {:csi, params, intermediates, final}    a CSI private marker leads the
+//                                           intermediates, as in ParserState
+//   {:dcs, params, intermediates, final, data}
+//   {:osc | :sos | :pm | :apc, data}
+//
+// Each parser belongs to one emulator, but its lock keeps a shared handle
+// from corrupting the state.
+typedef struct
+{
+  ErlNifMutex *lock;
+  struct vt_parser p;
+} vt_res_t;
+
+typedef struct
+{
+  ErlNifEnv *env;
+  ERL_NIF_TERM chunk;
+  const uint8_t *base;
+  size_t size;
+  ERL_NIF_TERM ops;
+} vt_ops_t;
+
+// Chunks larger than this are parsed on a dirty scheduler
+#define VT_DIRTY_CHUNK (64 * 1024)
+
+static void vt_dtor(ErlNifEnv *env, void *obj)
+{
+  (void)env;
+  vt_res_t *res = (vt_res_t *)obj;
+  vt_parser_free(&res->p);
+  if (res->lock != NULL)
+  {
+    enif_mutex_destroy(res->lock);
+  }
+}
+
+static ERL_NIF_TERM vt_binary(ErlNifEnv *env, const uint8_t *s, size_t n)
+{
+  ERL_NIF_TERM term;
+  unsigned char *data = enif_make_new_binary(env, n, &term);
+  if (n > 0)
+  {
+    memcpy(data, s, n);
+  }
+  return term;
+}
+
+static void vt_push(vt_ops_t *o, ERL_NIF_TERM op)
+{
+  o->ops = enif_make_list_cell(o->env, op, o->ops);
+}
+
+static void vt_on_print(void *ud, const uint8_t *s, size_t n)
+{
+  vt_ops_t *o = (vt_ops_t *)ud;
+  if (s >= o->base && s + n <= o->base + o->size)
+  {
+    vt_push(o, enif_make_sub_binary(o->env, o->chunk, (size_t)(s - o->base), n));
+  }
+  else
+  {
+    vt_push(o, vt_binary(o->env, s, n));
+  }
+}
+
+static void vt_on_execute(void *ud, uint8_t byte)
+{
+  vt_ops_t *o = (vt_ops_t *)ud;
+  vt_push(o, enif_make_uint(o->env, byte));
+}
+
+static void vt_on_esc(void *ud, const struct vt_parser *p)
+{
+  vt_ops_t *o = (vt_ops_t *)ud;
+  vt_push(o, enif_make_tuple3(o->env, atom_esc,
+                              vt_binary(o->env, p->intermediates, p->nintermediates),
+                              enif_make_uint(o->env, p->final)));
+}
+
+static void vt_on_csi(void *ud, const struct vt_parser *p)
+{
+  vt_ops_t *o = (vt_ops_t *)ud;
+  vt_push(o, enif_make_tuple4(o->env, atom_csi, vt_binary(o->env, p->params, p->nparams),
+                              vt_binary(o->env, p->intermediates, p->nintermediates),
+                              enif_make_uint(o->env, p->final)));
+}
+
+static void vt_on_string(void *ud, const struct vt_parser *p)
+{
+  vt_ops_t *o = (vt_ops_t *)ud;
+  ERL_NIF_TERM data = vt_binary(o->env, p->data, p->ndata);
+  switch (p->string)
+  {
+  case VT_STR_DCS:
+    vt_push(o, enif_make_tuple5(o->env, atom_dcs, vt_binary(o->env, p->params, p->nparams),
+                                vt_binary(o->env, p->intermediates, p->nintermediates),
+                                enif_make_uint(o->env, p->final), data));
+    break;
+  case VT_STR_OSC:
+    vt_push(o, enif_make_tuple2(o->env, atom_osc, data));
+    break;
+  case VT_STR_SOS:
+    vt_push(o, enif_make_tuple2(o->env, atom_sos, data));
+    break;
+  case VT_STR_PM:
+    vt_push(o, enif_make_tuple2(o->env, atom_pm, data));
+    break;
+  case VT_STR_APC:
+    vt_push(o, enif_make_tuple2(o->env, atom_apc, data));
+    break;
+  }
+}
+
+static const struct vt_callbacks vt_ops_callbacks = {
+    vt_on_print, vt_on_execute, vt_on_esc, vt_on_csi, vt_on_string};
+
+// vt_parser_new/0
+static ERL_NIF_TERM nif_vt_parser_new(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[])
+{
+  (void)argc;
+  (void)argv;
+  vt_res_t *res = enif_alloc_resource(vt_type, sizeof(vt_res_t));
+  if (res == NULL)
+  {
+    return enif_make_badarg(env);
+  }
+  vt_parser_init(&res->p);
+  res->lock = enif_mutex_create("termbox2_nif.vt_parser");
+  if (res->lock == NULL)
+  {
+    enif_release_resource(res);
+    return enif_make_tuple2(env, enif_make_atom(env, "error"), enif_make_int(env, TB_ERR_MEM));
+  }
+  ERL_NIF_TERM term = enif_make_resource(env, res);
+  enif_release_resource(res);
+  return enif_make_tuple2(env, enif_make_atom(env, "ok"), term);
+}
+
+// vt_parse/2 (parser, chunk)
+static ERL_NIF_TERM nif_vt_parse(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[])
+{
+  vt_res_t *res;
+  ErlNifBinary bin;
+  ERL_NIF_TERM ops;
+  if (!enif_get_resource(env, argv[0], vt_type, (void **)&res) ||
+      !enif_inspect_binary(env, argv[1], &bin))
+  {
+    return enif_make_badarg(env);
+  }
+  if (bin.size > VT_DIRTY_CHUNK && enif_thread_type() == ERL_NIF_THR_NORMAL_SCHEDULER)
+  {
+    return enif_schedule_nif(env, "vt_parse", ERL_NIF_DIRTY_JOB_CPU_BOUND, nif_vt_parse, argc,
+                             argv);
+  }
+  vt_ops_t o = {env, argv[1], bin.data, bin.size, enif_make_list(env, 0)};
+  enif_mutex_lock(res->lock);
+  vt_parse(&res->p, bin.data, bin.size, &vt_ops_callbacks, &o);
+  enif_mutex_unlock(res->lock);
+  enif_make_reverse_list(env, o.ops, &ops);
+  return ops;
+}
+
+// Styles interned for a grid or scrollback ring. The Elixir side stores a
+// small id per cell or span instead of the style, and the table that maps ids
+// back lives with the resource rather than in the struct holding it, so every
+// copy of the struct agrees on what an id means. Styles are copied into the
+// table's own env. Once every id is taken, the ones no cell or span refers to
+// any more are collected, keeping the table proportional to the styles in
+// use; the table only grows when most of them still are.
+#define STYLE_INITIAL_CAP 64
+#define STYLE_MAX_CAP (1u << 24)
+
+typedef struct
+{
+  ErlNifEnv *env;
+  // By id: the style, and whether the id is taken
+  ERL_NIF_TERM *terms;
+  uint8_t *live;
+  // Open-addressed index of 2 * cap slots holding id + 1, 0 when empty
+  uint32_t *slots;
+  // Ids below n have been handed out; nlive of them are taken
+  uint32_t n, nlive, cap;
+  // Where the search for a free id below n resumes
+  uint32_t hint;
+} style_table_t;
+
+// Marks the ids a resource's cells or spans refer to in t->live
+typedef void (*style_mark_fn)(void *res, style_table_t *t);
+
+static void style_table_free(style_table_t *t)
+{
+  if (t->env != NULL)
+  {
+    enif_free_env(t->env);
+  }
+  enif_free(t->terms);
+  enif_free(t->live);
+  enif_free(t->slots);
+  memset(t, 0, sizeof(*t));
+}
+
+static int style_table_init(style_table_t *t)
+{
+  memset(t, 0, sizeof(*t));
+  t->cap = STYLE_INITIAL_CAP;
+  t->env = enif_alloc_env();
+  t->terms = enif_alloc(t->cap * sizeof(ERL_NIF_TERM));
+  t->live = enif_alloc(t->cap);
+  t->slots = enif_alloc(2 * t->cap * sizeof(uint32_t));
+  if (t->env == NULL || t->terms == NULL || t->live == NULL || t->slots == NULL)
+  {
+    style_table_free(t);
+    return TB_ERR_MEM;
+  }
+  memset(t->slots, 0, 2 * t->cap * sizeof(uint32_t));
+  return TB_OK;
+}
+
+static uint32_t style_slot(style_table_t *t, ERL_NIF_TERM style)
+{
+  uint32_t mask = 2 * t->cap - 1;
+  uint32_t i = (uint32_t)enif_hash(ERL_NIF_INTERNAL_HASH, style, 0) & mask;
+  while (t->slots[i] != 0 && !enif_is_identical(t->terms[t->slots[i] - 1], style))
+  {
+    i = (i + 1) & mask;
+  }
+  return i;
+}
+
+static void style_reindex(style_table_t *t)
+{
+  memset(t->slots, 0, 2 * t->cap * sizeof(uint32_t));
+  for (uint32_t id = 0; id < t->n; id++)
+  {
+    if (t->live[id])
+    {
+      t->slots[style_slot(t, t->terms[id])] = id + 1;
+    }
+  }
+}
+
+// Frees the ids nothing refers to: those mark leaves unset and that are not
+// among the nkeep in keep, which the caller has handed out but not stored yet
+static int style_collect(style_table_t *t, style_mark_fn mark, void *res, const uint32_t *keep,
+                         size_t nkeep)
+{
+  ErlNifEnv *env = enif_alloc_env();
+  if (env == NULL)
+  {
+    return TB_ERR_MEM;
+  }
+  memset(t->live, 0, t->n);
+  mark(res, t);
+  for (size_t k = 0; k < nkeep; k++)
+  {
+    t->live[keep[k]] = 1;
+  }
+  // Copy the survivors into a fresh env so the dropped styles' memory goes too
+  t->nlive = 0;
+  for (uint32_t id = 0; id < t->n; id++)
+  {
+    if (t->live[id])
+    {
+      t->terms[id] = enif_make_copy(env, t->terms[id]);
+      t->nlive++;
+    }
+  }
+  enif_free_env(t->env);
+  t->env = env;
+  t->hint = 0;
+  style_reindex(t);
+  return TB_OK;
+}
+
+static int style_grow(style_table_t *t)
+{
+  uint32_t cap = t->cap * 2;
+  if (cap > STYLE_MAX_CAP)
+  {
+    return TB_ERR_MEM;
+  }
+  ERL_NIF_TERM *terms = enif_realloc(t->terms, cap * sizeof(ERL_NIF_TERM));
+  if (terms == NULL)
+  {
+    return TB_ERR_MEM;
+  }
+  t->terms = terms;
+  uint8_t *live = enif_realloc(t->live, cap);
+  if (live == NULL)
+  {
+    return TB_ERR_MEM;
+  }
+  t->live = live;
+  uint32_t *slots = enif_alloc(2 * cap * sizeof(uint32_t));
+  if (slots == NULL)
+  {
+    return TB_ERR_MEM;
+  }
+  enif_free(t->slots);
+  t->slots = slots;
+  t->cap = cap;
+  style_reindex(t);
+  return TB_OK;
+}
+
+// Returns the id of style, interning it if new, or a negative error code.
+// keep and nkeep are as for style_collect.
+static int64_t style_intern(style_table_t *t, ERL_NIF_TERM style, style_mark_fn mark, void *res,
+                            const uint32_t *keep, size_t nkeep)
+{
+  uint32_t i = style_slot(t, style);
+  if (t->slots[i] != 0)
+  {
+    return t->slots[i] - 1;
+  }
+  if (t->nlive == t->cap)
+  {
+    int rv = style_collect(t, mark, res, keep, nkeep);
+    if (rv == TB_OK && t->nlive > t->cap / 4 * 3)
+    {
+      rv = style_grow(t);
+    }
+    if (rv != TB_OK && t->nlive == t->cap)
+    {
+      return rv;
+    }
+    i = style_slot(t, style);
+  }
+  uint32_t id;
+  if (t->n < t->cap)
+  {
+    id = t->n++;
+  }
+  else
+  {
+    while (t->live[t->hint])
+    {
+      t->hint = (t->hint + 1) % t->n;
+    }
+    id = t->hint;
+  }
+  t->terms[id] = enif_make_copy(t->env, style);
+  t->live[id] = 1;
+  t->nlive++;
+  t->slots[i] = id + 1;
+  return id;
+}
+
+// Returns the style behind id in env, or nil for an id not taken
+static ERL_NIF_TERM style_term(ErlNifEnv *env, style_table_t *t, uint64_t id)
+{
+  if (id >= t->n || !t->live[id])
+  {
+    return atom_nil;
+  }
+  return enif_make_copy(env, t->terms[id]);
+}
+
+// Screen grids for the emulator (see tb_grid_new in termbox2.h). A grid keeps
+// its cells in C and is updated in place, so writes cost the same however
+// large the screen. Attributes are opaque 64-bit values to the grid; the
+// Elixir side stores ids from the grid's style table in fg, with 0 for the
+// blank style it fills with, and leaves bg at 0. Like the parser, a grid
+// belongs to one emulator, and its lock only keeps a shared handle safe.
+typedef struct
+{
+  ErlNifMutex *lock;
+  struct tb_grid *g;
+  style_table_t styles;
+} grid_res_t;
+
+static void grid_dtor(ErlNifEnv *env, void *obj)
+{
+  (void)env;
+  grid_res_t *res = (grid_res_t *)obj;
+  tb_grid_free(res->g);
+  style_table_free(&res->styles);
+  if (res->lock != NULL)
+  {
+    enif_mutex_destroy(res->lock);
+  }
+}
+
+static void grid_mark_styles(void *obj, style_table_t *t)
+{
+  grid_res_t *res = (grid_res_t *)obj;
+  struct tb_cell *cell;
+  int w = tb_grid_width(res->g);
+  int h = tb_grid_height(res->g);
+  // Blanks are filled in with id 0 whether or not a cell has it now
+  if (t->n > 0)
+  {
+    t->live[0] = 1;
+  }
+  for (int y = 0; y < h; y++)
+  {
+    for (int x = 0; x < w; x++)
+    {
+      tb_grid_get_cell(res->g, x, y, &cell);
+      if ((uint64_t)cell->fg < t->n)
+      {
+        t->live[cell->fg] = 1;
+      }
+    }
+  }
+}
+
+// Read the grid handle and the int arguments after it, which run up to the
+// first of fg and bg, if nattrs is 2
+static int grid_args(ErlNifEnv *env, const ERL_NIF_TERM argv[], int nints, int nattrs,
+                     grid_res_t **res, int *ints, ErlNifUInt64 *attrs)
+{
+  int k;
+  if (!enif_get_resource(env, argv[0], grid_type, (void **)res))
+  {
+    return 0;
+  }
+  for (k = 0; k < nints; k++)
+  {
+    if (!enif_get_int(env, argv[1 + k], &ints[k]))
+    {
+      return 0;
+    }
+  }
+  for (k = 0; k < nattrs; k++)
+  {
+    if (!enif_get_uint64(env, argv[1 + nints + k], &attrs[k]))
+    {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+// tb_grid_new/2 (width, height)
+static ERL_NIF_TERM nif_tb_grid_new(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[])
+{
+  (void)argc;
+  int w, h;
+  if (!enif_get_int(env, argv[0], &w) || !enif_get_int(env, argv[1], &h))
+  {
+    return enif_make_badarg(env);
+  }
+  grid_res_t *res = enif_alloc_resource(grid_type, sizeof(grid_res_t));
+  if (res == NULL)
+  {
+    return enif_make_badarg(env);
+  }
+  res->g = NULL;
+  memset(&res->styles, 0, sizeof(res->styles));
+  res->lock = enif_mutex_create("termbox2_nif.grid");
+  int result = res->lock == NULL ? TB_ERR_MEM : tb_grid_new(w, h, &res->g);
+  if (result == TB_OK)
+  {
+    result = style_table_init(&res->styles);
+  }
+  if (result != TB_OK)
+  {
+    enif_release_resource(res);
+    return enif_make_tuple2(env, enif_make_atom(env, "error"), enif_make_int(env, result));
+  }
+  ERL_NIF_TERM term = enif_make_resource(env, res);
+  enif_release_resource(res);
+  return enif_make_tuple2(env, enif_make_atom(env, "ok"), term);
+}
+
+// tb_grid_resize/5 (grid, width, height, fg, bg)
+static ERL_NIF_TERM nif_tb_grid_resize(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[])
+{
+  (void)argc;
+  grid_res_t *res;
+  int a[2];
+  ErlNifUInt64 attrs[2];
+  if (!grid_args(env, argv, 2, 2, &res, a, attrs))
+  {
+    return enif_make_badarg(env);
+  }
+  enif_mutex_lock(res->lock);
+  int result = tb_grid_resize(res->g, a[0], a[1], (uintattr_t)attrs[0], (uintattr_t)attrs[1]);
+  enif_mutex_unlock(res->lock);
+  return enif_make_int(env, result);
+}
+
+// tb_grid_size/1
+// Returns {width, height}.
+static ERL_NIF_TERM nif_tb_grid_size(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[])
+{
+  (void)argc;
+  grid_res_t *res;
+  if (!grid_args(env, argv, 0, 0, &res, NULL, NULL))
+  {
+    return enif_make_badarg(env);
+  }
+  enif_mutex_lock(res->lock);
+  int w = tb_grid_width(res->g);
+  int h = tb_grid_height(res->g);
+  enif_mutex_unlock(res->lock);
+  return enif_make_tuple2(env, enif_make_int(env, w), enif_make_int(env, h));
+}
+
+// tb_grid_print/6 (grid, x, y, fg, bg, text)
+// Returns {columns, bytes}: how far the text got along the row before it ran
+// out or reached the right edge, or a negative error code.
+static ERL_NIF_TERM nif_tb_grid_print(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[])
+{
+  (void)argc;
+  grid_res_t *res;
+  int a[2];
+  ErlNifUInt64 attrs[2];
+  ErlNifBinary bin;
+  size_t w, n;
+  if (!grid_args(env, argv, 2, 2, &res, a, attrs) ||
+      !enif_inspect_iolist_as_binary(env, argv[5], &bin))
+  {
+    return enif_make_badarg(env);
+  }
+  enif_mutex_lock(res->lock);
+  int result = tb_grid_print_n(res->g, a[0], a[1], (uintattr_t)attrs[0], (uintattr_t)attrs[1],
+                               &w, &n, (const char *)bin.data, bin.size);
+  enif_mutex_unlock(res->lock);
+  if (result != TB_OK)
+  {
+    return enif_make_int(env, result);
+  }
+  return enif_make_tuple2(env, enif_make_uint64(env, w), enif_make_uint64(env, n));
+}
+
+// tb_grid_erase/6 (grid, x, y, count, fg, bg)
+static ERL_NIF_TERM nif_tb_grid_erase(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[])
+{
+  (void)argc;
+  grid_res_t *res;
+  int a[3];
+  ErlNifUInt64 attrs[2];
+  if (!grid_args(env, argv, 3, 2, &res, a, attrs) || a[2] < 0)
+  {
+    return enif_make_badarg(env);
+  }
+  enif_mutex_lock(res->lock);
+  int result = tb_grid_erase(res->g, a[0], a[1], (size_t)a[2], (uintattr_t)attrs[0],
+                             (uintattr_t)attrs[1]);
+  enif_mutex_unlock(res->lock);
+  return enif_make_int(env, result);
+}
+
+// tb_grid_insert_cells/6, tb_grid_delete_cells/6 and tb_grid_scroll/6 share a
+// shape: grid, three ints, fg and bg
+typedef int (*grid_op_fn)(struct tb_grid *, int, int, int, uintattr_t, uintattr_t);
+
+static ERL_NIF_TERM grid_op(ErlNifEnv *env, const ERL_NIF_TERM argv[], grid_op_fn op)
+{
+  grid_res_t *res;
+  int a[3];
+  ErlNifUInt64 attrs[2];
+  if (!grid_args(env, argv, 3, 2, &res, a, attrs))
+  {
+    return enif_make_badarg(env);
+  }
+  enif_mutex_lock(res->lock);
+  int result = op(res->g, a[0], a[1], a[2], (uintattr_t)attrs[0], (uintattr_t)attrs[1]);
+  enif_mutex_unlock(res->lock);
+  return enif_make_int(env, result);
+}
+
+// tb_grid_insert_cells/6 (grid, x, y, count, fg, bg)
+static ERL_NIF_TERM nif_tb_grid_insert_cells(ErlNifEnv *env, int argc,
+                                             const ERL_NIF_TERM argv[])
+{
+  (void)argc;
+  return grid_op(env, argv, tb_grid_insert_cells);
+}
+
+// tb_grid_delete_cells/6 (grid, x, y, count, fg, bg)
+static ERL_NIF_TERM nif_tb_grid_delete_cells(ErlNifEnv *env, int argc,
+                                             const ERL_NIF_TERM argv[])
+{
+  (void)argc;
+  return grid_op(env, argv, tb_grid_delete_cells);
+}
+
+// tb_grid_scroll/6 (grid, top, bottom, count, fg, bg)
+static ERL_NIF_TERM nif_tb_grid_scroll(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[])
+{
+  (void)argc;
+  return grid_op(env, argv, tb_grid_scroll);
+}
+
+// tb_grid_intern/2 (grid, style)
+// Returns the id of style in the grid's style table, adding it if new, or a
+// negative error code.
+static ERL_NIF_TERM nif_tb_grid_intern(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[])
+{
+  (void)argc;
+  grid_res_t *res;
+  if (!grid_args(env, argv, 0, 0, &res, NULL, NULL))
+  {
+    return enif_make_badarg(env);
+  }
+  enif_mutex_lock(res->lock);
+  int64_t id = style_intern(&res->styles, argv[1], grid_mark_styles, res, NULL, 0);
+  enif_mutex_unlock(res->lock);
+  return enif_make_int64(env, id);
+}
+
+// The UTF-8 text of a cell that holds a grapheme cluster rather than one
+// codepoint, or 0 if it holds one
+static int grid_cluster(ErlNifEnv *env, struct tb_cell *cell, ERL_NIF_TERM *text)
+{
+#ifdef TB_OPT_EGC
+  if (cell->nech > 0)
+  {
+    char utf8[7];
+    size_t k, n = 0;
+    for (k = 0; k < cell->nech; k++)
+    {
+      n += (size_t)tb_utf8_unicode_to_char(utf8, cell->ech[k]);
+    }
+    unsigned char *out = enif_make_new_binary(env, n, text);
+    for (k = 0; k < cell->nech; k++)
+    {
+      out += tb_utf8_unicode_to_char((char *)out, cell->ech[k]);
+    }
+    return 1;
+  }
+#else
+  (void)env;
+  (void)cell;
+  (void)text;
+#endif
+  return 0;
+}
+
+// tb_grid_row/2 (grid, y)
+// Returns {cells, clusters, styles}: the row as tb_blit records
+// (TB_PACKED_RECT_SIZE bytes each, ch 0 marking the trailing columns of a wide
+// character), {x, utf8} for each cell holding a grapheme cluster rather than
+// one codepoint, and {id, style} for each style id in fg. Returns a negative
+// error code for a row outside the grid.
+static ERL_NIF_TERM nif_tb_grid_row(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[])
+{
+  (void)argc;
+  grid_res_t *res;
+  int y, x, w;
+  struct tb_cell *cell;
+  ERL_NIF_TERM cells, clusters, styles, text;
+  if (!grid_args(env, argv, 1, 0, &res, &y, NULL))
+  {
+    return enif_make_badarg(env);
+  }
+  clusters = enif_make_list(env, 0);
+  styles = enif_make_list(env, 0);
+  enif_mutex_lock(res->lock);
+  w = tb_grid_width(res->g);
+  if (y < 0 || y >= tb_grid_height(res->g))
+  {
+    enif_mutex_unlock(res->lock);
+    return enif_make_int(env, TB_ERR_OUT_OF_BOUNDS);
+  }
+  // One bit per style id, to list each style once
+  uint8_t *seen = enif_alloc(res->styles.n / 8 + 1);
+  if (seen == NULL)
+  {
+    enif_mutex_unlock(res->lock);
+    return enif_make_int(env, TB_ERR_MEM);
+  }
+  memset(seen, 0, res->styles.n / 8 + 1);
+  unsigned char *rec = enif_make_new_binary(env, (size_t)w * TB_PACKED_RECT_SIZE, &cells);
+  for (x = w - 1; x >= 0; x--)
+  {
+    uint32_t ch;
+    uint64_t fg, bg;
+    tb_grid_get_cell(res->g, x, y, &cell);
+    ch = cell->ch;
+    fg = cell->fg;
+    bg = cell->bg;
+    memcpy(rec + (size_t)x * TB_PACKED_RECT_SIZE, &ch, sizeof(ch));
+    memcpy(rec + (size_t)x * TB_PACKED_RECT_SIZE + 4, &fg, sizeof(fg));
+    memcpy(rec + (size_t)x * TB_PACKED_RECT_SIZE + 12, &bg, sizeof(bg));
+    if (fg < res->styles.n && !(seen[fg / 8] & (1 << (fg % 8))))
+    {
+      seen[fg / 8] |= (uint8_t)(1 << (fg % 8));
+      styles = enif_make_list_cell(
+          env, enif_make_tuple2(env, enif_make_uint64(env, fg), style_term(env, &res->styles, fg)),
+          styles);
+    }
+    if (grid_cluster(env, cell, &text))
+    {
+      clusters = enif_make_list_cell(
+          env, enif_make_tuple2(env, enif_make_int(env, x), text), clusters);
+    }
+  }
+  enif_mutex_unlock(res->lock);
+  enif_free(seen);
+  return enif_make_tuple3(env, cells, clusters, styles);
 }
 
-// tb_shutdown/0
-static ERL_NIF_TERM nif_tb_shutdown(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[])
+// tb_grid_cell/3 (grid, x, y)
+// Returns {text, style} for one cell, where text is its UTF-8 character or
+// cluster, or "" for the trailing columns of a wide character. Returns a
+// negative error code for a cell outside the grid.
+static ERL_NIF_TERM nif_tb_grid_cell(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[])
 {
   (void)argc;
-  (void)argv;
-  tb_shutdown();
-  return enif_make_atom(env, "ok");
+  grid_res_t *res;
+  int a[2];
+  struct tb_cell *cell;
+  ERL_NIF_TERM text;
+  if (!grid_args(env, argv, 2, 0, &res, a, NULL))
+  {
+    return enif_make_badarg(env);
+  }
+  enif_mutex_lock(res->lock);
+  if (a[0] < 0 || a[0] >= tb_grid_width(res->g) || a[1] < 0 || a[1] >= tb_grid_height(res->g))
+  {
+    enif_mutex_unlock(res->lock);
+    return enif_make_int(env, TB_ERR_OUT_OF_BOUNDS);
+  }
+  tb_grid_get_cell(res->g, a[0], a[1], &cell);
+  if (!grid_cluster(env, cell, &text))
+  {
+    char utf8[7];
+    int n = cell->ch == 0 ? 0 : tb_utf8_unicode_to_char(utf8, cell->ch);
+    memcpy(enif_make_new_binary(env, (size_t)n, &text), utf8, (size_t)n);
+  }
+  ERL_NIF_TERM style = style_term(env, &res->styles, (uint64_t)cell->fg);
+  enif_mutex_unlock(res->lock);
+  return enif_make_tuple2(env, text, style);
 }
 
-// tb_width/0
-static ERL_NIF_TERM nif_tb_width(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[])
+// Scrollback rings for the emulator (see scrollback.h). A line is pushed as
+// {text, spans}: its UTF-8 text and, as native-endian 32-bit pairs, the style
+// and byte length of each run of it. The top bit of a span's style marks the
+// trailing cell of a wide character, which takes no text. Lines with no spans
+// are plain text. Span styles are indexes into the list of styles pushed with
+// the lines; the ring interns those in its own style table and stores the
+// table's ids, so lines come back as {text, spans, styles}, where styles
+// lists {id, style} for each id in spans. Lines are pushed oldest first, and
+// indexes count back from the newest line (0). Like the parser and grids, a
+// ring belongs to one emulator, and its lock only keeps a shared handle safe.
+typedef struct
 {
-  (void)argc;
-  (void)argv;
-  int result = tb_width();
-  return enif_make_int(env, result);
+  ErlNifMutex *lock;
+  struct sb_ring r;
+  style_table_t styles;
+} sb_res_t;
+
+#define SB_SPAN_SIZE 8
+#define SB_SPAN_WIDE 0x80000000u
+
+// sb_push/4, sb_range/3 and sb_search/5 calls over more lines than this run
+// on a dirty scheduler
+#define SB_DIRTY_LINES 4096
+
+// Styles copied into the caller's env while one call builds lines, so each
+// is copied once however many lines use it. listed holds the number of the
+// last line that listed an id, 0 if none has.
+typedef struct
+{
+  ERL_NIF_TERM *terms;
+  uint32_t *listed;
+  uint32_t line;
+} sb_copies_t;
+
+static void sb_dtor(ErlNifEnv *env, void *obj)
+{
+  (void)env;
+  sb_res_t *res = (sb_res_t *)obj;
+  sb_free(&res->r);
+  style_table_free(&res->styles);
+  if (res->lock != NULL)
+  {
+    enif_mutex_destroy(res->lock);
+  }
 }
 
-// tb_height/0
-static ERL_NIF_TERM nif_tb_height(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[])
+static void sb_mark_styles(void *obj, style_table_t *t)
 {
-  (void)argc;
-  (void)argv;
-  int result = tb_height();
-  return enif_make_int(env, result);
+  sb_res_t *res = (sb_res_t *)obj;
+  for (size_t i = 0; i < res->r.count; i++)
+  {
+    const struct sb_line *l = sb_get(&res->r, i);
+    for (size_t k = 0; k + SB_SPAN_SIZE <= l->nspans; k += SB_SPAN_SIZE)
+    {
+      uint32_t id;
+      memcpy(&id, l->data + l->ntext + k, sizeof(id));
+      id &= ~SB_SPAN_WIDE;
+      if (id < t->n)
+      {
+        t->live[id] = 1;
+      }
+    }
+  }
 }
 
-// tb_clear/0
-static ERL_NIF_TERM nif_tb_clear(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[])
+static void sb_copies_free(sb_copies_t *c)
 {
-  (void)argc;
-  (void)argv;
-  tb_clear();
-  return enif_make_atom(env, "ok");
+  enif_free(c->terms);
+  enif_free(c->listed);
+  c->terms = NULL;
+  c->listed = NULL;
 }
 
-// tb_present/0
-static ERL_NIF_TERM nif_tb_present(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[])
+static int sb_copies_init(sb_copies_t *c, const style_table_t *t)
 {
-  (void)argc;
-  (void)argv;
-  tb_present();
-  return enif_make_atom(env, "ok");
+  c->line = 0;
+  c->terms = enif_alloc(((size_t)t->n + 1) * sizeof(ERL_NIF_TERM));
+  c->listed = enif_alloc(((size_t)t->n + 1) * sizeof(uint32_t));
+  if (c->terms == NULL || c->listed == NULL)
+  {
+    sb_copies_free(c);
+    return TB_ERR_MEM;
+  }
+  memset(c->listed, 0, ((size_t)t->n + 1) * sizeof(uint32_t));
+  return TB_OK;
 }
 
-// tb_set_cursor/2
-static ERL_NIF_TERM nif_tb_set_cursor(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[])
+// Copy a line into a {text, spans, styles} term, text and spans being two
+// sub-binaries of one binary
+static ERL_NIF_TERM sb_line_term(ErlNifEnv *env, sb_res_t *res, sb_copies_t *c,
+                                 const struct sb_line *l)
+{
+  ERL_NIF_TERM bin, styles = enif_make_list(env, 0);
+  size_t n = (size_t)l->ntext + l->nspans;
+  memcpy(enif_make_new_binary(env, n, &bin), l->data, n);
+  c->line++;
+  for (size_t k = 0; k + SB_SPAN_SIZE <= l->nspans; k += SB_SPAN_SIZE)
+  {
+    uint32_t id;
+    memcpy(&id, l->data + l->ntext + k, sizeof(id));
+    id &= ~SB_SPAN_WIDE;
+    if (id >= res->styles.n || c->listed[id] == c->line)
+    {
+      continue;
+    }
+    if (c->listed[id] == 0)
+    {
+      c->terms[id] = style_term(env, &res->styles, id);
+    }
+    c->listed[id] = c->line;
+    styles = enif_make_list_cell(
+        env, enif_make_tuple2(env, enif_make_uint(env, id), c->terms[id]), styles);
+  }
+  return enif_make_tuple3(env, enif_make_sub_binary(env, bin, 0, l->ntext),
+                          enif_make_sub_binary(env, bin, l->ntext, l->nspans), styles);
+}
+
+// Evict the lines over the ring's limits. If c is set they are prepended to
+// *acc, newest first, for the caller to reverse.
+static void sb_evict_into(ErlNifEnv *env, sb_res_t *res, sb_copies_t *c, ERL_NIF_TERM *acc)
+{
+  struct sb_line *l;
+  while ((l = sb_evict(&res->r)) != NULL)
+  {
+    if (c != NULL)
+    {
+      *acc = enif_make_list_cell(env, sb_line_term(env, res, c, l), *acc);
+    }
+    free(l);
+  }
+}
+
+// Copy n bytes of pushed spans to out, replacing each style, an index into
+// the nids styles pushed, with its id in ids. With out NULL, only checks the
+// spans. Returns 0 for an index out of range or a partial span.
+static int sb_remap(const uint8_t *spans, uint8_t *out, size_t n, const uint32_t *ids,
+                    size_t nids)
+{
+  if (n % SB_SPAN_SIZE != 0)
+  {
+    return 0;
+  }
+  for (size_t k = 0; k < n; k += SB_SPAN_SIZE)
+  {
+    uint32_t id;
+    memcpy(&id, spans + k, sizeof(id));
+    if ((id & ~SB_SPAN_WIDE) >= nids)
+    {
+      return 0;
+    }
+    if (out != NULL)
+    {
+      id = ids[id & ~SB_SPAN_WIDE] | (id & SB_SPAN_WIDE);
+      memcpy(out + k, &id, sizeof(id));
+      memcpy(out + k + 4, spans + k + 4, SB_SPAN_SIZE - 4);
+    }
+  }
+  return 1;
+}
+
+// Check that every element of list is a {text, spans} line whose spans index
+// into nids styles, setting *max_spans to the size of the largest spans.
+static int sb_lines_valid(ErlNifEnv *env, ERL_NIF_TERM list, size_t nids, size_t *max_spans)
+{
+  ERL_NIF_TERM head;
+  const ERL_NIF_TERM *line;
+  ErlNifBinary text, spans;
+  int arity;
+  *max_spans = 0;
+  while (enif_get_list_cell(env, list, &head, &list))
+  {
+    if (!enif_get_tuple(env, head, &arity, &line) || arity != 2 ||
+        !enif_inspect_binary(env, line[0], &text) || !enif_inspect_binary(env, line[1], &spans) ||
+        !sb_remap(spans.data, NULL, spans.size, NULL, nids))
+    {
+      return 0;
+    }
+    if (spans.size > *max_spans)
+    {
+      *max_spans = spans.size;
+    }
+  }
+  return 1;
+}
+
+static ERL_NIF_TERM sb_error(ErlNifEnv *env, int code)
+{
+  return enif_make_tuple2(env, enif_make_atom(env, "error"), enif_make_int(env, code));
+}
+
+static int sb_limits(ErlNifEnv *env, const ERL_NIF_TERM argv[], size_t *lines, size_t *bytes)
+{
+  ErlNifUInt64 l, b;
+  if (!enif_get_uint64(env, argv[0], &l) || !enif_get_uint64(env, argv[1], &b) ||
+      l > SIZE_MAX || b > SIZE_MAX)
+  {
+    return 0;
+  }
+  *lines = (size_t)l;
+  *bytes = (size_t)b;
+  return 1;
+}
+
+// sb_new/2 (max_lines, max_bytes)
+// A max_bytes of 0 means no byte limit.
+static ERL_NIF_TERM nif_sb_new(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[])
 {
   (void)argc;
-  (void)argv;
-  int x, y;
-  if (!enif_get_int(env, argv[0], &x) || !enif_get_int(env, argv[1], &y))
+  size_t lines, bytes;
+  if (!sb_limits(env, argv, &lines, &bytes))
   {
     return enif_make_badarg(env);
   }
-  tb_set_cursor(x, y);
-  return enif_make_atom(env, "ok");
+  sb_res_t *res = enif_alloc_resource(sb_type, sizeof(sb_res_t));
+  if (res == NULL)
+  {
+    return enif_make_badarg(env);
+  }
+  sb_init(&res->r, lines, bytes);
+  res->lock = NULL;
+  if (style_table_init(&res->styles) == TB_OK)
+  {
+    res->lock = enif_mutex_create("termbox2_nif.scrollback");
+  }
+  if (res->lock == NULL)
+  {
+    enif_release_resource(res);
+    return sb_error(env, TB_ERR_MEM);
+  }
+  ERL_NIF_TERM term = enif_make_resource(env, res);
+  enif_release_resource(res);
+  return enif_make_tuple2(env, enif_make_atom(env, "ok"), term);
 }
 
-// tb_hide_cursor/0
-static ERL_NIF_TERM nif_tb_hide_cursor(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[])
+// sb_push/4 (ring, lines, styles, keep_evicted)
+// Appends a list of {text, spans} lines, oldest first, whose spans index into
+// the list of styles, evicting whatever goes over the limits as it does.
+// Returns the evicted lines, oldest first, if keep_evicted is true and []
+// otherwise. The whole list is checked before the ring is touched, so a bad
+// element raises badarg with nothing pushed. Running out of memory before
+// that returns {:error, code}; part way through the list, it returns
+// {:error, code, evicted} with the lines evicted by those already pushed.
+static ERL_NIF_TERM nif_sb_push(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[])
 {
-  (void)argc;
-  (void)argv;
-  int result = tb_hide_cursor();
-  return enif_make_int(env, result);
+  sb_res_t *res;
+  ERL_NIF_TERM list = argv[1], styles = argv[2], head, evicted;
+  ErlNifBinary text, spans;
+  const ERL_NIF_TERM *line;
+  unsigned nlines, nstyles, k;
+  int arity, pushed = 0, result = TB_OK;
+  int keep = enif_is_identical(argv[3], atom_true);
+  size_t nbuf;
+  sb_copies_t c = {NULL, NULL, 0};
+  if (!enif_get_resource(env, argv[0], sb_type, (void **)&res) ||
+      !enif_get_list_length(env, list, &nlines) || !enif_get_list_length(env, styles, &nstyles))
+  {
+    return enif_make_badarg(env);
+  }
+  if (nlines > SB_DIRTY_LINES && enif_thread_type() == ERL_NIF_THR_NORMAL_SCHEDULER)
+  {
+    return enif_schedule_nif(env, "sb_push", ERL_NIF_DIRTY_JOB_CPU_BOUND, nif_sb_push, argc,
+                             argv);
+  }
+  if (!sb_lines_valid(env, list, nstyles, &nbuf))
+  {
+    return enif_make_badarg(env);
+  }
+  uint32_t *ids = enif_alloc(((size_t)nstyles + 1) * sizeof(uint32_t));
+  uint8_t *buf = enif_alloc(nbuf + 1);
+  if (ids == NULL || buf == NULL)
+  {
+    enif_free(ids);
+    enif_free(buf);
+    return sb_error(env, TB_ERR_MEM);
+  }
+  evicted = enif_make_list(env, 0);
+  enif_mutex_lock(res->lock);
+  // Ids handed out earlier in the list are kept from being collected, as no
+  // line refers to them yet
+  for (k = 0; result == TB_OK && enif_get_list_cell(env, styles, &head, &styles); k++)
+  {
+    int64_t id = style_intern(&res->styles, head, sb_mark_styles, res, ids, k);
+    result = id < 0 ? (int)id : TB_OK;
+    ids[k] = (uint32_t)id;
+  }
+  if (result == TB_OK && keep)
+  {
+    result = sb_copies_init(&c, &res->styles);
+  }
+  while (result == TB_OK && enif_get_list_cell(env, list, &head, &list))
+  {
+    // Checked by sb_lines_valid
+    enif_get_tuple(env, head, &arity, &line);
+    enif_inspect_binary(env, line[0], &text);
+    enif_inspect_binary(env, line[1], &spans);
+    sb_remap(spans.data, buf, spans.size, ids, nstyles);
+    result = sb_push(&res->r, text.data, text.size, spans.size > 0 ? buf : spans.data,
+                     spans.size) == 0
+                 ? TB_OK
+                 : TB_ERR_MEM;
+    pushed += result == TB_OK;
+    sb_evict_into(env, res, keep ? &c : NULL, &evicted);
+  }
+  enif_mutex_unlock(res->lock);
+  enif_free(ids);
+  enif_free(buf);
+  sb_copies_free(&c);
+  enif_make_reverse_list(env, evicted, &evicted);
+  if (result != TB_OK && pushed > 0)
+  {
+    return enif_make_tuple3(env, enif_make_atom(env, "error"), enif_make_int(env, result),
+                            evicted);
+  }
+  if (result != TB_OK)
+  {
+    return sb_error(env, result);
+  }
+  return evicted;
 }
 
-// tb_set_cell/5
-static ERL_NIF_TERM nif_tb_set_cell(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[])
+// sb_set_limits/4 (ring, max_lines, max_bytes, keep_evicted)
+// Returns the lines over the new limits as sb_push/4 does.
+static ERL_NIF_TERM nif_sb_set_limits(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[])
 {
   (void)argc;
-  (void)argv;
-  int x, y;
-  unsigned int ch;
-  unsigned int fg, bg;
-  if (!enif_get_int(env, argv[0], &x) ||
-      !enif_get_int(env, argv[1], &y) ||
-      !enif_get_uint(env, argv[2], &ch) ||
-      !enif_get_uint(env, argv[3], &fg) ||
-      !enif_get_uint(env, argv[4], &bg))
+  sb_res_t *res;
+  size_t lines, bytes;
+  sb_copies_t c = {NULL, NULL, 0};
+  int keep = enif_is_identical(argv[3], atom_true);
+  ERL_NIF_TERM evicted = enif_make_list(env, 0);
+  if (!enif_get_resource(env, argv[0], sb_type, (void **)&res) ||
+      !sb_limits(env, argv + 1, &lines, &bytes))
   {
     return enif_make_badarg(env);
   }
-  int result = tb_set_cell(x, y, ch, fg, bg);
-  return enif_make_int(env, result);
+  enif_mutex_lock(res->lock);
+  if (keep && sb_copies_init(&c, &res->styles) != TB_OK)
+  {
+    enif_mutex_unlock(res->lock);
+    return sb_error(env, TB_ERR_MEM);
+  }
+  sb_set_limits(&res->r, lines, bytes);
+  sb_evict_into(env, res, keep ? &c : NULL, &evicted);
+  enif_mutex_unlock(res->lock);
+  sb_copies_free(&c);
+  enif_make_reverse_list(env, evicted, &evicted);
+  return evicted;
 }
 
-// tb_set_input_mode/1
-static ERL_NIF_TERM nif_tb_set_input_mode(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[])
+// sb_get/2 (ring, index)
+// Returns {text, spans, styles}, nil past the oldest line, or {:error, code}.
+static ERL_NIF_TERM nif_sb_get(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[])
 {
   (void)argc;
-  (void)argv;
-  int mode;
-  if (!enif_get_int(env, argv[0], &mode))
+  sb_res_t *res;
+  ErlNifUInt64 i;
+  sb_copies_t c;
+  if (!enif_get_resource(env, argv[0], sb_type, (void **)&res) ||
+      !enif_get_uint64(env, argv[1], &i))
   {
     return enif_make_badarg(env);
   }
-  int result = tb_set_input_mode(mode);
-  return enif_make_int(env, result);
+  enif_mutex_lock(res->lock);
+  if (sb_copies_init(&c, &res->styles) != TB_OK)
+  {
+    enif_mutex_unlock(res->lock);
+    return sb_error(env, TB_ERR_MEM);
+  }
+  const struct sb_line *l = i < res->r.count ? sb_get(&res->r, (size_t)i) : NULL;
+  ERL_NIF_TERM term = l == NULL ? atom_nil : sb_line_term(env, res, &c, l);
+  enif_mutex_unlock(res->lock);
+  sb_copies_free(&c);
+  return term;
 }
 
-// tb_set_output_mode/1
-static ERL_NIF_TERM nif_tb_set_output_mode(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[])
+// sb_range/3 (ring, index, count)
+// Returns up to count lines from index back towards the oldest, newest first,
+// or {:error, code}.
+static ERL_NIF_TERM nif_sb_range(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[])
 {
-  (void)argc;
-  (void)argv;
-  int mode;
-  if (!enif_get_int(env, argv[0], &mode))
+  sb_res_t *res;
+  ErlNifUInt64 start, count, k;
+  sb_copies_t c;
+  ERL_NIF_TERM lines = enif_make_list(env, 0);
+  if (!enif_get_resource(env, argv[0], sb_type, (void **)&res) ||
+      !enif_get_uint64(env, argv[1], &start) || !enif_get_uint64(env, argv[2], &count))
   {
     return enif_make_badarg(env);
   }
-  int result = tb_set_output_mode(mode);
-  return enif_make_int(env, result);
+  enif_mutex_lock(res->lock);
+  count = start >= res->r.count ? 0 : count;
+  count = count > res->r.count - start ? res->r.count - start : count;
+  if (count > SB_DIRTY_LINES && enif_thread_type() == ERL_NIF_THR_NORMAL_SCHEDULER)
+  {
+    enif_mutex_unlock(res->lock);
+    return enif_schedule_nif(env, "sb_range", ERL_NIF_DIRTY_JOB_CPU_BOUND, nif_sb_range, argc,
+                             argv);
+  }
+  if (sb_copies_init(&c, &res->styles) != TB_OK)
+  {
+    enif_mutex_unlock(res->lock);
+    return sb_error(env, TB_ERR_MEM);
+  }
+  // Build from the oldest line in range so the list comes out newest first
+  for (k = count; k > 0; k--)
+  {
+    lines = enif_make_list_cell(env, sb_line_term(env, res, &c, sb_get(&res->r, start + k - 1)),
+                                lines);
+  }
+  enif_mutex_unlock(res->lock);
+  sb_copies_free(&c);
+  return lines;
 }
 
-// tb_print/5 (x, y, fg, bg, string)
-static ERL_NIF_TERM nif_tb_print(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[])
+// sb_search/5 (ring, pattern, index, count, fold)
+// Searches the text of up to count lines from index back towards the oldest
+// for pattern, ASCII letters matching either case if fold is true. Returns
+// {index, column, text} for each match, newest line first and left to right
+// within a line, where column counts the UTF-8 characters before the match
+// and text is what matched. Matches in a line don't overlap.
+static ERL_NIF_TERM nif_sb_search(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[])
+{
+  sb_res_t *res;
+  ErlNifBinary pattern;
+  ErlNifUInt64 start, count, k;
+  ERL_NIF_TERM matches = enif_make_list(env, 0), text;
+  int fold = enif_is_identical(argv[4], atom_true);
+  if (!enif_get_resource(env, argv[0], sb_type, (void **)&res) ||
+      !enif_inspect_binary(env, argv[1], &pattern) || pattern.size == 0 ||
+      !enif_get_uint64(env, argv[2], &start) || !enif_get_uint64(env, argv[3], &count))
+  {
+    return enif_make_badarg(env);
+  }
+  enif_mutex_lock(res->lock);
+  count = start >= res->r.count ? 0 : count;
+  count = count > res->r.count - start ? res->r.count - start : count;
+  if (count > SB_DIRTY_LINES && enif_thread_type() == ERL_NIF_THR_NORMAL_SCHEDULER)
+  {
+    enif_mutex_unlock(res->lock);
+    return enif_schedule_nif(env, "sb_search", ERL_NIF_DIRTY_JOB_CPU_BOUND, nif_sb_search,
+                             argc, argv);
+  }
+  for (k = 0; k < count; k++)
+  {
+    const struct sb_line *l = sb_get(&res->r, start + k);
+    size_t off = 0, column = 0, counted = 0, found;
+    while ((found = sb_find(l->data + off, l->ntext - off, pattern.data, pattern.size,
+                            fold)) != SB_NOT_FOUND)
+    {
+      off += found;
+      // Count characters by their lead bytes, skipping continuation bytes
+      for (; counted < off; counted++)
+      {
+        column += (l->data[counted] & 0xC0) != 0x80;
+      }
+      memcpy(enif_make_new_binary(env, pattern.size, &text), l->data + off, pattern.size);
+      matches = enif_make_list_cell(env,
+                                    enif_make_tuple3(env, enif_make_uint64(env, start + k),
+                                                     enif_make_uint64(env, column), text),
+                                    matches);
+      off += pattern.size;
+    }
+  }
+  enif_mutex_unlock(res->lock);
+  enif_make_reverse_list(env, matches, &matches);
+  return matches;
+}
+
+// sb_info/1
+// Returns {lines, bytes}.
+static ERL_NIF_TERM nif_sb_info(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[])
 {
   (void)argc;
-  (void)argv;
-  int x, y;
-  unsigned int fg, bg;
-  ErlNifBinary bin;
-  if (!enif_get_int(env, argv[0], &x) ||
-      !enif_get_int(env, argv[1], &y) ||
-      !enif_get_uint(env, argv[2], &fg) ||
-      !enif_get_uint(env, argv[3], &bg) ||
-      !enif_inspect_binary(env, argv[4], &bin))
+  sb_res_t *res;
+  if (!enif_get_resource(env, argv[0], sb_type, (void **)&res))
   {
     return enif_make_badarg(env);
   }
-  // Ensure null-terminated string
-  char *str = (char *)malloc(bin.size + 1);
-  memcpy(str, bin.data, bin.size);
-  str[bin.size] = '\0';
-  int result = tb_print(x, y, fg, bg, str);
-  free(str);
-  return enif_make_int(env, result);
+  enif_mutex_lock(res->lock);
+  size_t lines = res->r.count, bytes = res->r.bytes;
+  enif_mutex_unlock(res->lock);
+  return enif_make_tuple2(env, enif_make_uint64(env, lines), enif_make_uint64(env, bytes));
 }
 
-// Platform-specific implementation for setting terminal title
-static ERL_NIF_TERM tb_set_title(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[])
+// sb_clear/1
+static ERL_NIF_TERM nif_sb_clear(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[])
 {
-  if (argc != 1)
+  (void)argc;
+  sb_res_t *res;
+  if (!enif_get_resource(env, argv[0], sb_type, (void **)&res))
   {
-    return enif_make_tuple2(env, enif_make_atom(env, "error"), enif_make_atom(env, "badarg"));
+    return enif_make_badarg(env);
   }
-  char title[256];
-  if (enif_is_binary(env, argv[0]))
+  enif_mutex_lock(res->lock);
+  sb_clear(&res->r);
+  enif_mutex_unlock(res->lock);
+  return enif_make_atom(env, "ok");
+}
+
+// Copy a title given as a binary or charlist into title, NUL-terminated.
+// Returns 0 if it isn't one or doesn't fit.
+static int get_title(ErlNifEnv *env, ERL_NIF_TERM term, char *title, size_t size)
+{
+  if (enif_is_binary(env, term))
   {
     ErlNifBinary bin;
-    if (!enif_inspect_binary(env, argv[0], &bin))
+    if (!enif_inspect_binary(env, term, &bin) || bin.size >= size)
     {
-      return enif_make_tuple2(env, enif_make_atom(env, "error"), enif_make_atom(env, "badarg"));
-    }
-    if (bin.size >= sizeof(title))
-    {
-      return enif_make_tuple2(env, enif_make_atom(env, "error"), enif_make_atom(env, "badarg"));
+      return 0;
     }
     memcpy(title, bin.data, bin.size);
     title[bin.size] = '\0';
+    return 1;
   }
-  else if (enif_get_string(env, argv[0], title, sizeof(title), ERL_NIF_LATIN1))
+  return enif_get_string(env, term, title, size, ERL_NIF_LATIN1) > 0;
+}
+
+// Platform-specific implementation for setting terminal title
+static ERL_NIF_TERM tb_set_title(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[])
+{
+  if (argc != 1)
   {
-    // String was successfully converted
+    return enif_make_tuple2(env, enif_make_atom(env, "error"), enif_make_atom(env, "badarg"));
   }
-  else
+  char title[256];
+  if (!get_title(env, argv[0], title, sizeof(title)))
   {
     return enif_make_tuple2(env, enif_make_atom(env, "error"), enif_make_atom(env, "badarg"));
   }
@@ -263,20 +2673,205 @@ static ERL_NIF_TERM tb_set_position(ErlNifEnv *env, int argc, const ERL_NIF_TERM
 #endif
 }
 
+// tb_set_title/2 (context, title)
+// Queues the title sequence in ctx's output instead of writing it to the
+// BEAM's stdout, so it reaches ctx's terminal with the next present or flush.
+// Titles with control characters, which would end the sequence early, are
+// rejected.
+static ERL_NIF_TERM nif_tb_set_title(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[])
+{
+  (void)argc;
+  tb_ctx_t *ctx;
+  char title[256];
+  if (!enif_get_resource(env, argv[0], ctx_type, (void **)&ctx) ||
+      !get_title(env, argv[1], title, sizeof(title)))
+  {
+    return enif_make_badarg(env);
+  }
+  for (const char *c = title; *c; c++)
+  {
+    if ((unsigned char)*c < 0x20 || *c == 0x7f)
+    {
+      return enif_make_badarg(env);
+    }
+  }
+  ctx_lock(ctx);
+  int result = tb_sendf("\033]0;%s\007", title);
+  ctx_unlock(ctx);
+  return enif_make_int(env, result);
+}
+
+// tb_set_position/3 (context, x, y)
+// Queues the window position sequence in ctx's output, see tb_set_title/2.
+static ERL_NIF_TERM nif_tb_set_position(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[])
+{
+  (void)argc;
+  tb_ctx_t *ctx;
+  int x, y;
+  if (!enif_get_resource(env, argv[0], ctx_type, (void **)&ctx) ||
+      !enif_get_int(env, argv[1], &x) || !enif_get_int(env, argv[2], &y) ||
+      x < 0 || y < 0 || x > 32767 || y > 32767)
+  {
+    return enif_make_badarg(env);
+  }
+  ctx_lock(ctx);
+  int result = tb_sendf("\033[3;%d;%dt", y, x);
+  ctx_unlock(ctx);
+  return enif_make_int(env, result);
+}
+
 static ErlNifFunc nif_funcs[] = {
     {"tb_init", 0, nif_tb_init, 0},
-    {"tb_shutdown", 0, nif_tb_shutdown, 0},
+    {"tb_shutdown", 0, nif_tb_shutdown, ERL_NIF_DIRTY_JOB_IO_BOUND},
+    {"tb_open", 2, nif_tb_open, ERL_NIF_DIRTY_JOB_IO_BOUND},
+    {"tb_open_memory", 2, nif_tb_open_memory, 0},
+    {"tb_close", 1, nif_tb_close, ERL_NIF_DIRTY_JOB_IO_BOUND},
+    {"tb_resize", 2, nif_tb_resize, 0},
+    {"tb_resize", 3, nif_tb_resize, 0},
     {"tb_width", 0, nif_tb_width, 0},
+    {"tb_width", 1, nif_tb_width, 0},
     {"tb_height", 0, nif_tb_height, 0},
+    {"tb_height", 1, nif_tb_height, 0},
     {"tb_clear", 0, nif_tb_clear, 0},
-    {"tb_present", 0, nif_tb_present, 0},
+    {"tb_clear", 1, nif_tb_clear, 0},
+    {"tb_present", 0, nif_tb_present, ERL_NIF_DIRTY_JOB_IO_BOUND},
+    {"tb_present", 1, nif_tb_present, ERL_NIF_DIRTY_JOB_IO_BOUND},
+    {"tb_present_async", 0, nif_tb_present_async, 0},
+    {"tb_present_damage", 0, nif_tb_present_damage, ERL_NIF_DIRTY_JOB_IO_BOUND},
+    {"tb_present_damage", 1, nif_tb_present_damage, ERL_NIF_DIRTY_JOB_IO_BOUND},
+    {"tb_present_binary", 1, nif_tb_present_binary, ERL_NIF_DIRTY_JOB_CPU_BOUND},
+    {"tb_input_start", 1, nif_tb_input_start, 0},
+    {"tb_input_start", 2, nif_tb_input_start, 0},
+    {"tb_input_poll", 1, nif_tb_input_poll, ERL_NIF_DIRTY_JOB_IO_BOUND},
+    {"tb_input_stop", 1, nif_tb_input_stop, 0},
     {"tb_set_cursor", 2, nif_tb_set_cursor, 0},
+    {"tb_set_cursor", 3, nif_tb_set_cursor, 0},
     {"tb_hide_cursor", 0, nif_tb_hide_cursor, 0},
+    {"tb_hide_cursor", 1, nif_tb_hide_cursor, 0},
     {"tb_set_cell", 5, nif_tb_set_cell, 0},
+    {"tb_set_cell", 6, nif_tb_set_cell, 0},
+    {"tb_set_cells", 1, nif_tb_set_cells, 0},
+    {"tb_set_cells", 2, nif_tb_set_cells, 0},
+    {"tb_blit", 5, nif_tb_blit, 0},
+    {"tb_blit", 6, nif_tb_blit, 0},
     {"tb_set_input_mode", 1, nif_tb_set_input_mode, 0},
+    {"tb_set_input_mode", 2, nif_tb_set_input_mode, 0},
     {"tb_set_output_mode", 1, nif_tb_set_output_mode, 0},
+    {"tb_set_output_mode", 2, nif_tb_set_output_mode, 0},
+    {"tb_set_output_nonblock", 1, nif_tb_set_output_nonblock, 0},
+    {"tb_set_output_nonblock", 2, nif_tb_set_output_nonblock, 0},
+    {"tb_flush", 0, nif_tb_flush, ERL_NIF_DIRTY_JOB_IO_BOUND},
+    {"tb_flush", 1, nif_tb_flush, ERL_NIF_DIRTY_JOB_IO_BOUND},
     {"tb_print", 5, nif_tb_print, 0},
+    {"tb_print", 6, nif_tb_print, 0},
+    {"tb_print_runs", 1, nif_tb_print_runs, 0},
+    {"tb_print_runs", 2, nif_tb_print_runs, 0},
     {"tb_set_title", 1, tb_set_title, 0},
-    {"tb_set_position", 2, tb_set_position, 0}};
+    {"tb_set_title", 2, nif_tb_set_title, 0},
+    {"tb_set_position", 2, tb_set_position, 0},
+    {"tb_set_position", 3, nif_tb_set_position, 0},
+    {"tb_wcwidth_table", 0, nif_tb_wcwidth_table, 0},
+    {"vt_parser_new", 0, nif_vt_parser_new, 0},
+    {"vt_parse", 2, nif_vt_parse, 0},
+    {"tb_grid_new", 2, nif_tb_grid_new, 0},
+    {"tb_grid_resize", 5, nif_tb_grid_resize, 0},
+    {"tb_grid_size", 1, nif_tb_grid_size, 0},
+    {"tb_grid_print", 6, nif_tb_grid_print, 0},
+    {"tb_grid_erase", 6, nif_tb_grid_erase, 0},
+    {"tb_grid_insert_cells", 6, nif_tb_grid_insert_cells, 0},
+    {"tb_grid_delete_cells", 6, nif_tb_grid_delete_cells, 0},
+    {"tb_grid_scroll", 6, nif_tb_grid_scroll, 0},
+    {"tb_grid_intern", 2, nif_tb_grid_intern, 0},
+    {"tb_grid_row", 2, nif_tb_grid_row, 0},
+    {"tb_grid_cell", 3, nif_tb_grid_cell, 0},
+    {"sb_new", 2, nif_sb_new, 0},
+    {"sb_push", 4, nif_sb_push, 0},
+    {"sb_set_limits", 4, nif_sb_set_limits, 0},
+    {"sb_get", 2, nif_sb_get, 0},
+    {"sb_range", 3, nif_sb_range, 0},
+    {"sb_search", 5, nif_sb_search, 0},
+    {"sb_info", 1, nif_sb_info, 0},
+    {"sb_clear", 1, nif_sb_clear, 0}};
+
+// Undo the parts of load that unload would, for a load that failed midway.
+// Resource types need no cleanup: ERTS discards them with the failed module.
+static int load_failed(void)
+{
+  if (present_cond != NULL)
+  {
+    enif_cond_destroy(present_cond);
+    present_cond = NULL;
+  }
+  if (tb_lock != NULL)
+  {
+    enif_mutex_destroy(tb_lock);
+    tb_lock = NULL;
+  }
+  return 1;
+}
+
+static int load(ErlNifEnv *env, void **priv_data, ERL_NIF_TERM load_info)
+{
+  (void)priv_data;
+  (void)load_info;
+  tb_lock = enif_mutex_create("termbox2_nif.tb_lock");
+  present_cond = enif_cond_create("termbox2_nif.present_cond");
+  if (tb_lock == NULL || present_cond == NULL)
+  {
+    return load_failed();
+  }
+  atom_undefined = enif_make_atom(env, "undefined");
+  atom_true = enif_make_atom(env, "true");
+  atom_false = enif_make_atom(env, "false");
+  atom_nil = enif_make_atom(env, "nil");
+  atom_esc = enif_make_atom(env, "esc");
+  atom_csi = enif_make_atom(env, "csi");
+  atom_osc = enif_make_atom(env, "osc");
+  atom_dcs = enif_make_atom(env, "dcs");
+  atom_sos = enif_make_atom(env, "sos");
+  atom_pm = enif_make_atom(env, "pm");
+  atom_apc = enif_make_atom(env, "apc");
+  ErlNifResourceTypeInit input_init;
+  memset(&input_init, 0, sizeof(input_init));
+  input_init.dtor = input_dtor;
+  input_init.stop = input_stop;
+  input_init.down = input_down;
+  input_type = enif_open_resource_type_x(env, "termbox2_input", &input_init,
+                                         ERL_NIF_RT_CREATE, NULL);
+  ctx_type = enif_open_resource_type(env, NULL, "termbox2_context", ctx_dtor,
+                                     ERL_NIF_RT_CREATE, NULL);
+  output_type = enif_open_resource_type(env, NULL, "termbox2_output", output_dtor,
+                                        ERL_NIF_RT_CREATE, NULL);
+  vt_type = enif_open_resource_type(env, NULL, "termbox2_vt_parser", vt_dtor,
+                                    ERL_NIF_RT_CREATE, NULL);
+  grid_type = enif_open_resource_type(env, NULL, "termbox2_grid", grid_dtor,
+                                      ERL_NIF_RT_CREATE, NULL);
+  sb_type = enif_open_resource_type(env, NULL, "termbox2_scrollback", sb_dtor,
+                                    ERL_NIF_RT_CREATE, NULL);
+  if (input_type == NULL || ctx_type == NULL || output_type == NULL || vt_type == NULL ||
+      grid_type == NULL || sb_type == NULL)
+  {
+    return load_failed();
+  }
+  present_exit = 0;
+  if (enif_thread_create("termbox2_nif.present", &present_tid, present_worker, NULL, NULL) != 0)
+  {
+    return load_failed();
+  }
+  return 0;
+}
+
+static void unload(ErlNifEnv *env, void *priv_data)
+{
+  (void)env;
+  (void)priv_data;
+  enif_mutex_lock(tb_lock);
+  present_exit = 1;
+  enif_cond_signal(present_cond);
+  enif_mutex_unlock(tb_lock);
+  enif_thread_join(present_tid, NULL);
+  enif_cond_destroy(present_cond);
+  enif_mutex_destroy(tb_lock);
+}
 
-ERL_NIF_INIT(termbox2_nif, nif_funcs, NULL, NULL, NULL, NULL)
+ERL_NIF_INIT(termbox2_nif, nif_funcs, load, NULL, NULL, unload)
@@ -0,0 +1,485 @@
+#include "vt_parser.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define BEL 0x07
+#define CAN 0x18
+#define SUB 0x1a
+#define ESC 0x1b
+#define DEL 0x7f
+
+// String buffers above this size are freed once their string is dispatched,
+// so one large DCS or APC payload doesn't stay resident
+#define VT_KEEP_STRING (64 * 1024)
+
+#define IS_C0(b) ((b) < 0x20 && (b) != CAN && (b) != SUB && (b) != ESC)
+#define IS_PARAM(b) (((b) >= '0' && (b) <= '9') || (b) == ';' || (b) == ':')
+#define IS_PRIVATE(b) ((b) >= 0x3c && (b) <= 0x3f)
+#define IS_INTERMEDIATE(b) ((b) >= 0x20 && (b) <= 0x2f)
+#define IS_FINAL(b) ((b) >= 0x40 && (b) <= 0x7e)
+
+void vt_parser_init(struct vt_parser *p)
+{
+  memset(p, 0, sizeof(*p));
+  p->state = VT_GROUND;
+}
+
+void vt_parser_free(struct vt_parser *p)
+{
+  free(p->data);
+  p->data = NULL;
+  p->ndata = 0;
+  p->data_cap = 0;
+}
+
+static void clear(struct vt_parser *p)
+{
+  p->nparams = 0;
+  p->nintermediates = 0;
+  p->ignore = 0;
+  p->final = 0;
+}
+
+static void collect(struct vt_parser *p, uint8_t b)
+{
+  if (p->nintermediates < VT_MAX_INTERMEDIATES)
+  {
+    p->intermediates[p->nintermediates++] = b;
+  }
+  else
+  {
+    p->ignore = 1;
+  }
+}
+
+static void param(struct vt_parser *p, uint8_t b)
+{
+  if (p->nparams < VT_MAX_PARAMS)
+  {
+    p->params[p->nparams++] = b;
+  }
+  else
+  {
+    p->ignore = 1;
+  }
+}
+
+static void string_start(struct vt_parser *p, enum vt_state state, enum vt_string kind)
+{
+  p->state = state;
+  p->string = kind;
+  p->ndata = 0;
+}
+
+static void string_put(struct vt_parser *p, const uint8_t *s, size_t n)
+{
+  if (p->ignore)
+  {
+    return;
+  }
+  if (n > VT_MAX_STRING - p->ndata)
+  {
+    p->ignore = 1;
+    return;
+  }
+  if (p->ndata + n > p->data_cap)
+  {
+    size_t cap = p->data_cap ? p->data_cap : 256;
+    while (cap < p->ndata + n)
+    {
+      cap *= 2;
+    }
+    uint8_t *data = realloc(p->data, cap);
+    if (data == NULL)
+    {
+      p->ignore = 1;
+      return;
+    }
+    p->data = data;
+    p->data_cap = cap;
+  }
+  memcpy(p->data + p->ndata, s, n);
+  p->ndata += n;
+}
+
+// Finish the control string being collected, dispatching it unless it was
+// aborted or overflowed
+static void string_end(struct vt_parser *p, int dispatch,
+                       const struct vt_callbacks *cb, void *ud)
+{
+  if (dispatch && !p->ignore)
+  {
+    cb->string_dispatch(ud, p);
+  }
+  if (p->data_cap > VT_KEEP_STRING)
+  {
+    vt_parser_free(p);
+  }
+  p->ndata = 0;
+  clear(p);
+}
+
+static int in_string(enum vt_state state)
+{
+  return state == VT_OSC_STRING || state == VT_DCS_PASSTHROUGH ||
+         state == VT_SOS_PM_APC_STRING;
+}
+
+static size_t utf8_length(uint8_t lead)
+{
+  if (lead >= 0xf0 && lead <= 0xf7)
+  {
+    return 4;
+  }
+  if (lead >= 0xe0)
+  {
+    return lead <= 0xef ? 3 : 1;
+  }
+  return lead >= 0xc0 ? 2 : 1;
+}
+
+// Print the run [s, e), holding back a UTF-8 sequence cut off by the end of
+// the chunk until the next one completes it
+static void print_run(struct vt_parser *p, const uint8_t *s, const uint8_t *e,
+                      const uint8_t *end, const struct vt_callbacks *cb, void *ud)
+{
+  if (e == end)
+  {
+    const uint8_t *lead = e;
+    while (lead > s && e - lead < 3 && (lead[-1] & 0xc0) == 0x80)
+    {
+      lead--;
+    }
+    if (lead > s && (size_t)(e - lead + 1) < utf8_length(lead[-1]))
+    {
+      lead--;
+      p->nutf8 = (size_t)(e - lead);
+      memcpy(p->utf8, lead, p->nutf8);
+      e = lead;
+    }
+  }
+  if (e > s)
+  {
+    cb->print(ud, s, (size_t)(e - s));
+  }
+}
+
+// Complete the UTF-8 sequence held back by print_run with the continuation
+// bytes at the start of this chunk
+static const uint8_t *utf8_resume(struct vt_parser *p, const uint8_t *s, const uint8_t *end,
+                                  const struct vt_callbacks *cb, void *ud)
+{
+  size_t need = utf8_length(p->utf8[0]);
+  while (p->nutf8 < need && s < end && (*s & 0xc0) == 0x80)
+  {
+    p->utf8[p->nutf8++] = *s++;
+  }
+  if (p->nutf8 < need && s == end)
+  {
+    return s;
+  }
+  cb->print(ud, p->utf8, p->nutf8);
+  p->nutf8 = 0;
+  return s;
+}
+
+static void csi_dispatch(struct vt_parser *p, uint8_t b, const struct vt_callbacks *cb, void *ud)
+{
+  if (!p->ignore)
+  {
+    p->final = b;
+    cb->csi_dispatch(ud, p);
+  }
+  p->state = VT_GROUND;
+}
+
+static void dcs_hook(struct vt_parser *p, uint8_t b)
+{
+  p->final = b;
+  if (p->ignore)
+  {
+    p->state = VT_DCS_IGNORE;
+    return;
+  }
+  string_start(p, VT_DCS_PASSTHROUGH, VT_STR_DCS);
+}
+
+// One byte in any state but ground, or a control in ground
+static void step(struct vt_parser *p, uint8_t b, const struct vt_callbacks *cb, void *ud)
+{
+  int st;
+
+  // Transitions from anywhere
+  if (b == CAN || b == SUB || b == ESC)
+  {
+    st = in_string(p->state) || p->state == VT_DCS_IGNORE;
+    if (in_string(p->state))
+    {
+      string_end(p, b == ESC, cb, ud);
+    }
+    clear(p);
+    if (b == ESC)
+    {
+      p->state = VT_ESCAPE;
+      p->string_ended = st;
+    }
+    else
+    {
+      cb->execute(ud, b);
+      p->state = VT_GROUND;
+    }
+    return;
+  }
+
+  switch (p->state)
+  {
+  case VT_GROUND:
+    if (b != DEL)
+    {
+      cb->execute(ud, b);
+    }
+    break;
+
+  case VT_ESCAPE:
+    st = p->string_ended;
+    p->string_ended = 0;
+    if (IS_C0(b))
+    {
+      cb->execute(ud, b);
+      p->string_ended = st;
+    }
+    else if (IS_INTERMEDIATE(b))
+    {
+      collect(p, b);
+      p->state = VT_ESCAPE_INTERMEDIATE;
+    }
+    else if (b == '[')
+    {
+      p->state = VT_CSI_ENTRY;
+    }
+    else if (b == ']')
+    {
+      string_start(p, VT_OSC_STRING, VT_STR_OSC);
+    }
+    else if (b == 'P')
+    {
+      p->state = VT_DCS_ENTRY;
+    }
+    else if (b == 'X' || b == '^' || b == '_')
+    {
+      string_start(p, VT_SOS_PM_APC_STRING,
+                   b == 'X' ? VT_STR_SOS : b == '^' ? VT_STR_PM : VT_STR_APC);
+    }
+    else if (b == '\\' && st)
+    {
+      // The ST ending a control string, already dispatched at its ESC
+      p->state = VT_GROUND;
+    }
+    else if (b >= 0x30 && b <= 0x7e)
+    {
+      p->final = b;
+      cb->esc_dispatch(ud, p);
+      p->state = VT_GROUND;
+    }
+    break;
+
+  case VT_ESCAPE_INTERMEDIATE:
+    if (IS_C0(b))
+    {
+      cb->execute(ud, b);
+    }
+    else if (IS_INTERMEDIATE(b))
+    {
+      collect(p, b);
+    }
+    else if (b >= 0x30 && b <= 0x7e)
+    {
+      if (!p->ignore)
+      {
+        p->final = b;
+        cb->esc_dispatch(ud, p);
+      }
+      p->state = VT_GROUND;
+    }
+    break;
+
+  case VT_CSI_ENTRY:
+  case VT_CSI_PARAM:
+    if (IS_C0(b))
+    {
+      cb->execute(ud, b);
+    }
+    else if (IS_PARAM(b))
+    {
+      param(p, b);
+      p->state = VT_CSI_PARAM;
+    }
+    else if (IS_PRIVATE(b))
+    {
+      if (p->state == VT_CSI_ENTRY)
+      {
+        collect(p, b);
+        p->state = VT_CSI_PARAM;
+      }
+      else
+      {
+        p->state = VT_CSI_IGNORE;
+      }
+    }
+    else if (IS_INTERMEDIATE(b))
+    {
+      collect(p, b);
+      p->state = VT_CSI_INTERMEDIATE;
+    }
+    else if (IS_FINAL(b))
+    {
+      csi_dispatch(p, b, cb, ud);
+    }
+    break;
+
+  case VT_CSI_INTERMEDIATE:
+    if (IS_C0(b))
+    {
+      cb->execute(ud, b);
+    }
+    else if (IS_INTERMEDIATE(b))
+    {
+      collect(p, b);
+    }
+    else if (b >= 0x30 && b <= 0x3f)
+    {
+      p->state = VT_CSI_IGNORE;
+    }
+    else if (IS_FINAL(b))
+    {
+      csi_dispatch(p, b, cb, ud);
+    }
+    break;
+
+  case VT_CSI_IGNORE:
+    if (IS_C0(b))
+    {
+      cb->execute(ud, b);
+    }
+    else if (IS_FINAL(b))
+    {
+      p->state = VT_GROUND;
+    }
+    break;
+
+  case VT_DCS_ENTRY:
+  case VT_DCS_PARAM:
+    if (IS_PARAM(b))
+    {
+      param(p, b);
+      p->state = VT_DCS_PARAM;
+    }
+    else if (IS_PRIVATE(b))
+    {
+      if (p->state == VT_DCS_ENTRY)
+      {
+        collect(p, b);
+        p->state = VT_DCS_PARAM;
+      }
+      else
+      {
+        p->state = VT_DCS_IGNORE;
+      }
+    }
+    else if (IS_INTERMEDIATE(b))
+    {
+      collect(p, b);
+      p->state = VT_DCS_INTERMEDIATE;
+    }
+    else if (IS_FINAL(b))
+    {
+      dcs_hook(p, b);
+    }
+    break;
+
+  case VT_DCS_INTERMEDIATE:
+    if (IS_INTERMEDIATE(b))
+    {
+      collect(p, b);
+    }
+    else if (b >= 0x30 && b <= 0x3f)
+    {
+      p->state = VT_DCS_IGNORE;
+    }
+    else if (IS_FINAL(b))
+    {
+      dcs_hook(p, b);
+    }
+    break;
+
+  case VT_DCS_PASSTHROUGH:
+    if (b != DEL)
+    {
+      string_put(p, &b, 1);
+    }
+    break;
+
+  case VT_OSC_STRING:
+    if (b == BEL)
+    {
+      string_end(p, 1, cb, ud);
+      p->state = VT_GROUND;
+    }
+    else if (b >= 0x20)
+    {
+      string_put(p, &b, 1);
+    }
+    break;
+
+  case VT_SOS_PM_APC_STRING:
+    if (b >= 0x20)
+    {
+      string_put(p, &b, 1);
+    }
+    break;
+
+  case VT_DCS_IGNORE:
+    break;
+  }
+}
+
+void vt_parse(struct vt_parser *p, const uint8_t *buf, size_t n,
+              const struct vt_callbacks *cb, void *ud)
+{
+  const uint8_t *s = buf;
+  const uint8_t *end = buf + n;
+  const uint8_t *run;
+
+  if (p->nutf8 > 0)
+  {
+    s = utf8_resume(p, s, end, cb, ud);
+  }
+
+  while (s < end)
+  {
+    // Text and string data come in runs, so take them a run at a time
+    // rather than stepping through every byte
+    if (p->state == VT_GROUND || in_string(p->state))
+    {
+      run = s;
+      while (s < end && *s >= 0x20 && *s != DEL)
+      {
+        s++;
+      }
+      if (s > run)
+      {
+        if (p->state == VT_GROUND)
+        {
+          print_run(p, run, s, end, cb, ud);
+        }
+        else
+        {
+          string_put(p, run, (size_t)(s - run));
+        }
+        continue;
+      }
+    }
+    step(p, *s++, cb, ud);
+  }
+}
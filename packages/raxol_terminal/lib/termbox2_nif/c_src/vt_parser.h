@@ -0,0 +1,93 @@
+#ifndef VT_PARSER_H
+#define VT_PARSER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// A DEC VT500-style parser for the byte stream a program writes to a
+// terminal, after Paul Williams' state diagram
+// (https://vt100.net/emu/dec_ansi_parser). Input is UTF-8: bytes from 0x80 up
+// are printable in the ground state and string data elsewhere, so C1 controls
+// are only recognized in their 7-bit ESC forms.
+//
+// vt_parse may be fed any split of the stream; everything it needs to resume
+// (the state, collected parameters and intermediates, string data and the
+// leading bytes of a UTF-8 sequence cut off by the end of a chunk) lives in
+// struct vt_parser. Parsed items are reported through callbacks as they
+// complete.
+
+// Longest parameter string (digits, ';' and ':') and number of intermediates
+// (including a CSI private marker) kept for one sequence. Longer sequences are
+// ignored, as are strings longer than VT_MAX_STRING bytes.
+#define VT_MAX_PARAMS 256
+#define VT_MAX_INTERMEDIATES 4
+#define VT_MAX_STRING (4 * 1024 * 1024)
+
+enum vt_state
+{
+  VT_GROUND,
+  VT_ESCAPE,
+  VT_ESCAPE_INTERMEDIATE,
+  VT_CSI_ENTRY,
+  VT_CSI_PARAM,
+  VT_CSI_INTERMEDIATE,
+  VT_CSI_IGNORE,
+  VT_DCS_ENTRY,
+  VT_DCS_PARAM,
+  VT_DCS_INTERMEDIATE,
+  VT_DCS_PASSTHROUGH,
+  VT_DCS_IGNORE,
+  VT_OSC_STRING,
+  VT_SOS_PM_APC_STRING
+};
+
+// Which control string a string callback reports
+enum vt_string
+{
+  VT_STR_OSC,
+  VT_STR_DCS,
+  VT_STR_SOS,
+  VT_STR_PM,
+  VT_STR_APC
+};
+
+struct vt_parser
+{
+  enum vt_state state;
+  enum vt_string string;
+  // Set when a control string ended at an ESC, so the '\' completing ST is
+  // swallowed instead of dispatched
+  int string_ended;
+  int ignore;
+  uint8_t params[VT_MAX_PARAMS];
+  size_t nparams;
+  uint8_t intermediates[VT_MAX_INTERMEDIATES];
+  size_t nintermediates;
+  uint8_t final;
+  uint8_t *data;
+  size_t ndata;
+  size_t data_cap;
+  uint8_t utf8[4];
+  size_t nutf8;
+};
+
+// Callbacks receive the user data passed to vt_parse. print gets maximal runs
+// of printable bytes, pointing into the chunk being parsed except for a UTF-8
+// sequence completed across chunks. execute gets C0 controls. The dispatch
+// callbacks read the sequence's parameters, intermediates, final byte and
+// string data from the parser; they are only valid during the call.
+struct vt_callbacks
+{
+  void (*print)(void *ud, const uint8_t *s, size_t n);
+  void (*execute)(void *ud, uint8_t byte);
+  void (*esc_dispatch)(void *ud, const struct vt_parser *p);
+  void (*csi_dispatch)(void *ud, const struct vt_parser *p);
+  void (*string_dispatch)(void *ud, const struct vt_parser *p);
+};
+
+void vt_parser_init(struct vt_parser *p);
+void vt_parser_free(struct vt_parser *p);
+void vt_parse(struct vt_parser *p, const uint8_t *buf, size_t n,
+              const struct vt_callbacks *cb, void *ud);
+
+#endif
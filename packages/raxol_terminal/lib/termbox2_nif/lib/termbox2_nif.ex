@@ -80,73 +80,496 @@ defmodule :termbox2_nif do
 
   @doc """
   Shutdown the termbox2 library.
+  Runs on a dirty I/O scheduler.
   """
   def tb_shutdown, do: :erlang.nif_error(:nif_not_loaded)
 
+  @doc """
+  Open a termbox context on a terminal the caller already has open, reading
+  from `rfd` and writing to `wfd`. Runs on a dirty I/O scheduler.
+  A context has its own cell buffers, caps and output buffer, and every
+  function below that takes a `ctx` first runs against it instead of the
+  terminal from `tb_init/0`, without waiting on other contexts.
+  Returns `{:ok, ctx}` or `{:error, code}`. The context shuts down when
+  `tb_close/1` is called or it is garbage collected.
+  """
+  def tb_open(_rfd, _wfd), do: :erlang.nif_error(:nif_not_loaded)
+
+  @doc """
+  Open a termbox context without a terminal, with a `width`x`height` back
+  buffer. Output is kept in memory instead of being written, and
+  `tb_present_binary/1` returns it. Returns `{:ok, ctx}` or `{:error, code}`.
+  """
+  def tb_open_memory(_width, _height), do: :erlang.nif_error(:nif_not_loaded)
+
+  @doc """
+  Shut a context down. Later calls with it return a negative error code.
+  """
+  def tb_close(_ctx), do: :erlang.nif_error(:nif_not_loaded)
+
+  @doc """
+  Resize the back buffer, for terminals that report their size out of band.
+  Returns 0 on success, or a negative error code.
+  """
+  def tb_resize(_width, _height), do: :erlang.nif_error(:nif_not_loaded)
+
+  @doc """
+  Same as `tb_resize/2` for the context `ctx`.
+  """
+  def tb_resize(_ctx, _width, _height), do: :erlang.nif_error(:nif_not_loaded)
+
   @doc """
   Get the width of the terminal.
   """
   def tb_width, do: :erlang.nif_error(:nif_not_loaded)
 
+  @doc """
+  Same as `tb_width/0` for the context `ctx` from `tb_open/2` or `tb_open_memory/2`.
+  """
+  def tb_width(_ctx), do: :erlang.nif_error(:nif_not_loaded)
+
   @doc """
   Get the height of the terminal.
   """
   def tb_height, do: :erlang.nif_error(:nif_not_loaded)
 
+  @doc """
+  Same as `tb_height/0` for the context `ctx` from `tb_open/2` or `tb_open_memory/2`.
+  """
+  def tb_height(_ctx), do: :erlang.nif_error(:nif_not_loaded)
+
   @doc """
   Clear the terminal.
   """
   def tb_clear, do: :erlang.nif_error(:nif_not_loaded)
 
+  @doc """
+  Same as `tb_clear/0` for the context `ctx` from `tb_open/2` or `tb_open_memory/2`.
+  """
+  def tb_clear(_ctx), do: :erlang.nif_error(:nif_not_loaded)
+
   @doc """
   Present the changes to the terminal.
+  Runs on a dirty I/O scheduler.
   """
   def tb_present, do: :erlang.nif_error(:nif_not_loaded)
 
+  @doc """
+  Same as `tb_present/0` for the context `ctx` from `tb_open/2` or `tb_open_memory/2`.
+  A context from `tb_open_memory/2` has nowhere to write, so its output is
+  dropped; use `tb_present_binary/1` to get it.
+  """
+  def tb_present(_ctx), do: :erlang.nif_error(:nif_not_loaded)
+
+  @doc """
+  Present the changes to the terminal without blocking the caller.
+  Returns `:ok` once queued; the caller then receives
+  `{:termbox, :presented, %{result: integer, bytes: integer, cells: integer, duration_us: integer}}`.
+  Returns `:busy` while a previous async present is still in flight.
+  """
+  def tb_present_async, do: :erlang.nif_error(:nif_not_loaded)
+
+  @doc """
+  Present the changes to the terminal and report what was written.
+  Runs on a dirty I/O scheduler.
+  Returns `{:ok, %{bytes: integer, cells: integer, spans: [{y, x0, x1}], scroll: scroll, pending: integer}}`
+  where each span covers the changed columns `x0..(x1 - 1)` of row `y`,
+  or `{:error, code}`. When rows only moved vertically, the terminal scrolls
+  them in place first and `scroll` is `{top, bottom, rows}` (rows > 0 is up,
+  < 0 is down); otherwise it is `nil`. `pending` is the number of bytes
+  non-blocking output (see `tb_set_output_nonblock/1`) left queued.
+  """
+  def tb_present_damage, do: :erlang.nif_error(:nif_not_loaded)
+
+  @doc """
+  Same as `tb_present_damage/0` for the context `ctx` from `tb_open/2` or `tb_open_memory/2`.
+  As with `tb_present/1`, a context from `tb_open_memory/2` drops its output.
+  """
+  def tb_present_damage(_ctx), do: :erlang.nif_error(:nif_not_loaded)
+
+  @doc """
+  Present a context from `tb_open_memory/2` and return what would have been
+  written to its terminal: `{:ok, binary}` with only the escape sequences that
+  take the previous frame to this one (empty if nothing changed), or
+  `{:error, code}`. The first frame also carries the setup and clear sequences,
+  and a frame after `tb_resize/3` repaints everything.
+  The binary is the context's output buffer itself, not a copy. Once it is
+  garbage collected the buffer is reused for a later frame; holding on to old
+  frames just costs an extra allocation.
+  Runs on a dirty CPU scheduler.
+  """
+  def tb_present_binary(_ctx), do: :erlang.nif_error(:nif_not_loaded)
+
+  @doc """
+  Watch the terminal for input natively and report it to `owner`.
+  Registers termbox's tty and resize pipe with `enif_select`, so `owner`
+  receives `{:select, resource, :undefined, :ready_input}` when either is
+  readable and should then call `tb_input_poll/1`. Replaces any previous
+  watcher of the same context, and stops when `owner` exits.
+  Returns `{:ok, resource}` or `{:error, code}` if termbox is not initialized.
+  """
+  def tb_input_start(_owner), do: :erlang.nif_error(:nif_not_loaded)
+
+  @doc """
+  Same as `tb_input_start/1` for the context `ctx` from `tb_open/2` or `tb_open_memory/2`.
+  """
+  def tb_input_start(_ctx, _owner), do: :erlang.nif_error(:nif_not_loaded)
+
+  @doc """
+  Drain all pending input in one call, then re-arm the watcher.
+  Runs on a dirty I/O scheduler.
+  Returns a binary of native-endian 16-byte records
+  `<<type::8, mod::8, key::native-16, ch::native-32, x::native-signed-32, y::native-signed-32>>`
+  (see `Raxol.Terminal.Driver.EventTranslator.unpack/1`), or `{:error, :closed}`
+  after `tb_input_stop/1`. Mouse records carry the button in `key`: 0 to 4 for
+  left, right, middle, wheel up and wheel down, and 5 for a release. An
+  incomplete escape sequence stays buffered until the rest arrives.
+  If the terminal has hung up, the watcher stops instead of re-arming and
+  `owner` receives `{:termbox_input, :closed}`.
+  """
+  def tb_input_poll(_resource), do: :erlang.nif_error(:nif_not_loaded)
+
+  @doc """
+  Stop watching for input. `tb_shutdown/0` and `tb_close/1` also stop the
+  context's active watcher.
+  """
+  def tb_input_stop(_resource), do: :erlang.nif_error(:nif_not_loaded)
+
   @doc """
   Set the cursor position.
   """
   def tb_set_cursor(_x, _y), do: :erlang.nif_error(:nif_not_loaded)
 
+  @doc """
+  Same as `tb_set_cursor/2` for the context `ctx` from `tb_open/2` or `tb_open_memory/2`.
+  """
+  def tb_set_cursor(_ctx, _x, _y), do: :erlang.nif_error(:nif_not_loaded)
+
   @doc """
   Hide the cursor.
   Returns 0 on success, -1 on error.
   """
   def tb_hide_cursor, do: :erlang.nif_error(:nif_not_loaded)
 
+  @doc """
+  Same as `tb_hide_cursor/0` for the context `ctx` from `tb_open/2` or `tb_open_memory/2`.
+  """
+  def tb_hide_cursor(_ctx), do: :erlang.nif_error(:nif_not_loaded)
+
   @doc """
   Set a cell in the terminal.
   Returns 0 on success, -1 on error.
   """
   def tb_set_cell(_x, _y, _ch, _fg, _bg), do: :erlang.nif_error(:nif_not_loaded)
 
+  @doc """
+  Same as `tb_set_cell/5` for the context `ctx` from `tb_open/2` or `tb_open_memory/2`.
+  """
+  def tb_set_cell(_ctx, _x, _y, _ch, _fg, _bg), do: :erlang.nif_error(:nif_not_loaded)
+
+  @doc """
+  Set many cells in one call.
+  Takes a binary or iolist of native-endian 24-byte records
+  `<<x::native-16, y::native-16, ch::native-32, fg::native-64, bg::native-64>>`.
+  Records outside the back buffer are skipped.
+  Returns the number of cells written, or a negative error code.
+  """
+  def tb_set_cells(_cells), do: :erlang.nif_error(:nif_not_loaded)
+
+  @doc """
+  Same as `tb_set_cells/1` for the context `ctx` from `tb_open/2` or `tb_open_memory/2`.
+  """
+  def tb_set_cells(_ctx, _cells), do: :erlang.nif_error(:nif_not_loaded)
+
+  @doc """
+  Copy a row-major `w`x`h` rectangle of cells to `x`, `y`, clipped to the back buffer.
+  Takes a binary or iolist of native-endian 20-byte records
+  `<<ch::native-32, fg::native-64, bg::native-64>>`.
+  Returns the number of cells written, or a negative error code.
+  """
+  def tb_blit(_x, _y, _w, _h, _cells), do: :erlang.nif_error(:nif_not_loaded)
+
+  @doc """
+  Same as `tb_blit/5` for the context `ctx` from `tb_open/2` or `tb_open_memory/2`.
+  """
+  def tb_blit(_ctx, _x, _y, _w, _h, _cells), do: :erlang.nif_error(:nif_not_loaded)
+
   @doc """
   Set the input mode.
   Returns the previous mode.
   """
   def tb_set_input_mode(_mode), do: :erlang.nif_error(:nif_not_loaded)
 
+  @doc """
+  Same as `tb_set_input_mode/1` for the context `ctx` from `tb_open/2` or `tb_open_memory/2`.
+  """
+  def tb_set_input_mode(_ctx, _mode), do: :erlang.nif_error(:nif_not_loaded)
+
   @doc """
   Set the output mode.
   Returns the previous mode.
   """
   def tb_set_output_mode(_mode), do: :erlang.nif_error(:nif_not_loaded)
 
+  @doc """
+  Same as `tb_set_output_mode/1` for the context `ctx` from `tb_open/2` or `tb_open_memory/2`.
+  """
+  def tb_set_output_mode(_ctx, _mode), do: :erlang.nif_error(:nif_not_loaded)
+
+  @doc """
+  Stop (`true`) or go back to (`false`) waiting for the terminal when it
+  won't take more output. Non-blocking output that doesn't fit stays queued
+  behind later output, so presents return at once and a renderer that falls
+  behind can skip frames until `tb_flush/0` reports `:ok`: the next present
+  sends everything that changed in the meantime. Shutting down waits for the
+  queue to be written. Returns 0 on success.
+  """
+  def tb_set_output_nonblock(_nonblock), do: :erlang.nif_error(:nif_not_loaded)
+
+  @doc """
+  Same as `tb_set_output_nonblock/1` for the context `ctx` from `tb_open/2` or `tb_open_memory/2`.
+  """
+  def tb_set_output_nonblock(_ctx, _nonblock), do: :erlang.nif_error(:nif_not_loaded)
+
+  @doc """
+  Write as much queued output as the terminal takes now. Returns `:ok` once
+  nothing is left, `{:pending, bytes}` otherwise, or `{:error, code}`. Along
+  with `{:pending, bytes}` the caller receives
+  `{:select, watcher, :undefined, :ready_output}` as soon as the terminal has
+  room again. That message comes through the input watcher (see
+  `tb_input_start/1`), so without one the flush waits for the terminal to
+  take everything instead. Runs on a dirty I/O scheduler.
+  """
+  def tb_flush, do: :erlang.nif_error(:nif_not_loaded)
+
+  @doc """
+  Same as `tb_flush/0` for the context `ctx` from `tb_open/2` or `tb_open_memory/2`.
+  """
+  def tb_flush(_ctx), do: :erlang.nif_error(:nif_not_loaded)
+
   @doc """
   Print a string at the specified position.
   Returns 0 on success, -1 on error.
   """
   def tb_print(_x, _y, _fg, _bg, _str), do: :erlang.nif_error(:nif_not_loaded)
 
+  @doc """
+  Same as `tb_print/5` for the context `ctx` from `tb_open/2` or `tb_open_memory/2`.
+  """
+  def tb_print(_ctx, _x, _y, _fg, _bg, _str), do: :erlang.nif_error(:nif_not_loaded)
+
+  @doc """
+  Print many strings in one call.
+  Takes a binary or iolist of native-endian runs
+  `<<x::native-16, y::native-16, byte_size(text)::native-32, fg::native-64,
+  bg::native-64, text::binary>>`.
+  Returns the display width of each run, in order, with a negative error code
+  in place of a run that starts outside the back buffer. Returns a negative
+  error code and prints nothing if the runs are malformed.
+  """
+  def tb_print_runs(_runs), do: :erlang.nif_error(:nif_not_loaded)
+
+  @doc """
+  Same as `tb_print_runs/1` for the context `ctx` from `tb_open/2` or `tb_open_memory/2`.
+  """
+  def tb_print_runs(_ctx, _runs), do: :erlang.nif_error(:nif_not_loaded)
+
   @doc """
   Set the terminal title.
   Returns {:ok, "set"} on success, {:error, reason} on failure.
   """
   def tb_set_title(_title), do: :erlang.nif_error(:nif_not_loaded)
 
+  @doc """
+  Set the title of the terminal behind the context `ctx` from `tb_open/2` or
+  `tb_open_memory/2`. Unlike `tb_set_title/1`, which writes to the BEAM's
+  stdout, the sequence is queued in the context's output and goes out with its
+  next present or `tb_flush/1`. Raises `ArgumentError` for a title with control
+  characters. Returns 0 or a negative error code.
+  """
+  def tb_set_title(_ctx, _title), do: :erlang.nif_error(:nif_not_loaded)
+
   @doc """
   Set the terminal window position.
   Returns {:ok, "set"} on success, {:error, reason} on failure.
   """
   def tb_set_position(_x, _y), do: :erlang.nif_error(:nif_not_loaded)
+
+  @doc """
+  Same as `tb_set_position/2` for the context `ctx`, queued in its output like
+  `tb_set_title/2`. Returns 0 or a negative error code.
+  """
+  def tb_set_position(_ctx, _x, _y), do: :erlang.nif_error(:nif_not_loaded)
+
+  @doc """
+  Return the table termbox looks display widths up in, as
+  `{stage1, stage2, limit}`, or `{:error, code}` if it uses libc's `wcwidth`.
+  For a codepoint `cp < limit`, take the block number at byte `cp >>> 8` of
+  `stage1`; the width is then bits `2 * (cp &&& 0xF)` and up of native-endian
+  32-bit word `block * 16 + (cp >>> 4 &&& 0xF)` of `stage2`, where 3 means
+  not printable (-1). Works without `tb_init/0`.
+  """
+  def tb_wcwidth_table, do: :erlang.nif_error(:nif_not_loaded)
+
+  @doc """
+  Create a parser for the byte stream programs write to a terminal.
+  Returns `{:ok, parser}`. Works without `tb_init/0`.
+  """
+  def vt_parser_new, do: :erlang.nif_error(:nif_not_loaded)
+
+  @doc """
+  Parse the next chunk of the stream, which may split sequences anywhere.
+  Returns the completed items as a list of ops, in order: a binary of printable
+  UTF-8 text (a sub-binary of `chunk`), an integer C0 control,
+  `{:esc, intermediates, final}`, `{:csi, params, intermediates, final}`,
+  `{:dcs, params, intermediates, final, data}`, or
+  `{:osc | :sos | :pm | :apc, data}`. A CSI or DCS private marker (`?`, `>`,
+  ...) leads its intermediates.
+  """
+  def vt_parse(_parser, _chunk), do: :erlang.nif_error(:nif_not_loaded)
+
+  @doc """
+  Create a `width`x`height` screen grid of blank cells, updated in place by the
+  other `tb_grid_*` functions. Returns `{:ok, grid}` or `{:error, code}`.
+  Needs no initialized context.
+  """
+  def tb_grid_new(_width, _height), do: :erlang.nif_error(:nif_not_loaded)
+
+  @doc """
+  Resize the grid, keeping its upper-left part and filling new cells with
+  spaces in `fg` and `bg`. Returns 0 on success or a negative error code.
+  """
+  def tb_grid_resize(_grid, _width, _height, _fg, _bg), do: :erlang.nif_error(:nif_not_loaded)
+
+  @doc """
+  Return the grid's `{width, height}`.
+  """
+  def tb_grid_size(_grid), do: :erlang.nif_error(:nif_not_loaded)
+
+  @doc """
+  Print UTF-8 text (binary or iolist) along row `y` from column `x`, stopping
+  at the first character that doesn't fit in the row. Returns
+  `{columns, bytes}` for the part printed, so the caller can wrap the rest, or
+  a negative error code. Wide characters fill their trailing columns with
+  codepoint 0.
+  """
+  def tb_grid_print(_grid, _x, _y, _fg, _bg, _text), do: :erlang.nif_error(:nif_not_loaded)
+
+  @doc """
+  Blank `count` cells in reading order from `x`,`y`, continuing onto the
+  following rows. Returns 0 on success or a negative error code.
+  """
+  def tb_grid_erase(_grid, _x, _y, _count, _fg, _bg), do: :erlang.nif_error(:nif_not_loaded)
+
+  @doc """
+  Shift the rest of row `y` from column `x` right by `count` cells, opening
+  blanks. Returns 0 on success or a negative error code.
+  """
+  def tb_grid_insert_cells(_grid, _x, _y, _count, _fg, _bg),
+    do: :erlang.nif_error(:nif_not_loaded)
+
+  @doc """
+  Delete `count` cells from row `y` at column `x`, shifting the rest of the
+  row left. Returns 0 on success or a negative error code.
+  """
+  def tb_grid_delete_cells(_grid, _x, _y, _count, _fg, _bg),
+    do: :erlang.nif_error(:nif_not_loaded)
+
+  @doc """
+  Scroll rows `top` through `bottom` up by `count` rows, or down if `count`
+  is negative, blanking the rows scrolled in. Returns 0 on success or a
+  negative error code.
+  """
+  def tb_grid_scroll(_grid, _top, _bottom, _count, _fg, _bg),
+    do: :erlang.nif_error(:nif_not_loaded)
+
+  @doc """
+  Return the id of `style`, any term, in the grid's style table, adding it if
+  new, or a negative error code. Ids are meant to be passed as `fg`, and the
+  table lives with the grid, so every holder of the grid sees the same ids.
+  Once the table is full, the ids no cell's `fg` refers to are reused; id 0
+  is always kept, for filling blanks with.
+  """
+  def tb_grid_intern(_grid, _style), do: :erlang.nif_error(:nif_not_loaded)
+
+  @doc """
+  Return row `y` as `{cells, clusters, styles}`: `cells` holds a native-endian
+  `{uint32 ch, uint64 fg, uint64 bg}` record per column, the layout
+  `tb_blit/5` takes, `clusters` lists `{x, utf8}` for the cells holding a
+  grapheme cluster rather than a single codepoint, and `styles` lists
+  `{id, style}` for each `fg` in the row from `tb_grid_intern/2` (`nil` for
+  other values). Returns a negative error code for a row outside the grid.
+  """
+  def tb_grid_row(_grid, _y), do: :erlang.nif_error(:nif_not_loaded)
+
+  @doc """
+  Return the cell at `x`,`y` as `{utf8, style}`, where `utf8` is its character
+  or grapheme cluster, or `""` in the trailing columns of a wide character,
+  and `style` is as in `tb_grid_row/2`. Returns a negative error code for a
+  cell outside the grid.
+  """
+  def tb_grid_cell(_grid, _x, _y), do: :erlang.nif_error(:nif_not_loaded)
+
+  @doc """
+  Create a scrollback ring holding at most `max_lines` lines and, unless
+  `max_bytes` is 0, at most `max_bytes` bytes of them. Returns `{:ok, ring}`
+  or `{:error, code}`.
+
+  A line is pushed as `{text, spans}`: UTF-8 text and a binary of
+  native-endian 32-bit `style, bytes` pairs, one per run of the text, where
+  the top bit of `style` marks a run with no text as the trailing cell of a
+  wide character, and is otherwise left for the caller to read. Lines with no spans are plain text. Styles are interned in a
+  table kept with the ring, and lines come back as `{text, spans, styles}`,
+  with the table's ids in `spans` and `styles` listing `{id, style}` for each.
+  """
+  def sb_new(_max_lines, _max_bytes), do: :erlang.nif_error(:nif_not_loaded)
+
+  @doc """
+  Append a list of `{text, spans}` lines, oldest first, evicting the oldest
+  lines over the limits. The styles in `spans` are indexes into `styles`.
+  Returns the evicted lines, oldest first, if `keep_evicted` is true and `[]`
+  otherwise. The whole list is checked first, so a bad line raises
+  `ArgumentError` with nothing pushed. Returns `{:error, code}` if out of
+  memory before any line is pushed, or `{:error, code, evicted}` after. The
+  newest line is kept even if it alone is over the byte limit. Runs on a
+  dirty scheduler for more than 4096 lines.
+  """
+  def sb_push(_ring, _lines, _styles, _keep_evicted), do: :erlang.nif_error(:nif_not_loaded)
+
+  @doc """
+  Change the ring's limits, evicting and returning lines as `sb_push/4` does.
+  """
+  def sb_set_limits(_ring, _max_lines, _max_bytes, _keep_evicted),
+    do: :erlang.nif_error(:nif_not_loaded)
+
+  @doc """
+  Return line `index` counting back from the newest (0) as
+  `{text, spans, styles}`, nil if there are not that many lines, or
+  `{:error, code}`.
+  """
+  def sb_get(_ring, _index), do: :erlang.nif_error(:nif_not_loaded)
+
+  @doc """
+  Return up to `count` lines from `index` back towards the oldest, newest
+  first, as `sb_get/2` does, or `{:error, code}`.
+  """
+  def sb_range(_ring, _index, _count), do: :erlang.nif_error(:nif_not_loaded)
+
+  @doc """
+  Search the text of up to `count` lines from `index` back for `pattern`,
+  folding ASCII case if `fold` is true. Returns `{index, column, text}` per
+  match, newest line first.
+  """
+  def sb_search(_ring, _pattern, _index, _count, _fold),
+    do: :erlang.nif_error(:nif_not_loaded)
+
+  @doc """
+  Return `{lines, bytes}` held by the ring.
+  """
+  def sb_info(_ring), do: :erlang.nif_error(:nif_not_loaded)
+
+  @doc """
+  Drop every line in the ring.
+  """
+  def sb_clear(_ring), do: :erlang.nif_error(:nif_not_loaded)
 end
@@ -0,0 +1,81 @@
+defmodule Raxol.Terminal.ANSI.NativeParserTest do
+  use ExUnit.Case, async: true
+
+  alias Raxol.Terminal.ANSI.NativeParser
+  alias Raxol.Terminal.{Emulator, ScreenBuffer}
+
+  @moduletag :docker
+
+  defp parse(input) do
+    {:ok, parser} = NativeParser.new()
+    NativeParser.parse(parser, input)
+  end
+
+  # Text can come back in more pieces when a chunk boundary falls inside it
+  defp merge_text(ops) do
+    ops
+    |> Enum.chunk_by(&is_binary/1)
+    |> Enum.flat_map(fn
+      [text | _] = run when is_binary(text) -> [IO.iodata_to_binary(run)]
+      run -> run
+    end)
+  end
+
+  describe "parse/2" do
+    test "returns text runs, controls and sequences in order" do
+      assert parse("\e[1;31mred\e[0m\r\n") ==
+               [{:csi, "1;31", "", ?m}, "red", {:csi, "0", "", ?m}, ?\r, ?\n]
+    end
+
+    test "puts CSI private markers first among the intermediates" do
+      assert parse("\e[?25h\e[>c\e[2 q") ==
+               [{:csi, "25", "?", ?h}, {:csi, "", ">", ?c}, {:csi, "2", " ", ?q}]
+    end
+
+    test "collects control strings up to BEL or ST" do
+      assert parse("\e]0;title\a\e]8;;https://x\e\\link\ePq#0\e\\\e_Gf=1;AA\e\\") ==
+               [
+                 {:osc, "0;title"},
+                 {:osc, "8;;https://x"},
+                 "link",
+                 {:dcs, "", "", ?q, "#0"},
+                 {:apc, "Gf=1;AA"}
+               ]
+    end
+
+    test "reports escape sequences with their intermediates" do
+      assert parse("\e(0\e#8\e7\eM") ==
+               [{:esc, "(", ?0}, {:esc, "#", ?8}, {:esc, "", ?7}, {:esc, "", ?M}]
+    end
+
+    test "drops sequences cancelled by CAN" do
+      assert parse("\e[1;2\x18x") == [0x18, "x"]
+    end
+
+    test "resumes sequences and characters split across chunks" do
+      input = "a\e[38;2;1;2;3m中文\e]2;tï\e\\b"
+      whole = parse(input)
+
+      for split <- 1..(byte_size(input) - 1) do
+        <<first::binary-size(split), second::binary>> = input
+        {:ok, parser} = NativeParser.new()
+        ops = NativeParser.parse(parser, first) ++ NativeParser.parse(parser, second)
+        assert merge_text(ops) == whole, "split at #{split}"
+      end
+    end
+  end
+
+  describe "emulator" do
+    test "renders the same screen as the Elixir parser" do
+      input = "\e[2;3Hhello\e[1m bold\e[0m\r\nnext\e[1;1H\e[2KX\e[3;5H中"
+      native = Emulator.new(20, 5, native_parser: true)
+      assert is_reference(native.parser_state.native)
+
+      {native, _} = Emulator.process_input(native, input)
+      {elixir, _} = Emulator.process_input(Emulator.new(20, 5), input)
+
+      assert ScreenBuffer.get_content(Emulator.get_screen_buffer(native)) ==
+               ScreenBuffer.get_content(Emulator.get_screen_buffer(elixir))
+    end
+  end
+end
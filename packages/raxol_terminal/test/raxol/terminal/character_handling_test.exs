@@ -18,6 +18,16 @@ defmodule Raxol.Terminal.CharacterHandlingTest do
       assert Raxol.Terminal.CharacterHandling.get_char_width("a") == 1
       assert Raxol.Terminal.CharacterHandling.get_char_width("1") == 1
     end
+
+    test "agrees with wide_char?/1 for CJK, Hangul and fullwidth forms" do
+      for cp <- [?中, 0x3400, 0xAC00, 0xFF21, 0x20000, 0x1F600] do
+        assert CharacterHandling.get_char_width(cp) == 2, "U+#{Integer.to_string(cp, 16)}"
+      end
+
+      for cp <- [?a, 0xE9, 0x0416, 0x05D0] do
+        assert CharacterHandling.get_char_width(cp) == 1, "U+#{Integer.to_string(cp, 16)}"
+      end
+    end
   end
 
   describe "combining characters" do
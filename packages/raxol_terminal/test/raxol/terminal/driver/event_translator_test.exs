@@ -0,0 +1,71 @@
+defmodule Raxol.Terminal.Driver.EventTranslatorTest do
+  use ExUnit.Case, async: true
+
+  alias Raxol.Core.Events.Event
+  alias Raxol.Terminal.Driver.EventTranslator
+
+  defp record(type, mod, key, ch, x, y) do
+    <<type, mod, key::native-16, ch::native-32, x::native-signed-32,
+      y::native-signed-32>>
+  end
+
+  describe "unpack/1" do
+    test "unpacks tb_input_poll records in order" do
+      packed =
+        record(1, 0, 0, ?a, 0, 0) <>
+          record(1, 2, 65, 0, 0, 0) <>
+          record(2, 0, 0, 0, 120, 40) <>
+          record(3, 0, 1, 0, 10, 5)
+
+      assert EventTranslator.unpack(packed) == [
+               %{type: :key, key: 0, char: ?a, mod: 0},
+               %{type: :key, key: 65, char: 0, mod: 2},
+               %{type: :resize, width: 120, height: 40},
+               %{type: :mouse, x: 10, y: 5, button: 1}
+             ]
+    end
+
+    test "returns an empty list for an empty drain" do
+      assert EventTranslator.unpack(<<>>) == []
+    end
+
+    test "unpacked events translate like termbox event maps" do
+      [event_map] = EventTranslator.unpack(record(1, 0, 276, 0, 0, 0))
+
+      assert {:ok, %Event{type: :key, data: %{key: :f12}}} =
+               EventTranslator.translate(event_map)
+    end
+
+    test "translates editing keys and BackTab" do
+      codes = [{331, 0}, {330, 0}, {262, 0}, {360, 0}, {339, 0}, {338, 0}, {9, 1}]
+
+      keys =
+        for {key, mod} <- codes do
+          [event_map] = EventTranslator.unpack(record(1, mod, key, 0, 0, 0))
+          {:ok, %Event{data: data}} = EventTranslator.translate(event_map)
+          {data.key, data.shift}
+        end
+
+      assert keys == [
+               insert: false,
+               delete: false,
+               home: false,
+               end: false,
+               page_up: false,
+               page_down: false,
+               tab: true
+             ]
+    end
+
+    test "translates mouse buttons, including a release" do
+      buttons =
+        for button <- 0..5 do
+          [event_map] = EventTranslator.unpack(record(3, 0, button, 0, 4, 2))
+          {:ok, %Event{type: :mouse, data: data}} = EventTranslator.translate(event_map)
+          data.button
+        end
+
+      assert buttons == [:left, :right, :middle, :wheel_up, :wheel_down, :release]
+    end
+  end
+end
@@ -76,6 +76,37 @@ defmodule Raxol.Terminal.Driver.KeyEventTest do
       Helper.simulate_key_event(driver_pid, 0, 266)
       Helper.assert_key_event(nil, :f2)
 
+      # F12
+      Helper.simulate_key_event(driver_pid, 0, 276)
+      Helper.assert_key_event(nil, :f12)
+
+      Process.exit(driver_pid, :shutdown)
+    end
+
+    test ~c"parses and dispatches editing key events" do
+      test_pid = self()
+      driver_pid = Helper.start_driver(test_pid)
+
+      # Wait for driver to be ready and consume initial resize
+      Helper.wait_for_driver_ready(driver_pid)
+      Helper.consume_initial_resize()
+
+      Helper.simulate_key_event(driver_pid, 0, 13)
+      Helper.assert_key_event(nil, :enter)
+
+      Helper.simulate_key_event(driver_pid, 0, 9)
+      Helper.assert_key_event(nil, :tab)
+
+      Helper.simulate_key_event(driver_pid, 0, 27)
+      Helper.assert_key_event(nil, :escape)
+
+      Helper.simulate_key_event(driver_pid, 0, 127)
+      Helper.assert_key_event(nil, :backspace)
+
+      # Ctrl+C as decoded by tb_input_poll/1
+      Helper.simulate_key_event(driver_pid, ?c, 3, 2)
+      Helper.assert_key_event("c", nil, %{ctrl: true})
+
       Process.exit(driver_pid, :shutdown)
     end
 
@@ -0,0 +1,43 @@
+defmodule Raxol.Terminal.Integration.CellRendererTest do
+  use ExUnit.Case, async: true
+
+  alias Raxol.Terminal.Integration.CellRenderer
+
+  describe "pack_cells/1" do
+    test "packs one 24-byte record per cell" do
+      rows = [
+        {[{%{char: "A", fg: 1, bg: 2}, 0}, {%{char: "B", fg: 3, bg: 4}, 1}], 0},
+        {[{%{char: nil, fg: 0, bg: 0}, 5}], 7}
+      ]
+
+      packed = rows |> CellRenderer.pack_cells() |> IO.iodata_to_binary()
+
+      assert byte_size(packed) == 3 * 24
+
+      assert <<0::native-16, 0::native-16, ?A::native-32, 1::native-64, 2::native-64,
+               1::native-16, 0::native-16, ?B::native-32, 3::native-64, 4::native-64,
+               5::native-16, 7::native-16, ?\s::native-32, 0::native-64,
+               0::native-64>> = packed
+    end
+
+    test "uses the first codepoint of multi-codepoint chars" do
+      packed =
+        [{[{%{char: "e\u0301", fg: 0, bg: 0}, 0}], 0}]
+        |> CellRenderer.pack_cells()
+        |> IO.iodata_to_binary()
+
+      assert <<_::binary-size(4), ?e::native-32, _::binary>> = packed
+    end
+
+    test "rejects positions that don't fit 16 bits" do
+      cell = %{char: "a", fg: 0, bg: 0}
+
+      packed = [{[{cell, 0xFFFF}], 0xFFFF}] |> CellRenderer.pack_cells() |> IO.iodata_to_binary()
+      assert <<0xFFFF::native-16, 0xFFFF::native-16, _::binary>> = packed
+
+      for {x, y} <- [{0x10000, 0}, {0, 0x10000}, {-1, 0}, {0, -1}] do
+        assert_raise ArgumentError, fn -> CellRenderer.pack_cells([{[{cell, x}], y}]) end
+      end
+    end
+  end
+end
@@ -0,0 +1,71 @@
+defmodule Raxol.Terminal.Integration.NativeFrameTest do
+  use ExUnit.Case, async: true
+
+  import Bitwise
+
+  alias Raxol.Terminal.Integration.NativeFrame
+  alias Raxol.Terminal.ScreenBuffer
+
+  @bold 0x01000000
+  @underline 0x02000000
+  @hi_black 0x20000000
+
+  describe "attrs/1" do
+    test "maps named, indexed and RGB colors to 256-color attrs" do
+      assert NativeFrame.attrs(nil) == {0, 0}
+      assert NativeFrame.attrs(%{foreground: :red, background: :bright_blue}) == {1, 12}
+      assert NativeFrame.attrs(%{foreground: 200, background: 0}) == {200, @hi_black}
+      assert NativeFrame.attrs(%{foreground: :black}) == {@hi_black, 0}
+      assert NativeFrame.attrs(%{foreground: %{r: 255, g: 0, b: 0}}) == {196, 0}
+      assert NativeFrame.attrs(%{background: "#00ff00"}) == {0, 46}
+      assert NativeFrame.attrs(%{foreground: :no_such_color}) == {0, 0}
+    end
+
+    test "sets attribute bits on the foreground" do
+      assert NativeFrame.attrs(%{foreground: :green, bold: true, underline: true}) ==
+               {2 ||| @bold ||| @underline, 0}
+    end
+  end
+
+  describe "pack_buffer/1" do
+    test "packs one 20-byte record per cell, row-major" do
+      buffer =
+        ScreenBuffer.new(3, 2)
+        |> ScreenBuffer.write_char(1, 0, "A", %{foreground: :red})
+
+      packed = buffer |> NativeFrame.pack_buffer() |> IO.iodata_to_binary()
+
+      assert byte_size(packed) == 3 * 2 * 20
+
+      assert <<_::binary-size(20), ?A::native-32, 1::native-64, 0::native-64,
+               _::binary>> = packed
+    end
+
+    test "pads short rows and missing rows with blanks" do
+      buffer = %{ScreenBuffer.new(2, 2) | cells: [[]]}
+      packed = buffer |> NativeFrame.pack_buffer() |> IO.iodata_to_binary()
+
+      assert packed ==
+               String.duplicate(<<?\s::native-32, 0::native-64, 0::native-64>>, 4)
+    end
+  end
+
+  describe "render/2" do
+    @describetag :docker
+    test "only sends what changed since the last frame" do
+      {:ok, ctx} = NativeFrame.open(10, 2)
+      buffer = ScreenBuffer.write_char(ScreenBuffer.new(10, 2), 0, 0, "x", nil)
+
+      assert {:ok, first} = NativeFrame.render(ctx, buffer)
+      assert first =~ "x"
+      assert {:ok, ""} = NativeFrame.render(ctx, buffer)
+
+      buffer = ScreenBuffer.write_char(buffer, 5, 1, "y", nil)
+      assert {:ok, diff} = NativeFrame.render(ctx, buffer)
+      assert diff =~ "y"
+      refute diff =~ "x"
+
+      assert NativeFrame.close(ctx) == :ok
+    end
+  end
+end
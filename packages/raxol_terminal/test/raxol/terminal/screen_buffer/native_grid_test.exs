@@ -0,0 +1,147 @@
+defmodule Raxol.Terminal.ScreenBuffer.NativeGridTest do
+  use ExUnit.Case, async: true
+
+  alias Raxol.Terminal.ANSI.TextFormatting
+  alias Raxol.Terminal.ScreenBuffer
+  alias Raxol.Terminal.ScreenBuffer.NativeGrid
+
+  @moduletag :docker
+
+  defp grid(width \\ 10, height \\ 4) do
+    {:ok, buffer} = NativeGrid.open(width, height)
+    buffer
+  end
+
+  defp rows(buffer, text) do
+    text
+    |> String.split("\n")
+    |> Enum.with_index()
+    |> Enum.reduce(buffer, fn {line, y}, acc -> NativeGrid.write_string(acc, 0, y, line) end)
+  end
+
+  describe "writing" do
+    test "writes text and clips it at the right edge" do
+      buffer = grid() |> NativeGrid.write_string(7, 1, "hello")
+      assert NativeGrid.get_content(buffer) == "\n       hel"
+      assert NativeGrid.get_char(buffer, 9, 1) == "l"
+    end
+
+    test "returns the text that did not fit" do
+      {_buffer, columns, rest} = NativeGrid.write_run(grid(), 6, 0, "ab中文cd", nil)
+      assert {columns, rest} == {4, "文cd"}
+    end
+
+    test "keeps wide characters and clusters whole" do
+      buffer = grid() |> NativeGrid.write_string(0, 0, "中e\u0301")
+      [wide, placeholder, cluster | _] = NativeGrid.get_line(buffer, 0)
+
+      assert wide.char == "中"
+      assert placeholder.wide_placeholder
+      assert cluster.char == "e\u0301"
+      assert NativeGrid.get_content(buffer) == "中e\u0301"
+    end
+
+    test "gives back the style each cell was written with" do
+      bold = TextFormatting.new() |> TextFormatting.set_bold()
+
+      buffer =
+        grid() |> NativeGrid.write_string(0, 0, "ab", bold) |> NativeGrid.write_char(2, 0, "c")
+
+      assert NativeGrid.get_cell(buffer, 1, 0).style == bold
+      assert NativeGrid.get_cell(buffer, 2, 0).style == TextFormatting.new()
+    end
+
+    test "older copies of the buffer read styles written through newer ones" do
+      older = grid()
+      italic = TextFormatting.new() |> TextFormatting.set_italic()
+      _newer = NativeGrid.write_string(older, 0, 0, "x", italic)
+
+      assert NativeGrid.get_cell(older, 0, 0).style == italic
+      assert hd(NativeGrid.get_line(older, 0)).style == italic
+    end
+  end
+
+  # Edits change the grid in place, so each one gets a buffer of its own
+  describe "editing" do
+    test "erases, inserts and deletes characters at the cursor" do
+      buffer = fn -> grid() |> rows("abcdefgh") |> Map.put(:cursor_position, {2, 0}) end
+
+      assert buffer.() |> NativeGrid.insert_chars(2) |> NativeGrid.get_content() == "ab  cdefgh"
+      assert buffer.() |> NativeGrid.delete_chars(3) |> NativeGrid.get_content() == "abfgh"
+      assert buffer.() |> NativeGrid.erase_chars(1) |> NativeGrid.get_content() == "ab defgh"
+    end
+
+    test "erases around the cursor" do
+      buffer = fn ->
+        grid(4, 3) |> rows("abcd\nefgh\nijkl") |> Map.put(:cursor_position, {1, 1})
+      end
+
+      erased = NativeGrid.erase_from_cursor_to_end_of_line(buffer.())
+      assert NativeGrid.get_content(erased) == "abcd\ne\nijkl"
+
+      assert buffer.() |> NativeGrid.erase_from_start_to_cursor() |> NativeGrid.get_content() ==
+               "\n  gh\nijkl"
+
+      assert buffer.() |> NativeGrid.erase_all() |> NativeGrid.empty?()
+    end
+
+    test "inserts and deletes lines within the scroll region" do
+      buffer = fn ->
+        grid(4, 4)
+        |> rows("a\nb\nc\nd")
+        |> NativeGrid.set_scroll_region(0, 2)
+        |> Map.put(:cursor_position, {0, 1})
+      end
+
+      assert buffer.() |> NativeGrid.insert_lines(1) |> NativeGrid.get_content() == "a\n\nb\nd"
+      assert buffer.() |> NativeGrid.delete_lines(1) |> NativeGrid.get_content() == "a\nc\n\nd"
+    end
+
+    test "every copy of the buffer sees an edit" do
+      older = grid() |> rows("abcdefgh") |> Map.put(:cursor_position, {2, 0})
+      _newer = NativeGrid.delete_chars(older, 3)
+
+      assert NativeGrid.get_content(older) == "abfgh"
+    end
+  end
+
+  describe "scrolling" do
+    test "returns the lines scrolled out of the region" do
+      buffer = grid(4, 3) |> rows("a\nb\nc")
+      {buffer, scrolled_out} = NativeGrid.scroll_up(buffer, 2)
+
+      assert Enum.map(scrolled_out, &hd(&1).char) == ["a", "b"]
+      assert NativeGrid.get_content(buffer) == "c"
+      assert buffer |> NativeGrid.scroll_down(1) |> NativeGrid.get_content() == "\nc"
+    end
+  end
+
+  test "resizing keeps the upper-left part" do
+    buffer = grid(4, 3) |> rows("abcd\nefgh\nijkl") |> NativeGrid.resize(2, 2)
+
+    assert NativeGrid.get_dimensions(buffer) == {2, 2}
+    assert NativeGrid.get_content(buffer) == "ab\nef"
+  end
+
+  test "a copy from before a resize reads rows the grid lost as empty" do
+    older = grid(4, 3) |> rows("abcd\nefgh\nijkl")
+    _newer = NativeGrid.resize(older, 2, 2)
+
+    assert NativeGrid.get_line(older, 2) == []
+    assert NativeGrid.get_content(older) == "ab\nef"
+  end
+
+  test "matches ScreenBuffer on the same writes" do
+    writes = [{0, 0, "hello"}, {3, 1, "middle"}, {8, 2, "clipped"}]
+
+    native =
+      Enum.reduce(writes, grid(), fn {x, y, s}, b -> NativeGrid.write_string(b, x, y, s) end)
+
+    elixir =
+      Enum.reduce(writes, ScreenBuffer.new(10, 4), fn {x, y, s}, b ->
+        ScreenBuffer.write_string(b, x, y, s)
+      end)
+
+    assert NativeGrid.get_content(native) == ScreenBuffer.get_content(elixir)
+  end
+end
@@ -0,0 +1,114 @@
+defmodule Raxol.Terminal.Scrollback.ColdStoreTest do
+  use ExUnit.Case, async: true
+
+  alias Raxol.Terminal.Scrollback.ColdStore
+  alias Raxol.Terminal.Scrollback.Manager
+
+  defp lines(range), do: Enum.map(range, &"line #{&1}")
+
+  describe "blocks" do
+    test "seals full blocks and reads back across them, newest first" do
+      store = ColdStore.new(block_lines: 4) |> ColdStore.push(lines(1..10))
+
+      assert ColdStore.size(store) == 10
+      assert map_size(store.blocks) == 2
+      assert ColdStore.bytes(store) > 0
+      assert ColdStore.get(store, 0) == "line 10"
+      assert ColdStore.get(store, 9) == "line 1"
+      assert ColdStore.get(store, 10) == nil
+      assert ColdStore.range(store, 1, 6) == Enum.map(9..4//-1, &"line #{&1}")
+      assert ColdStore.range(store, 8, 5) == ["line 2", "line 1"]
+    end
+
+    test "keeps reading past the LRU" do
+      store = ColdStore.new(block_lines: 2, cache_blocks: 1) |> ColdStore.push(lines(1..8))
+
+      assert ColdStore.range(store, 0, 8) == Enum.map(8..1//-1, &"line #{&1}")
+      assert ColdStore.get(store, 7) == "line 1"
+    end
+
+    test "drops the oldest blocks over max_bytes" do
+      store = ColdStore.new(block_lines: 2, max_bytes: 1) |> ColdStore.push(lines(1..7))
+
+      assert ColdStore.bytes(store) == 0
+      assert ColdStore.size(store) == 1
+      assert ColdStore.range(store, 0, 10) == ["line 7"]
+    end
+
+    test "clears every line" do
+      store = ColdStore.new(block_lines: 2) |> ColdStore.push(lines(1..5)) |> ColdStore.clear()
+
+      assert ColdStore.size(store) == 0
+      assert ColdStore.range(store, 0, 5) == []
+      assert store |> ColdStore.push(["again"]) |> ColdStore.get(0) == "again"
+    end
+
+    test "copies that sealed different blocks under one id read their own" do
+      store = ColdStore.new(block_lines: 1)
+      a = ColdStore.push(store, ["a"])
+      b = ColdStore.push(store, ["b"])
+
+      assert ColdStore.get(a, 0) == "a"
+      assert ColdStore.get(b, 0) == "b"
+    end
+
+    test "deletes its cache on close and on clear, and still reads after" do
+      store = ColdStore.new(block_lines: 1) |> ColdStore.push(["a", "b"])
+      cleared = ColdStore.clear(store)
+
+      assert :ets.info(store.cache) == :undefined
+      assert ColdStore.get(store, 1) == "a"
+
+      assert ColdStore.close(cleared) == :ok
+      assert :ets.info(cleared.cache) == :undefined
+      assert cleared |> ColdStore.push(["c"]) |> ColdStore.get(0) == "c"
+    end
+  end
+
+  describe "search" do
+    test "finds lines in open and sealed blocks, newest first" do
+      store =
+        ColdStore.new(block_lines: 3)
+        |> ColdStore.push(["error a", "ok", "error b", "ok", "fine error", "ok", "error c"])
+
+      assert ColdStore.search(store, "error") == [0, 2, 4, 6]
+      assert ColdStore.search(store, "missing") == []
+    end
+
+    test "does not match across line boundaries" do
+      store = ColdStore.new(block_lines: 2) |> ColdStore.push(["ab", "cd"])
+      assert ColdStore.search(store, "bc") == []
+    end
+  end
+
+  describe "manager" do
+    test "moves lines leaving the hot window into cold storage" do
+      opts = [scrollback_limit: 3, cold_storage: true, cold_block_lines: 2]
+
+      manager =
+        Enum.reduce(1..10, Manager.new(opts), fn n, acc ->
+          Manager.add_to_scrollback(acc, "line #{n}")
+        end)
+
+      assert Manager.get_scrollback_buffer(manager) == ["line 10", "line 9", "line 8"]
+      assert Manager.get_scrollback_size(manager) == 10
+      assert Manager.get_scrollback_range(manager, 2, 4) == {:ok, ["line 8", "line 7", "line 6"]}
+      assert manager |> Manager.scroll_up(9) |> Manager.get_current_line() == {:ok, "line 1"}
+      assert Manager.search_scrollback(manager, "line 1") == [0, 9]
+      assert manager |> Manager.clear_scrollback() |> Manager.get_scrollback_size() == 0
+    end
+
+    test "moves lines cut by a lower limit into cold storage" do
+      manager =
+        Enum.reduce(1..4, Manager.new(cold_storage: true), fn n, acc ->
+          Manager.add_to_scrollback(acc, "line #{n}")
+        end)
+        |> Manager.set_scrollback_limit(1)
+
+      assert Manager.get_scrollback_buffer(manager) == ["line 4"]
+
+      assert Manager.get_scrollback_range(manager, 0, 3) ==
+               {:ok, ["line 4", "line 3", "line 2", "line 1"]}
+    end
+  end
+end
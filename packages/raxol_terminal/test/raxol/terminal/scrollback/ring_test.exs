@@ -0,0 +1,156 @@
+defmodule Raxol.Terminal.Scrollback.RingTest do
+  use ExUnit.Case, async: true
+
+  alias Raxol.Terminal.ANSI.TextFormatting
+  alias Raxol.Terminal.Buffer.Scrollback
+  alias Raxol.Terminal.Cell
+  alias Raxol.Terminal.ScreenBuffer
+  alias Raxol.Terminal.Scrollback.Manager
+  alias Raxol.Terminal.Scrollback.Ring
+
+  @moduletag :docker
+
+  defp ring(opts \\ []) do
+    {:ok, ring} = Ring.open(opts)
+    ring
+  end
+
+  defp cells(text, style \\ TextFormatting.new()),
+    do: text |> String.graphemes() |> Enum.map(&Cell.new(&1, style))
+
+  describe "lines" do
+    test "reads lines back by index, newest first" do
+      ring = ring() |> Ring.push(["one", "two", "three"])
+
+      assert Ring.size(ring) == 3
+      assert Ring.get(ring, 0) == "three"
+      assert Ring.get(ring, 2) == "one"
+      assert Ring.get(ring, 3) == nil
+      assert Ring.range(ring, 1, 5) == ["two", "one"]
+    end
+
+    test "round-trips cells with their styles and wide placeholders" do
+      bold = TextFormatting.new() |> TextFormatting.set_bold()
+      wide = [Cell.new("中", bold), Cell.new_wide_placeholder(bold)]
+      line = cells("ab") ++ cells("c", bold) ++ wide
+      ring = ring() |> Ring.push([line, []])
+
+      assert Ring.get(ring, 1) |> Enum.map(&{&1.char, &1.style, &1.wide_placeholder}) ==
+               Enum.map(line, &{&1.char, &1.style, &1.wide_placeholder})
+
+      assert Ring.get(ring, 0) == []
+    end
+
+    test "stores a run of one style as one span, placeholders and all" do
+      style = TextFormatting.new()
+      wide = fn char -> [Cell.new(char, style), Cell.new_wide_placeholder(style)] end
+      line = wide.("中") ++ cells("a") ++ wide.("文")
+      {ring, [record]} = ring(max_lines: 1) |> Ring.push_evicting([line, "x"])
+      {text, spans, _styles} = record
+
+      assert {text, byte_size(spans)} == {"中a文", 8}
+
+      assert Ring.decode(ring, record) |> Enum.map(&{&1.char, &1.wide_placeholder}) ==
+               Enum.map(line, &{&1.char, &1.wide_placeholder})
+    end
+
+    test "keeps a wide character without a placeholder apart from one with" do
+      style = TextFormatting.new()
+      line = [Cell.new("中", style), Cell.new("文", style), Cell.new_wide_placeholder(style)]
+      ring = ring() |> Ring.push([line])
+
+      assert Ring.get(ring, 0) |> Enum.map(&{&1.char, &1.wide_placeholder}) ==
+               Enum.map(line, &{&1.char, &1.wide_placeholder})
+    end
+
+    test "pushes nothing from a list with a bad line in it" do
+      ring = ring() |> Ring.push(["kept"])
+      lines = [{"a", <<>>}, {"b", <<5::native-32, 1::native-32>>}]
+
+      assert_raise ArgumentError, fn -> :termbox2_nif.sb_push(ring.ring, lines, [], false) end
+
+      assert Ring.to_list(ring) == ["kept"]
+    end
+
+    test "older copies of the ring read styles pushed through newer ones" do
+      italic = TextFormatting.new() |> TextFormatting.set_italic()
+      ring = ring()
+      _newer = Ring.push(ring, [cells("x", italic)])
+
+      assert [%{style: ^italic}] = Ring.get(ring, 0)
+    end
+
+    test "hands evicted cell lines back with their styles" do
+      bold = TextFormatting.new() |> TextFormatting.set_bold()
+      {ring, evicted} = ring(max_lines: 1) |> Ring.push_evicting([cells("a", bold), "b"])
+
+      assert [[%{char: "a", style: ^bold}]] = Enum.map(evicted, &Ring.decode(ring, &1))
+    end
+  end
+
+  describe "search" do
+    test "finds every match in range, newest line first" do
+      ring = ring() |> Ring.push(["error: a", "ok", "héllo Error error"])
+
+      assert Ring.search(ring, "error", 0, 3) == [{0, 12, "error"}, {2, 0, "error"}]
+      assert Ring.search(ring, "ERROR", 0, 1, true) == [{0, 6, "Error"}, {0, 12, "error"}]
+      assert Ring.search(ring, "error", 1, 1) == []
+      assert Ring.search(ring, "error", 5, 1) == []
+    end
+  end
+
+  describe "limits" do
+    test "drops the oldest lines over the line limit" do
+      ring = ring(max_lines: 2) |> Ring.push(["a", "b", "c"])
+      assert Ring.to_list(ring) == ["c", "b"]
+
+      assert ring |> Ring.set_limits(1, 0) |> Ring.to_list() == ["c"]
+    end
+
+    test "drops the oldest lines over the byte limit but keeps the newest" do
+      ring = ring(max_bytes: 100) |> Ring.push(List.duplicate(String.duplicate("x", 40), 5))
+      assert Ring.bytes(ring) <= 100
+      assert Ring.size(ring) in 1..2
+
+      ring = Ring.push(ring, [String.duplicate("y", 500)])
+      assert Ring.to_list(ring) == [String.duplicate("y", 500)]
+    end
+
+    test "hands back evicted lines when asked" do
+      {ring, evicted} = ring(max_lines: 1) |> Ring.push_evicting(["a", "b", "c"])
+      assert Enum.map(evicted, &Ring.decode(ring, &1)) == ["a", "b"]
+    end
+  end
+
+  describe "screen buffer scrollback" do
+    test "keeps the same order as the list" do
+      lines = [cells("first"), cells("second"), cells("third")]
+      list = ScreenBuffer.new(10, 2) |> Scrollback.add_lines(lines)
+      native = ScreenBuffer.new(10, 2) |> Scrollback.attach_native()
+      native = Scrollback.add_lines(native, lines)
+
+      assert %Ring{} = native.scrollback
+      assert Scrollback.size(native) == Scrollback.size(list)
+      assert Scrollback.get_line(native, 0) == Scrollback.get_line(list, 0)
+      assert Scrollback.get_lines(native, 1, 5) == Scrollback.get_lines(list, 1, 5)
+      assert Scrollback.get_newest_line(native) == Scrollback.get_newest_line(list)
+      assert native |> Scrollback.clear() |> Scrollback.size() == 0
+    end
+  end
+
+  describe "manager" do
+    test "serves ranges from the ring" do
+      manager =
+        Enum.reduce(1..5, Manager.new(native: true, scrollback_limit: 4), fn n, acc ->
+          Manager.add_to_scrollback(acc, "line #{n}")
+        end)
+
+      assert %Ring{} = manager.scrollback_buffer
+      assert Manager.get_scrollback_size(manager) == 4
+      assert Manager.get_scrollback_range(manager, 0, 1) == {:ok, ["line 5", "line 4"]}
+      assert Manager.get_scrollback_range(manager, 9, 10) == {:error, :invalid_range}
+      assert manager |> Manager.scroll_up(2) |> Manager.get_current_line() == {:ok, "line 3"}
+      assert Manager.search_scrollback(manager, "line 4") == [1]
+    end
+  end
+end
@@ -0,0 +1,189 @@
+defmodule Raxol.Terminal.Scrollback.SearchTest do
+  use ExUnit.Case, async: true
+
+  alias Raxol.Terminal.Buffer.Scrollback
+  alias Raxol.Terminal.{Cell, Emulator, ScreenBuffer, SearchManager}
+  alias Raxol.Terminal.Scrollback.{ColdStore, Manager, Matcher, Search}
+  alias Raxol.Terminal.SearchBuffer
+
+  defp manager(lines, opts \\ []) do
+    Enum.reduce(lines, Manager.new(opts), &Manager.add_to_scrollback(&2, &1))
+  end
+
+  defp lines(matches), do: Enum.map(matches, & &1.line)
+
+  defp cells(text), do: text |> String.graphemes() |> Enum.map(&Cell.new/1)
+
+  defp scroll_into(emulator, text) do
+    screen = emulator |> Emulator.get_screen_buffer() |> Scrollback.add_line(cells(text))
+    %{emulator | main_screen_buffer: screen}
+  end
+
+  describe "matcher" do
+    test "folds ASCII case only when asked" do
+      assert Matcher.line_matches(Matcher.compile("ab"), "ab AB") == [{0, "ab"}]
+      assert Matcher.line_matches(Matcher.compile("ab", true), "ab AB") == [{0, "ab"}, {3, "AB"}]
+    end
+
+    test "reports columns in characters" do
+      assert Matcher.line_matches(Matcher.compile("x"), "héllo x") == [{6, "x"}]
+    end
+
+    test "filters rule out text without the pattern's trigrams" do
+      filter = Matcher.filter("connection refused")
+
+      assert Matcher.may_match?(Matcher.compile("REFUSED", true), filter)
+      refute Matcher.may_match?(Matcher.compile("timeout"), filter)
+      assert Matcher.may_match?(Matcher.compile("zz"), filter)
+    end
+
+    test "sizes filters to the text's trigrams" do
+      small = Matcher.filter("abcd")
+      large = 1..2000 |> Enum.map_join(" ", &Integer.to_string/1) |> Matcher.filter()
+
+      assert bit_size(small) == 64
+      assert bit_size(large) > bit_size(small)
+      assert Matcher.may_match?(Matcher.compile("1999"), large)
+    end
+  end
+
+  describe "cold store" do
+    test "pages through blocks, skipping filtered ones" do
+      store =
+        ColdStore.new(block_lines: 2, trigrams: true)
+        |> ColdStore.push(["error 1", "ok", "ok", "ok", "x error 2", "ok"])
+
+      matcher = Matcher.compile("error")
+      assert ColdStore.search(store, matcher, 0, 6) == [{1, 2, "error"}, {5, 0, "error"}]
+      assert ColdStore.search(store, matcher, 2, 2) == []
+      assert ColdStore.search(store, matcher, 4, 10) == [{5, 0, "error"}]
+    end
+
+    test "counts filters against max_bytes" do
+      lines = Enum.map(1..4, &"line #{&1}")
+      plain = ColdStore.new(block_lines: 2) |> ColdStore.push(lines)
+      filtered = ColdStore.new(block_lines: 2, trigrams: true) |> ColdStore.push(lines)
+
+      filter_bytes = filtered.filters |> Map.values() |> Enum.map(&byte_size/1) |> Enum.sum()
+      assert ColdStore.bytes(filtered) == ColdStore.bytes(plain) + filter_bytes
+
+      store =
+        ColdStore.new(block_lines: 2, trigrams: true, max_bytes: ColdStore.bytes(plain))
+        |> ColdStore.push(lines)
+
+      assert ColdStore.size(store) == 2
+    end
+
+    test "finds matches hidden behind one that runs into the next line" do
+      store = ColdStore.new(block_lines: 2) |> ColdStore.push(["a", "aa"])
+      assert ColdStore.search(store, Matcher.compile("aa"), 0, 2) == [{0, 0, "aa"}]
+    end
+  end
+
+  describe "search" do
+    test "scans scrollback a page at a time, newest first" do
+      manager = manager(Enum.map(1..10, &"line #{&1}"))
+      search = Search.new("line", page_lines: 4)
+
+      {search, page} = Search.next_page(search, manager)
+      assert lines(page) == [0, 1, 2, 3]
+      refute Search.done?(search, manager)
+
+      {search, _page} = Search.next_page(search, manager)
+      {search, page} = Search.next_page(search, manager)
+      assert lines(page) == [8, 9]
+      assert Search.done?(search, manager)
+      assert Search.count(search) == 10
+    end
+
+    test "searches the screen from the bottom" do
+      search = Search.new("x") |> Search.screen(["x", "", "a x"])
+
+      assert Search.matches(search) == [
+               %{line: -1, start: 2, length: 1, text: "x"},
+               %{line: -3, start: 0, length: 1, text: "x"}
+             ]
+    end
+
+    test "follows the screen scrolling its region by scanning the new rows only" do
+      search = Search.new("x") |> Search.screen(["x 1", "a", "x 2", "status x"])
+      scrolled = Search.scroll_screen(search, {0, 2}, 1, ["x 3"], 4)
+      rescanned = Search.new("x") |> Search.screen(["a", "x 2", "x 3", "status x"])
+
+      assert Search.matches(scrolled) == Search.matches(rescanned)
+      assert Search.count(scrolled) == 3
+    end
+
+    test "takes in new lines without rescanning and keeps positions right" do
+      manager = manager(["hit 1", "miss", "hit 2"], scrollback_limit: 4)
+      {search, _page} = Search.next_page(Search.new("hit"), manager)
+      assert lines(Search.matches(search)) == [0, 2]
+
+      manager = manager |> Manager.add_to_scrollback("hit 3") |> Manager.add_to_scrollback("miss")
+      {search, added} = Search.lines_added(search, manager, 2)
+
+      assert lines(added) == [1]
+      # "hit 1" has left the scrollback
+      assert lines(Search.matches(search)) == [1, 2]
+      assert Search.count(search) == 2
+
+      assert for(%{line: line} <- Search.matches(search),
+                 do: Manager.get_scrollback_range(manager, line, line)) ==
+               [{:ok, ["hit 3"]}, {:ok, ["hit 2"]}]
+    end
+
+    test "reaches into cold storage" do
+      manager = manager(["needle", "a", "b", "c"], scrollback_limit: 2, cold_storage: true)
+      {search, _page} = Search.next_page(Search.new("NEEDLE"), manager)
+
+      assert [%{line: 3, text: "needle"}] = Search.matches(search)
+    end
+
+    test "passes cold_trigrams on to the cold store" do
+      manager = Manager.new(scrollback_limit: 1, cold_storage: true, cold_trigrams: true)
+      assert manager.cold.trigrams
+    end
+
+    test "searches a screen buffer's scrollback" do
+      buffer =
+        ScreenBuffer.new(10, 2)
+        |> Scrollback.add_lines([cells("hit 2"), cells("miss"), cells("hit 1")])
+
+      {search, _page} = Search.next_page(Search.new("hit"), buffer)
+      assert Enum.map(Search.matches(search), &{&1.line, &1.text}) == [{0, "hit"}, {2, "hit"}]
+      assert Search.done?(search, buffer)
+    end
+  end
+
+  describe "search manager" do
+    test "searches the emulator's scrollback and follows lines added to it" do
+      emulator = scroll_into(Emulator.new(10, 2), "hit 1")
+
+      {:ok, emulator} = SearchManager.start_search(emulator, "hit")
+      assert Enum.map(SearchManager.get_all_matches(emulator), & &1.line) == [0]
+
+      emulator = emulator |> scroll_into("hit 2") |> SearchManager.lines_added(1)
+
+      assert Enum.map(SearchManager.get_all_matches(emulator), & &1.line) == [0, 1]
+    end
+  end
+
+  describe "search buffer" do
+    test "loads matches a page at a time and follows new lines" do
+      manager = manager(Enum.map(1..6, &"hit #{&1}"))
+      buffer = SearchBuffer.set_options(%SearchBuffer{}, %{case_sensitive: true})
+      {:ok, buffer} = SearchBuffer.start_search(buffer, "hit", manager, ["hit on screen"])
+
+      assert SearchBuffer.get_match_count(buffer) == 7
+      assert {:ok, buffer, %{line: -1}} = SearchBuffer.find_next(buffer)
+      assert {:ok, buffer, %{line: 0}} = SearchBuffer.find_next(buffer)
+      assert {:error, :done} = SearchBuffer.load_more(buffer, manager)
+
+      manager = Manager.add_to_scrollback(manager, "hit 7")
+      buffer = SearchBuffer.lines_added(buffer, manager, 1, ["hit on screen"])
+
+      assert SearchBuffer.get_match_count(buffer) == 8
+      assert Enum.at(buffer.matches, buffer.current_index).line == 1
+    end
+  end
+end
@@ -26,14 +26,71 @@ defmodule Termbox2LoadingTest do
         {:tb_height, 0},
         {:tb_clear, 0},
         {:tb_present, 0},
+        {:tb_present_async, 0},
+        {:tb_present_damage, 0},
+        {:tb_input_start, 1},
+        {:tb_input_poll, 1},
+        {:tb_input_stop, 1},
         {:tb_set_cell, 5},
+        {:tb_set_cells, 1},
+        {:tb_blit, 5},
         {:tb_set_cursor, 2},
         {:tb_hide_cursor, 0},
         {:tb_print, 5},
         {:tb_set_title, 1},
         {:tb_set_position, 2},
         {:tb_set_input_mode, 1},
-        {:tb_set_output_mode, 1}
+        {:tb_set_output_mode, 1},
+        {:tb_open, 2},
+        {:tb_open_memory, 2},
+        {:tb_close, 1},
+        {:tb_resize, 2},
+        {:tb_resize, 3},
+        {:tb_width, 1},
+        {:tb_height, 1},
+        {:tb_clear, 1},
+        {:tb_present, 1},
+        {:tb_present_damage, 1},
+        {:tb_present_binary, 1},
+        {:tb_input_start, 2},
+        {:tb_set_cell, 6},
+        {:tb_set_cells, 2},
+        {:tb_blit, 6},
+        {:tb_set_cursor, 3},
+        {:tb_hide_cursor, 1},
+        {:tb_print, 6},
+        {:tb_print_runs, 1},
+        {:tb_print_runs, 2},
+        {:tb_set_title, 2},
+        {:tb_set_position, 3},
+        {:tb_set_input_mode, 2},
+        {:tb_set_output_mode, 2},
+        {:tb_set_output_nonblock, 1},
+        {:tb_set_output_nonblock, 2},
+        {:tb_flush, 0},
+        {:tb_flush, 1},
+        {:tb_wcwidth_table, 0},
+        {:vt_parser_new, 0},
+        {:vt_parse, 2},
+        {:tb_grid_new, 2},
+        {:tb_grid_resize, 5},
+        {:tb_grid_size, 1},
+        {:tb_grid_print, 6},
+        {:tb_grid_erase, 6},
+        {:tb_grid_insert_cells, 6},
+        {:tb_grid_delete_cells, 6},
+        {:tb_grid_scroll, 6},
+        {:tb_grid_intern, 2},
+        {:tb_grid_row, 2},
+        {:tb_grid_cell, 3},
+        {:sb_new, 2},
+        {:sb_push, 4},
+        {:sb_set_limits, 4},
+        {:sb_get, 2},
+        {:sb_range, 3},
+        {:sb_search, 5},
+        {:sb_info, 1},
+        {:sb_clear, 1}
       ]
 
       for {func, arity} <- expected_functions do
@@ -73,6 +130,242 @@ defmodule Termbox2LoadingTest do
     end
   end
 
+  describe "memory contexts" do
+    @tag :docker
+    test "contexts are independent of each other" do
+      {:ok, a} = :termbox2_nif.tb_open_memory(80, 24)
+      {:ok, b} = :termbox2_nif.tb_open_memory(40, 10)
+
+      assert :termbox2_nif.tb_width(a) == 80
+      assert :termbox2_nif.tb_height(b) == 10
+      assert :termbox2_nif.tb_print(a, 0, 0, 0, 0, "hello") == 0
+      assert {:ok, %{cells: 5}} = :termbox2_nif.tb_present_damage(a)
+      assert {:ok, %{cells: 0}} = :termbox2_nif.tb_present_damage(b)
+
+      assert :termbox2_nif.tb_resize(b, 100, 30) == 0
+      assert :termbox2_nif.tb_width(b) == 100
+      assert :termbox2_nif.tb_width(a) == 80
+
+      assert :termbox2_nif.tb_close(a) == :ok
+      assert :termbox2_nif.tb_width(a) < 0
+      assert :termbox2_nif.tb_close(b) == :ok
+    end
+
+    @tag :docker
+    test "memory contexts never have output pending" do
+      {:ok, ctx} = :termbox2_nif.tb_open_memory(20, 5)
+
+      assert :termbox2_nif.tb_set_output_nonblock(ctx, true) == 0
+      assert :termbox2_nif.tb_print(ctx, 0, 0, 0, 0, "hi") == 0
+      assert {:ok, %{pending: 0}} = :termbox2_nif.tb_present_damage(ctx)
+      assert :termbox2_nif.tb_flush(ctx) == :ok
+      assert_raise ArgumentError, fn -> :termbox2_nif.tb_set_output_nonblock(ctx, 1) end
+
+      assert :termbox2_nif.tb_close(ctx) == :ok
+    end
+
+    @tag :docker
+    test "tb_set_cells skips records outside the back buffer" do
+      {:ok, ctx} = :termbox2_nif.tb_open_memory(20, 5)
+
+      cell = fn x, y ->
+        <<x::native-16, y::native-16, ?x::native-32, 0::native-64, 0::native-64>>
+      end
+
+      cells = [cell.(0, 0), cell.(19, 4), cell.(20, 0), cell.(0, 5), cell.(0xFFFF, 0xFFFF)]
+      assert :termbox2_nif.tb_set_cells(ctx, cells) == 2
+      assert {:ok, %{spans: [{0, 0, 1}, {4, 19, 20}]}} = :termbox2_nif.tb_present_damage(ctx)
+      assert :termbox2_nif.tb_set_cells(ctx, binary_part(cell.(1, 1), 0, 23)) < 0
+
+      assert :termbox2_nif.tb_close(ctx) == :ok
+    end
+
+    @tag :docker
+    test "tb_blit clips at every edge" do
+      {:ok, ctx} = :termbox2_nif.tb_open_memory(20, 5)
+      rect = fn w, h -> :binary.copy(<<?x::native-32, 0::native-64, 0::native-64>>, w * h) end
+
+      # right and bottom edges: only the 2x2 corner lands
+      assert :termbox2_nif.tb_blit(ctx, 18, 3, 4, 3, rect.(4, 3)) == 4
+      assert {:ok, %{spans: [{3, 18, 20}, {4, 18, 20}]}} = :termbox2_nif.tb_present_damage(ctx)
+
+      # negative origin: only the lower-right 2x2 lands
+      assert :termbox2_nif.tb_blit(ctx, -1, -1, 3, 3, rect.(3, 3)) == 4
+      assert {:ok, %{spans: [{0, 0, 2}, {1, 0, 2}]}} = :termbox2_nif.tb_present_damage(ctx)
+
+      # wholly outside, or far enough out that x + w would overflow
+      assert :termbox2_nif.tb_blit(ctx, 20, 0, 2, 2, rect.(2, 2)) == 0
+      assert :termbox2_nif.tb_blit(ctx, -3, 0, 2, 2, rect.(2, 2)) == 0
+      assert :termbox2_nif.tb_blit(ctx, 0x7FFFFFFF, 0, 1, 1, rect.(1, 1)) == 0
+      assert {:ok, %{cells: 0}} = :termbox2_nif.tb_present_damage(ctx)
+
+      # the rectangle's size must match the binary
+      assert :termbox2_nif.tb_blit(ctx, 0, 0, 2, 2, rect.(2, 1)) < 0
+
+      assert :termbox2_nif.tb_close(ctx) == :ok
+    end
+
+    @tag :docker
+    test "prints runs and reports their widths" do
+      {:ok, ctx} = :termbox2_nif.tb_open_memory(20, 5)
+
+      run = fn x, y, text ->
+        <<x::native-16, y::native-16, byte_size(text)::native-32, 0::native-64, 0::native-64,
+          text::binary>>
+      end
+
+      runs = [run.(0, 0, "hello"), run.(2, 1, "中文!"), run.(30, 0, "off"), run.(0, 2, "")]
+      assert [5, 5, out_of_bounds, 0] = :termbox2_nif.tb_print_runs(ctx, runs)
+      assert out_of_bounds < 0
+      assert {:ok, %{cells: cells}} = :termbox2_nif.tb_present_damage(ctx)
+      assert cells > 0
+
+      truncated = binary_part(run.(0, 3, "abc"), 0, 26)
+      assert :termbox2_nif.tb_print_runs(ctx, [run.(0, 4, "x"), truncated]) < 0
+      assert {:ok, %{cells: 0}} = :termbox2_nif.tb_present_damage(ctx)
+
+      assert :termbox2_nif.tb_close(ctx) == :ok
+    end
+
+    @tag :docker
+    test "titles and window positions go out with the context's next frame" do
+      {:ok, ctx} = :termbox2_nif.tb_open_memory(20, 5)
+      {:ok, _setup} = :termbox2_nif.tb_present_binary(ctx)
+
+      assert :termbox2_nif.tb_set_title(ctx, "raxol") == 0
+      assert :termbox2_nif.tb_set_position(ctx, 10, 20) == 0
+      assert {:ok, "\e]0;raxol\a\e[3;20;10t"} = :termbox2_nif.tb_present_binary(ctx)
+
+      assert_raise ArgumentError, fn -> :termbox2_nif.tb_set_title(ctx, "a\ab") end
+      assert_raise ArgumentError, fn -> :termbox2_nif.tb_set_position(ctx, -1, 0) end
+
+      assert :termbox2_nif.tb_close(ctx) == :ok
+      assert :termbox2_nif.tb_set_title(ctx, "raxol") < 0
+    end
+
+    @tag :docker
+    test "invalid sizes and handles are rejected" do
+      assert {:error, code} = :termbox2_nif.tb_open_memory(0, 24)
+      assert code < 0
+      assert_raise ArgumentError, fn -> :termbox2_nif.tb_width(make_ref()) end
+    end
+  end
+
+  describe "terminal contexts" do
+    # Opens path raw, so the fd lives in this OS process, and finds its number
+    defp open_fd(path, mode \\ :write) do
+      {:ok, file} = File.open(path, [mode, :raw])
+      access = if mode == :read, do: 0, else: 1
+
+      fd =
+        Enum.find_value(File.ls!("/proc/self/fd"), fn fd ->
+          File.read_link("/proc/self/fd/#{fd}") == {:ok, path} && fd_access(fd) == access &&
+            String.to_integer(fd)
+        end)
+
+      {file, fd}
+    end
+
+    # O_ACCMODE bits of an fd's flags, or nil if it's gone
+    defp fd_access(fd) do
+      with {:ok, info} <- File.read("/proc/self/fdinfo/#{fd}"),
+           [_, flags] <- Regex.run(~r/flags:\s+(\d+)/, info) do
+        Bitwise.band(String.to_integer(flags, 8), 3)
+      else
+        _ -> nil
+      end
+    end
+
+    defp present_until_closed(ctx, n \\ 0) do
+      if :termbox2_nif.tb_width(ctx) > 0 do
+        :termbox2_nif.tb_print(ctx, 0, rem(n, 24), rem(n, 8), 0, String.duplicate("x", 80))
+        :termbox2_nif.tb_present(ctx)
+        present_until_closed(ctx, n + 1)
+      else
+        n
+      end
+    end
+
+    @tag :docker
+    test "presents racing a close never write to a reused fd" do
+      name = "termbox2_close_race_#{System.unique_integer([:positive])}"
+      dir = Path.join(System.tmp_dir!(), name)
+      File.mkdir_p!(dir)
+      on_exit(fn -> File.rm_rf!(dir) end)
+
+      for round <- 1..20 do
+        {term, fd} = open_fd(Path.join(dir, "term#{round}"))
+        {:ok, ctx} = :termbox2_nif.tb_open(fd, fd)
+        presenters = for _ <- 1..4, do: Task.async(fn -> present_until_closed(ctx) end)
+
+        Process.sleep(2)
+        assert :termbox2_nif.tb_close(ctx) == :ok
+        :ok = File.close(term)
+        # Likely takes the number of the fd just closed
+        other_path = Path.join(dir, "other#{round}")
+        {other, _fd} = open_fd(other_path)
+
+        Enum.each(presenters, &Task.await/1)
+        :ok = File.close(other)
+        assert File.read!(other_path) == ""
+      end
+    end
+
+    @tag :docker
+    test "an input watcher stops when the terminal hangs up" do
+      name = "termbox2_hangup_#{System.unique_integer([:positive])}"
+      dir = Path.join(System.tmp_dir!(), name)
+      File.mkdir_p!(dir)
+      on_exit(fn -> File.rm_rf!(dir) end)
+
+      fifo = Path.join(dir, "input")
+      {_, 0} = System.cmd("mkfifo", [fifo])
+      # Opening either end of a FIFO waits for the other, so the terminal's
+      # end is opened by a process of its own
+      terminal =
+        spawn_link(fn ->
+          {:ok, input} = File.open(fifo, [:write, :raw])
+          :ok = IO.binwrite(input, "a")
+
+          receive do
+            :hang_up -> :ok = File.close(input)
+          end
+        end)
+
+      {input, rfd} = open_fd(fifo, :read)
+      {output, wfd} = open_fd(Path.join(dir, "output"))
+
+      {:ok, ctx} = :termbox2_nif.tb_open(rfd, wfd)
+      {:ok, watcher} = :termbox2_nif.tb_input_start(ctx, self())
+      assert_receive {:select, ^watcher, _, :ready_input}, 1000
+
+      packed = :termbox2_nif.tb_input_poll(watcher)
+      assert [%{type: :key, char: ?a}] = Raxol.Terminal.Driver.EventTranslator.unpack(packed)
+
+      send(terminal, :hang_up)
+      assert_receive {:select, ^watcher, _, :ready_input}, 1000
+      assert :termbox2_nif.tb_input_poll(watcher) == {:error, :closed}
+      assert_receive {:termbox_input, :closed}
+      refute_receive {:select, ^watcher, _, :ready_input}, 100
+
+      assert :termbox2_nif.tb_close(ctx) == :ok
+      :ok = File.close(input)
+      :ok = File.close(output)
+    end
+  end
+
+  describe "width table" do
+    @tag :docker
+    test "covers the BMP and matches tb_wcwidth's widths" do
+      {stage1, stage2, limit} = :termbox2_nif.tb_wcwidth_table()
+
+      assert limit >= 0x10000
+      assert byte_size(stage1) == div(limit, 256)
+      assert rem(byte_size(stage2), 64) == 0
+      assert Raxol.Terminal.CharacterHandling.get_char_width(0x4E2D) == 2
+    end
+  end
+
   describe "module constants" do
     test "termbox color constants are defined" do
       # These should be defined by the module or available as constants
@@ -111,7 +404,8 @@ defmodule Termbox2LoadingTest do
 
       expected_files = [
         "termbox2_nif.c",
-        "termbox_impl.c"
+        "termbox_impl.c",
+        "vt_parser.c"
       ]
 
       for file <- expected_files do